@@ -341,7 +341,9 @@ namespace Mapper
 
         public enum Protocol {
             UDP,              //!< Map updates are sent using UDP.
-            TCP               //!< Map updates are sent using TCP.
+            TCP,              //!< Map updates are sent using TCP.
+            SHM,              //!< Map updates are sent using shared memory.
+            UNIX              //!< Map updates are sent using Unix domain sockets.
         }
 
         [DllImport("mapper", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.StdCall)]
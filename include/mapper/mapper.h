@@ -220,6 +220,57 @@ mpr_list mpr_dev_get_maps(mpr_dev device, mpr_dir direction);
  *  \return             The number of handled messages. May be zero if there was nothing to do. */
 int mpr_dev_poll(mpr_dev device, int block_ms);
 
+/*! Start a thread owned by the library that polls a device in the background, so that the
+ *  application does not have to call mpr_dev_poll(). Signal handlers are then called from this
+ *  thread. An application that handles updates on its own thread can instead wait for the
+ *  descriptor returned by mpr_dev_get_update_fd() to become readable and read the new values
+ *  with mpr_sig_copy_value().
+ *
+ *  The device is not locked. While the thread runs, other threads may only call:
+ *  - mpr_sig_push_value() to update a signal, using a queue reserved beforehand with
+ *    mpr_sig_reserve_queue(),
+ *  - mpr_dev_update_maps() to send pushed updates without waiting for the current poll to end,
+ *  - mpr_sig_copy_value() to read a signal value,
+ *  - mpr_dev_get_update_fd(),
+ *  - mpr_dev_stop_polling().
+ *
+ *  All other calls on the device, its signals and its maps, such as creating, modifying or
+ *  releasing maps and signals, mpr_sig_set_value(), mpr_sig_reserve_queue(),
+ *  mpr_sig_release_inst(), mpr_dev_begin_batch() and mpr_dev_commit_batch(), or querying the
+ *  graph, must be made from a signal handler or after mpr_dev_stop_polling(). mpr_dev_poll()
+ *  does nothing while the thread runs.
+ *
+ *  mpr_dev_update_maps() interrupts the wait of the thread by sending an empty datagram to the
+ *  device's own data port over the loopback interface, since the sockets are waited on by liblo
+ *  and it cannot wait on a separate wakeup descriptor.
+ *  \param device       The device to poll.
+ *  \param block_ms     Number of milliseconds each call to mpr_dev_poll() blocks waiting for
+ *                      messages. Stopping the thread may take up to this long.
+ *  \return             Zero if the thread was started or is already running, non-zero
+ *                      otherwise. */
+int mpr_dev_start_polling(mpr_dev device, int block_ms);
+
+/*! Stop the thread polling a device in the background, waiting for it to finish. This is
+ *  also done when the device is freed.
+ *  \param device       The device being polled.
+ *  \return             Zero if the thread was stopped, non-zero if it was not running. */
+int mpr_dev_stop_polling(mpr_dev device);
+
+/*! Get a descriptor that becomes readable after the thread polling a device in the background
+ *  has dispatched signal events, such as updates of its input signals. At most one byte is
+ *  written each time the thread finishes waiting for messages. The descriptor is non-blocking; the application should read it until empty
+ *  before reading signal values, and must not close it. It is closed by mpr_dev_stop_polling().
+ *  \param device       The device being polled.
+ *  \return             A file descriptor, or -1 if the device is not polled in the background. */
+int mpr_dev_get_update_fd(mpr_dev device);
+
+/*! Get the number of system calls saved by sending the UDP bundles for the links of a device
+ *  together at the end of each poll rather than one at a time.
+ *  \param device       The device to query.
+ *  \return             The number of bundles sent by this device in the same system call as an
+ *                      earlier bundle, or zero on platforms without sendmmsg(). */
+uint64_t mpr_dev_get_num_syscalls_saved(mpr_dev device);
+
 /*! Detect whether a device is completely initialized.
  *  \param device       The device to query.
  *  \return             Non-zero if device is completely initialized, i.e., has an allocated
@@ -240,10 +291,25 @@ void mpr_dev_set_time(mpr_dev device, mpr_time time);
 
 /*! Indicates that all signal values have been updated for a given timestep. This function can be
  *  omitted if mpr_dev_poll() is called each sampling timestep instead, however calling
- *  mpr_dev_poll() at a lower rate may be more performant.
+ *  mpr_dev_poll() at a lower rate may be more performant. If the device is polled in the
+ *  background, this wakes the polling thread to send updates pushed to signal queues.
  *  \param device       The device to use. */
 void mpr_dev_update_maps(mpr_dev device);
 
+/*! Begin a batch of signal updates. Until the matching call to mpr_dev_commit_batch(), signal
+ *  updates are tagged with the same time and routed to maps as usual, but maps are not evaluated
+ *  and nothing is sent, even if mpr_dev_update_maps() or mpr_dev_set_time() is called. Batches
+ *  may be nested, in which case only the outermost commit sends the updates. Updates should be
+ *  made from the thread that polls the device.
+ *  \param device       The device to use. */
+void mpr_dev_begin_batch(mpr_dev device);
+
+/*! Commit a batch of signal updates started with mpr_dev_begin_batch(). If this ends the
+ *  outermost batch, all updated maps are evaluated and each link sends its updates in a single
+ *  bundle tagged with the time of the batch.
+ *  \param device       The device to use. */
+void mpr_dev_commit_batch(mpr_dev device);
+
 /** @} */ /* end of group Devices */
 
 /*** Signals ***/
@@ -264,7 +330,10 @@ void mpr_dev_update_maps(mpr_dev device);
  *  \param length       The array length of the update value.
  *  \param type         The data type of the update value.
  *  \param value        A pointer to the value update.
- *  \param time         The timetag associated with this event. */
+ *  \param time         The timetag associated with this event.
+ *
+ *  When a map updates several instances of a signal at once, the new values of all of these
+ *  instances may be computed before the handler is called for the first of them. */
 typedef void mpr_sig_handler(mpr_sig signal, mpr_sig_evt event, mpr_id instance, int length,
                              mpr_type type, const void *value, mpr_time time);
 
@@ -306,6 +375,52 @@ void mpr_sig_free(mpr_sig signal);
 void mpr_sig_set_value(mpr_sig signal, mpr_id instance, int length, mpr_type type,
                        const void *value);
 
+/*! Update the values of several instances of a signal at once. This is equivalent to calling
+ *  mpr_sig_set_value() for each instance, but all instances share one time tag and are passed to
+ *  the signal's maps together. To update several signals at once, call this function for each
+ *  of them between mpr_dev_begin_batch() and mpr_dev_commit_batch().
+ *  \param signal       The signal to operate on.
+ *  \param num_inst     The number of instances to update.
+ *  \param instances    An array of num_inst instance identifiers, or 0 to update the instances
+ *                      with identifiers 0 to num_inst - 1.
+ *  \param length       Length of the value of each instance. Must be equal to the signal length.
+ *  \param type         Data type of the values argument.
+ *  \param values       The new values, stored contiguously as num_inst vectors of the given
+ *                      length and type.
+ *  \return             The number of instances updated. Instances are skipped if their value
+ *                      contains NaN or if no instance is available for their identifier. If
+ *                      the signal steals instances, an identifier later in the array may steal
+ *                      the instance of an earlier one, which is then released and not counted. */
+int mpr_sig_set_values(mpr_sig signal, int num_inst, const mpr_id *instances, int length,
+                       mpr_type type, const void *values);
+
+/*! Allocate a queue through which one other thread, such as an audio callback or interrupt
+ *  handler, can update a signal using mpr_sig_push_value(). This function must be called from
+ *  the thread polling the device, before the other thread starts pushing updates. A queue
+ *  cannot be resized once reserved, since the other thread may already be pushing to it.
+ *  \param signal       The signal to operate on.
+ *  \param size         The number of updates that can be queued between calls to
+ *                      mpr_dev_poll().
+ *  \return             Non-zero if the queue is ready, zero otherwise. If a queue was already
+ *                      reserved, non-zero only if it can hold size updates. */
+int mpr_sig_reserve_queue(mpr_sig signal, int size);
+
+/*! Queue an update of a signal instance from a thread other than the one polling the device.
+ *  This function does not lock or allocate memory. Queued updates are applied at the start of
+ *  the next call to mpr_dev_poll() as if mpr_sig_set_value() had been called at the given time.
+ *  Only one thread may push updates to a given signal.
+ *  \param signal       The signal to operate on.
+ *  \param instance     The identifier of the instance to update, or 0 for the default
+ *                      instance.
+ *  \param length       Length of the value argument, or 0 to release the instance.
+ *  \param type         Data type of the value argument.
+ *  \param value        A pointer to a new value for this signal.
+ *  \param time         The time of the update, or MPR_NOW to use the current time.
+ *  \return             Non-zero if the update was queued, or zero if no queue was reserved
+ *                      using mpr_sig_reserve_queue() or the queue is full. */
+int mpr_sig_push_value(mpr_sig signal, mpr_id instance, int length, mpr_type type,
+                       const void *value, mpr_time time);
+
 /*! Get the value of a signal instance.
  *  \param signal       The signal to operate on.
  *  \param instance     A pointer to the identifier of the instance to query,
@@ -315,6 +430,19 @@ void mpr_sig_set_value(mpr_sig signal, mpr_id instance, int length, mpr_type typ
  *                      instance, or 0 if the signal instance has no value. */
 const void *mpr_sig_get_value(mpr_sig signal, mpr_id instance, mpr_time *time);
 
+/*! Copy a consistent snapshot of the value and time of a signal instance. Unlike
+ *  mpr_sig_get_value(), this function can be called from any thread, such as an audio callback,
+ *  while the device is being polled. It does not lock and never blocks the polling thread, but
+ *  will retry if the value changes while it is being copied. Instances may be activated and
+ *  released while other threads are reading them, but must not be reserved or removed.
+ *  \param signal       The signal to operate on.
+ *  \param instance     The identifier of the instance to query, or 0 for the default instance.
+ *  \param value        A location to receive the value. It must have room for the full vector
+ *                      length of the signal in the signal's data type.
+ *  \param time         A location to receive the value's time tag. May be 0.
+ *  \return             Non-zero if the instance is active and has a value, zero otherwise. */
+int mpr_sig_copy_value(mpr_sig signal, mpr_id instance, void *value, mpr_time *time);
+
 /*! Return the list of maps associated with a given signal.
  *  \param signal       Signal record to query for maps.
  *  \param direction    The direction of the map relative to the given signal.
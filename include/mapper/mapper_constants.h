@@ -117,6 +117,10 @@ typedef enum {
     MPR_PROTO_UNDEFINED,        /*!< Not yet defined */
     MPR_PROTO_UDP,              /*!< Map updates are sent using UDP. */
     MPR_PROTO_TCP,              /*!< Map updates are sent using TCP. */
+    MPR_PROTO_SHM,              /*!< Map updates are sent through shared memory if both
+                                 *   devices are on the same host, otherwise using UDP. */
+    MPR_PROTO_UNIX,             /*!< Map updates are sent using Unix domain sockets if both
+                                 *   devices are on the same host, otherwise using UDP. */
     MPR_NUM_PROTO
 } mpr_proto;
 
@@ -491,7 +491,9 @@ namespace mapper {
         enum class Protocol
         {
             UDP         = MPR_PROTO_UDP,    /*!< Map updates are sent using UDP. */
-            TCP         = MPR_PROTO_TCP     /*!< Map updates are sent using TCP. */
+            TCP         = MPR_PROTO_TCP,    /*!< Map updates are sent using TCP. */
+            SHM         = MPR_PROTO_SHM,    /*!< Map updates are sent using shared memory. */
+            UNIX        = MPR_PROTO_UNIX    /*!< Map updates are sent using Unix domain sockets. */
         };
 
         /*! the set of possible voice-stealing modes for instances. */
@@ -738,10 +740,43 @@ namespace mapper {
         template <typename T>
         Signal& set_value(std::vector<T> val)
             { return set_value(&val[0], (int)val.size()); }
+
+        /* Bulk updates of several instances from values stored contiguously, one vector of the
+         * signal length per instance. If ids is 0 the instances 0 to num_inst - 1 are updated. */
+        Signal& set_value(const int *vals, int len, int num_inst, const Id *ids)
+            { mpr_sig_set_values(_obj, num_inst, ids, len, MPR_INT32, vals); RETURN_SELF }
+        Signal& set_value(const float *vals, int len, int num_inst, const Id *ids)
+            { mpr_sig_set_values(_obj, num_inst, ids, len, MPR_FLT, vals); RETURN_SELF }
+        Signal& set_value(const double *vals, int len, int num_inst, const Id *ids)
+            { mpr_sig_set_values(_obj, num_inst, ids, len, MPR_DBL, vals); RETURN_SELF }
+        template <typename T>
+        Signal& set_value(const std::vector<T>& vals, const std::vector<Id>& ids)
+        {
+            int num_inst = (int)ids.size();
+            return num_inst ? set_value(vals.data(), (int)vals.size() / num_inst, num_inst,
+                                        ids.data()) : (*this);
+        }
+
+        /* Lock-free value updates from one other thread */
+        Signal& reserve_queue(int size)
+            { mpr_sig_reserve_queue(_obj, size); RETURN_SELF }
+        bool push_value(const int *val, int len)
+            { return mpr_sig_push_value(_obj, 0, len, MPR_INT32, val, MPR_NOW); }
+        bool push_value(const float *val, int len)
+            { return mpr_sig_push_value(_obj, 0, len, MPR_FLT, val, MPR_NOW); }
+        bool push_value(const double *val, int len)
+            { return mpr_sig_push_value(_obj, 0, len, MPR_DBL, val, MPR_NOW); }
+        template <typename T>
+        bool push_value(T val)
+            { return push_value(&val, 1); }
         const void *value() const
             { return mpr_sig_get_value(_obj, 0, 0); }
         const void *value(Time time) const
             { return mpr_sig_get_value(_obj, 0, (mpr_time*)time); }
+        bool copy_value(void *val) const
+            { return mpr_sig_copy_value(_obj, 0, val, 0); }
+        bool copy_value(void *val, Time& time) const
+            { return mpr_sig_copy_value(_obj, 0, val, (mpr_time*)time); }
 
         /*! Signal Instances can be used to describe the multiplicity and/or ephemerality of
          *  phenomena associated with Signals. A signal describes the phenomena, e.g. the position
@@ -807,6 +842,10 @@ namespace mapper {
                 mpr_time *_time = time;
                 return mpr_sig_get_value(_sig, _id, _time);
             }
+            bool copy_value(void *val) const
+                { return mpr_sig_copy_value(_sig, _id, val, 0); }
+            bool copy_value(void *val, Time& time) const
+                { return mpr_sig_copy_value(_sig, _id, val, (mpr_time*)time); }
             Signal signal() const
                 { return Signal(_sig); }
         protected:
@@ -1105,6 +1144,14 @@ namespace mapper {
 
         int poll(int block_ms=0) const
             { return mpr_dev_poll(_obj, block_ms); }
+        Device& start_polling(int block_ms=10)
+            { mpr_dev_start_polling(_obj, block_ms); RETURN_SELF }
+        Device& stop_polling()
+            { mpr_dev_stop_polling(_obj); RETURN_SELF }
+        int update_fd() const
+            { return mpr_dev_get_update_fd(_obj); }
+        uint64_t num_syscalls_saved() const
+            { return mpr_dev_get_num_syscalls_saved(_obj); }
 
         bool ready() const
             { return mpr_dev_get_is_ready(_obj); }
@@ -1114,6 +1161,24 @@ namespace mapper {
             { mpr_dev_set_time(_obj, *time); RETURN_SELF }
         Device& update_maps()
             { mpr_dev_update_maps(_obj); RETURN_SELF }
+        Device& begin_batch()
+            { mpr_dev_begin_batch(_obj); RETURN_SELF }
+        Device& commit_batch()
+            { mpr_dev_commit_batch(_obj); RETURN_SELF }
+
+        /*! A Batch holds back the signal updates of a Device for as long as it is in scope. When
+         *  it is destroyed the updated maps are evaluated and each link sends a single bundle. */
+        class Batch {
+        public:
+            Batch(const Device& dev) : _dev(dev)
+                { mpr_dev_begin_batch(_dev); }
+            ~Batch()
+                { mpr_dev_commit_batch(_dev); }
+            Batch(const Batch&) = delete;
+            Batch& operator=(const Batch&) = delete;
+        private:
+            mpr_dev _dev;
+        };
 
         OBJ_METHODS(Device);
 
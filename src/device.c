@@ -1,3 +1,6 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for recvmmsg() */
+#endif
 #include <lo/lo.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -7,6 +10,7 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <stddef.h>
+#include <zlib.h>
 
 #include "mapper_internal.h"
 #include "types_internal.h"
@@ -15,16 +19,45 @@
 
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+ #include <sys/socket.h>
+ #include <arpa/inet.h>
+#else
+ #ifdef HAVE_WINSOCK2_H
+  #include <winsock2.h>
+ #endif
 #endif
 
 extern const char* net_msg_strings[NUM_MSG_STRINGS];
 
+#define MIN_NUM_IDMAP_BUCKETS 16
+#define MIN_NUM_SIG_BUCKETS 16
+#define MAX_FAST_ARGS 64
+#define MAX_FAST_RECV 64
+#define MAX_DRAIN_RECV 1024
+#define RECV_BATCH 16
+
+#ifdef HAVE_PTHREAD
+/* State of a thread polling a device in the background. */
+typedef struct _mpr_poll_thread {
+    pthread_t thread;
+    struct sockaddr_storage wake_addr; /*!< Loopback address of the device's data port. */
+    socklen_t wake_addr_len;
+    int update_fd[2];                  /*!< Pipe written when signal events were dispatched. */
+    int block_ms;
+    volatile int stop;
+} mpr_poll_thread_t, *mpr_poll_thread;
+#endif
+
 /* prototypes */
 void mpr_dev_start_servers(mpr_local_dev dev);
 static void mpr_dev_remove_idmap(mpr_local_dev dev, int group, mpr_id_map rem);
 MPR_INLINE static int _process_outgoing_maps(mpr_local_dev dev);
+static void _process_maps(mpr_local_dev dev);
 
-mpr_time ts = {0,1};
 
 static int cmp_qry_linked(const void *ctx, mpr_dev dev)
 {
@@ -118,7 +151,12 @@ mpr_dev mpr_dev_new(const char *name_prefix, mpr_graph g)
     dev->ordinal_allocator.val = 1;
     dev->idmaps.active = (mpr_id_map*) malloc(sizeof(mpr_id_map));
     dev->idmaps.active[0] = 0;
+    dev->idmaps.num_buckets = MIN_NUM_IDMAP_BUCKETS;
+    dev->idmaps.LID_hash = (mpr_id_map*) calloc(MIN_NUM_IDMAP_BUCKETS, sizeof(mpr_id_map));
+    dev->idmaps.GID_hash = (mpr_id_map*) calloc(MIN_NUM_IDMAP_BUCKETS, sizeof(mpr_id_map));
     dev->num_sig_groups = 1;
+    mpr_time_set(&dev->bundle_time, MPR_NOW);
+    dev->expr_eval_buff = mpr_expr_new_eval_buffer(NULL);
 
     mpr_net_add_dev(&g->net, dev);
 
@@ -143,6 +181,8 @@ void mpr_dev_free(mpr_dev dev)
     gph = dev->obj.graph;
     net = &gph->net;
 
+    mpr_dev_stop_polling(dev);
+
     /* free any queued graph messages without sending */
     mpr_net_free_msgs(net);
 
@@ -157,6 +197,13 @@ void mpr_dev_free(mpr_dev dev)
         free(sub);
     }
 
+    if (ldev->batch_depth) {
+        /* send updates held back by an open batch while their signals and maps still exist */
+        ldev->batch_depth = 0;
+        if (!ldev->polling)
+            _process_maps(ldev);
+    }
+
     list = mpr_dev_get_sigs(dev, MPR_DIR_ANY);
     while (list) {
         mpr_local_sig sig = (mpr_local_sig)*list;
@@ -200,6 +247,9 @@ void mpr_dev_free(mpr_dev dev)
         }
     }
     free(ldev->idmaps.active);
+    FUNC_IF(free, ldev->idmaps.LID_hash);
+    FUNC_IF(free, ldev->idmaps.GID_hash);
+    FUNC_IF(free, ldev->sig_paths.buckets);
 
     while (ldev->idmaps.reserve) {
         mpr_id_map map = ldev->idmaps.reserve;
@@ -207,24 +257,24 @@ void mpr_dev_free(mpr_dev dev)
         free(map);
     }
 
-    if (net->rtr) {
-        while (net->rtr->sigs) {
-            mpr_rtr_sig rs = net->rtr->sigs;
-            net->rtr->sigs = net->rtr->sigs->next;
-            free(rs);
-        }
-        free(net->rtr);
-    }
+    FUNC_IF(mpr_rtr_free, net->rtr);
+    FUNC_IF(free, ldev->recv_buf);
 
+    if (net->servers[SERVER_UNIX]) {
+        char path[108];
+        mpr_net_get_unix_path(path, 108, lo_server_get_port(net->servers[SERVER_UDP]));
+        lo_server_free(net->servers[SERVER_UNIX]);
+        net->servers[SERVER_UNIX] = 0;
+        unlink(path);
+    }
     FUNC_IF(lo_server_free, net->servers[SERVER_UDP]);
     FUNC_IF(lo_server_free, net->servers[SERVER_TCP]);
     FUNC_IF(free, dev->prefix);
+    FUNC_IF(mpr_expr_free_eval_buffer, ldev->expr_eval_buff);
 
     mpr_graph_remove_dev(gph, dev, MPR_OBJ_REM, 1);
     if (!gph->own)
         mpr_graph_free(gph);
-
-    mpr_expr_free_buffers();
 }
 
 void mpr_dev_on_registered(mpr_local_dev dev)
@@ -267,7 +317,7 @@ MPR_INLINE static int check_types(const mpr_type *types, int len, mpr_type type,
 
 int mpr_dev_bundle_start(lo_timetag t, void *data)
 {
-    mpr_time_set(&ts, t);
+    mpr_time_set(&((mpr_local_dev)data)->bundle_time, t);
     return 0;
 }
 
@@ -292,19 +342,11 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
 {
     mpr_local_sig sig = (mpr_local_sig)data;
     mpr_local_dev dev;
-    mpr_sig_inst si;
-    mpr_rtr rtr = sig->obj.graph->net.rtr;
-    int i, val_len = 0, vals, size, all;
-    int idmap_idx, inst_idx, slot_idx = -1, map_manages_inst = 0;
+    int i, val_len = 0, slot_idx = -1;
     mpr_id GID = 0;
-    mpr_id_map idmap;
-    mpr_local_map map = 0;
-    mpr_local_slot slot = 0;
-    float diff;
 
     TRACE_RETURN_UNLESS(sig && (dev = sig->dev), 0,
                         "error in mpr_dev_handler, cannot retrieve user data\n");
-    TRACE_DEV_RETURN_UNLESS(sig->num_inst, 0, "signal '%s' has no instances.\n", sig->name);
     RETURN_ARG_UNLESS(argc, 0);
 
     /* We need to consider that there may be properties appended to the msg
@@ -335,6 +377,22 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
             return 0;
         }
     }
+    return mpr_dev_update_sig(sig, types, argv, val_len, GID, slot_idx);
+}
+
+int mpr_dev_update_sig(mpr_local_sig sig, const mpr_type *types, lo_arg **argv, int val_len,
+                       mpr_id GID, int slot_idx)
+{
+    mpr_local_dev dev = sig->dev;
+    mpr_sig_inst si;
+    mpr_rtr rtr = sig->obj.graph->net.rtr;
+    int i, vals, size, all, idmap_idx, inst_idx, map_manages_inst = 0;
+    mpr_id_map idmap;
+    mpr_local_map map = 0;
+    mpr_local_slot slot = 0;
+    float diff;
+
+    TRACE_DEV_RETURN_UNLESS(sig->num_inst, 0, "signal '%s' has no instances.\n", sig->name);
 
     if (slot_idx >= 0) {
         /* retrieve mapping associated with this slot */
@@ -364,7 +422,7 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
      */
 
     if (GID) {
-        idmap_idx = mpr_sig_get_idmap_with_GID(sig, GID, RELEASED_LOCALLY, ts, 0);
+        idmap_idx = mpr_sig_get_idmap_with_GID(sig, GID, RELEASED_LOCALLY, dev->bundle_time, 0);
         if (idmap_idx < 0) {
             /* No instance found with this map – don't activate instance just to release it again */
             RETURN_ARG_UNLESS(vals && sig->dir == MPR_DIR_IN, 0);
@@ -373,7 +431,8 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
                 /* special case: do a dry-run to check whether this map will
                  * cause a release. If so, don't bother stealing an instance. */
                 mpr_value *src;
-                mpr_value_t v = {0, 0, 1, 0, 1};
+                /* one instance holding a single sample, so the ring mask is zero */
+                mpr_value_t v = {0, 0, 1, 0, 1, 0};
                 mpr_value_buffer_t b = {0, 0, -1};
                 b.samps = argv[0];
                 v.inst = &b;
@@ -382,12 +441,13 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
                 src = alloca(map->num_src * sizeof(mpr_value));
                 for (i = 0; i < map->num_src; i++)
                     src[i] = (i == slot->id) ? &v : 0;
-                if (mpr_expr_eval(map->expr, src, 0, 0, 0, 0, 0) & EXPR_RELEASE_BEFORE_UPDATE)
+                if (mpr_expr_eval(dev->expr_eval_buff, map->expr, src, 0, 0, 0, 0, 0)
+                    & EXPR_RELEASE_BEFORE_UPDATE)
                     return 0;
             }
 
             /* otherwise try to init reserved/stolen instance with device map */
-            idmap_idx = mpr_sig_get_idmap_with_GID(sig, GID, 0, ts, 1);
+            idmap_idx = mpr_sig_get_idmap_with_GID(sig, GID, 0, dev->bundle_time, 1);
             TRACE_DEV_RETURN_UNLESS(idmap_idx >= 0, 0,
                                     "no instances available for GUID %"PR_MPR_ID" (1)\n", GID);
         }
@@ -396,7 +456,7 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
             if (0 == vals) {
                 /* we can clear signal's reference to map */
                 idmap = sig->idmaps[idmap_idx].map;
-                sig->idmaps[idmap_idx].map = 0;
+                mpr_sig_clear_idmap_map(sig, idmap_idx);
                 mpr_dev_GID_decref(dev, sig->group, idmap);
             }
             return 0;
@@ -408,12 +468,12 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
         /* use the first available instance */
         idmap_idx = 0;
         if (!sig->idmaps[0].inst)
-            idmap_idx = mpr_sig_get_idmap_with_LID(sig, sig->inst[0]->id, 1, ts, 1);
+            idmap_idx = mpr_sig_get_idmap_with_LID(sig, sig->inst[0]->id, 1, dev->bundle_time, 1);
         RETURN_ARG_UNLESS(idmap_idx >= 0, 0);
     }
     si = sig->idmaps[idmap_idx].inst;
     inst_idx = si->idx;
-    diff = mpr_time_get_diff(ts, si->time);
+    diff = mpr_time_get_diff(dev->bundle_time, si->time);
     idmap = sig->idmaps[idmap_idx].map;
 
     size = mpr_type_get_size(map ? slot->sig->type : sig->type);
@@ -425,9 +485,9 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
             if (!sig->use_inst) {
                 /* clear signal's reference to idmap */
                 mpr_dev_LID_decref(dev, sig->group, idmap);
-                sig->idmaps[idmap_idx].map = 0;
+                mpr_sig_clear_idmap_map(sig, idmap_idx);
                 sig->idmaps[idmap_idx].inst->active = 0;
-                sig->idmaps[idmap_idx].inst = 0;
+                mpr_sig_clear_idmap_inst(sig, idmap_idx);
                 return 0;
             }
         }
@@ -437,10 +497,10 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
          * know if the local signal instance will actually be released. */
         if (sig->dir == MPR_DIR_IN) {
             int evt = (MPR_SIG_REL_UPSTRM & sig->event_flags) ? MPR_SIG_REL_UPSTRM : MPR_SIG_UPDATE;
-            mpr_sig_call_handler(sig, evt, idmap->LID, 0, 0, &ts, diff);
+            mpr_sig_call_handler(sig, evt, idmap->LID, 0, 0, &dev->bundle_time, diff);
         }
         else if (MPR_SIG_REL_DNSTRM & sig->event_flags)
-            mpr_sig_call_handler(sig, MPR_SIG_REL_DNSTRM, idmap->LID, 0, 0, &ts, diff);
+            mpr_sig_call_handler(sig, MPR_SIG_REL_DNSTRM, idmap->LID, 0, 0, &dev->bundle_time, diff);
 
         RETURN_ARG_UNLESS(map && MPR_LOC_DST == map->process_loc && sig->dir == MPR_DIR_IN, 0);
 
@@ -480,7 +540,7 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
                 /* TODO: jitter mitigation etc. */
                 mpr_value_set_sample(&slot->val, inst_idx, argv[0], dev->time);
                 set_bitflag(map->updated_inst, inst_idx);
-                map->updated = 1;
+                mpr_dev_queue_map(dev, map, 1);
                 dev->receiving = 1;
             }
             if (!all)
@@ -493,6 +553,7 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
         /* check if instance is active */
         if ((si = sig->idmaps[idmap_idx].inst)) {
             idmap = sig->idmaps[idmap_idx].map;
+            mpr_sig_inst_begin_write(si);
             for (i = 0; i < sig->len; i++) {
                 if (types[i] == MPR_NULL)
                     continue;
@@ -501,14 +562,16 @@ int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc
             }
             if (!compare_bitflags(si->has_val_flags, sig->vec_known, sig->len))
                 si->has_val = 1;
+            if (si->has_val)
+                memcpy(&si->time, &dev->bundle_time, sizeof(mpr_time));
+            mpr_sig_inst_end_write(si);
             if (si->has_val) {
-                memcpy(&si->time, &ts, sizeof(mpr_time));
-                mpr_sig_call_handler(sig, MPR_SIG_UPDATE, idmap->LID, sig->len, si->val, &ts, diff);
+                mpr_sig_call_handler(sig, MPR_SIG_UPDATE, idmap->LID, sig->len, si->val, &dev->bundle_time, diff);
                 /* Pass this update downstream if signal is an input and was not updated in handler. */
                 if (   !(sig->dir & MPR_DIR_OUT)
                     && !get_bitflag(sig->updated_inst, si->idx)) {
-                    mpr_rtr_process_sig(rtr, sig, idmap_idx, si->val, ts);
-                    /* TODO: ensure update is propagated within this poll cycle */
+                    /* the queued maps are evaluated within this poll cycle by _process_maps() */
+                    mpr_rtr_process_sig(rtr, sig, idmap_idx, si->val, dev->bundle_time);
                 }
             }
         }
@@ -539,31 +602,92 @@ mpr_id mpr_dev_get_unused_sig_id(mpr_local_dev dev)
     return id;
 }
 
+MPR_INLINE static unsigned long _hash_path(const char *path)
+{
+    return crc32(0L, (const Bytef *)path, strlen(path));
+}
+
+/* Rebuild the signal path hash table with num_buckets buckets, which must be a power of two. */
+static void _rehash_sig_paths(mpr_local_dev dev, int num_buckets)
+{
+    mpr_local_sig *old = dev->sig_paths.buckets, sig;
+    int i, old_num_buckets = dev->sig_paths.num_buckets;
+    dev->sig_paths.buckets = (mpr_local_sig*) calloc(num_buckets, sizeof(mpr_local_sig));
+    dev->sig_paths.num_buckets = num_buckets;
+    for (i = 0; i < old_num_buckets; i++) {
+        while ((sig = old[i])) {
+            mpr_local_sig *bucket = &dev->sig_paths.buckets[sig->path_hash & (num_buckets - 1)];
+            old[i] = sig->hash_next;
+            sig->hash_next = *bucket;
+            *bucket = sig;
+        }
+    }
+    FUNC_IF(free, old);
+}
+
+mpr_local_sig mpr_dev_find_sig_by_path(mpr_local_dev dev, const char *path)
+{
+    unsigned long hash;
+    mpr_local_sig sig;
+    RETURN_ARG_UNLESS(dev->sig_paths.num_buckets, 0);
+    hash = _hash_path(path);
+    sig = dev->sig_paths.buckets[hash & (dev->sig_paths.num_buckets - 1)];
+    while (sig && (sig->path_hash != hash || strcmp(sig->path, path)))
+        sig = sig->hash_next;
+    return sig;
+}
+
+/* Single method registered on the data servers in place of one method per signal. Messages
+ * that do not address a signal are left to any methods registered after this one. */
+static int _handler_sig(const char *path, const char *types, lo_arg **argv, int argc,
+                        lo_message msg, void *data)
+{
+    mpr_local_dev dev = (mpr_local_dev)data;
+    mpr_local_sig sig;
+    int i, handled = 0;
+    if (!strpbrk(path, "*?[]{}")) {
+        RETURN_ARG_UNLESS(sig = mpr_dev_find_sig_by_path(dev, path), 1);
+        mpr_dev_handler(path, types, argv, argc, msg, (void*)sig);
+        return 0;
+    }
+    /* OSC address patterns still need to be matched against every signal */
+    for (i = 0; i < dev->sig_paths.num_buckets; i++) {
+        for (sig = dev->sig_paths.buckets[i]; sig; sig = sig->hash_next) {
+            if (lo_pattern_match(sig->path, path)) {
+                mpr_dev_handler(sig->path, types, argv, argc, msg, (void*)sig);
+                handled = 1;
+            }
+        }
+    }
+    return !handled;
+}
+
 void mpr_dev_add_sig_methods(mpr_local_dev dev, mpr_local_sig sig)
 {
-    mpr_net net;
-    RETURN_UNLESS(sig && sig->is_local);
-    net = &dev->obj.graph->net;
-    lo_server_add_method(net->servers[SERVER_UDP], sig->path, NULL, mpr_dev_handler, (void*)sig);
-    lo_server_add_method(net->servers[SERVER_TCP], sig->path, NULL, mpr_dev_handler, (void*)sig);
+    mpr_local_sig *bucket;
+    RETURN_UNLESS(sig && sig->is_local && !mpr_dev_find_sig_by_path(dev, sig->path));
+    sig->path_hash = _hash_path(sig->path);
+    if (++dev->sig_paths.num_sigs > dev->sig_paths.num_buckets) {
+        _rehash_sig_paths(dev, dev->sig_paths.num_buckets
+                          ? dev->sig_paths.num_buckets * 2 : MIN_NUM_SIG_BUCKETS);
+    }
+    bucket = &dev->sig_paths.buckets[sig->path_hash & (dev->sig_paths.num_buckets - 1)];
+    sig->hash_next = *bucket;
+    *bucket = sig;
     ++dev->n_output_callbacks;
 }
 
 void mpr_dev_remove_sig_methods(mpr_local_dev dev, mpr_local_sig sig)
 {
-    mpr_net net;
-    char *path = 0;
-    int len;
-    RETURN_UNLESS(sig && sig->is_local);
-    net = &dev->obj.graph->net;
-    len = (int)strlen(sig->path) + 5;
-    path = (char*)realloc(path, len);
-    snprintf(path, len, "%s%s", sig->path, "/get");
-    lo_server_del_method(net->servers[SERVER_UDP], path, NULL);
-    lo_server_del_method(net->servers[SERVER_TCP], path, NULL);
-    free(path);
-    lo_server_del_method(net->servers[SERVER_UDP], sig->path, NULL);
-    lo_server_del_method(net->servers[SERVER_TCP], sig->path, NULL);
+    mpr_local_sig *bucket;
+    RETURN_UNLESS(sig && sig->is_local && dev->sig_paths.num_buckets);
+    bucket = &dev->sig_paths.buckets[sig->path_hash & (dev->sig_paths.num_buckets - 1)];
+    while (*bucket && *bucket != sig)
+        bucket = &(*bucket)->hash_next;
+    RETURN_UNLESS(*bucket);
+    *bucket = sig->hash_next;
+    sig->hash_next = 0;
+    --dev->sig_paths.num_sigs;
     --dev->n_output_callbacks;
 }
 
@@ -667,66 +791,449 @@ mpr_link mpr_dev_get_link_by_remote(mpr_local_dev dev, mpr_dev remote)
     return 0;
 }
 
+/* Worklists are kept sorted by map rank. Maps of equal rank are kept in the order they were
+ * queued. */
+static void _worklist_push(mpr_map_worklist wl, mpr_local_map map)
+{
+    mpr_local_map *m;
+    map->next_updated = 0;
+    ++wl->len;
+    if (!wl->tail || wl->tail->rank <= map->rank) {
+        if (wl->tail)
+            wl->tail->next_updated = map;
+        else
+            wl->head = map;
+        wl->tail = map;
+        return;
+    }
+    /* ranks may have changed since the list was sorted, so do not rely on the tail */
+    for (m = &wl->head; *m && (*m)->rank <= map->rank; m = &(*m)->next_updated) {}
+    map->next_updated = *m;
+    *m = map;
+    if (!map->next_updated)
+        wl->tail = map;
+}
+
+static mpr_local_map _worklist_pop(mpr_map_worklist wl)
+{
+    mpr_local_map map = wl->head;
+    RETURN_ARG_UNLESS(map, 0);
+    if (!(wl->head = map->next_updated))
+        wl->tail = 0;
+    map->next_updated = 0;
+    --wl->len;
+    return map;
+}
+
+static void _worklist_remove(mpr_map_worklist wl, mpr_local_map map)
+{
+    mpr_local_map *m = &wl->head, prev = 0;
+    while (*m && *m != map) {
+        prev = *m;
+        m = &(*m)->next_updated;
+    }
+    RETURN_UNLESS(*m);
+    *m = map->next_updated;
+    if (wl->tail == map)
+        wl->tail = prev;
+    map->next_updated = 0;
+    --wl->len;
+}
+
+void mpr_dev_queue_map(mpr_local_dev dev, mpr_local_map map, int is_incoming)
+{
+    RETURN_UNLESS(!map->updated);
+    map->updated = 1;
+    _worklist_push(is_incoming ? &dev->updated_in : &dev->updated_out, map);
+}
+
+void mpr_dev_dequeue_map(mpr_local_dev dev, mpr_local_map map)
+{
+    RETURN_UNLESS(map->updated);
+    _worklist_remove(&dev->updated_in, map);
+    _worklist_remove(&dev->updated_out, map);
+    _worklist_remove(&dev->deferred, map);
+    map->updated = 0;
+}
+
+/* Process the queued maps in order of rank, so that each map is evaluated after the local maps
+ * that feed it. Maps queued while processing are handled in the same pass unless they were
+ * already evaluated in the current cycle, as happens with local loops. These, and maps that are
+ * skipped and remain updated, are left for the next cycle. Returns the number of maps
+ * evaluated, and sets looped if any map was left because it was already evaluated. */
+static int _process_worklist(mpr_local_dev dev, mpr_map_worklist wl, int is_incoming,
+                             int *looped)
+{
+    mpr_local_map map;
+    int count = 0;
+    *looped = 0;
+    while ((map = _worklist_pop(wl))) {
+        if (map->cycle == dev->map_cycle) {
+            _worklist_push(&dev->deferred, map);
+            *looped = 1;
+            continue;
+        }
+        map->cycle = dev->map_cycle;
+        ++count;
+        if (map->expr && !map->muted) {
+            if (is_incoming)
+                mpr_map_receive(map, dev->time);
+            else
+                mpr_map_send(map, dev->time);
+        }
+        if (map->updated)
+            _worklist_push(&dev->deferred, map);
+    }
+    /* the worklist is empty, so it can simply take over the deferred maps */
+    *wl = dev->deferred;
+    memset(&dev->deferred, 0, sizeof(mpr_map_worklist_t));
+    return count;
+}
+
+static uint32_t _get32(const char *p)
+{
+    const unsigned char *u = (const unsigned char*)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+/* Return the padded length of an OSC string, or zero if it is not terminated before end. */
+static int _osc_strlen(const char *s, const char *end)
+{
+    const char *term = memchr(s, 0, end - s);
+    return term ? (int)((term - s + 4) & ~3) : 0;
+}
+
+/* Check a single OSC message addressed to a local signal. If dispatch is set, swap the
+ * arguments to host byte order in place and pass them to mpr_dev_handler() without copying.
+ * Returns zero if the message should be left to liblo. */
+static int _fast_msg(mpr_local_dev dev, char *data, int len, int dispatch)
+{
+    char *path = data, *types, *arg, *end = data + len;
+    lo_arg *argv[MAX_FAST_ARGS];
+    int i, n, argc;
+    mpr_local_sig sig;
+
+    /* only literal paths can be looked up directly */
+    RETURN_ARG_UNLESS('/' == *path && (n = _osc_strlen(path, end)) && !strpbrk(path, "*?[]{}"), 0);
+    if (!(sig = mpr_dev_find_sig_by_path(dev, path))) {
+        /* the signal may have been removed by a handler earlier in the bundle */
+        return dispatch;
+    }
+    types = path + n;
+    RETURN_ARG_UNLESS(types < end && ',' == *types && (n = _osc_strlen(types, end)), 0);
+    arg = types + n;
+    argc = strlen(++types);
+    RETURN_ARG_UNLESS(argc <= MAX_FAST_ARGS, 0);
+
+    for (i = 0; i < argc; i++) {
+        argv[i] = (lo_arg*)arg;
+        switch (types[i]) {
+            case MPR_INT32:
+            case MPR_FLT:
+                RETURN_ARG_UNLESS(end - arg >= 4, 0);
+                if (dispatch) {
+                    uint32_t v = _get32(arg);
+                    memcpy(arg, &v, 4);
+                }
+                arg += 4;
+                break;
+            case MPR_DBL:
+            case MPR_INT64:
+                RETURN_ARG_UNLESS(end - arg >= 8, 0);
+                if (dispatch) {
+                    /* 64-bit arguments are only aligned to four bytes */
+                    uint64_t v = ((uint64_t)_get32(arg) << 32) | _get32(arg + 4);
+                    memcpy(arg, &v, 8);
+                }
+                arg += 8;
+                break;
+            case MPR_STR:
+                RETURN_ARG_UNLESS(arg < end && (n = _osc_strlen(arg, end)), 0);
+                arg += n;
+                break;
+            case MPR_NULL:
+                break;
+            default:
+                return 0;
+        }
+    }
+    RETURN_ARG_UNLESS(arg == end, 0);
+    if (dispatch)
+        mpr_dev_handler(path, types, argv, argc, NULL, (void*)sig);
+    return 1;
+}
+
+/* Check or dispatch a datagram containing a message or a flat bundle of messages. */
+static int _fast_datagram(mpr_local_dev dev, char *data, int len, int dispatch)
+{
+    int size, offset = 16;
+    if (len < 16 || memcmp(data, "#bundle", 8))
+        return len >= 8 && !(len & 3) && _fast_msg(dev, data, len, dispatch);
+    if (dispatch) {
+        mpr_time t;
+        t.sec = _get32(data + 8);
+        t.frac = _get32(data + 12);
+        mpr_dev_bundle_start(t, dev);
+    }
+    while (offset < len) {
+        RETURN_ARG_UNLESS(len - offset >= 4, 0);
+        size = (int)_get32(data + offset);
+        offset += 4;
+        RETURN_ARG_UNLESS(size >= 8 && !(size & 3) && size <= len - offset, 0);
+        RETURN_ARG_UNLESS(_fast_msg(dev, data + offset, size, dispatch), 0);
+        offset += size;
+    }
+    return 1;
+}
+
+static void _dispatch_datagram(mpr_local_dev dev, char *data, int len)
+{
+    if (_fast_datagram(dev, data, len, 0))
+        _fast_datagram(dev, data, len, 1);
+    else
+        lo_server_dispatch_data(dev->obj.graph->net.servers[SERVER_UDP], data, len);
+}
+
+/* Read up to max bundles from the shared-memory rings of links to devices on this host. */
+static int _recv_shm(mpr_local_dev dev, int max)
+{
+    int len, count = 0;
+    char *data;
+    mpr_list links = mpr_list_from_data(dev->obj.graph->links);
+    while (links && count < max) {
+        mpr_link link = (mpr_link)*links;
+        links = mpr_list_get_next(links);
+        if (!link->shm_in)
+            continue;
+        len = 0;
+        while (count < max && (data = mpr_shm_peek(link->shm_in, &len))) {
+            ++count;
+            _dispatch_datagram(dev, data, len);
+            mpr_shm_release(link->shm_in);
+        }
+        if (len < 0)
+            mpr_link_close_shm(link);
+    }
+    return count;
+}
+
+/* Announce to the producers of all shared-memory rings that this device is about to block.
+ * Returns non-zero if any ring already has data, in which case it should not block. */
+static int _prepare_wait_shm(mpr_local_dev dev, int waiting)
+{
+    int ready = 0;
+    mpr_list links = mpr_list_from_data(dev->obj.graph->links);
+    while (links) {
+        mpr_link link = (mpr_link)*links;
+        links = mpr_list_get_next(links);
+        if (!link->shm_in)
+            continue;
+        if (waiting)
+            ready |= mpr_shm_prepare_wait(link->shm_in);
+        else
+            mpr_shm_end_wait(link->shm_in);
+    }
+    return ready;
+}
+
+#ifdef HAVE_RECVMMSG
+/* Double the number of datagram slots in the receive buffer, up to RECV_BATCH. */
+static void _grow_recv_buf(mpr_local_dev dev)
+{
+    char *buf = (char*)realloc(dev->recv_buf, dev->recv_slots * 2 * MAX_UDP_BUNDLE_LEN);
+    RETURN_UNLESS(buf);
+    dev->recv_buf = buf;
+    dev->recv_slots *= 2;
+}
+#endif
+
+/* Read up to max datagrams from a datagram server socket without blocking. */
+static int _recv_socket(mpr_local_dev dev, lo_server server, int max)
+{
+    int count = 0;
+#ifdef HAVE_RECVMMSG
+    /* Pull a batch of datagrams per system call into consecutive slots of the receive buffer,
+     * then dispatch them in order. */
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iovs[RECV_BATCH];
+    int i, n, batch, fd;
+    RETURN_ARG_UNLESS(server, 0);
+    fd = lo_server_get_socket_fd(server);
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < RECV_BATCH; i++) {
+        iovs[i].iov_len = MAX_UDP_BUNDLE_LEN;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (count < max) {
+        batch = max - count < dev->recv_slots ? max - count : dev->recv_slots;
+        /* the buffer may have moved when it grew */
+        for (i = 0; i < batch; i++)
+            iovs[i].iov_base = dev->recv_buf + i * MAX_UDP_BUNDLE_LEN;
+        n = recvmmsg(fd, msgs, batch, MSG_DONTWAIT, NULL);
+        if (n <= 0)
+            break;
+        for (i = 0; i < n; i++) {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                trace_dev(dev, "dropped datagram larger than %d bytes\n", MAX_UDP_BUNDLE_LEN);
+            }
+            else if (msgs[i].msg_len > 0)
+                _dispatch_datagram(dev, (char*)iovs[i].iov_base, msgs[i].msg_len);
+        }
+        count += n;
+        /* a short batch means the socket is empty */
+        if (n < batch)
+            break;
+        /* datagrams arrive in bursts, so take more of them per system call from now on */
+        if (n == dev->recv_slots && dev->recv_slots < RECV_BATCH)
+            _grow_recv_buf(dev);
+    }
+#elif defined(MSG_DONTWAIT)
+    struct msghdr msg;
+    struct iovec iov;
+    int len, fd;
+    RETURN_ARG_UNLESS(server, 0);
+    fd = lo_server_get_socket_fd(server);
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = dev->recv_buf;
+    iov.iov_len = MAX_UDP_BUNDLE_LEN;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    while (count < max && (len = recvmsg(fd, &msg, MSG_DONTWAIT)) > 0) {
+        ++count;
+        if (msg.msg_flags & MSG_TRUNC) {
+            trace_dev(dev, "dropped datagram larger than %d bytes\n", MAX_UDP_BUNDLE_LEN);
+        }
+        else
+            _dispatch_datagram(dev, dev->recv_buf, len);
+    }
+#endif
+    return count;
+}
+
+/* Read up to max datagrams from shared memory, the Unix domain socket and the data port without
+ * blocking. Signal updates are decoded in place and dispatched directly; anything else is passed
+ * to liblo unchanged. */
+static int _recv_datagrams(mpr_local_dev dev, int max)
+{
+    lo_server *servers = dev->obj.graph->net.servers;
+    int count = _recv_shm(dev, max);
+    count += _recv_socket(dev, servers[SERVER_UNIX], max - count);
+    count += _recv_socket(dev, servers[SERVER_UDP], max - count);
+    return count;
+}
+
+/* Apply updates pushed to signal queues by other threads since the last poll. */
+static void _process_queues(mpr_local_dev dev)
+{
+    mpr_local_sig lsig = dev->queued_sigs;
+    while (lsig) {
+        mpr_sig_process_queue(lsig);
+        lsig = lsig->queue_next;
+    }
+}
+
 /* TODO: handle interrupt-driven updates that omit call to this function */
-MPR_INLINE static void _process_incoming_maps(mpr_local_dev dev)
-{
-    mpr_graph graph;
-    mpr_list maps;
-    RETURN_UNLESS(dev->receiving);
-    graph = dev->obj.graph;
-    /* process and send updated maps */
-    /* TODO: speed this up! */
+MPR_INLINE static int _process_incoming_maps(mpr_local_dev dev)
+{
+    int count, looped;
+    RETURN_ARG_UNLESS(dev->receiving, 0);
+    /* process and send updated maps; maps left for the next cycle by a loop keep the flag set */
     dev->receiving = 0;
-    maps = mpr_list_from_data(graph->maps);
-    while (maps) {
-        mpr_local_map map = *(mpr_local_map*)maps;
-        maps = mpr_list_get_next(maps);
-        if (map->is_local && map->updated && map->expr && !map->muted)
-            mpr_map_receive(map, dev->time);
-    }
+    count = _process_worklist(dev, &dev->updated_in, 1, &looped);
+    if (looped)
+        dev->receiving = 1;
+    return count;
 }
 
 /* TODO: handle interrupt-driven updates that omit call to this function */
 MPR_INLINE static int _process_outgoing_maps(mpr_local_dev dev)
 {
-    int msgs = 0;
+    int count, looped;
     mpr_list list;
-    mpr_graph graph;
-    RETURN_ARG_UNLESS(dev->sending, 0);
+    /* updates made during a batch are held back until it is committed */
+    RETURN_ARG_UNLESS(dev->sending && !dev->batch_depth, 0);
 
-    graph = dev->obj.graph;
-    /* process and send updated maps */
-    /* TODO: speed this up! */
-    list = mpr_list_from_data(graph->maps);
-    while (list) {
-        mpr_local_map map = *(mpr_local_map*)list;
-        list = mpr_list_get_next(list);
-        if (map->is_local && map->updated && map->expr && !map->muted)
-            mpr_map_send(map, dev->time);
-    }
+    /* process and send updated maps; maps updated meanwhile, or left for the next cycle by a
+     * loop, will set the flag again */
     dev->sending = 0;
-    list = mpr_list_from_data(graph->links);
+    count = _process_worklist(dev, &dev->updated_out, 0, &looped);
+    if (looped)
+        dev->sending = 1;
+    list = mpr_list_from_data(dev->obj.graph->links);
     while (list) {
-        msgs += mpr_link_process_bundles((mpr_link)*list, dev->time, 0);
+        mpr_link_process_bundles((mpr_link)*list, dev->time, 0);
         list = mpr_list_get_next(list);
     }
-    return msgs ? 1 : 0;
+    mpr_net_flush_udp(&dev->obj.graph->net);
+    return count;
+}
+
+/* Evaluate updated maps until everything reachable through local maps in this cycle is done.
+ * Updates delivered to local signals while sending, for example through maps between signals
+ * of this device, queue further maps, which are evaluated in the same cycle unless they were
+ * already evaluated in it. */
+static void _process_maps(mpr_local_dev dev)
+{
+    mpr_rtr rtr = dev->obj.graph->net.rtr;
+    uint8_t polling = dev->polling;
+    if (rtr->ranks_dirty)
+        mpr_rtr_rank_maps(rtr);
+    /* do not let handlers called from here start another cycle */
+    dev->polling = 1;
+    ++dev->map_cycle;
+    while (_process_incoming_maps(dev) + _process_outgoing_maps(dev)) {}
+    dev->polling = polling;
+}
+
+#ifdef HAVE_PTHREAD
+/* Interrupt the wait of the polling thread by sending an empty bundle to the data port. */
+static void _wake_poll_thread(mpr_local_dev dev)
+{
+    static const char empty[16] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    lo_server server = dev->obj.graph->net.servers[SERVER_UDP];
+    sendto(lo_server_get_socket_fd(server), empty, 16, 0,
+           (struct sockaddr*)&dev->thread->wake_addr, dev->thread->wake_addr_len);
+}
+#endif
+
+/* Tell the application that signal events were dispatched by the polling thread. */
+static void _notify_sig_events(mpr_local_dev dev)
+{
+#ifdef HAVE_PTHREAD
+    RETURN_UNLESS(dev->thread && dev->sig_events);
+    dev->sig_events = 0;
+    /* if the pipe is full the application is already due to wake up, so a failed write is not
+     * an error */
+    if (write(dev->thread->update_fd[1], "", 1) < 0) {}
+#endif
 }
 
 void mpr_dev_update_maps(mpr_dev dev) {
     RETURN_UNLESS(dev && dev->is_local);
-    ((mpr_local_dev)dev)->time_is_stale = 1;
+#ifdef HAVE_PTHREAD
+    if (((mpr_local_dev)dev)->thread) {
+        /* let the polling thread send updates pushed to signal queues */
+        _wake_poll_thread((mpr_local_dev)dev);
+        return;
+    }
+#endif
+    /* updates in an open batch keep the time it was begun with */
+    if (!((mpr_local_dev)dev)->batch_depth)
+        ((mpr_local_dev)dev)->time_is_stale = 1;
     if (!((mpr_local_dev)dev)->polling)
-        _process_outgoing_maps((mpr_local_dev)dev);
+        _process_maps((mpr_local_dev)dev);
 }
 
-int mpr_dev_poll(mpr_dev dev, int block_ms)
+static int _poll(mpr_dev dev, int block_ms)
 {
-    int admin_count = 0, device_count = 0, status[4];
-    mpr_net net;
-    RETURN_ARG_UNLESS(dev && dev->is_local, 0);
-    net = &dev->obj.graph->net;
+    int admin_count = 0, device_count = 0, status[5] = {0, 0, 0, 0, 0}, num_servers, drained;
+    int drain = 1;
+    mpr_net net = &dev->obj.graph->net;
     mpr_net_poll(net);
+    /* the Unix domain socket is not available on all platforms */
+    num_servers = net->servers[SERVER_UNIX] ? 5 : 4;
+    _process_queues((mpr_local_dev)dev);
 
     if (!((mpr_local_dev)dev)->registered) {
         if (lo_servers_recv_noblock(&net->servers[SERVER_ADMIN], status, 2, block_ms)) {
@@ -738,17 +1245,40 @@ int mpr_dev_poll(mpr_dev dev, int block_ms)
     }
 
     ((mpr_local_dev)dev)->polling = 1;
-    ((mpr_local_dev)dev)->time_is_stale = 1;
+    if (!((mpr_local_dev)dev)->batch_depth)
+        ((mpr_local_dev)dev)->time_is_stale = 1;
     mpr_dev_get_time(dev);
-    _process_outgoing_maps((mpr_local_dev)dev);
+    _process_maps((mpr_local_dev)dev);
     ((mpr_local_dev)dev)->polling = 0;
 
     if (!block_ms) {
-        if (lo_servers_recv_noblock(net->servers, status, 4, 0)) {
-            admin_count = (status[0] > 0) + (status[1] > 0);
-            device_count = (status[2] > 0) + (status[3] > 0);
-            net->msgs_recvd |= admin_count;
+        /* Check all servers with a single system call and only read from those that are ready,
+         * so that polling an idle device costs no more than it does with liblo alone. */
+        device_count = _recv_shm((mpr_local_dev)dev, MAX_FAST_RECV);
+        if (lo_servers_wait(net->servers, status, num_servers, 0)) {
+            if (status[SERVER_UNIX] && (drained = _recv_socket((mpr_local_dev)dev,
+                                                               net->servers[SERVER_UNIX],
+                                                               MAX_FAST_RECV - device_count))) {
+                device_count += drained;
+                status[SERVER_UNIX] = 0;
+            }
+            if (status[SERVER_UDP] && (drained = _recv_socket((mpr_local_dev)dev,
+                                                              net->servers[SERVER_UDP],
+                                                              MAX_FAST_RECV - device_count))) {
+                device_count += drained;
+                status[SERVER_UDP] = 0;
+            }
+            /* leave everything else, including datagrams that could not be read directly, to liblo */
+            if ((status[0] || status[1] || status[2] || status[3] || status[4])
+                && lo_servers_recv_noblock(net->servers, status, num_servers, 0)) {
+                admin_count = (status[0] > 0) + (status[1] > 0);
+                device_count += (status[2] > 0) + (status[3] > 0) + (status[4] > 0);
+                net->msgs_recvd |= admin_count;
+            }
         }
+        /* a short read means the sockets were empty, so draining them again would only cost
+         * more system calls on every poll */
+        drain = device_count >= MAX_FAST_RECV;
     }
     else {
         double then = mpr_get_current_time();
@@ -758,14 +1288,22 @@ int mpr_dev_poll(mpr_dev dev, int block_ms)
             if (left_ms > 100)
                 left_ms = 100;
             ((mpr_local_dev)dev)->polling = 1;
-            if (lo_servers_recv_noblock(net->servers, status, 4, left_ms)) {
+            /* do not block in liblo if datagrams were already waiting */
+            if ((drained = _recv_datagrams((mpr_local_dev)dev, MAX_FAST_RECV))
+                || _prepare_wait_shm((mpr_local_dev)dev, 1))
+                left_ms = 0;
+            device_count += drained;
+            if (lo_servers_recv_noblock(net->servers, status, num_servers, left_ms)) {
                 admin_count += (status[0] > 0) + (status[1] > 0);
-                device_count += (status[2] > 0) + (status[3] > 0);
+                device_count += (status[2] > 0) + (status[3] > 0) + (status[4] > 0);
             }
+            _prepare_wait_shm((mpr_local_dev)dev, 0);
             /* check if any signal update bundles need to be sent */
-            _process_incoming_maps((mpr_local_dev)dev);
-            _process_outgoing_maps((mpr_local_dev)dev);
+            _process_queues((mpr_local_dev)dev);
+            _process_maps((mpr_local_dev)dev);
             ((mpr_local_dev)dev)->polling = 0;
+            /* at most one notification per wait */
+            _notify_sig_events((mpr_local_dev)dev);
 
             elapsed = (mpr_get_current_time() - then) * 1000;
             if ((elapsed - checked_admin) > 100) {
@@ -776,18 +1314,25 @@ int mpr_dev_poll(mpr_dev dev, int block_ms)
         }
     }
 
-    /* When done, or if non-blocking, check for remaining messages up to a
-     * proportion of the number of input signals. Arbitrarily choosing 1 for
-     * now, but perhaps could be a heuristic based on a recent number of
-     * messages per channel per poll. */
+    /* When done, or if non-blocking and more datagrams may be waiting, drain the datagram sockets
+     * so that bursts from many senders do not overflow the kernel receive buffers between polls.
+     * The drain is bounded so that a flood of updates cannot starve the caller. */
+    while (drain && (drained = _recv_datagrams((mpr_local_dev)dev, MAX_FAST_RECV))
+           && (device_count += drained) < MAX_DRAIN_RECV) {}
+
+    /* Check for remaining messages from liblo up to a proportion of the number of input
+     * signals. Arbitrarily choosing 1 for now, but perhaps could be a heuristic based on a
+     * recent number of messages per channel per poll. */
     while (device_count < (dev->num_inputs + ((mpr_local_dev)dev)->n_output_callbacks)*1
-           && (lo_servers_recv_noblock(&net->servers[SERVER_DEVICE], &status[2], 2, 0)))
-        device_count += (status[2] > 0) + (status[3] > 0);
+           && (lo_servers_recv_noblock(&net->servers[SERVER_DEVICE], &status[2],
+                                       num_servers - SERVER_DEVICE, 0)))
+        device_count += (status[2] > 0) + (status[3] > 0) + (status[4] > 0);
 
-    /* process incoming maps */
+    /* process incoming maps and any local maps downstream of them */
     ((mpr_local_dev)dev)->polling = 1;
-    _process_incoming_maps((mpr_local_dev)dev);
+    _process_maps((mpr_local_dev)dev);
     ((mpr_local_dev)dev)->polling = 0;
+    _notify_sig_events((mpr_local_dev)dev);
 
     if (dev->obj.props.synced->dirty && mpr_dev_get_is_ready(dev)
         && ((mpr_local_dev)dev)->subscribers) {
@@ -800,6 +1345,128 @@ int mpr_dev_poll(mpr_dev dev, int block_ms)
     return admin_count + device_count;
 }
 
+int mpr_dev_poll(mpr_dev dev, int block_ms)
+{
+    RETURN_ARG_UNLESS(dev && dev->is_local, 0);
+    /* a device polled in the background must not be polled by the application as well */
+    RETURN_ARG_UNLESS(!((mpr_local_dev)dev)->thread, 0);
+    return _poll(dev, block_ms);
+}
+
+#ifdef HAVE_PTHREAD
+static void *_poll_thread_func(void *data)
+{
+    mpr_local_dev dev = (mpr_local_dev)data;
+    mpr_poll_thread pt = dev->thread;
+    while (!__atomic_load_n(&pt->stop, __ATOMIC_ACQUIRE))
+        _poll((mpr_dev)dev, pt->block_ms);
+    return 0;
+}
+#endif
+
+int mpr_dev_start_polling(mpr_dev dev, int block_ms)
+{
+#ifdef HAVE_PTHREAD
+    mpr_local_dev ldev = (mpr_local_dev)dev;
+    mpr_poll_thread pt;
+    lo_server server;
+    RETURN_ARG_UNLESS(dev && dev->is_local, 1);
+    RETURN_ARG_UNLESS(!ldev->thread, 0);
+    server = dev->obj.graph->net.servers[SERVER_UDP];
+    pt = (mpr_poll_thread)calloc(1, sizeof(mpr_poll_thread_t));
+    pt->block_ms = block_ms;
+    if (pipe(pt->update_fd)) {
+        trace_dev(ldev, "couldn't create update descriptor\n");
+        free(pt);
+        return 1;
+    }
+    /* neither the polling thread nor the application should block on the pipe */
+    fcntl(pt->update_fd[0], F_SETFL, fcntl(pt->update_fd[0], F_GETFL) | O_NONBLOCK);
+    fcntl(pt->update_fd[1], F_SETFL, fcntl(pt->update_fd[1], F_GETFL) | O_NONBLOCK);
+
+    /* wake-ups are sent to the data port on the loopback interface */
+    pt->wake_addr_len = sizeof(pt->wake_addr);
+    getsockname(lo_server_get_socket_fd(server), (struct sockaddr*)&pt->wake_addr,
+                &pt->wake_addr_len);
+    if (AF_INET6 == pt->wake_addr.ss_family)
+        ((struct sockaddr_in6*)&pt->wake_addr)->sin6_addr = in6addr_loopback;
+    else
+        ((struct sockaddr_in*)&pt->wake_addr)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    ldev->thread = pt;
+    if (pthread_create(&pt->thread, 0, _poll_thread_func, dev)) {
+        trace_dev(ldev, "couldn't start polling thread\n");
+        ldev->thread = 0;
+        close(pt->update_fd[0]);
+        close(pt->update_fd[1]);
+        free(pt);
+        return 1;
+    }
+    return 0;
+#else
+    trace("threads are not supported on this platform\n");
+    return 1;
+#endif
+}
+
+int mpr_dev_stop_polling(mpr_dev dev)
+{
+#ifdef HAVE_PTHREAD
+    mpr_local_dev ldev = (mpr_local_dev)dev;
+    mpr_poll_thread pt;
+    RETURN_ARG_UNLESS(dev && dev->is_local && (pt = ldev->thread), 1);
+    __atomic_store_n(&pt->stop, 1, __ATOMIC_RELEASE);
+    _wake_poll_thread(ldev);
+    pthread_join(pt->thread, 0);
+    ldev->thread = 0;
+    close(pt->update_fd[0]);
+    close(pt->update_fd[1]);
+    free(pt);
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+int mpr_dev_get_update_fd(mpr_dev dev)
+{
+#ifdef HAVE_PTHREAD
+    RETURN_ARG_UNLESS(dev && dev->is_local && ((mpr_local_dev)dev)->thread, -1);
+    return ((mpr_local_dev)dev)->thread->update_fd[0];
+#else
+    return -1;
+#endif
+}
+
+void mpr_dev_begin_batch(mpr_dev dev)
+{
+    mpr_local_dev ldev = (mpr_local_dev)dev;
+    RETURN_UNLESS(dev && dev->is_local);
+    if (!ldev->batch_depth) {
+        /* send earlier updates now, then tag every update in the batch with the same time */
+        mpr_dev_get_time(dev);
+        if (!ldev->polling)
+            _process_maps(ldev);
+    }
+    ++ldev->batch_depth;
+}
+
+void mpr_dev_commit_batch(mpr_dev dev)
+{
+    mpr_local_dev ldev = (mpr_local_dev)dev;
+    RETURN_UNLESS(dev && dev->is_local && ldev->batch_depth);
+    RETURN_UNLESS(--ldev->batch_depth == 0);
+    if (!ldev->polling)
+        _process_maps(ldev);
+    ldev->time_is_stale = 1;
+}
+
+uint64_t mpr_dev_get_num_syscalls_saved(mpr_dev dev)
+{
+    RETURN_ARG_UNLESS(dev && dev->is_local, 0);
+    return ((mpr_local_dev)dev)->syscalls_saved;
+}
+
 mpr_time mpr_dev_get_time(mpr_dev dev)
 {
     RETURN_ARG_UNLESS(dev && dev->is_local, MPR_NOW);
@@ -815,7 +1482,7 @@ void mpr_dev_set_time(mpr_dev dev, mpr_time time)
     mpr_time_set(&((mpr_local_dev)dev)->time, time);
     ((mpr_local_dev)dev)->time_is_stale = 0;
     if (!((mpr_local_dev)dev)->polling)
-        _process_outgoing_maps((mpr_local_dev)dev);
+        _process_maps((mpr_local_dev)dev);
 }
 
 void mpr_dev_reserve_idmap(mpr_local_dev dev)
@@ -826,6 +1493,41 @@ void mpr_dev_reserve_idmap(mpr_local_dev dev)
     dev->idmaps.reserve = map;
 }
 
+/* Active id maps are kept in a list per signal group, and are also indexed by LID and by GID
+ * in chained hash tables that grow with the number of active maps. */
+MPR_INLINE static int _idmap_bucket(mpr_local_dev dev, int group, mpr_id id)
+{
+    return (mpr_id_hash(id) + group) & (dev->idmaps.num_buckets - 1);
+}
+
+static void _link_idmap(mpr_local_dev dev, mpr_id_map map)
+{
+    mpr_id_map *bucket = &dev->idmaps.LID_hash[_idmap_bucket(dev, map->group, map->LID)];
+    map->next_LID = *bucket;
+    *bucket = map;
+    bucket = &dev->idmaps.GID_hash[_idmap_bucket(dev, map->group, map->GID)];
+    map->next_GID = *bucket;
+    *bucket = map;
+}
+
+static void _rehash_idmaps(mpr_local_dev dev, int num_buckets)
+{
+    int i;
+    mpr_id_map *old = dev->idmaps.LID_hash, map;
+    int old_num_buckets = dev->idmaps.num_buckets;
+    free(dev->idmaps.GID_hash);
+    dev->idmaps.LID_hash = (mpr_id_map*) calloc(num_buckets, sizeof(mpr_id_map));
+    dev->idmaps.GID_hash = (mpr_id_map*) calloc(num_buckets, sizeof(mpr_id_map));
+    dev->idmaps.num_buckets = num_buckets;
+    for (i = 0; i < old_num_buckets; i++) {
+        while ((map = old[i])) {
+            old[i] = map->next_LID;
+            _link_idmap(dev, map);
+        }
+    }
+    free(old);
+}
+
 mpr_id_map mpr_dev_add_idmap(mpr_local_dev dev, int group, mpr_id LID, mpr_id GID)
 {
     mpr_id_map map;
@@ -834,26 +1536,46 @@ mpr_id_map mpr_dev_add_idmap(mpr_local_dev dev, int group, mpr_id LID, mpr_id GI
     map = dev->idmaps.reserve;
     map->LID = LID;
     map->GID = GID ? GID : mpr_dev_generate_unique_id((mpr_dev)dev);
+    map->group = group;
     map->LID_refcount = 1;
     map->GID_refcount = 0;
     dev->idmaps.reserve = map->next;
-    map->next = dev->idmaps.active[group];
+    map->prev = 0;
+    if ((map->next = dev->idmaps.active[group]))
+        map->next->prev = map;
     dev->idmaps.active[group] = map;
+    if (++dev->idmaps.num_active > dev->idmaps.num_buckets)
+        _rehash_idmaps(dev, dev->idmaps.num_buckets * 2);
+    _link_idmap(dev, map);
     return map;
 }
 
 static void mpr_dev_remove_idmap(mpr_local_dev dev, int group, mpr_id_map rem)
 {
-    mpr_id_map *map = &dev->idmaps.active[group];
-    while (*map) {
-        if ((*map) == rem) {
-            *map = (*map)->next;
-            rem->next = dev->idmaps.reserve;
-            dev->idmaps.reserve = rem;
-            break;
-        }
-        map = &(*map)->next;
-    }
+    mpr_id_map *map;
+
+    /* unlink from the hash tables */
+    map = &dev->idmaps.LID_hash[_idmap_bucket(dev, group, rem->LID)];
+    while (*map && *map != rem)
+        map = &(*map)->next_LID;
+    RETURN_UNLESS(*map);
+    *map = rem->next_LID;
+    map = &dev->idmaps.GID_hash[_idmap_bucket(dev, group, rem->GID)];
+    while (*map && *map != rem)
+        map = &(*map)->next_GID;
+    if (*map)
+        *map = rem->next_GID;
+    --dev->idmaps.num_active;
+
+    /* move from the active list to the reserve list */
+    if (rem->prev)
+        rem->prev->next = rem->next;
+    else
+        dev->idmaps.active[group] = rem->next;
+    if (rem->next)
+        rem->next->prev = rem->prev;
+    rem->next = dev->idmaps.reserve;
+    dev->idmaps.reserve = rem;
 }
 
 int mpr_dev_LID_decref(mpr_local_dev dev, int group, mpr_id_map map)
@@ -884,22 +1606,22 @@ int mpr_dev_GID_decref(mpr_local_dev dev, int group, mpr_id_map map)
 
 mpr_id_map mpr_dev_get_idmap_by_LID(mpr_local_dev dev, int group, mpr_id LID)
 {
-    mpr_id_map map = dev->idmaps.active[group];
+    mpr_id_map map = dev->idmaps.LID_hash[_idmap_bucket(dev, group, LID)];
     while (map) {
-        if (map->LID == LID)
+        if (map->LID == LID && map->group == group)
             return map;
-        map = map->next;
+        map = map->next_LID;
     }
     return 0;
 }
 
 mpr_id_map mpr_dev_get_idmap_by_GID(mpr_local_dev dev, int group, mpr_id GID)
 {
-    mpr_id_map map = dev->idmaps.active[group];
+    mpr_id_map map = dev->idmaps.GID_hash[_idmap_bucket(dev, group, GID)];
     while (map) {
-        if (map->GID == GID)
+        if (map->GID == GID && map->group == group)
             return map;
-        map = map->next;
+        map = map->next_GID;
     }
     return 0;
 }
@@ -914,8 +1636,10 @@ void mpr_dev_start_servers(mpr_local_dev dev)
 {
     int portnum;
     char port[16], *pport = 0, *url, *host;
+#ifdef HAVE_SYS_UN_H
+    char path[108];
+#endif
     mpr_net net = &dev->obj.graph->net;
-    mpr_list sigs;
     RETURN_UNLESS(!net->servers[SERVER_UDP] && !net->servers[SERVER_TCP]);
     while (!(net->servers[SERVER_UDP] = lo_server_new(pport, handler_error)))
         pport = 0;
@@ -924,6 +1648,12 @@ void mpr_dev_start_servers(mpr_local_dev dev)
     while (!(net->servers[SERVER_TCP] = lo_server_new_with_proto(pport, LO_TCP, handler_error)))
         pport = 0;
 
+    if (!dev->recv_buf) {
+        /* start with a single datagram slot, which grows when datagrams arrive in bursts */
+        dev->recv_buf = (char*)malloc(MAX_UDP_BUNDLE_LEN);
+        dev->recv_slots = 1;
+    }
+
     /* Disable liblo message queueing */
     lo_server_enable_queue(net->servers[SERVER_UDP], 0, 1);
     lo_server_enable_queue(net->servers[SERVER_TCP], 0, 1);
@@ -944,16 +1674,23 @@ void mpr_dev_start_servers(mpr_local_dev dev)
     free(host);
     free(url);
 
-    /* add signal methods */
-    sigs = mpr_dev_get_sigs((mpr_dev)dev, MPR_DIR_ANY);
-    while (sigs) {
-        mpr_local_sig sig = (mpr_local_sig)*sigs;
-        sigs = mpr_list_get_next(sigs);
-        if (sig->handler) {
-            lo_server_add_method(net->servers[SERVER_UDP], sig->path, NULL, mpr_dev_handler, (void*)sig);
-            lo_server_add_method(net->servers[SERVER_TCP], sig->path, NULL, mpr_dev_handler, (void*)sig);
-        }
+    /* add signal method, dispatching by path to the signals in dev->sig_paths */
+    lo_server_add_method(net->servers[SERVER_UDP], NULL, NULL, _handler_sig, (void*)dev);
+    lo_server_add_method(net->servers[SERVER_TCP], NULL, NULL, _handler_sig, (void*)dev);
+
+#ifdef HAVE_SYS_UN_H
+    /* bind a Unix domain socket for devices on this host at a path derived from the port */
+    mpr_net_get_unix_path(path, 108, portnum);
+    if (mpr_net_prepare_unix_path(path))
+        net->servers[SERVER_UNIX] = lo_server_new_with_proto(path, LO_UNIX, handler_error);
+    if (net->servers[SERVER_UNIX]) {
+        lo_server_enable_queue(net->servers[SERVER_UNIX], 0, 1);
+        lo_server_add_bundle_handlers(net->servers[SERVER_UNIX], mpr_dev_bundle_start, NULL,
+                                      (void*)dev);
+        lo_server_add_method(net->servers[SERVER_UNIX], NULL, NULL, _handler_sig, (void*)dev);
+        trace_dev(dev, "bound to Unix socket %s\n", path);
     }
+#endif
 }
 
 const char *mpr_dev_get_name(mpr_dev dev)
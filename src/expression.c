@@ -30,9 +30,19 @@ typedef union _mpr_expr_val {
  * pro: vectors, commonality with I/O
  * con: timetags wasted
  * option: create version with unallocated timetags */
-mpr_expr_val stk = 0;
-uint8_t *dims = 0;
-int stk_size = 0;
+/* The maximum number of instances evaluated together by mpr_expr_eval_batch(). */
+#define MPR_EXPR_MAX_LANES 32
+/* The minimum number of instances for which evaluating them together is faster. */
+#define MPR_EXPR_MIN_LANES 4
+/* The minimum vector length for which the bytecode evaluates a single instance faster than the
+ * token interpreter. */
+#define MPR_EXPR_BC_MIN_VEC_LEN 16
+
+struct _mpr_expr_eval_buffer {
+    mpr_expr_val stk;       /* Room for MPR_EXPR_MAX_LANES frames plus one scratch frame. */
+    uint8_t *dims;
+    int size;
+};
 
 #define EXTREMA_FUNC(NAME, TYPE, OP)    \
     static TYPE NAME(TYPE x, TYPE y) { return (x OP y) ? x : y; }
@@ -975,6 +985,10 @@ struct _mpr_expr
     int8_t inst_ctl;
     int8_t mute_ctl;
     int8_t n_ins;
+    struct _mpr_bc *bc;
+    uint8_t use_bc;
+    struct _mpr_lin *lin;
+    uint8_t use_lin;
 };
 
 void mpr_expr_free(mpr_expr expr)
@@ -982,6 +996,8 @@ void mpr_expr_free(mpr_expr expr)
     int i;
     FUNC_IF(free, expr->in_hist_size);
     FUNC_IF(free, expr->tokens);
+    FUNC_IF(free, expr->bc);
+    FUNC_IF(free, expr->lin);
     if (expr->n_vars && expr->vars) {
         for (i = 0; i < expr->n_vars; i++)
             free(expr->vars[i].name);
@@ -990,18 +1006,39 @@ void mpr_expr_free(mpr_expr expr)
     free(expr);
 }
 
-void mpr_expr_free_buffers()
+mpr_expr_eval_buffer mpr_expr_new_eval_buffer(mpr_expr expr)
 {
-    if (stk) {
-        free(stk);
-        stk = 0;
-    }
-    if (dims) {
-        free(dims);
-        dims = 0;
+    mpr_expr_eval_buffer buff = calloc(1, sizeof(struct _mpr_expr_eval_buffer));
+    if (expr)
+        mpr_expr_realloc_eval_buffer(expr, buff);
+    return buff;
+}
+
+void mpr_expr_realloc_eval_buffer(mpr_expr expr, mpr_expr_eval_buffer buff)
+{
+    /* Reallocate evaluation stack if necessary. */
+    int num_samps = expr->stack_size * expr->vec_len;
+    if (num_samps > buff->size) {
+        size_t stk_size = buff->size = num_samps;
+        stk_size *= (MPR_EXPR_MAX_LANES + 1) * sizeof(mpr_expr_val_t);
+        if (buff->stk)
+            buff->stk = realloc(buff->stk, stk_size);
+        else
+            buff->stk = malloc(stk_size);
+        if (buff->dims)
+            buff->dims = realloc(buff->dims, buff->size * sizeof(uint8_t));
+        else
+            buff->dims = malloc(buff->size * sizeof(uint8_t));
     }
 }
 
+void mpr_expr_free_eval_buffer(mpr_expr_eval_buffer buff)
+{
+    FUNC_IF(free, buff->stk);
+    FUNC_IF(free, buff->dims);
+    free(buff);
+}
+
 #ifdef TRACE_PARSE
 
 static void printtoken(mpr_token_t t, mpr_var_t *vars)
@@ -1299,26 +1336,12 @@ error:
     return -1;
 }
 
-static void expr_stack_realloc(int num_samps) {
-    /* Reallocate evaluation stack if necessary. */
-    if (num_samps > stk_size) {
-        stk_size = num_samps;
-        if (stk)
-            stk = realloc(stk, stk_size * sizeof(mpr_expr_val_t));
-        else
-            stk = malloc(stk_size * sizeof(mpr_expr_val_t));
-        if (dims)
-            dims = realloc(dims, stk_size * sizeof(uint8_t));
-        else
-            dims = malloc(stk_size * sizeof(uint8_t));
-    }
-}
-
 static int precompute(mpr_token_t *stk, int len, int vec_len)
 {
     int i;
     struct _mpr_expr e = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1, -1};
-    mpr_value_t v = {0, 0, 1, 0, 1};
+    mpr_expr_eval_buffer buff;
+    mpr_value_t v = {0, 0, 1, 0, 1, 0};
     mpr_value_buffer_t b = {0, 0, -1};
     void *s;
 
@@ -1334,9 +1357,10 @@ static int precompute(mpr_token_t *stk, int len, int vec_len)
     v.vlen = vec_len;
     v.type = stk[len - 1].gen.datatype;
 
-    expr_stack_realloc(len * vec_len);
-
-    if (!(mpr_expr_eval(&e, 0, 0, &v, 0, 0, 0) & 1)) {
+    buff = mpr_expr_new_eval_buffer(&e);
+    i = mpr_expr_eval(buff, &e, 0, 0, &v, 0, 0, 0);
+    mpr_expr_free_eval_buffer(buff);
+    if (!(i & 1)) {
         free(s);
         return 0;
     }
@@ -1693,6 +1717,1592 @@ static int _eval_stack_size(mpr_token_t *token_stack, int token_stack_len)
     return eval_stack_len;
 }
 
+MPR_INLINE static int _max(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+/* Expressions are lowered from the RPN token stack into a flat array of
+ * instructions once parsing is complete. Each instruction has its datatype,
+ * vector lengths and register offsets resolved at compile time, so evaluation
+ * no longer needs to track the stack pointer or the per-entry vector lengths
+ * kept in the global 'dims' array. Registers are fixed regions of the
+ * evaluation stack, each 'vec_len' elements wide. Register contents are
+ * packed arrays of the register's datatype rather than mpr_expr_val_t unions,
+ * so that vector operators can use the kernels in simd.c. Expressions using
+ * features the compiler does not handle (timetags and instance reduce
+ * functions) or whose stack entries change type without a cast are evaluated
+ * by the token interpreter instead. */
+
+#if defined(__GNUC__) && !defined(MPR_EXPR_NO_THREADED_DISPATCH)
+    #define BC_THREADED 1   /* Use computed goto for direct-threaded dispatch. */
+#else
+    #define BC_THREADED 0
+#endif
+
+/* Opcodes listed with BC_TYPED are expanded into consecutive int, float and
+ * double variants so that the typed opcode can be found by adding an offset. */
+#define BC_OPCODES(TYPED, INT, UNTYPED) \
+    TYPED(LIT)          \
+    TYPED(ADD)          \
+    TYPED(SUB)          \
+    TYPED(MUL)          \
+    TYPED(DIV)          \
+    TYPED(MOD)          \
+    TYPED(EQ)           \
+    TYPED(NE)           \
+    TYPED(LT)           \
+    TYPED(LE)           \
+    TYPED(GT)           \
+    TYPED(GE)           \
+    TYPED(AND)          \
+    TYPED(OR)           \
+    TYPED(NOT)          \
+    TYPED(IF_ELSE)      \
+    TYPED(IF_THEN_ELSE) \
+    TYPED(FN1)          \
+    TYPED(FN2)          \
+    TYPED(FN3)          \
+    TYPED(FN4)          \
+    INT(SHL)            \
+    INT(SHR)            \
+    INT(BAND)           \
+    INT(BOR)            \
+    INT(BXOR)           \
+    UNTYPED(CAST_IF)    \
+    UNTYPED(CAST_ID)    \
+    UNTYPED(CAST_FI)    \
+    UNTYPED(CAST_FD)    \
+    UNTYPED(CAST_DI)    \
+    UNTYPED(CAST_DF)    \
+    UNTYPED(LOAD_X)     \
+    UNTYPED(LOAD_Y)     \
+    UNTYPED(LOAD_X_HIST)\
+    UNTYPED(LOAD_Y_HIST)\
+    UNTYPED(LOAD_VAR)   \
+    UNTYPED(VFN)        \
+    UNTYPED(REDUCE)     \
+    UNTYPED(EXTEND)     \
+    UNTYPED(MOVE)       \
+    UNTYPED(ASSIGN_Y)   \
+    UNTYPED(ASSIGN_VAR) \
+    UNTYPED(END)
+
+#define BC_ENUM_TYPED(NAME) BC_##NAME##_I, BC_##NAME##_F, BC_##NAME##_D,
+#define BC_ENUM_INT(NAME) BC_##NAME##_I,
+#define BC_ENUM_UNTYPED(NAME) BC_##NAME,
+
+typedef enum {
+    BC_OPCODES(BC_ENUM_TYPED, BC_ENUM_INT, BC_ENUM_UNTYPED)
+    N_BC_OPCODES
+} bc_opcode_t;
+
+#undef BC_ENUM_TYPED
+#undef BC_ENUM_INT
+#undef BC_ENUM_UNTYPED
+
+/* Typed base opcode for each expr_op_t, or -1 if not supported. */
+static const int16_t bc_op_tbl[] = {
+    BC_NOT_I,           /* OP_LOGICAL_NOT */
+    BC_MUL_I,           /* OP_MULTIPLY */
+    BC_DIV_I,           /* OP_DIVIDE */
+    BC_MOD_I,           /* OP_MODULO */
+    BC_ADD_I,           /* OP_ADD */
+    BC_SUB_I,           /* OP_SUBTRACT */
+    BC_SHL_I,           /* OP_LEFT_BIT_SHIFT */
+    BC_SHR_I,           /* OP_RIGHT_BIT_SHIFT */
+    BC_GT_I,            /* OP_IS_GREATER_THAN */
+    BC_GE_I,            /* OP_IS_GREATER_THAN_OR_EQUAL */
+    BC_LT_I,            /* OP_IS_LESS_THAN */
+    BC_LE_I,            /* OP_IS_LESS_THAN_OR_EQUAL */
+    BC_EQ_I,            /* OP_IS_EQUAL */
+    BC_NE_I,            /* OP_IS_NOT_EQUAL */
+    BC_BAND_I,          /* OP_BITWISE_AND */
+    BC_BXOR_I,          /* OP_BITWISE_XOR */
+    BC_BOR_I,           /* OP_BITWISE_OR */
+    BC_AND_I,           /* OP_LOGICAL_AND */
+    BC_OR_I,            /* OP_LOGICAL_OR */
+    -1,                 /* OP_IF */
+    BC_IF_ELSE_I,       /* OP_IF_ELSE */
+    BC_IF_THEN_ELSE_I,  /* OP_IF_THEN_ELSE */
+};
+
+/* Vectorised kernel for each expr_op_t, or -1 if not supported. */
+static const int8_t bc_simd_tbl[] = {
+    -1,                 /* OP_LOGICAL_NOT */
+    MPR_SIMD_MUL,       /* OP_MULTIPLY */
+    MPR_SIMD_DIV,       /* OP_DIVIDE */
+    -1,                 /* OP_MODULO */
+    MPR_SIMD_ADD,       /* OP_ADD */
+    MPR_SIMD_SUB,       /* OP_SUBTRACT */
+    -1,                 /* OP_LEFT_BIT_SHIFT */
+    -1,                 /* OP_RIGHT_BIT_SHIFT */
+    MPR_SIMD_GT,        /* OP_IS_GREATER_THAN */
+    MPR_SIMD_GE,        /* OP_IS_GREATER_THAN_OR_EQUAL */
+    MPR_SIMD_LT,        /* OP_IS_LESS_THAN */
+    MPR_SIMD_LE,        /* OP_IS_LESS_THAN_OR_EQUAL */
+    MPR_SIMD_EQ,        /* OP_IS_EQUAL */
+    MPR_SIMD_NE,        /* OP_IS_NOT_EQUAL */
+    -1,                 /* OP_BITWISE_AND */
+    -1,                 /* OP_BITWISE_XOR */
+    -1,                 /* OP_BITWISE_OR */
+    -1,                 /* OP_LOGICAL_AND */
+    -1,                 /* OP_LOGICAL_OR */
+    -1,                 /* OP_IF */
+    -1,                 /* OP_IF_ELSE */
+    -1,                 /* OP_IF_THEN_ELSE */
+};
+
+/* Vector functions that are compiled to BC_REDUCE. */
+#define BC_REDUCE_MEAN  0x01    /* divide the sum by the vector length */
+#define BC_REDUCE_NORM  0x02    /* take the square root of the dot product with itself */
+
+typedef struct _mpr_instr {
+#if BC_THREADED
+    const void *addr;       /*!< Handler address for direct-threaded dispatch. */
+#endif
+    union {
+        mpr_expr_val_t lit; /*!< Literal value for BC_LIT_*. */
+        void *fn;           /*!< Function pointer for BC_FN* and BC_VFN, or the SIMD kernels
+                             *   for vector operators and BC_REDUCE. */
+        int jump;           /*!< Instruction to resume from after an integer division by
+                             *   zero, or -1 to abort evaluation. */
+    } arg;
+    uint16_t dst;           /*!< Register offset of the result and first operand; always a
+                             *   multiple of the register width. */
+    uint16_t src;           /*!< Register offset of the source for BC_MOVE. */
+    uint16_t tok;           /*!< Index of the token this instruction was compiled from. */
+    uint8_t op;             /*!< The bc_opcode_t. */
+    uint8_t len;            /*!< Vector length of the result. */
+    uint8_t dim[4];         /*!< Vector lengths of the operands. */
+    uint8_t var;            /*!< Input slot or variable index for loads and stores. */
+    uint8_t vec_idx;        /*!< Vector index for loads and stores. */
+    uint8_t offset;         /*!< Offset into the operand for assignments, or the element
+                             *   offset of the destination for BC_MOVE. */
+    uint8_t flags;          /*!< Flags copied from the token. */
+    uint8_t type;           /*!< Index datatype for history loads, datatype for stores,
+                             *   vector functions and reductions. */
+    uint8_t aux;            /*!< BC_ASSIGN_* flags for stores, arity for BC_VFN, BC_REDUCE_*
+                             *   flags for BC_REDUCE, element size for BC_MOVE and BC_EXTEND. */
+} mpr_instr_t, *mpr_instr;
+
+#define BC_ASSIGN_CONST 0x01
+
+typedef struct _mpr_bc {
+    mpr_instr_t *code;
+    uint16_t *tok_pc;       /*!< Instruction index for each token index. */
+    int n_instr;
+    int vec_len;            /*!< Stride between register elements for a single lane. */
+    int has_jumps;          /*!< Nonzero if a division by zero can skip instructions. */
+} mpr_bc_t, *mpr_bc;
+
+static int bc_type_offset(mpr_type type)
+{
+    switch (type) {
+        case MPR_INT32: return 0;
+        case MPR_FLT:   return 1;
+        case MPR_DBL:   return 2;
+        default:        return -1;
+    }
+}
+
+static mpr_instr bc_emit(mpr_instr_t *code, int *n_instr, int max_instr, int op, int tok, int dp,
+                         int vec_len)
+{
+    mpr_instr ins;
+    if (*n_instr >= max_instr || dp < 0)
+        return 0;
+    ins = &code[(*n_instr)++];
+    memset(ins, 0, sizeof(mpr_instr_t));
+    ins->op = op;
+    ins->tok = tok;
+    ins->dst = dp * vec_len;
+    return ins;
+}
+
+#define BC_EMIT(OP, DP)                                                         \
+    if (!(ins = bc_emit(code, &n_instr, max_instr, OP, t, DP, vec_len)))        \
+        goto fail;
+
+/* Emit an instruction repeating a register's contents to fill a longer vector. */
+#define BC_EXTEND(DP, FROM, TO)                                                 \
+    if ((FROM) < (TO)) {                                                        \
+        BC_EMIT(BC_EXTEND, DP);                                                 \
+        ins->dim[0] = FROM;                                                     \
+        ins->len = TO;                                                          \
+        ins->aux = mpr_type_get_size(types[DP]);                                \
+    }
+
+/* Registers are packed arrays of a single type, so operands must match the type of the
+ * instruction consuming them. */
+#define BC_CHECK_TYPES(DP, N, TYPE)                                             \
+    for (i = 0; i < (N); i++) {                                                 \
+        if (types[(DP) + i] != (TYPE))                                          \
+            goto fail;                                                          \
+    }
+
+/*! Lower a parsed token stack to bytecode by tracking the evaluation stack
+ *  pointer and the vector length of every stack entry at compile time. */
+static mpr_bc bc_compile(mpr_token_t *tokens, int n_tokens, int stack_size, int vec_len,
+                         int inst_ctl, int mute_ctl)
+{
+    int t, i, dp = -1, n_instr = 0, max_instr, type_offset;
+    uint8_t dims[STACK_SIZE + 4];
+    mpr_type types[STACK_SIZE + 4], last_type = 0;
+    const mpr_simd_kernel_t *kernel;
+    int simd_op;
+    mpr_instr_t *code;
+    mpr_instr ins;
+    uint16_t *tok_pc;
+    mpr_bc bc;
+
+    /* Each token produces at most 3 instructions (extension, operation, cast). */
+    max_instr = n_tokens * 3 + 1;
+    bc = malloc(sizeof(mpr_bc_t) + sizeof(mpr_instr_t) * max_instr
+                + sizeof(uint16_t) * (n_tokens + 1));
+    RETURN_ARG_UNLESS(bc, 0);
+    code = bc->code = (mpr_instr_t*)(bc + 1);
+    tok_pc = bc->tok_pc = (uint16_t*)(code + max_instr);
+    bc->vec_len = vec_len;
+    memset(dims, 0, sizeof(dims));
+    memset(types, 0, sizeof(types));
+
+    for (t = 0; t < n_tokens; t++) {
+        mpr_token_t *tok = &tokens[t];
+        tok_pc[t] = n_instr;
+        if (dp >= STACK_SIZE || (stack_size && dp >= stack_size))
+            goto fail;
+        switch (tok->toktype) {
+            case TOK_LITERAL:
+                ++dp;
+                dims[dp] = tok->gen.vec_len;
+                types[dp] = tok->gen.datatype;
+                BC_EMIT(BC_LIT_I + bc_type_offset(tok->gen.datatype), dp);
+                ins->len = tok->gen.vec_len;
+                switch (tok->gen.datatype) {
+                    case MPR_INT32: ins->arg.lit.i = tok->lit.val.i;    break;
+                    case MPR_FLT:   ins->arg.lit.f = tok->lit.val.f;    break;
+                    case MPR_DBL:   ins->arg.lit.d = tok->lit.val.d;    break;
+                    default:                                            goto fail;
+                }
+                break;
+            case TOK_VAR: {
+                int delay = tok->gen.flags & VAR_DELAY;
+                if (!delay)
+                    ++dp;
+                dims[dp] = tok->gen.vec_len;
+                if (tok->var.idx >= VAR_Y) {
+                    if (delay) {
+                        if (bc_type_offset(last_type) < 0 || types[dp] != last_type)
+                            goto fail;
+                        BC_EMIT(VAR_Y == tok->var.idx ? BC_LOAD_Y_HIST : BC_LOAD_X_HIST, dp);
+                        ins->type = last_type;
+                    }
+                    else
+                        BC_EMIT(VAR_Y == tok->var.idx ? BC_LOAD_Y : BC_LOAD_X, dp);
+                    if (tok->var.idx >= VAR_X)
+                        ins->var = tok->var.idx - VAR_X;
+                }
+                else {
+                    BC_EMIT(BC_LOAD_VAR, dp);
+                    ins->var = tok->var.idx;
+                }
+                ins->len = tok->gen.vec_len;
+                ins->vec_idx = tok->var.vec_idx;
+                ins->flags = tok->gen.flags;
+                types[dp] = tok->gen.datatype;
+                break;
+            }
+            case TOK_OP: {
+                int arity = op_tbl[tok->op.idx].arity, maxlen, base;
+                if (tok->op.idx < 0 || tok->op.idx > OP_IF_THEN_ELSE)
+                    goto fail;
+                base = bc_op_tbl[tok->op.idx];
+                type_offset = bc_type_offset(tok->gen.datatype);
+                if (base < 0 || type_offset < 0)
+                    goto fail;
+                if (base >= BC_SHL_I) {
+                    /* bitwise operators are only defined for integers */
+                    if (type_offset)
+                        goto fail;
+                }
+                else
+                    base += type_offset;
+                dp -= arity - 1;
+                if (dp < 0)
+                    goto fail;
+                BC_CHECK_TYPES(dp, arity, tok->gen.datatype);
+                maxlen = dims[dp];
+                for (i = 1; i < arity; i++)
+                    maxlen = _max(maxlen, dims[dp + i]);
+                BC_EXTEND(dp, dims[dp], maxlen);
+                dims[dp] = maxlen;
+                BC_EMIT(base, dp);
+                for (i = 0; i < 3; i++)
+                    ins->dim[i] = dims[dp + i];
+                if (bc_simd_tbl[tok->op.idx] >= 0)
+                    ins->arg.fn = (void*)mpr_simd_get_kernel(bc_simd_tbl[tok->op.idx],
+                                                             tok->gen.datatype, MPR_SIMD_AUTO);
+                /* the interpreter uses the token vector length for these operators */
+                if (BC_DIV_I == base || BC_MOD_F == base || BC_MOD_D == base)
+                    ins->len = tok->gen.vec_len;
+                else
+                    ins->len = maxlen;
+                if (BC_DIV_I == base) {
+                    /* division by zero skips to the end of the current statement; store the
+                     * token index for now and resolve it once all tokens are compiled */
+                    i = t;
+                    while (++i < n_tokens && !(tokens[i].toktype & TOK_ASSIGN)) {}
+                    while (++i < n_tokens && tokens[i].toktype & TOK_ASSIGN) {}
+                    ins->arg.jump = i < n_tokens ? i : -1;
+                }
+                break;
+            }
+            case TOK_FN: {
+                int arity = fn_tbl[tok->fn.idx].arity, maxlen;
+                void *fn;
+                if (tok->fn.idx >= FN_DELAY && tok->fn.idx != FN_UNIFORM)
+                    goto fail;
+                if (arity < 1 || arity > 4)
+                    goto fail;
+                switch (tok->gen.datatype) {
+                    case MPR_INT32: fn = fn_tbl[tok->fn.idx].fn_int;    break;
+                    case MPR_FLT:   fn = fn_tbl[tok->fn.idx].fn_flt;    break;
+                    case MPR_DBL:   fn = fn_tbl[tok->fn.idx].fn_dbl;    break;
+                    default:                                            goto fail;
+                }
+                if (!fn)
+                    goto fail;
+                dp -= arity - 1;
+                if (dp < 0)
+                    goto fail;
+                BC_CHECK_TYPES(dp, arity, tok->gen.datatype);
+                maxlen = dims[dp];
+                for (i = 1; i < arity; i++)
+                    maxlen = _max(maxlen, dims[dp + i]);
+                BC_EXTEND(dp, dims[dp], maxlen);
+                dims[dp] = maxlen;
+                BC_EMIT(BC_FN1_I + (arity - 1) * 3 + bc_type_offset(tok->gen.datatype), dp);
+                ins->arg.fn = fn;
+                ins->len = maxlen;
+                for (i = 0; i < 4; i++)
+                    ins->dim[i] = dims[dp + i];
+                break;
+            }
+            case TOK_VFN: {
+                int arity = vfn_tbl[tok->fn.idx].arity;
+                vfn_template *fn;
+                switch (tok->gen.datatype) {
+                    case MPR_INT32: fn = vfn_tbl[tok->fn.idx].fn_int;   break;
+                    case MPR_FLT:   fn = vfn_tbl[tok->fn.idx].fn_flt;   break;
+                    case MPR_DBL:   fn = vfn_tbl[tok->fn.idx].fn_dbl;   break;
+                    default:                                            goto fail;
+                }
+                if (!fn)
+                    goto fail;
+                dp -= arity - 1;
+                if (dp < 0)
+                    goto fail;
+                BC_CHECK_TYPES(dp, arity, tok->gen.datatype);
+                if (arity > 1 || VFN_DOT == tok->fn.idx) {
+                    /* ensure the vector lengths are equal */
+                    BC_EXTEND(dp + 1, dims[dp + 1], dims[dp]);
+                    BC_EXTEND(dp, dims[dp], dims[dp + 1]);
+                    dims[dp] = dims[dp + 1] = _max(dims[dp], dims[dp + 1]);
+                }
+                switch (tok->fn.idx) {
+                    case VFN_SUM:
+                    case VFN_MEAN:  simd_op = MPR_SIMD_ADD;     break;
+                    case VFN_MAX:   simd_op = MPR_SIMD_MAX;     break;
+                    case VFN_MIN:   simd_op = MPR_SIMD_MIN;     break;
+                    case VFN_DOT:
+                    case VFN_NORM:  simd_op = MPR_SIMD_DOT;     break;
+                    default:        simd_op = -1;               break;
+                }
+                kernel = simd_op >= 0 ? mpr_simd_get_kernel(simd_op, tok->gen.datatype,
+                                                            MPR_SIMD_AUTO) : 0;
+                if (kernel && kernel->reduce) {
+                    BC_EMIT(BC_REDUCE, dp);
+                    ins->arg.fn = (void*)kernel;
+                    if (VFN_MEAN == tok->fn.idx)
+                        ins->aux = BC_REDUCE_MEAN;
+                    else if (VFN_NORM == tok->fn.idx)
+                        ins->aux = BC_REDUCE_NORM;
+                }
+                else {
+                    BC_EMIT(BC_VFN, dp);
+                    ins->arg.fn = (void*)fn;
+                    ins->aux = arity;
+                }
+                ins->dim[0] = dims[dp];
+                ins->type = tok->gen.datatype;
+                ins->len = vfn_tbl[tok->fn.idx].reduce ? tok->gen.vec_len : 0;
+                dims[dp] = tok->gen.vec_len;
+                break;
+            }
+            case TOK_VECTORIZE: {
+                int j;
+                dp -= tok->fn.arity - 1;
+                if (dp < 0)
+                    goto fail;
+                BC_CHECK_TYPES(dp, tok->fn.arity, tok->gen.datatype);
+                j = dims[dp];
+                for (i = 1; i < tok->fn.arity; i++) {
+                    BC_EMIT(BC_MOVE, dp);
+                    ins->offset = j;
+                    ins->src = (dp + i) * vec_len;
+                    ins->len = dims[dp + i];
+                    ins->aux = mpr_type_get_size(tok->gen.datatype);
+                    j += dims[dp + i];
+                }
+                dims[dp] = j;
+                break;
+            }
+            case TOK_ASSIGN:
+            case TOK_ASSIGN_USE:
+            case TOK_ASSIGN_CONST:
+                if (tok->var.idx < 0 || tok->var.idx > VAR_Y)
+                    goto fail;
+                if (dp < 0 || types[dp] != tok->gen.datatype)
+                    goto fail;
+                /* the history index is read as an integer */
+                if (tok->gen.flags & VAR_DELAY && (dp < 1 || types[dp - 1] != MPR_INT32))
+                    goto fail;
+                BC_EMIT(VAR_Y == tok->var.idx ? BC_ASSIGN_Y : BC_ASSIGN_VAR, dp);
+                ins->var = tok->var.idx;
+                ins->len = tok->gen.vec_len;
+                ins->vec_idx = tok->var.vec_idx;
+                ins->offset = tok->var.offset;
+                ins->flags = tok->gen.flags;
+                ins->dim[0] = dims[dp];
+                ins->type = tok->gen.datatype;
+                if (TOK_ASSIGN_CONST == tok->toktype)
+                    ins->aux = BC_ASSIGN_CONST;
+                /* assignments to the instance and mute controls leave the stack as is */
+                if (tok->var.idx == inst_ctl || tok->var.idx == mute_ctl)
+                    break;
+                if (tok->gen.flags & CLEAR_STACK)
+                    dp = -1;
+                else if (tok->gen.flags & VAR_DELAY)
+                    --dp;
+                break;
+            default:
+                /* timetags and instance reduce functions are not supported */
+                goto fail;
+        }
+        if (tok->gen.casttype && tok->toktype != TOK_LITERAL && tok->toktype < TOK_ASSIGN) {
+            int op;
+            switch (tok->gen.datatype) {
+                case MPR_INT32:
+                    op = MPR_FLT == tok->gen.casttype ? BC_CAST_IF : BC_CAST_ID;
+                    break;
+                case MPR_FLT:
+                    op = MPR_INT32 == tok->gen.casttype ? BC_CAST_FI : BC_CAST_FD;
+                    break;
+                case MPR_DBL:
+                    op = MPR_INT32 == tok->gen.casttype ? BC_CAST_DI : BC_CAST_DF;
+                    break;
+                default:
+                    goto fail;
+            }
+            BC_EMIT(op, dp);
+            ins->len = dims[dp];
+            last_type = tok->gen.casttype;
+        }
+        else
+            last_type = tok->gen.datatype;
+        if (tok->toktype < TOK_ASSIGN)
+            types[dp] = last_type;
+    }
+    tok_pc[n_tokens] = n_instr;
+    if (n_instr >= max_instr)
+        goto fail;
+    ins = &code[n_instr++];
+    memset(ins, 0, sizeof(mpr_instr_t));
+    ins->op = BC_END;
+    ins->dst = dp >= 0 ? dp * vec_len : 0;
+    bc->n_instr = n_instr;
+    bc->has_jumps = 0;
+
+    for (i = 0; i < n_instr; i++) {
+        if (BC_DIV_I == code[i].op && code[i].arg.jump >= 0) {
+            code[i].arg.jump = tok_pc[code[i].arg.jump];
+            bc->has_jumps = 1;
+        }
+    }
+    return bc;
+
+  fail:
+#if TRACE_PARSE
+    printf("Expression could not be compiled to bytecode (token %d).\n", t);
+#endif
+    free(bc);
+    return 0;
+}
+
+#undef BC_EMIT
+#undef BC_EXTEND
+#undef BC_CHECK_TYPES
+
+#if BC_THREADED
+    #define BC_DISPATCH()   { ins = pc++; r = stk + ins->dst * n; goto *ins->addr; }
+    #define BC_LABEL(NAME)  BC_L_##NAME
+#else
+    #define BC_DISPATCH()   goto dispatch
+    #define BC_LABEL(NAME)  case BC_##NAME
+#endif
+
+/* Vector operations shorter than this are evaluated inline rather than by the SIMD kernels. */
+#define BC_SIMD_MIN_LEN 8
+
+/* Each register holds a packed array of its datatype, with the elements of each lane next to
+ * each other, so element 'I' of lane 'L' in the register at offset 'OFF' is found at index
+ * I * n + L of the array starting at stk + OFF * n. */
+#define BC_REG_i(OFF, I, L) ((int*)(r + (OFF) * n))[(I) * n + (L)]
+#define BC_REG_f(OFF, I, L) ((float*)(r + (OFF) * n))[(I) * n + (L)]
+#define BC_REG_d(OFF, I, L) ((double*)(r + (OFF) * n))[(I) * n + (L)]
+#define BC_REG(T, OFF, I, L) BC_REG_##T(OFF, I, L)
+
+#define BC_LIT_CASE(S, TYPE, T)                                             \
+    BC_LABEL(LIT_##S): {                                                    \
+        TYPE *a = (TYPE*)r;                                                 \
+        for (i = 0; i < ins->len * n; i++)                                  \
+            a[i] = ins->arg.lit.T;                                          \
+        BC_DISPATCH();                                                      \
+    }
+
+/* Binary operators use the SIMD kernels stored with the instruction (if any) for element-wise
+ * operations and for broadcasting a single element across a vector. */
+#define BC_BINARY_CASE(NAME, S, SYM, TYPE)                                  \
+    BC_LABEL(NAME##_##S): {                                                 \
+        const mpr_simd_kernel_t *k = (const mpr_simd_kernel_t*)ins->arg.fn; \
+        TYPE *a = (TYPE*)r, *b = (TYPE*)(r + vlen * n);                     \
+        if (ins->dim[1] == ins->len) {                                      \
+            j = ins->len * n;                                               \
+            if (k && j >= BC_SIMD_MIN_LEN)                                  \
+                k->vv(a, b, j);                                             \
+            else {                                                          \
+                for (i = 0; i < j; i++)                                     \
+                    a[i] = a[i] SYM b[i];                                   \
+            }                                                               \
+        }                                                                   \
+        else if (1 == ins->dim[1] && 1 == n) {                              \
+            if (k && ins->len >= BC_SIMD_MIN_LEN)                           \
+                k->vs(a, b, ins->len);                                      \
+            else {                                                          \
+                for (i = 0; i < ins->len; i++)                              \
+                    a[i] = a[i] SYM b[0];                                   \
+            }                                                               \
+        }                                                                   \
+        else {                                                              \
+            for (i = 0; i < ins->len; i++) {                                \
+                TYPE *ai = a + i * n, *bi = b + (i % ins->dim[1]) * n;      \
+                if (k && n >= BC_SIMD_MIN_LEN)                              \
+                    k->vv(ai, bi, n);                                       \
+                else {                                                      \
+                    for (l = 0; l < n; l++)                                 \
+                        ai[l] = ai[l] SYM bi[l];                            \
+                }                                                           \
+            }                                                               \
+        }                                                                   \
+        BC_DISPATCH();                                                      \
+    }
+
+#define BC_FN_CASES(S, FN, T)                                               \
+    BC_LABEL(FN1_##S):                                                      \
+        for (i = 0; i < ins->len * n; i++)                                  \
+            BC_REG(T, 0, 0, i) = ((FN##_arity1*)ins->arg.fn)(BC_REG(T, 0, 0, i)); \
+        BC_DISPATCH();                                                      \
+    BC_LABEL(FN2_##S):                                                      \
+        for (i = 0; i < ins->len; i++) {                                    \
+            for (l = 0; l < n; l++)                                         \
+                BC_REG(T, 0, i, l) = ((FN##_arity2*)ins->arg.fn)            \
+                    (BC_REG(T, 0, i, l), BC_REG(T, vlen, i % ins->dim[1], l)); \
+        }                                                                   \
+        BC_DISPATCH();                                                      \
+    BC_LABEL(FN3_##S):                                                      \
+        for (i = 0; i < ins->len; i++) {                                    \
+            for (l = 0; l < n; l++)                                         \
+                BC_REG(T, 0, i, l) = ((FN##_arity3*)ins->arg.fn)            \
+                    (BC_REG(T, 0, i, l), BC_REG(T, vlen, i % ins->dim[1], l), \
+                     BC_REG(T, 2 * vlen, i % ins->dim[2], l));              \
+        }                                                                   \
+        BC_DISPATCH();                                                      \
+    BC_LABEL(FN4_##S):                                                      \
+        for (i = 0; i < ins->len; i++) {                                    \
+            for (l = 0; l < n; l++)                                         \
+                BC_REG(T, 0, i, l) = ((FN##_arity4*)ins->arg.fn)            \
+                    (BC_REG(T, 0, i, l), BC_REG(T, vlen, i % ins->dim[1], l), \
+                     BC_REG(T, 2 * vlen, i % ins->dim[2], l),               \
+                     BC_REG(T, 3 * vlen, i % ins->dim[3], l));              \
+        }                                                                   \
+        BC_DISPATCH();
+
+#define BC_TYPED_CASES(S, TYPE, T, FN)                                      \
+    BC_LIT_CASE(S, TYPE, T)                                                 \
+    BC_BINARY_CASE(ADD, S, +, TYPE)                                         \
+    BC_BINARY_CASE(SUB, S, -, TYPE)                                         \
+    BC_BINARY_CASE(MUL, S, *, TYPE)                                         \
+    BC_BINARY_CASE(EQ, S, ==, TYPE)                                         \
+    BC_BINARY_CASE(NE, S, !=, TYPE)                                         \
+    BC_BINARY_CASE(LT, S, <, TYPE)                                          \
+    BC_BINARY_CASE(LE, S, <=, TYPE)                                         \
+    BC_BINARY_CASE(GT, S, >, TYPE)                                          \
+    BC_BINARY_CASE(GE, S, >=, TYPE)                                         \
+    BC_BINARY_CASE(AND, S, &&, TYPE)                                        \
+    BC_BINARY_CASE(OR, S, ||, TYPE)                                         \
+    BC_LABEL(NOT_##S):                                                      \
+        for (i = 0; i < ins->len * n; i++)                                  \
+            BC_REG(T, 0, 0, i) = !BC_REG(T, 0, 0, i);                       \
+        BC_DISPATCH();                                                      \
+    BC_LABEL(IF_ELSE_##S):                                                  \
+        for (i = 0; i < ins->len; i++) {                                    \
+            for (l = 0; l < n; l++) {                                       \
+                if (!BC_REG(T, 0, i, l))                                    \
+                    BC_REG(T, 0, i, l) = BC_REG(T, vlen, i % ins->dim[1], l); \
+            }                                                               \
+        }                                                                   \
+        BC_DISPATCH();                                                      \
+    BC_LABEL(IF_THEN_ELSE_##S):                                             \
+        for (i = 0; i < ins->len; i++) {                                    \
+            for (l = 0; l < n; l++) {                                       \
+                if (BC_REG(T, 0, i, l))                                     \
+                    BC_REG(T, 0, i, l) = BC_REG(T, vlen, i % ins->dim[1], l); \
+                else                                                        \
+                    BC_REG(T, 0, i, l) = BC_REG(T, 2 * vlen, i % ins->dim[2], l); \
+            }                                                               \
+        }                                                                   \
+        BC_DISPATCH();                                                      \
+    BC_FN_CASES(S, FN, T)
+
+/* Casts convert registers in place; conversions to a wider type run backwards so that
+ * elements are not overwritten before they are read. */
+#define BC_CAST_CASE(NAME, T0, TYPE1, T1)                                   \
+    BC_LABEL(NAME):                                                         \
+        if (sizeof(BC_REG(T1, 0, 0, 0)) > sizeof(BC_REG(T0, 0, 0, 0))) {    \
+            for (i = ins->len * n - 1; i >= 0; i--)                         \
+                BC_REG(T1, 0, 0, i) = (TYPE1)BC_REG(T0, 0, 0, i);           \
+        }                                                                   \
+        else {                                                              \
+            for (i = 0; i < ins->len * n; i++)                              \
+                BC_REG(T1, 0, 0, i) = (TYPE1)BC_REG(T0, 0, 0, i);           \
+        }                                                                   \
+        BC_DISPATCH();
+
+#define BC_COPY_TYPED(MTYPE, TYPE, T)                                       \
+    case MTYPE:                                                             \
+        for (i = 0; i < ins->len; i++)                                      \
+            BC_REG(T, 0, i, l) = ((TYPE*)a)[i + ins->vec_idx];              \
+        break;
+
+#define BC_WEIGHTED_ADD(MTYPE, TYPE, T)                                     \
+    case MTYPE:                                                             \
+        for (i = 0; i < ins->len; i++)                                      \
+            BC_REG(T, 0, i, l) = BC_REG(T, 0, i, l) * weight                \
+                                 + ((TYPE*)a)[i + ins->vec_idx] * (1 - weight); \
+        break;
+
+/* Copy a sample to the current register, indexing history using the value
+ * already present in the register. */
+#define BC_COPY_HIST(VAL)                                                   \
+for (l = 0; l < n; l++) {                                                   \
+    int hidx, inst_idx = lanes[l].inst;                                     \
+    float weight = 0.f;                                                     \
+    void *a;                                                                \
+    switch (ins->type) {                                                    \
+        case MPR_INT32:                                                     \
+            hidx = BC_REG(i, 0, 0, l);                                      \
+            break;                                                          \
+        case MPR_FLT:                                                       \
+            hidx = (int)BC_REG(f, 0, 0, l);                                 \
+            weight = fabsf(BC_REG(f, 0, 0, l) - hidx);                      \
+            break;                                                          \
+        default:                                                            \
+            hidx = (int)BC_REG(d, 0, 0, l);                                 \
+            weight = fabs(BC_REG(d, 0, 0, l) - hidx);                       \
+            break;                                                          \
+    }                                                                       \
+    a = mpr_value_get_samp_hist(VAL, inst_idx % VAL->num_inst, hidx);       \
+    switch (VAL->type) {                                                    \
+        BC_COPY_TYPED(MPR_INT32, int, i)                                    \
+        BC_COPY_TYPED(MPR_FLT, float, f)                                    \
+        BC_COPY_TYPED(MPR_DBL, double, d)                                   \
+        default:                                                            \
+            goto error;                                                     \
+    }                                                                       \
+    if (weight) {                                                           \
+        a = mpr_value_get_samp_hist(VAL, inst_idx % VAL->num_inst, hidx-1); \
+        switch (VAL->type) {                                                \
+            BC_WEIGHTED_ADD(MPR_INT32, int, i)                              \
+            BC_WEIGHTED_ADD(MPR_FLT, float, f)                              \
+            BC_WEIGHTED_ADD(MPR_DBL, double, d)                             \
+            default:                                                        \
+                goto error;                                                 \
+        }                                                                   \
+    }                                                                       \
+}
+
+/* Copy the current sample to the current register. */
+#define BC_COPY_CURRENT(VAL)                                                \
+for (l = 0; l < n; l++) {                                                   \
+    void *a = mpr_value_get_samp_hist(VAL, lanes[l].inst % VAL->num_inst, 0); \
+    switch (VAL->type) {                                                    \
+        BC_COPY_TYPED(MPR_INT32, int, i)                                    \
+        BC_COPY_TYPED(MPR_FLT, float, f)                                    \
+        BC_COPY_TYPED(MPR_DBL, double, d)                                   \
+        default:                                                            \
+            goto error;                                                     \
+    }                                                                       \
+}
+
+/* Copy the registers used by a vector function between the packed register layout and the
+ * mpr_expr_val_t scratch frame 'tmp' expected by the functions in vfn_tbl. */
+#define BC_VFN_COPY(T, TO_TMP)                                              \
+    for (j = 0; j < ins->aux; j++) {                                        \
+        for (i = 0; i < vlen; i++) {                                        \
+            if (TO_TMP)                                                     \
+                tmp[j * vlen + i].T = BC_REG(T, j * vlen, i, l);            \
+            else                                                            \
+                BC_REG(T, j * vlen, i, l) = tmp[j * vlen + i].T;            \
+        }                                                                   \
+    }
+
+/* Finish evaluation of every lane that is still running, e.g. because an input
+ * needed by the expression was not provided. */
+#define BC_RETURN_ALL()                                                     \
+{                                                                           \
+    for (l = 0; l < n; l++)                                                 \
+        lanes[l].done = 1;                                                  \
+    return;                                                                 \
+}
+
+/*! State for each instance evaluated in a single pass of the bytecode. */
+typedef struct _bc_lane {
+    mpr_type *types;        /*!< Output types for this instance, or NULL. */
+    int inst;               /*!< The instance index. */
+    int status;             /*!< The evaluation result. */
+    uint8_t alive;
+    uint8_t muted;
+    uint8_t can_advance;
+    uint8_t done;           /*!< Set once the result for this instance is known. */
+} bc_lane_t, *bc_lane;
+
+/* Read the first element of a register as a boolean. */
+static int bc_reg_is_true(mpr_expr_val r, mpr_type type, int n, int l)
+{
+    switch (type) {
+        case MPR_FLT:   return BC_REG(f, 0, 0, l) != 0.f;
+        case MPR_DBL:   return BC_REG(d, 0, 0, l) != 0.;
+        default:        return BC_REG(i, 0, 0, l) != 0;
+    }
+}
+
+/*! Evaluate an expression for one or more instances using its compiled bytecode.
+ *  Each instruction is run for all of the lanes before moving on to the next,
+ *  and the behaviour for each lane mirrors that of the token interpreter in
+ *  mpr_expr_eval(). All lanes must either start at the expression offset or at
+ *  the beginning, and branching is only supported when evaluating a single
+ *  lane. If thread_only is set the handler addresses are resolved without
+ *  evaluating anything. */
+static void bc_eval(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_bc bc, mpr_value *v_in,
+                    mpr_value *v_vars, mpr_value v_out, mpr_time *time, bc_lane lanes, int n,
+                    int thread_only)
+{
+    int vlen = bc->vec_len, i, j, l, active = n, advance = 0;
+    mpr_instr_t *pc = bc->code, *ins;
+    mpr_expr_val stk, r;
+
+#if BC_THREADED
+#define BC_ADDR_TYPED(NAME) &&BC_L_##NAME##_I, &&BC_L_##NAME##_F, &&BC_L_##NAME##_D,
+#define BC_ADDR_INT(NAME) &&BC_L_##NAME##_I,
+#define BC_ADDR_UNTYPED(NAME) &&BC_L_##NAME,
+    static const void *addrs[] = {
+        BC_OPCODES(BC_ADDR_TYPED, BC_ADDR_INT, BC_ADDR_UNTYPED)
+    };
+#undef BC_ADDR_TYPED
+#undef BC_ADDR_INT
+#undef BC_ADDR_UNTYPED
+    if (thread_only) {
+        for (i = 0; i < bc->n_instr; i++)
+            bc->code[i].addr = addrs[bc->code[i].op];
+        return;
+    }
+#else
+    if (thread_only)
+        return;
+#endif
+
+    stk = buff->stk;
+    if (v_out && v_out->inst[lanes[0].inst].pos >= 0)
+        pc += bc->tok_pc[expr->offset];
+
+    for (l = 0; l < n; l++) {
+        bc_lane lane = &lanes[l];
+        lane->status = 1 | EXPR_EVAL_DONE;
+        lane->alive = lane->can_advance = 1;
+        lane->muted = lane->done = 0;
+        if (v_vars) {
+            if (expr->inst_ctl >= 0) {
+                /* recover instance state */
+                mpr_value v = *v_vars + expr->inst_ctl;
+                int *vi = v->inst[lane->inst].samps;
+                lane->alive = (0 != vi[0]);
+            }
+            if (expr->mute_ctl >= 0) {
+                /* recover mute state */
+                mpr_value v = *v_vars + expr->mute_ctl;
+                int *vi = v->inst[lane->inst].samps;
+                lane->muted = (0 != vi[0]);
+            }
+        }
+        if (v_out) {
+            mpr_value_buffer b_out = &v_out->inst[lane->inst];
+            /* init types */
+            if (lane->types)
+                memset(lane->types, MPR_NULL, v_out->vlen);
+            /* Increment index position of output data structure. */
+            b_out->pos = (b_out->pos + 1) & v_out->mask;
+        }
+    }
+
+    for (i = 0; i < expr->n_vars; i++)
+        expr->vars[i].assigned = 0;
+
+    BC_DISPATCH();
+
+#if !BC_THREADED
+  dispatch:
+    ins = pc++;
+    r = stk + ins->dst * n;
+    switch (ins->op) {
+#endif
+
+    BC_TYPED_CASES(I, int, i, fn_int)
+    BC_TYPED_CASES(F, float, f, fn_flt)
+    BC_TYPED_CASES(D, double, d, fn_dbl)
+
+    BC_LABEL(DIV_I):
+        for (i = 0, j = 0; i < ins->len; i++, j = (j + 1) % ins->dim[1]) {
+            for (l = 0; l < n; l++) {
+                int divisor = BC_REG(i, vlen, j, l);
+                if (lanes[l].done)
+                    continue;
+                if (divisor) {
+                    BC_REG(i, 0, i, l) /= divisor;
+                    continue;
+                }
+                /* skip to after this assignment */
+                if (ins->arg.jump >= 0) {
+                    pc = bc->code + ins->arg.jump;
+                    BC_DISPATCH();
+                }
+                lanes[l].status = 0;
+                lanes[l].done = 1;
+                RETURN_UNLESS(--active);
+            }
+        }
+        BC_DISPATCH();
+    BC_BINARY_CASE(DIV, F, /, float)
+    BC_BINARY_CASE(DIV, D, /, double)
+    BC_LABEL(MOD_I):
+        for (i = 0; i < ins->len; i++) {
+            for (l = 0; l < n; l++) {
+                if (!lanes[l].done)
+                    BC_REG(i, 0, i, l) %= BC_REG(i, vlen, i % ins->dim[1], l);
+            }
+        }
+        BC_DISPATCH();
+    BC_LABEL(MOD_F):
+        for (i = 0; i < ins->len; i++) {
+            for (l = 0; l < n; l++)
+                BC_REG(f, 0, i, l) = fmodf(BC_REG(f, 0, i, l), BC_REG(f, vlen, i % ins->dim[1], l));
+        }
+        BC_DISPATCH();
+    BC_LABEL(MOD_D):
+        for (i = 0; i < ins->len; i++) {
+            for (l = 0; l < n; l++)
+                BC_REG(d, 0, i, l) = fmod(BC_REG(d, 0, i, l), BC_REG(d, vlen, i % ins->dim[1], l));
+        }
+        BC_DISPATCH();
+    BC_BINARY_CASE(SHL, I, <<, int)
+    BC_BINARY_CASE(SHR, I, >>, int)
+    BC_BINARY_CASE(BAND, I, &, int)
+    BC_BINARY_CASE(BOR, I, |, int)
+    BC_BINARY_CASE(BXOR, I, ^, int)
+
+    BC_CAST_CASE(CAST_IF, i, float, f)
+    BC_CAST_CASE(CAST_ID, i, double, d)
+    BC_CAST_CASE(CAST_FI, f, int, i)
+    BC_CAST_CASE(CAST_FD, f, double, d)
+    BC_CAST_CASE(CAST_DI, d, int, i)
+    BC_CAST_CASE(CAST_DF, d, float, f)
+
+    BC_LABEL(LOAD_X): {
+        mpr_value v;
+        if (!v_in)
+            BC_RETURN_ALL();
+        v = v_in[ins->var];
+        BC_COPY_CURRENT(v);
+        for (l = 0; l < n; l++)
+            lanes[l].status &= ~EXPR_EVAL_DONE;
+        BC_DISPATCH();
+    }
+    BC_LABEL(LOAD_Y):
+        if (!v_out)
+            BC_RETURN_ALL();
+        BC_COPY_CURRENT(v_out);
+        BC_DISPATCH();
+    BC_LABEL(LOAD_X_HIST): {
+        mpr_value v;
+        if (!v_in)
+            BC_RETURN_ALL();
+        v = v_in[ins->var];
+        BC_COPY_HIST(v);
+        for (l = 0; l < n; l++)
+            lanes[l].status &= ~EXPR_EVAL_DONE;
+        BC_DISPATCH();
+    }
+    BC_LABEL(LOAD_Y_HIST):
+        if (!v_out)
+            BC_RETURN_ALL();
+        BC_COPY_HIST(v_out);
+        BC_DISPATCH();
+    BC_LABEL(LOAD_VAR): {
+        mpr_value v;
+        if (!v_vars)
+            goto error;
+        v = *v_vars + ins->var;
+        switch (v->type) {
+#define TYPED_CASE(MTYPE, TYPE, T)                                          \
+            case MTYPE:                                                     \
+                for (l = 0; l < n; l++) {                                   \
+                    TYPE *vt = v->inst[lanes[l].inst].samps;                \
+                    for (i = 0; i < ins->len; i++)                          \
+                        BC_REG(T, 0, i, l) = vt[i + ins->vec_idx];          \
+                }                                                           \
+                break;
+            TYPED_CASE(MPR_INT32, int, i)
+            TYPED_CASE(MPR_FLT, float, f)
+            TYPED_CASE(MPR_DBL, double, d)
+#undef TYPED_CASE
+        }
+        BC_DISPATCH();
+    }
+    BC_LABEL(VFN): {
+        /* vector functions expect mpr_expr_val_t operands so we copy each lane into the
+         * scratch frame at the end of the evaluation buffer */
+        mpr_expr_val tmp = stk + buff->size * MPR_EXPR_MAX_LANES;
+        for (l = 0; l < n; l++) {
+            switch (ins->type) {
+                case MPR_INT32: BC_VFN_COPY(i, 1);  break;
+                case MPR_FLT:   BC_VFN_COPY(f, 1);  break;
+                default:        BC_VFN_COPY(d, 1);  break;
+            }
+            ((vfn_template*)ins->arg.fn)(tmp, ins->dim, 0, vlen);
+            switch (ins->type) {
+                case MPR_INT32: BC_VFN_COPY(i, 0);  break;
+                case MPR_FLT:   BC_VFN_COPY(f, 0);  break;
+                default:        BC_VFN_COPY(d, 0);  break;
+            }
+        }
+        goto broadcast;
+    }
+    BC_LABEL(REDUCE): {
+        const mpr_simd_kernel_t *k = (const mpr_simd_kernel_t*)ins->arg.fn;
+        k->reduce(r, (ins->aux & BC_REDUCE_NORM) ? r : r + vlen * n, ins->dim[0], n);
+        if (ins->aux) {
+            for (l = 0; l < n; l++) {
+                switch (ins->type) {
+#define TYPED_CASE(MTYPE, T, SQRT)                                                  \
+                    case MTYPE:                                                     \
+                        if (ins->aux & BC_REDUCE_MEAN)                              \
+                            BC_REG(T, 0, 0, l) /= ins->dim[0];                      \
+                        else                                                        \
+                            BC_REG(T, 0, 0, l) = SQRT(BC_REG(T, 0, 0, l));          \
+                        break;
+                    TYPED_CASE(MPR_FLT, f, sqrtf)
+                    TYPED_CASE(MPR_DBL, d, sqrt)
+#undef TYPED_CASE
+                }
+            }
+        }
+        goto broadcast;
+    }
+  broadcast:
+    /* broadcast the result of reducing functions */
+    j = mpr_type_get_size(ins->type) * n;
+    for (i = 1; i < ins->len; i++)
+        memcpy((char*)r + i * j, r, j);
+    BC_DISPATCH();
+    BC_LABEL(EXTEND):
+        j = ins->aux * n;
+        for (i = ins->dim[0]; i < ins->len; i++)
+            memcpy((char*)r + i * j, (char*)r + (i - ins->dim[0]) * j, j);
+        BC_DISPATCH();
+    BC_LABEL(MOVE):
+        j = ins->aux * n;
+        memmove((char*)r + ins->offset * j, stk + ins->src * n, ins->len * j);
+        BC_DISPATCH();
+    BC_LABEL(ASSIGN_Y): {
+        advance = 0;
+        for (l = 0; l < n; l++) {
+            bc_lane lane = &lanes[l];
+            mpr_value_buffer b_out;
+            int hidx = 0, idx;
+            void *v;
+            if (lane->done)
+                continue;
+            if (!(ins->aux & BC_ASSIGN_CONST))
+                lane->can_advance = 0;
+            if (ins->flags & VAR_DELAY) {
+                hidx = BC_REG(i, -vlen, 0, l);
+                /* var{-1} is the current sample, so we allow hidx range of 0 -> -mlen inclusive */
+                if (hidx > 0 || hidx < -v_out->mlen) {
+                    lane->status = 0;
+                    lane->done = 1;
+                    --active;
+                    continue;
+                }
+            }
+            if (lane->alive) {
+                lane->status |= lane->muted ? EXPR_MUTED_UPDATE : EXPR_UPDATE;
+                lane->can_advance = 0;
+                if (!v_out) {
+                    lane->done = 1;
+                    --active;
+                    continue;
+                }
+
+                b_out = &v_out->inst[lane->inst];
+                idx = (b_out->pos + hidx) & v_out->mask;
+                v = (char*)b_out->samps + idx * v_out->samp_stride;
+                switch (v_out->type) {
+#define TYPED_CASE(MTYPE, TYPE, T)                                                  \
+                    case MTYPE:                                                     \
+                        for (i = 0, j = ins->offset; i < ins->len; i++, j++) {      \
+                            if (j >= ins->dim[0]) j = 0;                            \
+                            ((TYPE*)v)[i + ins->vec_idx] = BC_REG(T, 0, j, l);      \
+                        }                                                           \
+                        break;
+                    TYPED_CASE(MPR_INT32, int, i)
+                    TYPED_CASE(MPR_FLT, float, f)
+                    TYPED_CASE(MPR_DBL, double, d)
+#undef TYPED_CASE
+                    default:
+                        goto error;
+                }
+                if (lane->types) {
+                    for (i = ins->vec_idx; i < ins->vec_idx + ins->len; i++)
+                        lane->types[i] = ins->type;
+                }
+                /* Also copy time from input */
+                if (time)
+                    memcpy(&b_out->times[idx * v_out->max_inst], time, sizeof(mpr_time));
+            }
+            if (lane->can_advance || ins->flags & VAR_DELAY)
+                advance = 1;
+        }
+        RETURN_UNLESS(active);
+        goto assign_done;
+    }
+    BC_LABEL(ASSIGN_VAR): {
+        mpr_value v;
+        advance = 0;
+        if (!v_vars)
+            goto error;
+        v = *v_vars + ins->var;
+        for (l = 0; l < n; l++) {
+            bc_lane lane = &lanes[l];
+            mpr_value_buffer b;
+            int hidx = 0;
+            if (lane->done)
+                continue;
+            if (!(ins->aux & BC_ASSIGN_CONST))
+                lane->can_advance = 0;
+            if (ins->flags & VAR_DELAY) {
+                hidx = BC_REG(i, -vlen, 0, l);
+                /* var{-1} is the current sample, so we allow hidx of 0 or -1 */
+                if (hidx > 0 || hidx < -v_out->mlen || hidx < -1) {
+                    lane->status = 0;
+                    lane->done = 1;
+                    --active;
+                    continue;
+                }
+            }
+            b = &v->inst[lane->inst];
+            switch (v->type) {
+#define TYPED_CASE(MTYPE, TYPE, T)                                                  \
+                case MTYPE: {                                                       \
+                    TYPE *vi = b->samps;                                            \
+                    for (i = 0, j = ins->offset; i < ins->len; i++, j++) {          \
+                        vi[i + ins->vec_idx] = BC_REG(T, 0, j, l);                  \
+                        if (j >= ins->dim[0]) j = 0;                                \
+                    }                                                               \
+                    break;                                                          \
+                }
+                TYPED_CASE(MPR_INT32, int, i)
+                TYPED_CASE(MPR_FLT, float, f)
+                TYPED_CASE(MPR_DBL, double, d)
+#undef TYPED_CASE
+            }
+            /* Also copy time from input */
+            if (time)
+                memcpy(b->times, time, sizeof(mpr_time));
+
+            if (ins->var == expr->inst_ctl) {
+                int alive = bc_reg_is_true(r, ins->type, n, l);
+                if (lane->alive && !alive) {
+                    if (lane->status & EXPR_UPDATE)
+                        lane->status |= EXPR_RELEASE_AFTER_UPDATE;
+                    else
+                        lane->status |= EXPR_RELEASE_BEFORE_UPDATE;
+                }
+                lane->alive = alive;
+            }
+            else if (ins->var == expr->mute_ctl)
+                lane->muted = bc_reg_is_true(r, ins->type, n, l);
+            else if (lane->can_advance || ins->flags & VAR_DELAY)
+                advance = 1;
+        }
+        RETURN_UNLESS(active);
+        expr->vars[ins->var].assigned = 1;
+        if (ins->var == expr->inst_ctl || ins->var == expr->mute_ctl)
+            BC_DISPATCH();
+        goto assign_done;
+    }
+  assign_done:
+    /* If assignment was constant or history initialization, move expr start
+     * offset so we don't evaluate this section again. */
+    if (advance)
+        expr->offset = ins->tok + 1;
+    BC_DISPATCH();
+    BC_LABEL(END):
+        if (!v_out)
+            BC_RETURN_ALL();
+        for (l = 0; l < n; l++) {
+            bc_lane lane = &lanes[l];
+            mpr_value_buffer b_out = &v_out->inst[lane->inst];
+            if (lane->done)
+                continue;
+            lane->done = 1;
+            if (!lane->types) {
+                void *v;
+                /* Increment index position of output data structure. */
+                b_out->pos = (b_out->pos + 1) & v_out->mask;
+                v = mpr_value_get_samp(v_out, lane->inst);
+                switch (v_out->type) {
+#define TYPED_CASE(MTYPE, TYPE, T)                          \
+                    case MTYPE:                             \
+                        for (i = 0; i < v_out->vlen; i++)   \
+                            ((TYPE*)v)[i] = BC_REG(T, 0, i, l); \
+                        break;
+                    TYPED_CASE(MPR_INT32, int, i)
+                    TYPED_CASE(MPR_FLT, float, f)
+                    TYPED_CASE(MPR_DBL, double, d)
+#undef TYPED_CASE
+                    default:
+                        lane->status = 0;
+                }
+            }
+            else if (!(lane->status & (EXPR_UPDATE | EXPR_MUTED_UPDATE))) {
+                /* Undo position increment if nothing was updated. */
+                b_out->pos = (b_out->pos - 1) & v_out->mask;
+            }
+        }
+        return;
+
+#if !BC_THREADED
+        default:
+            goto error;
+    }
+#endif
+
+  error:
+    trace("Unexpected instruction in expression bytecode.");
+    for (l = 0; l < n; l++) {
+        if (!lanes[l].done) {
+            lanes[l].status = 0;
+            lanes[l].done = 1;
+        }
+    }
+}
+
+#undef BC_DISPATCH
+#undef BC_LABEL
+#undef BC_SIMD_MIN_LEN
+#undef BC_REG_i
+#undef BC_REG_f
+#undef BC_REG_d
+#undef BC_REG
+#undef BC_LIT_CASE
+#undef BC_BINARY_CASE
+#undef BC_FN_CASES
+#undef BC_TYPED_CASES
+#undef BC_CAST_CASE
+#undef BC_COPY_HIST
+#undef BC_COPY_CURRENT
+#undef BC_COPY_TYPED
+#undef BC_WEIGHTED_ADD
+#undef BC_VFN_COPY
+#undef BC_RETURN_ALL
+
+/* Linear and affine expressions such as those generated for linear maps are evaluated by a
+ * fused kernel instead of the token interpreter or bytecode. The final statement must have
+ * the form y=m*x+b, optionally wrapped in min() and max() for clamping, where m, b and the
+ * clamping bounds are scalar literals or user variables. Statements preceding it must be
+ * constant assignments so that the expression offset eventually skips over them. */
+
+#define LIN_MAX_CLAMP 2
+
+typedef struct _lin_operand {
+    mpr_expr_val_t val;     /*!< Value of a literal operand. */
+    int8_t var;             /*!< Index of a user variable, or -1 for a literal. */
+    uint8_t vec_idx;
+    uint8_t vec_len;
+    uint8_t neg;            /*!< Nonzero if the operand is subtracted. */
+} lin_operand_t, *lin_operand;
+
+typedef struct _lin_clamp {
+    lin_operand_t bound;
+    uint8_t is_max;         /*!< Nonzero for max(), zero for min(). */
+    uint8_t bound_first;    /*!< Nonzero if the bound is the first function argument. */
+} lin_clamp_t;
+
+typedef struct _mpr_lin {
+    lin_operand_t x;        /*!< The source signal; var is the input index. */
+    lin_operand_t m;
+    lin_operand_t b;
+    lin_clamp_t clamp[LIN_MAX_CLAMP];
+    mpr_type type;
+    uint8_t start;          /*!< Token offset of the affine statement. */
+    uint8_t len;            /*!< Vector length of the right-hand side. */
+    uint8_t has_m;
+    uint8_t has_b;
+    uint8_t neg_mx;         /*!< Nonzero if the product is subtracted from b. */
+    uint8_t n_clamp;
+    uint8_t y_offset;       /*!< Offset into the right-hand side of the first assigned element. */
+    uint8_t y_idx;
+    uint8_t y_len;
+} mpr_lin_t, *mpr_lin;
+
+/* Return the index of the first token of the subexpression ending at token 'end'. */
+static int lin_subexpr_start(mpr_token_t *tokens, int end)
+{
+    int needed = 1;
+    while (end >= 0) {
+        needed += tok_arity(tokens[end]) - 1;
+        if (!needed)
+            return end;
+        --end;
+    }
+    return -1;
+}
+
+static int lin_check_type(mpr_token tok, mpr_type type)
+{
+    return tok->gen.datatype == type && (!tok->gen.casttype || tok->gen.casttype == type);
+}
+
+static int lin_match_operand(mpr_token tok, lin_operand op, mpr_lin lin)
+{
+    if (!lin_check_type(tok, lin->type) || (tok->gen.vec_len != 1 && tok->gen.vec_len != lin->len))
+        return 0;
+    memset(op, 0, sizeof(lin_operand_t));
+    if (TOK_LITERAL == tok->toktype) {
+        op->var = -1;
+        op->val.d = 0;
+        switch (lin->type) {
+            case MPR_INT32: op->val.i = tok->lit.val.i; break;
+            case MPR_FLT:   op->val.f = tok->lit.val.f; break;
+            default:        op->val.d = tok->lit.val.d; break;
+        }
+        return 1;
+    }
+    if (TOK_VAR != tok->toktype || tok->var.idx < 0 || tok->var.idx >= N_USER_VARS
+        || tok->gen.flags & VAR_DELAY)
+        return 0;
+    op->var = tok->var.idx;
+    op->vec_idx = tok->var.vec_idx;
+    op->vec_len = tok->gen.vec_len;
+    return 1;
+}
+
+static int lin_match_x(mpr_token tok, mpr_lin lin)
+{
+    if (TOK_VAR != tok->toktype || tok->var.idx < VAR_X || tok->gen.flags & VAR_DELAY
+        || !lin_check_type(tok, lin->type)
+        || (tok->gen.vec_len != 1 && tok->gen.vec_len != lin->len))
+        return 0;
+    lin->x.var = tok->var.idx - VAR_X;
+    lin->x.vec_idx = tok->var.vec_idx;
+    lin->x.vec_len = tok->gen.vec_len;
+    return 1;
+}
+
+/* Match x, m*x or x*m. */
+static int lin_match_product(mpr_token_t *tokens, int start, int end, mpr_lin lin)
+{
+    int mid;
+    lin->has_m = 0;
+    if (start == end)
+        return lin_match_x(&tokens[end], lin);
+    if (TOK_OP != tokens[end].toktype || OP_MULTIPLY != tokens[end].op.idx || end - start != 2
+        || !lin_check_type(&tokens[end], lin->type))
+        return 0;
+    mid = start + 1;
+    lin->has_m = 1;
+    if (lin_match_x(&tokens[mid], lin) && lin_match_operand(&tokens[start], &lin->m, lin))
+        return 1;
+    return lin_match_x(&tokens[start], lin) && lin_match_operand(&tokens[mid], &lin->m, lin);
+}
+
+/* Match a product optionally added to or subtracted from an operand. */
+static int lin_match_affine(mpr_token_t *tokens, int start, int end, mpr_lin lin)
+{
+    int mid;
+    mpr_lin_t saved;
+    mpr_token tok = &tokens[end];
+    if (TOK_OP != tok->toktype || (OP_ADD != tok->op.idx && OP_SUBTRACT != tok->op.idx))
+        return lin_match_product(tokens, start, end, lin);
+    if (!lin_check_type(tok, lin->type) || (mid = lin_subexpr_start(tokens, end - 1)) <= start)
+        return 0;
+    lin->has_b = 1;
+    saved = *lin;
+    if (mid == end - 1 && lin_match_product(tokens, start, mid - 1, lin)
+        && lin_match_operand(&tokens[mid], &lin->b, lin)) {
+        /* m*x+b or m*x-b */
+        lin->b.neg = OP_SUBTRACT == tok->op.idx;
+        return 1;
+    }
+    *lin = saved;
+    if (mid == start + 1 && lin_match_product(tokens, mid, end - 1, lin)
+        && lin_match_operand(&tokens[start], &lin->b, lin)) {
+        /* b+m*x or b-m*x */
+        lin->neg_mx = OP_SUBTRACT == tok->op.idx;
+        return 1;
+    }
+    return 0;
+}
+
+/* Match an affine expression optionally wrapped in calls to min() and max(). */
+static int lin_match_clamp(mpr_token_t *tokens, int start, int end, mpr_lin lin)
+{
+    int mid, bound_first = 0;
+    mpr_lin_t saved = *lin;
+    mpr_token tok = &tokens[end], bound;
+    lin_clamp_t *clamp;
+    if (TOK_FN != tok->toktype || (FN_MIN != tok->fn.idx && FN_MAX != tok->fn.idx))
+        return lin_match_affine(tokens, start, end, lin);
+    if (!lin_check_type(tok, lin->type) || (mid = lin_subexpr_start(tokens, end - 1)) <= start)
+        return 0;
+    if (mid == end - 1 && lin_match_clamp(tokens, start, mid - 1, lin))
+        bound = &tokens[mid];
+    else {
+        *lin = saved;
+        if (mid != start + 1 || !lin_match_clamp(tokens, mid, end - 1, lin))
+            return 0;
+        bound = &tokens[start];
+        bound_first = 1;
+    }
+    if (lin->n_clamp >= LIN_MAX_CLAMP)
+        return 0;
+    clamp = &lin->clamp[lin->n_clamp++];
+    clamp->is_max = FN_MAX == tok->fn.idx;
+    clamp->bound_first = bound_first;
+    return lin_match_operand(bound, &clamp->bound, lin);
+}
+
+/* Variable tokens may be longer than the variable itself, in which case the variable must
+ * be a scalar. */
+static int lin_fix_var_len(lin_operand op, mpr_expr expr)
+{
+    int len;
+    if (op->var < 0)
+        return 1;
+    len = expr->vars[op->var].vec_len;
+    if (1 == len)
+        op->vec_len = 1;
+    return op->vec_idx + op->vec_len <= len;
+}
+
+/*! Check whether the final statement of an expression can be evaluated by the fused linear
+ *  kernel and return a description of it if so. */
+static mpr_lin lin_detect(mpr_expr expr)
+{
+    mpr_token_t *tokens = expr->start;
+    mpr_token assign;
+    mpr_lin_t lin;
+    mpr_lin ret;
+    int i, end = expr->n_tokens - 1, start;
+
+    if (expr->inst_ctl >= 0 || expr->mute_ctl >= 0)
+        return 0;
+    if (end >= 0 && TOK_END == tokens[end].toktype)
+        --end;
+    if (end < 1)
+        return 0;
+    assign = &tokens[end];
+    if (TOK_ASSIGN != assign->toktype || VAR_Y != assign->var.idx || assign->gen.flags & VAR_DELAY)
+        return 0;
+
+    memset(&lin, 0, sizeof(mpr_lin_t));
+    lin.m.var = lin.b.var = -1;
+    lin.type = assign->gen.datatype;
+    lin.len = tokens[end - 1].gen.vec_len;
+    if (bc_type_offset(lin.type) < 0 || !lin.len)
+        return 0;
+
+    /* the statement must follow an assignment so that it can be skipped to */
+    start = lin_subexpr_start(tokens, end - 1);
+    if (start < 0 || (start > 0 && (tokens[start - 1].toktype < TOK_ASSIGN
+                                    || tokens[start - 1].toktype > TOK_ASSIGN_TT)))
+        return 0;
+    if (!lin_match_clamp(tokens, start, end - 1, &lin))
+        return 0;
+
+    /* variables used as scalars are broadcast */
+    if (!lin_fix_var_len(&lin.m, expr) || !lin_fix_var_len(&lin.b, expr))
+        return 0;
+    for (i = 0; i < lin.n_clamp; i++) {
+        if (!lin_fix_var_len(&lin.clamp[i].bound, expr))
+            return 0;
+    }
+
+    /* fold the sign of literal offsets */
+    if (lin.b.neg && lin.b.var < 0) {
+        switch (lin.type) {
+            case MPR_INT32: lin.b.val.i = -lin.b.val.i; break;
+            case MPR_FLT:   lin.b.val.f = -lin.b.val.f; break;
+            default:        lin.b.val.d = -lin.b.val.d; break;
+        }
+        lin.b.neg = 0;
+    }
+
+    lin.start = start;
+    lin.y_offset = assign->var.offset;
+    lin.y_idx = assign->var.vec_idx;
+    lin.y_len = assign->gen.vec_len;
+    ret = malloc(sizeof(mpr_lin_t));
+    memcpy(ret, &lin, sizeof(mpr_lin_t));
+    return ret;
+}
+
+/* Clamp using the same comparisons as the min() and max() functions. */
+#define LIN_CLAMP(R, BOUND, FIRST, OP)                                      \
+    if (FIRST)                                                              \
+        R = (BOUND OP R) ? BOUND : R;                                       \
+    else                                                                    \
+        R = (R OP BOUND) ? R : BOUND;
+
+/* Flags are copied to locals since stores to the output may otherwise alias them. */
+#define LIN_KERNEL(TYPE, T)                                                 \
+static void lin_kernel_##T(mpr_lin lin, TYPE *y, const TYPE *x, const TYPE *m, const TYPE *b, \
+                           const TYPE **bounds)                             \
+{                                                                           \
+    int i, j, k, len = lin->len, y_len = lin->y_len, n_clamp = lin->n_clamp; \
+    int xs = lin->x.vec_len > 1, ms = lin->m.vec_len > 1, bs = lin->b.vec_len > 1; \
+    int has_m = lin->has_m, has_b = lin->has_b, neg_mx = lin->neg_mx, neg_b = lin->b.neg; \
+    y += lin->y_idx;                                                        \
+    for (i = 0, j = lin->y_offset; i < y_len; i++, j++) {                   \
+        TYPE r;                                                             \
+        if (j >= len)                                                       \
+            j = 0;                                                          \
+        r = x[j * xs];                                                      \
+        if (has_m)                                                          \
+            r = m[j * ms] * r;                                              \
+        if (has_b) {                                                        \
+            if (neg_mx)                                                     \
+                r = -r;                                                     \
+            r = r + (neg_b ? -b[j * bs] : b[j * bs]);                       \
+        }                                                                   \
+        for (k = 0; k < n_clamp; k++) {                                     \
+            lin_clamp_t *clamp = &lin->clamp[k];                            \
+            TYPE c = bounds[k][j * (clamp->bound.vec_len > 1)];             \
+            if (clamp->is_max) {                                            \
+                LIN_CLAMP(r, c, clamp->bound_first, >);                     \
+            }                                                               \
+            else {                                                          \
+                LIN_CLAMP(r, c, clamp->bound_first, <);                     \
+            }                                                               \
+        }                                                                   \
+        y[i] = r;                                                           \
+    }                                                                       \
+}
+
+LIN_KERNEL(int, i)
+LIN_KERNEL(float, f)
+LIN_KERNEL(double, d)
+
+/* Return a pointer to the value of an operand for the given instance. */
+static const void *lin_operand_ptr(lin_operand op, mpr_value *v_vars, mpr_type type, int inst_idx)
+{
+    mpr_value v;
+    if (op->var < 0)
+        return &op->val;
+    v = *v_vars + op->var;
+    if (v->type != type)
+        return 0;
+    return (char*)v->inst[inst_idx].samps + op->vec_idx * mpr_type_get_size(type);
+}
+
+/*! Evaluate an expression using its fused linear kernel. Returns -1 if the kernel cannot be
+ *  used for this evaluation, otherwise the same status as mpr_expr_eval(). */
+static int lin_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars, mpr_value v_out,
+                    mpr_time *time, mpr_type *types, int inst_idx)
+{
+    mpr_lin lin = expr->lin;
+    mpr_value_buffer b_out;
+    mpr_value x;
+    const void *xv, *m = 0, *b = 0, *bounds[LIN_MAX_CLAMP];
+    void *y;
+    int i, idx;
+
+    if (!v_in || !v_out || !types || v_out->type != lin->type)
+        return -1;
+    b_out = &v_out->inst[inst_idx];
+    if ((b_out->pos >= 0 ? expr->offset : 0) != lin->start)
+        return -1;
+    x = v_in[lin->x.var];
+    if (x->type != lin->type)
+        return -1;
+    if (lin->has_m && !(m = lin_operand_ptr(&lin->m, v_vars, lin->type, inst_idx)))
+        return -1;
+    if (lin->has_b && !(b = lin_operand_ptr(&lin->b, v_vars, lin->type, inst_idx)))
+        return -1;
+    for (i = 0; i < lin->n_clamp; i++) {
+        if (!(bounds[i] = lin_operand_ptr(&lin->clamp[i].bound, v_vars, lin->type, inst_idx)))
+            return -1;
+    }
+
+    for (i = 0; i < expr->n_vars; i++)
+        expr->vars[i].assigned = 0;
+
+    memset(types, MPR_NULL, v_out->vlen);
+    idx = b_out->pos = (b_out->pos + 1) & v_out->mask;
+    y = (char*)b_out->samps + idx * v_out->samp_stride;
+    xv = ((char*)mpr_value_get_samp_hist(x, inst_idx % x->num_inst, 0)
+          + lin->x.vec_idx * mpr_type_get_size(lin->type));
+    switch (lin->type) {
+#define TYPED_CASE(MTYPE, TYPE, T)                                                  \
+        case MTYPE:                                                                 \
+            lin_kernel_##T(lin, y, xv, m, b, (const TYPE**)bounds);     \
+            break;
+        TYPED_CASE(MPR_INT32, int, i)
+        TYPED_CASE(MPR_FLT, float, f)
+        TYPED_CASE(MPR_DBL, double, d)
+#undef TYPED_CASE
+    }
+    for (i = lin->y_idx; i < lin->y_idx + lin->y_len; i++)
+        types[i] = lin->type;
+    /* Also copy time from input */
+    if (time)
+        memcpy(&b_out->times[idx * v_out->max_inst], time, sizeof(mpr_time));
+    return 1 | EXPR_UPDATE;
+}
+
+#undef LIN_CLAMP
+#undef LIN_KERNEL
+
 /* Macros to help express stack operations in parser. */
 #define FAIL(msg) {                                                 \
     while (--n_vars >= 0)                                           \
@@ -2609,7 +4219,15 @@ mpr_expr mpr_expr_new_from_str(const char *str, int n_ins, const mpr_type *in_ty
     /* TODO: is this the same as n_ins arg passed to this function? */
     expr->n_ins = _get_num_input_slots(expr);
 
-    expr_stack_realloc(expr->stack_size * expr->vec_len);
+    expr->bc = bc_compile(expr->start, expr->n_tokens, expr->stack_size, expr->vec_len,
+                          expr->inst_ctl, expr->mute_ctl);
+    if (expr->bc)
+        bc_eval(0, expr, expr->bc, 0, 0, 0, 0, 0, 0, 1);
+    /* for short vectors the bytecode is no faster than the interpreter, so for a single instance
+     * it is only used by default if it can apply its vector kernels to longer vectors */
+    expr->use_bc = expr->vec_len >= MPR_EXPR_BC_MIN_VEC_LEN;
+    expr->lin = lin_detect(expr);
+    expr->use_lin = 1;
 
 #if TRACE_PARSE
     printf("expression allocated and initialized\n");
@@ -2675,6 +4293,20 @@ int mpr_expr_get_manages_inst(mpr_expr expr)
     return expr ? expr->inst_ctl >= 0 : 0;
 }
 
+int mpr_expr_set_use_bytecode(mpr_expr expr, int enable)
+{
+    RETURN_ARG_UNLESS(expr, 0);
+    expr->use_bc = enable ? 1 : 0;
+    return expr->bc && expr->use_bc;
+}
+
+int mpr_expr_set_use_linear(mpr_expr expr, int enable)
+{
+    RETURN_ARG_UNLESS(expr, 0);
+    expr->use_lin = enable ? 1 : 0;
+    return expr->lin && expr->use_lin;
+}
+
 #if TRACE_EVAL
 static void print_stack_vec(mpr_expr_val stk, mpr_type type, int vec_len)
 {
@@ -2810,15 +4442,12 @@ static const char *type_name(const mpr_type type)
         }                                                                   \
     }                                                                       \
 
-MPR_INLINE static int _max(int a, int b)
-{
-    return a > b ? a : b;
-}
-
-int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
+int mpr_expr_eval(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
                   mpr_value v_out, mpr_time *time, mpr_type *types, int inst_idx)
 {
     mpr_token_t *tok, *end;
+    mpr_expr_val stk;
+    uint8_t *dims;
     int status = 1 | EXPR_EVAL_DONE, cache = 0, vlen;
     int i, j, sp, dp = -1;
     uint8_t alive = 1, muted = 0, can_advance = 1;
@@ -2833,6 +4462,27 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
         return 0;
     }
 
+    if (expr->lin && expr->use_lin) {
+        status = lin_eval(expr, v_in, v_vars, v_out, time, types, inst_idx);
+        if (status >= 0)
+            return status;
+        status = 1 | EXPR_EVAL_DONE;
+    }
+
+    if (buff->size < expr->stack_size * expr->vec_len)
+        mpr_expr_realloc_eval_buffer(expr, buff);
+
+    if (expr->bc && expr->use_bc) {
+        bc_lane_t lane;
+        lane.inst = inst_idx;
+        lane.types = types;
+        bc_eval(buff, expr, expr->bc, v_in, v_vars, v_out, time, &lane, 1, 0);
+        return lane.status;
+    }
+
+    stk = buff->stk;
+    dims = buff->dims;
+
     sp = -expr->vec_len;
     vlen = expr->vec_len;
     tok = expr->start;
@@ -2862,7 +4512,7 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
         if (types)
             memset(types, MPR_NULL, v_out->vlen);
         /* Increment index position of output data structure. */
-        b_out->pos = (b_out->pos + 1) % v_out->mlen;
+        b_out->pos = (b_out->pos + 1) & v_out->mask;
     }
 
     /* choose one input to represent active instances
@@ -3034,10 +4684,10 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
                 mpr_value_buffer b;
                 RETURN_ARG_UNLESS(v_out, status);
                 b = b_out;
-                idx = (b->pos + v_out->mlen + hidx) % v_out->mlen;
-                t_d = mpr_time_as_dbl(b->times[idx]);
+                idx = (b->pos + hidx) & v_out->mask;
+                t_d = mpr_time_as_dbl(b->times[idx * v_out->max_inst]);
                 if (weight)
-                    t_d = t_d * weight + ((b->pos + v_out->mlen + hidx - 1) % v_out->mlen) * (1 - weight);
+                    t_d = t_d * weight + ((b->pos + hidx - 1) & v_out->mask) * (1 - weight);
             }
             else if (tok->var.idx >= VAR_X) {
                 mpr_value v;
@@ -3046,9 +4696,9 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
                 v = v_in[tok->var.idx - VAR_X];
                 b = &v->inst[inst_idx % v->num_inst];
                 /* TODO: ensure buffer overrun is not possible here amd similar */
-                t_d = mpr_time_as_dbl(b->times[(b->pos + v->mlen + hidx) % v->mlen]);
+                t_d = mpr_time_as_dbl(b->times[((b->pos + hidx) & v->mask) * v->max_inst]);
                 if (weight)
-                    t_d = t_d * weight + ((b->pos + v->mlen + hidx - 1) % v->mlen) * (1 - weight);
+                    t_d = t_d * weight + ((b->pos + hidx - 1) & v->mask) * (1 - weight);
             }
             else if (v_vars) {
                 mpr_value v = *v_vars + tok->var.idx;
@@ -3416,8 +5066,8 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
                 if (!v_out)
                     return status;
 
-                idx = (b_out->pos + v_out->mlen + hidx) % v_out->mlen;
-                v = (char*)b_out->samps + idx * v_out->vlen * mpr_type_get_size(v_out->type);
+                idx = (b_out->pos + hidx) & v_out->mask;
+                v = (char*)b_out->samps + idx * v_out->samp_stride;
 
                 switch (v_out->type) {
 #define TYPED_CASE(MTYPE, TYPE, T)                                                          \
@@ -3441,7 +5091,7 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
                 }
                 /* Also copy time from input */
                 if (time) {
-                    mpr_time *tvar = &b_out->times[idx];
+                    mpr_time *tvar = &b_out->times[idx * v_out->max_inst];
                     memcpy(tvar, time, sizeof(mpr_time));
                 }
 #if TRACE_EVAL
@@ -3534,10 +5184,8 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
             if (!v_out)
                 return status;
             hist = tok->gen.flags & VAR_DELAY;
-            idx = (b_out->pos + v_out->mlen + (hist ? stk[sp - vlen].i : 0)) % v_out->mlen;
-            if (idx < 0)
-                idx = v_out->mlen + idx;
-            mpr_time_set_dbl(&b_out->times[idx], stk[sp].d);
+            idx = (b_out->pos + (hist ? stk[sp - vlen].i : 0)) & v_out->mask;
+            mpr_time_set_dbl(&b_out->times[idx * v_out->max_inst], stk[sp].d);
             /* If assignment was constant or history initialization, move expr
              * start token pointer so we don't evaluate this section again. */
             if (hist || can_advance) {
@@ -3605,7 +5253,7 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
          * so we need to copy to output here. */
 
         /* Increment index position of output data structure. */
-        b_out->pos = (b_out->pos + 1) % v_out->mlen;
+        b_out->pos = (b_out->pos + 1) & v_out->mask;
         v = mpr_value_get_samp(v_out, inst_idx);
         switch (v_out->type) {
 #define TYPED_CASE(MTYPE, TYPE, T)                              \
@@ -3625,9 +5273,7 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
 
     /* Undo position increment if nothing was updated. */
     if (!(status & (EXPR_UPDATE | EXPR_MUTED_UPDATE))) {
-        --b_out->pos;
-        if (b_out->pos < 0)
-            b_out->pos = v_out->mlen - 1;
+        b_out->pos = (b_out->pos - 1) & v_out->mask;
         return status;
     }
 
@@ -3637,3 +5283,393 @@ int mpr_expr_eval(mpr_expr expr, mpr_value *v_in, mpr_value *v_vars,
     trace("Unexpected token in expression.");
     return 0;
 }
+
+int mpr_expr_get_can_batch(mpr_expr expr, int num_inst)
+{
+    RETURN_ARG_UNLESS(expr && num_inst >= MPR_EXPR_MIN_LANES, 0);
+    return expr->bc && !expr->bc->has_jumps && !(expr->lin && expr->use_lin);
+}
+
+int mpr_expr_eval_batch(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_value *v_in,
+                        mpr_value *v_vars, mpr_value v_out, mpr_time *time, mpr_type *types,
+                        const int *inst_idx, int num_inst, int *status)
+{
+    bc_lane_t lanes[MPR_EXPR_MAX_LANES];
+    int i = 0, l, n, offset = -1, updated = 0, tlen = v_out ? v_out->vlen : 0;
+
+    RETURN_ARG_UNLESS(expr && num_inst > 0, 0);
+
+    if (!mpr_expr_get_can_batch(expr, MPR_EXPR_MIN_LANES)) {
+        /* evaluate instances one at a time */
+        for (i = 0; i < num_inst; i++) {
+            status[i] = mpr_expr_eval(buff, expr, v_in, v_vars, v_out, time,
+                                      types ? types + i * tlen : 0, inst_idx[i]);
+            if (status[i] & (EXPR_UPDATE | EXPR_MUTED_UPDATE))
+                ++updated;
+        }
+        return updated;
+    }
+
+    if (buff->size < expr->stack_size * expr->vec_len)
+        mpr_expr_realloc_eval_buffer(expr, buff);
+
+    while (i < num_inst) {
+        int from_offset = v_out && v_out->inst[inst_idx[i]].pos >= 0;
+        if (expr->offset != offset) {
+            /* Constant assignments and history initialisation move the expression offset and
+             * change where the following instances start; evaluate singly until it settles. */
+            offset = expr->offset;
+            n = 1;
+        }
+        else {
+            /* all lanes must start at the same instruction */
+            for (n = 1; n < MPR_EXPR_MAX_LANES && i + n < num_inst; n++) {
+                if ((v_out && v_out->inst[inst_idx[i + n]].pos >= 0) != from_offset)
+                    break;
+            }
+        }
+        for (l = 0; l < n; l++) {
+            lanes[l].inst = inst_idx[i + l];
+            lanes[l].types = types ? types + (i + l) * tlen : 0;
+        }
+        bc_eval(buff, expr, expr->bc, v_in, v_vars, v_out, time, lanes, n, 0);
+        for (l = 0; l < n; l++, i++) {
+            status[i] = lanes[l].status;
+            if (status[i] & (EXPR_UPDATE | EXPR_MUTED_UPDATE))
+                ++updated;
+        }
+    }
+    return updated;
+}
+
+/* Named constants are user variables assigned only literals and other constants at the start
+ * of an expression, e.g. "sMin=0;dMax=[1,2,3];". Since the parser marks these assignments
+ * TOK_ASSIGN_CONST and evaluation skips them once they have run, they can be retuned by
+ * rewriting their literal tokens and bytecode instructions and rerunning only the statements
+ * that depend on them. */
+
+typedef struct _const_update {
+    int var;
+    int n_vals;
+    mpr_type types[MPR_MAX_VECTOR_LEN];
+    mpr_expr_val_t vals[MPR_MAX_VECTOR_LEN];
+} const_update_t;
+
+/* Return the index of the assignment token that ends the statement starting at token 'start'. */
+static int const_stmt_end(mpr_expr expr, int start)
+{
+    int i;
+    for (i = start; i < expr->n_tokens; i++) {
+        mpr_token_t *tok = expr->start + i;
+        if ((tok->toktype & TOK_ASSIGN) && (tok->gen.flags & CLEAR_STACK))
+            return i;
+    }
+    return expr->n_tokens - 1;
+}
+
+/* Return the user variable assigned by a constant statement, or -1 for other statements. */
+static int const_stmt_var(mpr_expr expr, int start, int end)
+{
+    mpr_token_t *tok = expr->start + end;
+    int i, var = tok->var.idx;
+    if (TOK_ASSIGN_CONST != tok->toktype || tok->gen.flags & VAR_DELAY)
+        return -1;
+    if (var < 0 || var >= N_USER_VARS || var == expr->inst_ctl || var == expr->mute_ctl)
+        return -1;
+    for (i = start; i < end; i++) {
+        tok = expr->start + i;
+        switch (tok->toktype) {
+            case TOK_LITERAL:
+            case TOK_OP:
+            case TOK_FN:
+            case TOK_VFN:
+            case TOK_VECTORIZE:
+                break;
+            case TOK_VAR:
+                if (tok->var.idx >= 0 && tok->var.idx < N_USER_VARS
+                    && !(tok->gen.flags & VAR_DELAY))
+                    break;
+            default:
+                return -1;
+        }
+    }
+    return var;
+}
+
+/* Return non-zero if the statement reads any of the variables in the bitmask 'vars'. */
+static int const_stmt_reads(mpr_expr expr, int start, int end, int vars)
+{
+    int i;
+    for (i = start; i < end; i++) {
+        mpr_token_t *tok = expr->start + i;
+        if (TOK_VAR == tok->toktype && tok->var.idx >= 0 && tok->var.idx < N_USER_VARS
+            && vars & (1 << tok->var.idx))
+            return 1;
+    }
+    return 0;
+}
+
+/* Find the run of constant statements following any history initialisation, which the parser
+ * moves to the start of the expression. */
+static int const_region(mpr_expr expr, int *start)
+{
+    int s = 0, e;
+    while (s < expr->n_tokens) {
+        e = const_stmt_end(expr, s);
+        if (!(expr->start[e].gen.flags & VAR_DELAY) && TOK_ASSIGN_TT != expr->start[e].toktype)
+            break;
+        s = e + 1;
+    }
+    *start = s;
+    while (s < expr->n_tokens) {
+        e = const_stmt_end(expr, s);
+        if (const_stmt_var(expr, s, e) < 0)
+            break;
+        s = e + 1;
+    }
+    return s;
+}
+
+/* Parse a numeric literal using the same typing rules as the lexer. */
+static const char *const_parse_val(const char *str, const char *end, mpr_type *type,
+                                   mpr_expr_val val)
+{
+    const char *s = str;
+    int digits = 0;
+    double d;
+    *type = MPR_INT32;
+    if (s < end && '-' == *s)
+        ++s;
+    while (s < end && isdigit(*s)) {
+        ++s;
+        ++digits;
+    }
+    if (s < end && '.' == *s) {
+        *type = MPR_FLT;
+        for (++s; s < end && isdigit(*s); s++)
+            ++digits;
+    }
+    if (!digits)
+        return 0;
+    if (s < end && 'e' == *s) {
+        *type = MPR_DBL;
+        ++s;
+        if (s < end && ('-' == *s || '+' == *s))
+            ++s;
+        if (s >= end || !isdigit(*s))
+            return 0;
+        while (s < end && isdigit(*s))
+            ++s;
+    }
+    d = strtod(str, NULL);
+    switch (*type) {
+        case MPR_INT32: val->i = (int)d;    break;
+        case MPR_FLT:   val->f = (float)d;  break;
+        default:        val->d = d;         break;
+    }
+    return s;
+}
+
+/* Parse a statement of the form "name=value" or "name=[value,...]". Returns the index of the
+ * named variable, or -1 if the statement has any other form. */
+static int const_parse_stmt(mpr_expr expr, const char *str, const char *end, const_update_t *u)
+{
+    const char *name;
+    int var, vector = 0;
+    while (str < end && isspace(*str))
+        ++str;
+    for (name = str; str < end && (isalnum(*str) || '_' == *str); str++) {}
+    RETURN_ARG_UNLESS(str > name && !isdigit(*name), -1);
+    var = find_var_by_name(expr->vars, expr->n_vars, name, str - name);
+    RETURN_ARG_UNLESS(var >= 0, -1);
+    while (str < end && isspace(*str))
+        ++str;
+    RETURN_ARG_UNLESS(str < end && '=' == *str, -1);
+    for (++str; str < end && isspace(*str); str++) {}
+    if (str < end && '[' == *str) {
+        vector = 1;
+        ++str;
+    }
+    u->var = var;
+    u->n_vals = 0;
+    while (u->n_vals < MPR_MAX_VECTOR_LEN) {
+        while (str < end && isspace(*str))
+            ++str;
+        str = const_parse_val(str, end, &u->types[u->n_vals], &u->vals[u->n_vals]);
+        RETURN_ARG_UNLESS(str, -1);
+        ++u->n_vals;
+        while (str < end && isspace(*str))
+            ++str;
+        if (!vector || str >= end || ',' != *str)
+            break;
+        ++str;
+    }
+    if (vector) {
+        RETURN_ARG_UNLESS(str < end && ']' == *str, -1);
+        ++str;
+    }
+    while (str < end && isspace(*str))
+        ++str;
+    return str == end ? var : -1;
+}
+
+/* Check that the literal token at index 't' can be rewritten, including its bytecode. */
+static int const_can_set_literal(mpr_expr expr, int t)
+{
+    mpr_token_t *tok = expr->start + t;
+    RETURN_ARG_UNLESS(TOK_LITERAL == tok->toktype && !(tok->gen.flags & CONST_SPECIAL), 0);
+    if (expr->bc) {
+        mpr_instr ins = &expr->bc->code[expr->bc->tok_pc[t]];
+        RETURN_ARG_UNLESS(ins->op == BC_LIT_I + bc_type_offset(tok->gen.datatype), 0);
+    }
+    return 1;
+}
+
+static void const_set_literal(mpr_expr expr, int t, mpr_type type, mpr_expr_val_t val)
+{
+    mpr_token_t *tok = expr->start + t;
+    double d = MPR_INT32 == type ? val.i : MPR_FLT == type ? val.f : val.d;
+    switch (tok->gen.datatype) {
+        case MPR_INT32: tok->lit.val.i = (int)d;    break;
+        case MPR_FLT:   tok->lit.val.f = (float)d;  break;
+        default:        tok->lit.val.d = d;         break;
+    }
+    if (expr->bc) {
+        mpr_instr ins = &expr->bc->code[expr->bc->tok_pc[t]];
+        switch (tok->gen.datatype) {
+            case MPR_INT32: ins->arg.lit.i = tok->lit.val.i;    break;
+            case MPR_FLT:   ins->arg.lit.f = tok->lit.val.f;    break;
+            default:        ins->arg.lit.d = tok->lit.val.d;    break;
+        }
+    }
+}
+
+/* Find the statement assigning a constant and check that its literals can be rewritten with
+ * the new values. Returns the index of the first token of the statement or -1. */
+static int const_find_stmt(mpr_expr expr, int start, int end, const_update_t *u)
+{
+    int s, e, i, found = -1, n_lit;
+    for (s = start; s < end; s = e + 1) {
+        e = const_stmt_end(expr, s);
+        if (const_stmt_var(expr, s, e) != u->var)
+            continue;
+        /* constants must be assigned exactly once */
+        RETURN_ARG_UNLESS(found < 0, -1);
+        found = s;
+    }
+    RETURN_ARG_UNLESS(found >= 0, -1);
+    s = found;
+    e = const_stmt_end(expr, s);
+    if (e - s == 1) {
+        /* a single literal, possibly folded from a vector of identical values */
+        for (i = 1; i < u->n_vals; i++) {
+            if (memcmp(&u->vals[i], &u->vals[0], sizeof(mpr_expr_val_t)))
+                return -1;
+        }
+        n_lit = 1;
+    }
+    else {
+        RETURN_ARG_UNLESS(TOK_VECTORIZE == expr->start[e - 1].toktype, -1);
+        n_lit = expr->start[e - 1].fn.arity;
+        RETURN_ARG_UNLESS(n_lit == u->n_vals && e - s == n_lit + 1, -1);
+    }
+    for (i = s; i < s + n_lit; i++) {
+        RETURN_ARG_UNLESS(const_can_set_literal(expr, i), -1);
+        RETURN_ARG_UNLESS(n_lit == 1 || 1 == expr->start[i].gen.vec_len, -1);
+    }
+    return s;
+}
+
+int mpr_expr_update_consts(mpr_expr expr, const char *old_str, const char *new_str)
+{
+    const_update_t *updates;
+    int i, j, s, e, start, end, n_updates = 0, changed = 0, dirty, stmts[N_USER_VARS];
+
+    RETURN_ARG_UNLESS(expr && old_str && new_str, -1);
+    updates = alloca(sizeof(const_update_t) * N_USER_VARS);
+    end = const_region(expr, &start);
+
+    /* compare the expression strings statement by statement */
+    while (*old_str || *new_str) {
+        const char *old_end = strchr(old_str, ';'), *new_end = strchr(new_str, ';');
+        const_update_t old;
+        if (!old_end)
+            old_end = old_str + strlen(old_str);
+        if (!new_end)
+            new_end = new_str + strlen(new_str);
+        if (old_end - old_str != new_end - new_str
+            || strncmp(old_str, new_str, old_end - old_str)) {
+            const_update_t *u = &updates[n_updates];
+            RETURN_ARG_UNLESS(n_updates < N_USER_VARS, -1);
+            RETURN_ARG_UNLESS(const_parse_stmt(expr, old_str, old_end, &old) >= 0, -1);
+            RETURN_ARG_UNLESS(const_parse_stmt(expr, new_str, new_end, u) == old.var, -1);
+            /* a change of datatype or length would change the parsed expression */
+            RETURN_ARG_UNLESS(u->n_vals == old.n_vals, -1);
+            RETURN_ARG_UNLESS(!memcmp(u->types, old.types, u->n_vals * sizeof(mpr_type)), -1);
+            RETURN_ARG_UNLESS(!(changed & (1 << u->var)), -1);
+            RETURN_ARG_UNLESS((stmts[n_updates] = const_find_stmt(expr, start, end, u)) >= 0, -1);
+            changed |= 1 << u->var;
+            ++n_updates;
+        }
+        /* statement counts must match */
+        RETURN_ARG_UNLESS(!*old_end == !*new_end, -1);
+        old_str = *old_end ? old_end + 1 : old_end;
+        new_str = *new_end ? new_end + 1 : new_end;
+    }
+    RETURN_ARG_UNLESS(changed, 0);
+
+    /* Constants that depend on the changed values must be rerun too. Statements outside the
+     * constant section that are skipped after their first evaluation cannot be rerun. */
+    dirty = changed;
+    for (s = 0; s < expr->n_tokens; s = e + 1) {
+        e = const_stmt_end(expr, s);
+        if (s >= start && s < end) {
+            if (const_stmt_reads(expr, s, e, dirty))
+                dirty |= 1 << expr->start[e].var.idx;
+            continue;
+        }
+        for (i = s; i <= e; i++) {
+            mpr_token_t *tok = expr->start + i;
+            if (TOK_ASSIGN_CONST == tok->toktype
+                || ((tok->toktype & TOK_ASSIGN) && (tok->gen.flags & VAR_DELAY)))
+                break;
+        }
+        RETURN_ARG_UNLESS(i > e || !const_stmt_reads(expr, s, e, dirty), -1);
+    }
+
+    for (i = 0; i < n_updates; i++) {
+        const_update_t *u = &updates[i];
+        if (TOK_VECTORIZE == expr->start[const_stmt_end(expr, stmts[i]) - 1].toktype) {
+            for (j = 0; j < u->n_vals; j++)
+                const_set_literal(expr, stmts[i] + j, u->types[j], u->vals[j]);
+        }
+        else
+            const_set_literal(expr, stmts[i], u->types[0], u->vals[0]);
+    }
+    return dirty;
+}
+
+int mpr_expr_eval_consts(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_value *v_vars,
+                         mpr_time *time, int inst_idx, int vars)
+{
+    struct _mpr_expr sub;
+    int s, e, start, end;
+
+    RETURN_ARG_UNLESS(expr && v_vars, 0);
+    end = const_region(expr, &start);
+
+    /* evaluate each statement using the interpreter on a view of the token stack */
+    memcpy(&sub, expr, sizeof(struct _mpr_expr));
+    sub.bc = 0;
+    sub.lin = 0;
+    for (s = start; s < end; s = e + 1) {
+        e = const_stmt_end(expr, s);
+        if (!(vars & (1 << expr->start[e].var.idx)))
+            continue;
+        sub.start = expr->start + s;
+        sub.n_tokens = e - s + 1;
+        sub.offset = 0;
+        RETURN_ARG_UNLESS(mpr_expr_eval(buff, &sub, 0, v_vars, 0, time, 0, inst_idx), 0);
+    }
+    return 1;
+}
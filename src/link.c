@@ -4,11 +4,44 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <limits.h>
+#include <errno.h>
+
+#include "config.h"
+
+#ifdef HAVE_ARPA_INET_H
+ #include <sys/socket.h>
+ #include <netdb.h>
+ #ifdef HAVE_SYS_UN_H
+  #include <sys/un.h>
+ #endif
+#else
+ #ifdef HAVE_WINSOCK2_H
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+ #endif
+#endif
+
+#include <zlib.h>
 
 #include "mapper_internal.h"
 #include "types_internal.h"
 #include <mapper/mapper.h>
 
+#define BUNDLE_HEADER_LEN 16
+
+/* Header of an update queued for a signal on the same device, followed by len types and then
+ * len values, each part padded to eight bytes. */
+typedef struct _local_msg {
+    mpr_local_sig sig;
+    mpr_time time;
+    mpr_id GID;
+    int slot_id;
+    int len;
+    int size;           /*!< Total size of the record in bytes. */
+} local_msg_t, *local_msg;
+
+#define ALIGN8(N) (((N) + 7) & ~7)
+
 mpr_link mpr_link_new(mpr_local_dev local_dev, mpr_dev remote_dev)
 {
     return mpr_graph_add_link(local_dev->obj.graph, (mpr_dev)local_dev, remote_dev);
@@ -55,10 +88,139 @@ void mpr_link_init(mpr_link link)
     mpr_net_send(net);
 }
 
+/* Resolve the remote data port once so that encoded bundles can be sent from the device's UDP
+ * server socket without involving liblo. Bundles fall back to liblo if this fails. */
+static void _resolve_udp_raw(mpr_link link, const char *host, const char *port)
+{
+    struct addrinfo hints;
+    struct sockaddr_storage ss;
+    socklen_t ss_len = sizeof(ss);
+    lo_server server = link->obj.graph->net.servers[SERVER_UDP];
+    if (link->addr.udp_raw) {
+        freeaddrinfo(link->addr.udp_raw);
+        link->addr.udp_raw = 0;
+    }
+    RETURN_UNLESS(server && link->devs[LOCAL_DEV] != link->devs[REMOTE_DEV]);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    /* the address must match the family of the socket it will be sent from */
+    if (0 == getsockname(lo_server_get_socket_fd(server), (struct sockaddr*)&ss, &ss_len))
+        hints.ai_family = ss.ss_family;
+    if (getaddrinfo(host, port, &hints, &link->addr.udp_raw)) {
+        trace_net("couldn't resolve %s:%s, using liblo for UDP bundles\n", host, port);
+        link->addr.udp_raw = 0;
+    }
+}
+
+/* Name the shared-memory ring carrying bundles from one device to another. Device ids and
+ * ports are hashed to keep the name within the 31 characters some platforms allow. */
+static void _shm_name(char *name, mpr_dev from, mpr_dev to)
+{
+    int from_port = mpr_obj_get_prop_as_int32((mpr_obj)from, MPR_PROP_PORT, NULL);
+    int to_port = mpr_obj_get_prop_as_int32((mpr_obj)to, MPR_PROP_PORT, NULL);
+    unsigned long from_hash = crc32(crc32(0L, (const Bytef*)&from->obj.id, sizeof(mpr_id)),
+                                    (const Bytef*)&from_port, sizeof(int));
+    unsigned long to_hash = crc32(crc32(0L, (const Bytef*)&to->obj.id, sizeof(mpr_id)),
+                                  (const Bytef*)&to_port, sizeof(int));
+    snprintf(name, 32, "/mpr.%08lx%08lx", from_hash & 0xFFFFFFFF, to_hash & 0xFFFFFFFF);
+}
+
+int mpr_link_get_is_same_host(mpr_link link)
+{
+    mpr_dev local = link->devs[LOCAL_DEV], remote = link->devs[REMOTE_DEV];
+    const char *local_host, *host;
+    RETURN_ARG_UNLESS(local != remote, 0);
+    /* the host of the remote device is the address its messages came from, which may be the
+     * address of our own interface rather than a hostname */
+    if (link->addr.udp_raw && AF_INET == link->addr.udp_raw->ai_family) {
+        struct in_addr addr = ((struct sockaddr_in*)link->addr.udp_raw->ai_addr)->sin_addr;
+        if (   htonl(INADDR_LOOPBACK) == addr.s_addr
+            || link->obj.graph->net.iface.addr.s_addr == addr.s_addr)
+            return 1;
+    }
+    local_host = mpr_obj_get_prop_as_str((mpr_obj)local, MPR_PROP_HOST, NULL);
+    host = mpr_obj_get_prop_as_str((mpr_obj)remote, MPR_PROP_HOST, NULL);
+    return local_host && host && (   !strcmp(host, local_host)
+                                  || !strcmp(host, "127.0.0.1")
+                                  || !strcmp(host, "localhost"));
+}
+
+static void _close_shm(mpr_link link)
+{
+    FUNC_IF(mpr_shm_close, link->shm_out);
+    FUNC_IF(mpr_shm_close, link->shm_in);
+    link->shm_out = link->shm_in = 0;
+}
+
+void mpr_link_close_shm(mpr_link link)
+{
+    trace_dev(link->devs[LOCAL_DEV], "malformed shared-memory record from device '%s', "
+              "using UDP\n", link->devs[REMOTE_DEV]->name);
+    _close_shm(link);
+    link->use_shm = 0;
+}
+
+/* Open shared-memory rings in both directions if the remote device is on this host. We create the
+ * ring we read from; the ring we write to is created by the remote device and only written once it
+ * exists, so a peer without shared-memory support keeps receiving bundles over UDP. */
+void mpr_link_open_shm(mpr_link link)
+{
+    char name[32];
+    mpr_dev local = link->devs[LOCAL_DEV], remote = link->devs[REMOTE_DEV];
+    link->use_shm = 1;
+    RETURN_UNLESS(local->is_local && mpr_link_get_is_same_host(link));
+    if (!link->shm_in) {
+        _shm_name(name, remote, local);
+        if ((link->shm_in = mpr_shm_open(name, 1)))
+            trace_dev(local, "using shared memory with device '%s'\n", remote->name);
+    }
+    if (!link->shm_out) {
+        _shm_name(name, local, remote);
+        link->shm_out = mpr_shm_open(name, 0);
+    }
+}
+
+/* Address the Unix domain socket of the remote device if it is on this host. Whether the remote
+ * device actually has one is only known when the first bundle is sent to it; if it does not, the
+ * address is dropped until the link is connected again. */
+static void _resolve_unix(mpr_link link, int data_port)
+{
+    FUNC_IF(free, link->addr.unix_raw);
+    link->addr.unix_raw = 0;
+#ifdef HAVE_SYS_UN_H
+    RETURN_UNLESS(link->obj.graph->net.servers[SERVER_UNIX] && mpr_link_get_is_same_host(link));
+    link->addr.unix_raw = (struct sockaddr_un*)calloc(1, sizeof(struct sockaddr_un));
+    link->addr.unix_raw->sun_family = AF_UNIX;
+    mpr_net_get_unix_path(link->addr.unix_raw->sun_path, sizeof(link->addr.unix_raw->sun_path),
+                          data_port);
+#endif
+}
+
+/* Send any bundles waiting in the UDP queue, which refers to their buffers. */
+static void _flush_queued_bundles(mpr_link link)
+{
+    int i;
+    for (i = 0; i < NUM_BUNDLES; i++) {
+        if (link->bundles[i].queued) {
+            mpr_net_flush_udp(&link->obj.graph->net);
+            return;
+        }
+    }
+}
+
+static void _free_bundle_bufs(mpr_link link)
+{
+    int i;
+    for (i = 0; i < NUM_BUNDLES; i++)
+        FUNC_IF(free, link->bundles[i].buf);
+}
+
 void mpr_link_connect(mpr_link link, const char *host, int admin_port,
                       int data_port)
 {
     char str[16];
+    /* the bundle buffers are reset below */
+    _flush_queued_bundles(link);
     mpr_tbl_set(link->devs[REMOTE_DEV]->obj.props.synced, MPR_PROP_HOST, NULL, 1,
                 MPR_STR, host, REMOTE_MODIFY);
     mpr_tbl_set(link->devs[REMOTE_DEV]->obj.props.synced, MPR_PROP_PORT, NULL, 1,
@@ -66,10 +228,17 @@ void mpr_link_connect(mpr_link link, const char *host, int admin_port,
     sprintf(str, "%d", data_port);
     link->addr.udp = lo_address_new(host, str);
     link->addr.tcp = lo_address_new_with_proto(LO_TCP, host, str);
+    _resolve_udp_raw(link, host, str);
+    /* the names of the rings depend on the port of the remote device */
+    _close_shm(link);
+    if (link->use_shm)
+        mpr_link_open_shm(link);
+    _resolve_unix(link, data_port);
     sprintf(str, "%d", admin_port);
     link->addr.admin = lo_address_new(host, str);
     trace_dev(link->devs[LOCAL_DEV], "activated router to device '%s' at %s:%d\n",
               link->devs[REMOTE_DEV]->name, host, data_port);
+    _free_bundle_bufs(link);
     memset(link->bundles, 0, sizeof(mpr_bundle_t) * NUM_BUNDLES);
     mpr_dev_add_link(link->devs[LOCAL_DEV], link->devs[REMOTE_DEV]);
 }
@@ -82,9 +251,15 @@ void mpr_link_free(mpr_link link)
     FUNC_IF(free, link->num_maps);
     if (!link->devs[LOCAL_DEV]->is_local)
         return;
+    /* queued bundles are sent to the addresses freed below */
+    _flush_queued_bundles(link);
     FUNC_IF(lo_address_free, link->addr.admin);
     FUNC_IF(lo_address_free, link->addr.udp);
     FUNC_IF(lo_address_free, link->addr.tcp);
+    FUNC_IF(freeaddrinfo, link->addr.udp_raw);
+    FUNC_IF(free, link->addr.unix_raw);
+    _close_shm(link);
+    _free_bundle_bufs(link);
     for (i = 0; i < NUM_BUNDLES; i++) {
         FUNC_IF(lo_bundle_free_recursive, link->bundles[i].udp);
         FUNC_IF(lo_bundle_free_recursive, link->bundles[i].tcp);
@@ -98,16 +273,221 @@ void mpr_link_add_msg(mpr_link link, mpr_sig dst, lo_message msg, mpr_time t, mp
 {
     lo_bundle *b;
     RETURN_UNLESS(msg);
-    if (link->devs[0] == link->devs[1])
+    if (mpr_link_get_is_local_only(link))
         proto = MPR_PROTO_UDP;
 
     /* add message to existing bundles */
-    b = (proto == MPR_PROTO_UDP) ? &link->bundles[idx].udp : &link->bundles[idx].tcp;
+    b = (proto == MPR_PROTO_TCP) ? &link->bundles[idx].tcp : &link->bundles[idx].udp;
     if (!(*b))
         *b = lo_bundle_new(t);
     lo_bundle_add_message(*b, dst->path, msg);
 }
 
+static char *_put32(char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static int _send_shm(mpr_link link, mpr_bundle b)
+{
+    int wake = 0;
+    lo_server server = link->obj.graph->net.servers[SERVER_UDP];
+    RETURN_ARG_UNLESS(link->shm_out && mpr_shm_write(link->shm_out, b->buf, b->len, &wake), 0);
+    if (wake) {
+        /* an empty bundle wakes the remote device if it is blocked on its sockets */
+        sendto(lo_server_get_socket_fd(server), b->buf, BUNDLE_HEADER_LEN, 0,
+               link->addr.udp_raw->ai_addr, link->addr.udp_raw->ai_addrlen);
+    }
+    return 1;
+}
+
+static int _send_unix(mpr_link link, mpr_bundle b)
+{
+#ifdef HAVE_SYS_UN_H
+    int flags = 0;
+    lo_server server = link->obj.graph->net.servers[SERVER_UNIX];
+    RETURN_ARG_UNLESS(server && link->addr.unix_raw, 0);
+#ifdef MSG_DONTWAIT
+    /* do not block if the receive buffer of the remote device is full */
+    flags = MSG_DONTWAIT;
+#endif
+    if (sendto(lo_server_get_socket_fd(server), b->buf, b->len, flags,
+               (struct sockaddr*)link->addr.unix_raw, sizeof(struct sockaddr_un)) >= 0)
+        return 1;
+    if (ENOENT == errno || ECONNREFUSED == errno) {
+        /* the remote device has no Unix domain socket, so stop trying until it reconnects */
+        trace_dev(link->devs[LOCAL_DEV], "no Unix domain socket at %s, using UDP\n",
+                  link->addr.unix_raw->sun_path);
+        free(link->addr.unix_raw);
+        link->addr.unix_raw = 0;
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+/* Send the bundle buffer, or if queue is non-zero and the bundle is sent over UDP, queue it to be
+ * sent together with the bundles of other links by mpr_net_flush_udp(). */
+static int _send_bundle_buf(mpr_link link, mpr_bundle b, int queue)
+{
+    int num = b->count, sent = 0;
+    lo_server server = link->obj.graph->net.servers[SERVER_UDP];
+    RETURN_ARG_UNLESS(num, 0);
+    if (MPR_PROTO_SHM == b->proto)
+        sent = _send_shm(link, b);
+    else if (MPR_PROTO_UNIX == b->proto)
+        sent = _send_unix(link, b);
+    /* fall back to UDP if the remote device is not reading from shared memory or its Unix domain
+     * socket, or if either is full */
+    if (!sent && queue) {
+        mpr_net_queue_udp(&link->obj.graph->net, link, b);
+        return num;
+    }
+    if (!sent && sendto(lo_server_get_socket_fd(server), b->buf, b->len, 0,
+                        link->addr.udp_raw->ai_addr, link->addr.udp_raw->ai_addrlen) < 0)
+        trace_net("error sending bundle to device '%s'\n", link->devs[REMOTE_DEV]->name);
+    b->len = b->count = 0;
+    return num;
+}
+
+/* Grow the bundle buffer to hold at least len bytes. The buffer grows to fit the largest bundle
+ * sent so far and is reused. */
+static void _reserve_bundle_buf(mpr_bundle b, int len)
+{
+    int size;
+    RETURN_UNLESS(len > b->size);
+    size = b->size ? b->size : 1024;
+    while (size < len)
+        size *= 2;
+    b->buf = realloc(b->buf, size);
+    b->size = size;
+}
+
+char *mpr_link_reserve_msg(mpr_link link, mpr_time t, mpr_proto proto, int idx, int len)
+{
+    mpr_bundle b = &link->bundles[idx];
+    char *p;
+    RETURN_ARG_UNLESS(MPR_PROTO_TCP != proto && link->addr.udp_raw, 0);
+    RETURN_ARG_UNLESS(len + 4 + BUNDLE_HEADER_LEN <= MAX_UDP_BUNDLE_LEN, 0);
+    if (b->queued)
+        mpr_net_flush_udp(&link->obj.graph->net);
+
+    /* send the current bundle early if it would grow beyond the maximum datagram size or if
+     * it holds messages for another datagram transport */
+    if (b->len + len + 4 > MAX_UDP_BUNDLE_LEN || (b->count && proto != b->proto))
+        _send_bundle_buf(link, b, 0);
+    b->proto = proto;
+    if (b->len + len + 4 > b->size)
+        _reserve_bundle_buf(b, b->len + len + 4 + BUNDLE_HEADER_LEN);
+    if (!b->len) {
+        memcpy(b->buf, "#bundle", 8);
+        _put32(_put32(b->buf + 8, t.sec), t.frac);
+        b->len = BUNDLE_HEADER_LEN;
+    }
+    p = _put32(b->buf + b->len, len);
+    b->len += len + 4;
+    ++b->count;
+    return p;
+}
+
+void mpr_link_add_local_msg(mpr_link link, mpr_local_sig dst, int len, const mpr_type *types,
+                            const void *val, mpr_id GID, int slot_id, mpr_time t, int idx)
+{
+    mpr_bundle b = &link->bundles[idx];
+    local_msg msg;
+    int i, val_size = 0, size;
+    for (i = 0; i < len; i++) {
+        if (MPR_NULL != types[i]) {
+            val_size = mpr_type_get_size(types[i]) * len;
+            break;
+        }
+    }
+    size = sizeof(local_msg_t) + ALIGN8(len) + ALIGN8(val_size);
+    _reserve_bundle_buf(b, b->len + size);
+    msg = (local_msg)(b->buf + b->len);
+    msg->sig = dst;
+    msg->time = t;
+    msg->GID = GID;
+    msg->slot_id = slot_id;
+    msg->len = len;
+    msg->size = size;
+    memcpy((char*)(msg + 1), types, len);
+    if (val_size)
+        memcpy((char*)(msg + 1) + ALIGN8(len), val, val_size);
+    b->len += size;
+    ++b->count;
+}
+
+/* Clear any queued updates for a signal that is about to be freed. */
+static void _clear_local_msgs(char *buf, int len, mpr_local_sig sig)
+{
+    int offset = 0;
+    while (offset < len) {
+        local_msg msg = (local_msg)(buf + offset);
+        if (msg->sig == sig)
+            msg->sig = 0;
+        offset += msg->size;
+    }
+}
+
+void mpr_link_remove_local_sig(mpr_link link, mpr_local_sig sig)
+{
+    int i;
+    RETURN_UNLESS(link && mpr_link_get_is_local_only(link));
+    for (i = 0; i < NUM_BUNDLES; i++)
+        _clear_local_msgs(link->bundles[i].buf, link->bundles[i].len, sig);
+    _clear_local_msgs(link->local_msgs.buf, link->local_msgs.len, sig);
+}
+
+/* Deliver updates queued for local signals without serializing them. */
+static int _process_local_msgs(mpr_link link, mpr_bundle b)
+{
+    int i, offset = 0, num = b->count, elem_size;
+    lo_arg *argv[MPR_MAX_VECTOR_LEN];
+
+    /* detach the buffer since handlers may queue further updates */
+    link->local_msgs.buf = b->buf;
+    link->local_msgs.len = b->len;
+    link->local_msgs.size = b->size;
+    b->buf = 0;
+    b->size = b->len = b->count = 0;
+
+    while (offset < link->local_msgs.len) {
+        local_msg msg = (local_msg)(link->local_msgs.buf + offset);
+        offset += msg->size;
+        /* skip updates for signals that were unmapped or freed after queueing */
+        if (!msg->sig || !msg->sig->rsig || msg->len > MPR_MAX_VECTOR_LEN)
+            continue;
+        /* element pointers into the contiguous value array */
+        elem_size = 0;
+        for (i = 0; i < msg->len && !elem_size; i++) {
+            mpr_type type = ((mpr_type*)(msg + 1))[i];
+            if (MPR_NULL != type)
+                elem_size = mpr_type_get_size(type);
+        }
+        for (i = 0; i < msg->len; i++)
+            argv[i] = (lo_arg*)((char*)(msg + 1) + ALIGN8(msg->len) + i * elem_size);
+        mpr_dev_bundle_start(msg->time, msg->sig->dev);
+        mpr_dev_update_sig(msg->sig, (mpr_type*)(msg + 1), argv, msg->len, msg->GID, msg->slot_id);
+    }
+
+    /* reuse the detached buffer unless a new one was allocated meanwhile */
+    if (!b->buf) {
+        b->buf = link->local_msgs.buf;
+        b->size = link->local_msgs.size;
+    }
+    else
+        free(link->local_msgs.buf);
+    link->local_msgs.buf = 0;
+    link->local_msgs.len = 0;
+    return num;
+}
+
 /* TODO: pass in bundle index as argument */
 /* TODO: interrupt driven signal updates may not be followed by mpr_dev_process_outputs(); in the
  * case where the interrupt has interrupted mpr_dev_poll() these messages will not be dispatched. */
@@ -120,11 +500,14 @@ int mpr_link_process_bundles(mpr_link link, mpr_time t, int idx)
 
     b = &link->bundles[idx];
 
-    if (link->devs[0] != link->devs[1]) {
+    if (!mpr_link_get_is_local_only(link)) {
         mpr_net n = &link->obj.graph->net;
+        if (b->count && !b->queued)
+            num = _send_bundle_buf(link, b, 1);
         if ((lb = b->udp)) {
             b->udp = 0;
-            if ((num = lo_bundle_count(lb))) {
+            if ((tmp = lo_bundle_count(lb))) {
+                num += tmp;
                 lo_send_bundle_from(link->addr.udp, n->servers[SERVER_UDP], lb);
             }
             lo_bundle_free_recursive(lb);
@@ -138,24 +521,24 @@ int mpr_link_process_bundles(mpr_link link, mpr_time t, int idx)
             lo_bundle_free_recursive(lb);
         }
     }
-    else if ((lb = b->udp)) {
+    else {
         const char *path;
+        if (b->count)
+            num = _process_local_msgs(link, b);
+        RETURN_ARG_UNLESS(lb = b->udp, num);
         b->udp = 0;
-        /* set out-of-band timestamp */
-        mpr_dev_bundle_start(lo_bundle_get_timestamp(lb), NULL);
         /* call handler directly instead of sending over the network */
-        num = lo_bundle_count(lb);
-        while (i < num) {
+        tmp = lo_bundle_count(lb);
+        num += tmp;
+        while (i < tmp) {
             lo_message m = lo_bundle_get_message(lb, i, &path);
             /* need to look up signal by path */
-            mpr_rtr_sig rs = link->obj.graph->net.rtr->sigs;
-            while (rs) {
-                if (0 == strcmp(path, rs->sig->path)) {
-                    mpr_dev_handler(NULL, lo_message_get_types(m), lo_message_get_argv(m),
-                                    lo_message_get_argc(m), m, (void*)rs->sig);
-                    break;
-                }
-                rs = rs->next;
+            mpr_rtr_sig rs = mpr_rtr_find_sig_by_path(link->obj.graph->net.rtr, path);
+            if (rs) {
+                /* set out-of-band timestamp on the receiving device */
+                mpr_dev_bundle_start(lo_bundle_get_timestamp(lb), rs->sig->dev);
+                mpr_dev_handler(NULL, lo_message_get_types(m), lo_message_get_argv(m),
+                                lo_message_get_argc(m), m, (void*)rs->sig);
             }
             ++i;
         }
@@ -217,3 +600,8 @@ int mpr_link_get_is_local(mpr_link link)
 {
     return link->devs[0]->is_local || link->devs[1]->is_local;
 }
+
+int mpr_link_get_is_local_only(mpr_link link)
+{
+    return link->devs[0]->is_local && link->devs[1]->is_local;
+}
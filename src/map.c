@@ -443,8 +443,8 @@ static int _update_scope(mpr_map m, mpr_msg_atom a)
 /* only called for outgoing maps */
 void mpr_map_send(mpr_local_map m, mpr_time time)
 {
-    int i, j, status, map_manages_inst = 0;
-    lo_message msg;
+    int i, j, k, len, status, map_manages_inst = 0, num_updated = 0;
+    int *inst_idx, *statuses = 0;
     mpr_local_dev dev;
     uint8_t bundle_idx;
     mpr_local_slot src_slot, dst_slot;
@@ -473,40 +473,55 @@ void mpr_map_send(mpr_local_map m, mpr_time time)
     for (i = 0; i < m->num_src; i++)
         src_vals[i] = &m->src[i]->val;
     dst_slot = m->dst;
+    len = dst_slot->sig->len;
 
     if (m->use_inst && !src_sig->use_inst) {
         map_manages_inst = 1;
         idmap = m->idmap;
     }
 
-    types = alloca(dst_slot->sig->len * sizeof(char));
-
+    /* collect the indices of updated instances */
+    inst_idx = alloca(m->num_inst * sizeof(int));
     for (i = 0; i < m->num_inst; i++) {
-        if (!get_bitflag(m->updated_inst, i))
-            continue;
-        status = mpr_expr_eval(m->expr, src_vals, &m->vars, &dst_slot->val, &time, types, i);
+        if (get_bitflag(m->updated_inst, i))
+            inst_idx[num_updated++] = i;
+    }
+
+    if (m->use_inst && mpr_expr_get_can_batch(m->expr, num_updated)) {
+        /* evaluate all updated instances together before building messages */
+        types = alloca(num_updated * len * sizeof(char));
+        statuses = alloca(num_updated * sizeof(int));
+        mpr_expr_eval_batch(dev->expr_eval_buff, m->expr, src_vals, &m->vars, &dst_slot->val,
+                            &time, types, inst_idx, num_updated, statuses);
+    }
+    else
+        types = alloca(len * sizeof(char));
+
+    for (k = 0; k < num_updated; k++) {
+        char *inst_types = types;
+        i = inst_idx[k];
+        if (statuses) {
+            status = statuses[k];
+            inst_types += k * len;
+        }
+        else
+            status = mpr_expr_eval(dev->expr_eval_buff, m->expr, src_vals, &m->vars,
+                                   &dst_slot->val, &time, types, i);
         if (!status)
             continue;
 
         if (src_sig->use_inst && !map_manages_inst) {
-            /* finding idmaps here will be a bit inefficient for now */
-            /* TODO: optimize storage and lookup */
-            for (j = 0; j < src_sig->idmap_len; j++) {
-                if (idmaps[j].inst && idmaps[j].inst->idx == i) {
-                    idmap = idmaps[j].map;
-                    break;
-                }
-            }
-            if (j == src_sig->idmap_len) {
+            j = mpr_sig_get_idmap_with_inst_idx(src_sig, i);
+            if (j < 0) {
                 trace("error: couldn't find idmap for signal instance idx %d\n", i);
                 continue;
             }
+            idmap = idmaps[j].map;
         }
 
         /* send instance release if dst is instanced and either src or map is also instanced. */
         if (idmap && status & EXPR_RELEASE_BEFORE_UPDATE && m->use_inst) {
-            msg = mpr_map_build_msg(m, 0, 0, 0, idmap);
-            mpr_link_add_msg(dst_slot->link, dst_slot->sig, msg, time, m->protocol, bundle_idx);
+            mpr_map_add_msg(m, 0, 0, 0, idmap, dst_slot->link, dst_slot->sig, time, bundle_idx);
             if (map_manages_inst) {
                 mpr_dev_LID_decref(dev, 0, idmap);
                 idmap = m->idmap = 0;
@@ -519,15 +534,12 @@ void mpr_map_send(mpr_local_map m, mpr_time time)
                 /* create an id_map and store it in the map */
                 idmap = m->idmap = mpr_dev_add_idmap(dev, 0, 0, 0);
             }
-            msg = mpr_map_build_msg(m, src_slot, result, types, idmap);
-            mpr_link_add_msg(dst_slot->link, dst_slot->sig, msg,
-                             *(mpr_time*)mpr_value_get_time(&dst_slot->val, i),
-                             m->protocol, bundle_idx);
+            mpr_map_add_msg(m, src_slot, result, inst_types, idmap, dst_slot->link, dst_slot->sig,
+                            *(mpr_time*)mpr_value_get_time(&dst_slot->val, i), bundle_idx);
         }
         /* send instance release if dst is instanced and either src or map is also instanced. */
         if (idmap && status & EXPR_RELEASE_AFTER_UPDATE && m->use_inst) {
-            msg = mpr_map_build_msg(m, 0, 0, 0, idmap);
-            mpr_link_add_msg(dst_slot->link, dst_slot->sig, msg, time, m->protocol, bundle_idx);
+            mpr_map_add_msg(m, 0, 0, 0, idmap, dst_slot->link, dst_slot->sig, time, bundle_idx);
             if (map_manages_inst) {
                 mpr_dev_LID_decref(dev, 0, idmap);
                 idmap = m->idmap = 0;
@@ -544,7 +556,8 @@ void mpr_map_send(mpr_local_map m, mpr_time time)
 /* TODO: merge with mpr_map_send()? */
 void mpr_map_receive(mpr_local_map m, mpr_time time)
 {
-    int i, j, status, type_size, map_manages_inst = 0;
+    int i, j, k, status, type_size, map_manages_inst = 0, num_updated = 0;
+    int *inst_idx, *statuses = 0;
     mpr_local_slot src_slot, dst_slot;
     mpr_sig src_sig;
     mpr_local_sig dst_sig;
@@ -577,32 +590,46 @@ void mpr_map_receive(mpr_local_map m, mpr_time time)
         else
             idmap = 0;
     }
-    types = alloca(dst_sig->len * sizeof(char));
-
+    /* collect the indices of updated instances */
+    inst_idx = alloca(m->num_inst * sizeof(int));
     for (i = 0; i < m->num_inst; i++) {
+        if (get_bitflag(m->updated_inst, i))
+            inst_idx[num_updated++] = i;
+    }
+
+    if (m->use_inst && mpr_expr_get_can_batch(m->expr, num_updated)) {
+        /* Evaluate all updated instances together before calling handlers. Since each
+         * instance has its own expression state this gives the same values, but all of them
+         * are computed before the handler is called for the first instance. */
+        types = alloca(num_updated * dst_sig->len * sizeof(char));
+        statuses = alloca(num_updated * sizeof(int));
+        mpr_expr_eval_batch(m->rtr->dev->expr_eval_buff, m->expr, src_vals, &m->vars,
+                            &dst_slot->val, &time, types, inst_idx, num_updated, statuses);
+    }
+    else
+        types = alloca(dst_sig->len * sizeof(char));
+
+    for (k = 0; k < num_updated; k++) {
         mpr_sig_inst si;
         float diff;
 
-        if (!get_bitflag(m->updated_inst, i))
-            continue;
-        status = mpr_expr_eval(m->expr, src_vals, &m->vars, &dst_slot->val, &time, types, i);
+        i = inst_idx[k];
+        if (statuses)
+            status = statuses[k];
+        else
+            status = mpr_expr_eval(m->rtr->dev->expr_eval_buff, m->expr, src_vals, &m->vars,
+                                   &dst_slot->val, &time, types, i);
         if (!status)
             continue;
 
         j = 0;
         if (dst_sig->use_inst && !map_manages_inst) {
-            /* finding idmaps here will be a bit inefficient for now */
-            /* TODO: optimize storage and lookup */
-            for (j = 0; j < dst_sig->idmap_len; j++) {
-                if (idmaps[j].inst && idmaps[j].inst->idx == i) {
-                    idmap = idmaps[j].map;
-                    break;
-                }
-            }
-            if (j == dst_sig->idmap_len) {
+            j = mpr_sig_get_idmap_with_inst_idx(dst_sig, i);
+            if (j < 0) {
                 trace("error: couldn't find idmap for signal instance idx %d\n", i);
                 continue;
             }
+            idmap = idmaps[j].map;
         }
         else {
             
@@ -631,9 +658,11 @@ void mpr_map_receive(mpr_local_map m, mpr_time time)
  */
 
             /* copy to signal value */
+            mpr_sig_inst_begin_write(si);
             memcpy(si->val, result, type_size);
             memcpy(&si->time, &time, sizeof(mpr_time));
             si->has_val = 1;
+            mpr_sig_inst_end_write(si);
 
             mpr_sig_call_handler(dst_sig, MPR_SIG_UPDATE, idmap ? idmap->LID : 0,
                                  dst_sig->len, si->val, &time, diff);
@@ -661,6 +690,142 @@ void mpr_map_receive(mpr_local_map m, mpr_time time)
     m->updated = 0;
 }
 
+/* OSC strings are null-terminated and padded to a multiple of four bytes. */
+#define OSC_STR_LEN(len) (((len) + 4) & ~3)
+
+static char *_put32(char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static char *_put64(char *p, uint64_t v)
+{
+    return _put32(_put32(p, v >> 32), v);
+}
+
+/* Encode the same message as mpr_map_build_msg() as OSC bytes. If buf is zero only the
+ * encoded length is returned. */
+static int _encode_msg(mpr_local_map m, mpr_local_slot slot, const void *val, mpr_type *types,
+                       mpr_id_map idmap, const char *path, char *buf)
+{
+    int i, len = 0, num_types = 1, arg_len = 0, path_len = strlen(path);
+    char *tt, *arg;
+    union { float f; uint32_t i; } f;
+    union { double d; uint64_t i; } d;
+
+    if (MPR_LOC_SRC == m->process_loc)
+        len = m->dst->sig->len;
+    else if (slot)
+        len = slot->sig->len;
+
+    if (val && types) {
+        for (i = 0; i < len; i++) {
+            switch (types[i]) {
+                case MPR_INT32:
+                case MPR_FLT:   arg_len += 4;   break;
+                case MPR_DBL:   arg_len += 8;   break;
+                case MPR_NULL:                  break;
+                default:                        continue;
+            }
+            ++num_types;
+        }
+    }
+    else if (m->use_inst)
+        num_types += len;
+    if (m->use_inst && idmap) {
+        num_types += 2;
+        arg_len += 12;
+    }
+    if (slot) {
+        num_types += 2;
+        arg_len += 8;
+    }
+    RETURN_ARG_UNLESS(buf, OSC_STR_LEN(path_len) + OSC_STR_LEN(num_types) + arg_len);
+
+    memset(buf + OSC_STR_LEN(path_len) - 4, 0, 4);
+    memcpy(buf, path, path_len);
+    tt = buf + OSC_STR_LEN(path_len);
+    arg = tt + OSC_STR_LEN(num_types);
+    memset(arg - 4, 0, 4);
+    *tt++ = ',';
+
+    if (val && types) {
+        for (i = 0; i < len; i++) {
+            switch (types[i]) {
+                case MPR_INT32:
+                    arg = _put32(arg, ((int*)val)[i]);
+                    break;
+                case MPR_FLT:
+                    f.f = ((float*)val)[i];
+                    arg = _put32(arg, f.i);
+                    break;
+                case MPR_DBL:
+                    d.d = ((double*)val)[i];
+                    arg = _put64(arg, d.i);
+                    break;
+                case MPR_NULL:
+                    break;
+                default:
+                    continue;
+            }
+            *tt++ = types[i];
+        }
+    }
+    else if (m->use_inst) {
+        for (i = 0; i < len; i++)
+            *tt++ = MPR_NULL;
+    }
+    if (m->use_inst && idmap) {
+        *tt++ = MPR_STR;
+        *tt++ = MPR_INT64;
+        memcpy(arg, "@in", 4);
+        arg = _put64(arg + 4, idmap->GID);
+    }
+    if (slot) {
+        *tt++ = MPR_STR;
+        *tt++ = MPR_INT32;
+        memcpy(arg, "@sl", 4);
+        arg = _put32(arg + 4, slot->id);
+    }
+    return arg - buf;
+}
+
+void mpr_map_add_msg(mpr_local_map m, mpr_local_slot slot, const void *val, mpr_type *types,
+                     mpr_id_map idmap, mpr_link link, mpr_sig dst, mpr_time t, int idx)
+{
+    char *buf;
+    int len;
+    if (mpr_link_get_is_local_only(link)) {
+        /* both ends are local: skip OSC and queue the typed values directly */
+        mpr_type nulls[MPR_MAX_VECTOR_LEN];
+        if (MPR_LOC_SRC == m->process_loc)
+            len = m->dst->sig->len;
+        else
+            len = slot ? slot->sig->len : 0;
+        if (!(val && types)) {
+            val = 0;
+            if (!m->use_inst)
+                len = 0;
+            memset(nulls, MPR_NULL, len);
+            types = nulls;
+        }
+        mpr_link_add_local_msg(link, (mpr_local_sig)dst, len, types, val,
+                               m->use_inst && idmap ? idmap->GID : 0, slot ? slot->id : -1,
+                               t, idx);
+        return;
+    }
+    len = _encode_msg(m, slot, val, types, idmap, dst->path, 0);
+    if ((buf = mpr_link_reserve_msg(link, t, m->protocol, idx, len)))
+        _encode_msg(m, slot, val, types, idmap, dst->path, buf);
+    else
+        mpr_link_add_msg(link, dst, mpr_map_build_msg(m, slot, val, types, idmap), t,
+                         m->protocol, idx);
+}
+
 /*! Build a value update message for a given map. */
 lo_message mpr_map_build_msg(mpr_local_map m, mpr_local_slot slot, const void *val,
                              mpr_type *types, mpr_id_map idmap)
@@ -823,6 +988,8 @@ static int _replace_expr_str(mpr_local_map m, const char *expr_str)
     }
     FUNC_IF(mpr_expr_free, m->expr);
     m->expr = expr;
+    /* preallocate the device's evaluation stack */
+    mpr_expr_realloc_eval_buffer(expr, m->rtr->dev->expr_eval_buff);
 
     if (m->expr_str == expr_str)
         return 0;
@@ -831,6 +998,32 @@ static int _replace_expr_str(mpr_local_map m, const char *expr_str)
     return 0;
 }
 
+/* Helper to retune the named constants of a map's expression in place if the new
+ * string differs from the current one only in the values assigned to them. This
+ * avoids reparsing the expression and reallocating its variables and history, so
+ * stateful expressions are not disturbed by e.g. range changes. Returns 0 on
+ * success, non-zero if the expression must be replaced. */
+static int _update_expr_consts(mpr_local_map m, const char *expr_str)
+{
+    int i, vars;
+    mpr_time now;
+    RETURN_ARG_UNLESS(m->expr && m->expr_str && m->vars, 1);
+    RETURN_ARG_UNLESS(m->num_vars == mpr_expr_get_num_vars(m->expr), 1);
+    /* expressions without inputs are evaluated once when they are set */
+    RETURN_ARG_UNLESS(mpr_expr_get_num_input_slots(m->expr) > 0, 1);
+
+    vars = mpr_expr_update_consts(m->expr, m->expr_str, expr_str);
+    RETURN_ARG_UNLESS(vars > 0, 1);
+
+    mpr_time_set(&now, MPR_NOW);
+    for (i = 0; i < m->num_inst; i++)
+        mpr_expr_eval_consts(m->rtr->dev->expr_eval_buff, m->expr, &m->vars, &now, i, vars);
+
+    mpr_tbl_set(m->obj.props.synced, PROP(EXPR), NULL, 1, MPR_STR, expr_str, REMOTE_MODIFY);
+    mpr_tbl_remove(m->obj.props.staged, PROP(EXPR), NULL, 0);
+    return 0;
+}
+
 MPR_INLINE static int _trim_zeros(char *str, int len)
 {
     if (!strchr(str, '.'))
@@ -1166,6 +1359,8 @@ static int _set_expr(mpr_local_map m, const char *expr)
         expr = new_expr = _set_linear(m, expr);
     RETURN_ARG_UNLESS(expr, 1);
 
+    if (!_update_expr_consts(m, expr))
+        goto done;
     if (!_replace_expr_str(m, expr)) {
         mpr_time now;
         char *types = alloca(m->dst->sig->len * sizeof(char));
@@ -1173,7 +1368,8 @@ static int _set_expr(mpr_local_map m, const char *expr)
         /* evaluate expression to intialise literals */
         mpr_time_set(&now, MPR_NOW);
         for (i = 0; i < m->num_inst; i++)
-            mpr_expr_eval(m->expr, 0, &m->vars, &m->dst->val, &now, types, i);
+            mpr_expr_eval(m->rtr->dev->expr_eval_buff, m->expr, 0, &m->vars, &m->dst->val, &now,
+                          types, i);
     }
     else {
         if (!m->expr && (   (MPR_LOC_DST == m->process_loc && m->dst->sig->is_local)
@@ -1258,6 +1454,20 @@ static void _check_status(mpr_local_map m)
     return;
 }
 
+/* Check whether any device linked by a map is known to be on a different host. */
+static int _get_has_remote_host(mpr_map m)
+{
+    int i;
+    for (i = 0; i <= m->num_src; i++) {
+        mpr_link link = (i < m->num_src) ? m->src[i]->link : m->dst->link;
+        if (   link && link->devs[LOCAL_DEV] != link->devs[REMOTE_DEV]
+            && mpr_obj_get_prop_as_str((mpr_obj)link->devs[REMOTE_DEV], MPR_PROP_HOST, NULL)
+            && !mpr_link_get_is_same_host(link))
+            return 1;
+    }
+    return 0;
+}
+
 /* if 'override' flag is not set, only remote properties can be set */
 int mpr_map_set_from_msg(mpr_map m, mpr_msg msg, int override)
 {
@@ -1409,8 +1619,21 @@ int mpr_map_set_from_msg(mpr_map m, mpr_msg msg, int override)
                 break;
             case PROP(PROTOCOL): {
                 mpr_proto pro = mpr_protocol_from_str(&(a->vals[0])->s);
+                /* transports that only work within one host are downgraded to UDP if any peer
+                 * is elsewhere, so that the reply to /mapTo or /mapped carries the protocol
+                 * actually in use */
+                if (   (MPR_PROTO_SHM == pro || MPR_PROTO_UNIX == pro)
+                    && m->is_local && _get_has_remote_host(m))
+                    pro = MPR_PROTO_UDP;
                 updated += mpr_tbl_set(tbl, PROP(PROTOCOL), NULL, 1, MPR_INT32,
                                        &pro, REMOTE_MODIFY);
+                if (MPR_PROTO_SHM == pro && m->is_local) {
+                    /* both ends of the map get here, so each creates the ring it reads from */
+                    for (j = 0; j <= m->num_src; j++) {
+                        mpr_link link = (j < m->num_src) ? m->src[j]->link : m->dst->link;
+                        FUNC_IF(mpr_link_open_shm, link);
+                    }
+                }
                 break;
             }
             case PROP(USE_INST): {
@@ -101,6 +101,22 @@ void mpr_net_free_msgs(mpr_net n);
 
 void mpr_net_free(mpr_net n);
 
+/*! Get the path of the Unix domain socket of the device bound to a given data port. */
+void mpr_net_get_unix_path(char *path, int len, int port);
+
+/*! Create the private directory of a Unix domain socket path and remove a stale socket of the
+ *  current user at the path.
+ *  \param path         The path returned by mpr_net_get_unix_path().
+ *  \return             Non-zero if the path can be bound. */
+int mpr_net_prepare_unix_path(const char *path);
+
+/*! Queue the UDP bundle buffer of a link to be sent by mpr_net_flush_udp(). The bundle buffer
+ *  must not be modified until then. */
+void mpr_net_queue_udp(mpr_net n, mpr_link link, mpr_bundle b);
+
+/*! Send all queued UDP bundles, using as few system calls as possible, and clear their buffers. */
+void mpr_net_flush_udp(mpr_net n);
+
 #define NEW_LO_MSG(VARNAME, FAIL)                   \
 lo_message VARNAME = lo_message_new();              \
 if (!VARNAME) {                                     \
@@ -137,8 +153,30 @@ void mpr_dev_remove_link(mpr_dev dev, mpr_dev rem);
 int mpr_dev_handler(const char *path, const char *types, lo_arg **argv, int argc,
                     lo_message msg, void *data);
 
+/*! Apply a value update to a local signal, or to one of its incoming map slots.
+ *  \param sig          The local signal.
+ *  \param types        The type of each vector element, MPR_NULL if the element has no value.
+ *  \param argv         Pointers to each element value. Values must be contiguous unless some
+ *                      elements are MPR_NULL.
+ *  \param val_len      The number of vector elements.
+ *  \param GID          The global id of the updated instance, or zero.
+ *  \param slot_idx     The id of the map slot this update is for, or -1.
+ *  \return             Always zero, so that liblo considers the message handled. */
+int mpr_dev_update_sig(mpr_local_sig sig, const mpr_type *types, lo_arg **argv, int val_len,
+                       mpr_id GID, int slot_idx);
+
+/*! Record the timetag of a bundle about to be dispatched to the local device given as data. */
 int mpr_dev_bundle_start(lo_timetag t, void *data);
 
+/*! Mix the bits of an instance id for indexing power-of-two hash tables. */
+MPR_INLINE static unsigned int mpr_id_hash(mpr_id id)
+{
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (unsigned int)id;
+}
+
 MPR_INLINE static void mpr_dev_LID_incref(mpr_local_dev dev, mpr_id_map map)
 {
     ++map->LID_refcount;
@@ -161,6 +199,21 @@ void mpr_dev_add_sig_methods(mpr_local_dev dev, mpr_local_sig sig);
 
 void mpr_dev_remove_sig_methods(mpr_local_dev dev, mpr_local_sig sig);
 
+/*! Find a local signal accepting updates by its full path.
+ *  \param dev          The local device.
+ *  \param path         The signal path, including the leading slash.
+ *  \return             The signal, or zero if no signal with this path was found. */
+mpr_local_sig mpr_dev_find_sig_by_path(mpr_local_dev dev, const char *path);
+
+/*! Queue an updated map for processing during the next poll, unless it is already queued.
+ *  \param dev          The local device.
+ *  \param map          The updated map.
+ *  \param is_incoming  Non-zero if the map destination belongs to this device. */
+void mpr_dev_queue_map(mpr_local_dev dev, mpr_local_map map, int is_incoming);
+
+/*! Remove a map from the device worklists before it is freed. */
+void mpr_dev_dequeue_map(mpr_local_dev dev, mpr_local_map map);
+
 mpr_id_map mpr_dev_add_idmap(mpr_local_dev dev, int group, mpr_id LID, mpr_id GID);
 
 mpr_id_map mpr_dev_get_idmap_by_LID(mpr_local_dev dev, int group, mpr_id LID);
@@ -205,6 +258,15 @@ void mpr_graph_cleanup(mpr_graph g);
 
 void mpr_rtr_remove_sig(mpr_rtr r, mpr_rtr_sig rs);
 
+/*! Find the router entry for a local signal by its path.
+ *  \param r           The router to query.
+ *  \param path        The signal path, including the leading slash.
+ *  \return            The router entry, or NULL if the signal is not mapped. */
+mpr_rtr_sig mpr_rtr_find_sig_by_path(mpr_rtr r, const char *path);
+
+/*! Free the router and all of its signal entries. */
+void mpr_rtr_free(mpr_rtr r);
+
 void mpr_rtr_num_inst_changed(mpr_rtr r, mpr_local_sig sig, int size);
 
 void mpr_rtr_remove_inst(mpr_rtr rtr, mpr_local_sig sig, int idx);
@@ -213,6 +275,22 @@ void mpr_rtr_remove_inst(mpr_rtr rtr, mpr_local_sig sig, int idx);
  *  destinations. */
 void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int inst_idx, const void *val, mpr_time t);
 
+/*! Forward the current values of several updated instances of a signal to its maps, making a
+ *  single pass over the router slots.
+ *  \param rtr          The router to use.
+ *  \param sig          The updated signal.
+ *  \param num          The number of updated instances.
+ *  \param idmap_idxs   The id map indices of the updated instances.
+ *  \param t            The time of the update. */
+void mpr_rtr_process_sig_insts(mpr_rtr rtr, mpr_local_sig sig, int num, const int *idmap_idxs,
+                               mpr_time t);
+
+/*! Order the local maps of a router by the length of the longest chain of local maps that
+ *  feeds their sources, so that maps can be evaluated after all of their local dependencies.
+ *  Maps that are part of a loop are ranked as if the loop were broken where it was entered.
+ *  \param rtr          The router to use. */
+void mpr_rtr_rank_maps(mpr_rtr rtr);
+
 void mpr_rtr_add_map(mpr_rtr rtr, mpr_local_map map);
 
 void mpr_rtr_remove_link(mpr_rtr rtr, mpr_link lnk);
@@ -285,9 +363,42 @@ int mpr_sig_get_idmap_with_LID(mpr_local_sig sig, mpr_id LID, int flags, mpr_tim
  *                  strategy. */
 int mpr_sig_get_idmap_with_GID(mpr_local_sig sig, mpr_id GID, int flags, mpr_time t, int activate);
 
+/*! Get the instance id map for a signal instance.
+ *  \param sig      The signal owning the instance.
+ *  \param inst_idx The index of the instance value history.
+ *  \return         The index of the instance id map, or -1 if the instance is inactive. */
+MPR_INLINE static int mpr_sig_get_idmap_with_inst_idx(mpr_local_sig sig, int inst_idx)
+{
+    return inst_idx < sig->num_inst ? sig->inst_idmaps[inst_idx] - 1 : -1;
+}
+
+/*! Mark the value and time of a signal instance as being changed, so that threads reading them
+ *  with mpr_sig_copy_value() will retry. Must be followed by mpr_sig_inst_end_write(). */
+MPR_INLINE static void mpr_sig_inst_begin_write(mpr_sig_inst si)
+{
+    __atomic_store_n(&si->seq, si->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+MPR_INLINE static void mpr_sig_inst_end_write(mpr_sig_inst si)
+{
+    __atomic_store_n(&si->seq, si->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*! Clear the instance of a signal instance id map. */
+void mpr_sig_clear_idmap_inst(mpr_local_sig sig, int idmap_idx);
+
+/*! Clear the device id map of a signal instance id map. */
+void mpr_sig_clear_idmap_map(mpr_local_sig sig, int idmap_idx);
+
 /*! Release a specific signal instance. */
 void mpr_sig_release_inst_internal(mpr_local_sig sig, int inst_idx);
 
+/*! Apply the updates pushed to a signal's queue since it was last processed.
+ *  \param sig      The signal to operate on.
+ *  \return         The number of updates applied. */
+int mpr_sig_process_queue(mpr_local_sig sig);
+
 /**** Links ****/
 
 mpr_link mpr_link_new(mpr_local_dev local_dev, mpr_dev remote_dev);
@@ -306,10 +417,85 @@ void mpr_link_free(mpr_link link);
 int mpr_link_process_bundles(mpr_link link, mpr_time t, int idx);
 void mpr_link_add_msg(mpr_link link, mpr_sig dst, lo_message msg, mpr_time t, mpr_proto proto, int idx);
 
+/*! Reserve space for an encoded OSC message in a link's preallocated UDP bundle.
+ *  \param link         The link to the destination device.
+ *  \param t            Timestamp for a new bundle.
+ *  \param proto        The protocol the message will be sent with.
+ *  \param idx          The bundle index.
+ *  \param len          The length of the encoded message in bytes.
+ *  \return             A pointer to len bytes to write the message into, or zero if the
+ *                      message must be added as an lo_message instead. */
+char *mpr_link_reserve_msg(mpr_link link, mpr_time t, mpr_proto proto, int idx, int len);
+
+/*! Queue an update for a signal on a local device. The update is delivered without
+ *  serialization when the bundle is processed.
+ *  \param link         A link between two local devices, usually from a device to itself.
+ *  \param dst          The destination signal.
+ *  \param len          The number of vector elements.
+ *  \param types        The type of each vector element, MPR_NULL if the element has no value.
+ *  \param val          The contiguous element values, or zero if all elements are MPR_NULL.
+ *  \param GID          The global id of the updated instance, or zero.
+ *  \param slot_id      The id of the destination map slot, or -1.
+ *  \param t            The timestamp of the update.
+ *  \param idx          The bundle index. */
+void mpr_link_add_local_msg(mpr_link link, mpr_local_sig dst, int len, const mpr_type *types,
+                            const void *val, mpr_id GID, int slot_id, mpr_time t, int idx);
+
+/*! Drop any queued updates for a local signal that is about to be freed. */
+void mpr_link_remove_local_sig(mpr_link link, mpr_local_sig sig);
+
 mpr_link mpr_graph_add_link(mpr_graph g, mpr_dev dev1, mpr_dev dev2);
 
 int mpr_link_get_is_local(mpr_link link);
 
+/*! Check whether both devices of a link are local, so updates can skip the network. */
+int mpr_link_get_is_local_only(mpr_link link);
+
+/*! Check whether the remote device of a link is on the same host as the local device. */
+int mpr_link_get_is_same_host(mpr_link link);
+
+/*! Open the shared-memory rings to the remote device of a link once a map uses them. */
+void mpr_link_open_shm(mpr_link link);
+
+/*! Close the shared-memory rings of a link after a malformed record and send over UDP instead. */
+void mpr_link_close_shm(mpr_link link);
+
+/**** Shared memory ****/
+
+/*! Open a shared-memory ring. The consumer creates the segment. The producer attaches to it
+ *  once it exists, and removes its name so that it does not outlive both ends.
+ *  \param name         The name of the shared-memory object.
+ *  \param is_consumer  Non-zero to create the reading end.
+ *  \return             The ring, or zero if shared memory is not available. */
+mpr_shm mpr_shm_open(const char *name, int is_consumer);
+
+void mpr_shm_close(mpr_shm shm);
+
+/*! Copy a datagram into the ring.
+ *  \param shm          The ring.
+ *  \param data         The datagram.
+ *  \param len          The length of the datagram.
+ *  \param wake         Set to non-zero if the consumer is waiting and must be woken.
+ *  \return             Non-zero if the datagram was written, or zero if the ring is full or
+ *                      no consumer is attached. A producer whose consumer has closed the ring
+ *                      detaches from it and attaches to the next consumer's segment. */
+int mpr_shm_write(mpr_shm shm, const char *data, int len, int *wake);
+
+/*! Return the next datagram in the ring without copying it, or zero if the ring is empty. The
+ *  datagram may be modified in place and must be released with mpr_shm_release(). Once the ring
+ *  is empty and its producer has closed it, a new segment is created for the next producer.
+ *  If the next record is malformed, zero is returned and len is set to -1; the ring should then
+ *  be closed. */
+char *mpr_shm_peek(mpr_shm shm, int *len);
+
+void mpr_shm_release(mpr_shm shm);
+
+/*! Announce that the consumer is about to block.
+ *  \return             Non-zero if the ring is not empty, in which case it should not block. */
+int mpr_shm_prepare_wait(mpr_shm shm);
+
+void mpr_shm_end_wait(mpr_shm shm);
+
 /**** Maps ****/
 
 void mpr_map_alloc_values(mpr_local_map map);
@@ -325,6 +511,12 @@ void mpr_map_receive(mpr_local_map map, mpr_time time);
 lo_message mpr_map_build_msg(mpr_local_map map, mpr_local_slot slot, const void *val,
                              mpr_type *types, mpr_id_map idmap);
 
+/*! Add a value update message for a given map to the outgoing bundle of a link, encoding it
+ *  directly into the link's send buffer when possible. Arguments are as for
+ *  mpr_map_build_msg(), followed by the link, destination signal, time and bundle index. */
+void mpr_map_add_msg(mpr_local_map map, mpr_local_slot slot, const void *val, mpr_type *types,
+                     mpr_id_map idmap, mpr_link link, mpr_sig dst, mpr_time t, int idx);
+
 /*! Set a mapping's properties based on message parameters. */
 int mpr_map_set_from_msg(mpr_map map, mpr_msg msg, int override);
 
@@ -458,11 +650,26 @@ int mpr_expr_get_var_is_public(mpr_expr expr, int idx);
 
 int mpr_expr_get_manages_inst(mpr_expr expr);
 
+/*! Create a buffer for holding the evaluation stack. Each thread evaluating
+ *  expressions concurrently must use its own buffer.
+ *  \param expr         An expression to size the buffer for, or NULL.
+ *  \return             The new buffer. */
+mpr_expr_eval_buffer mpr_expr_new_eval_buffer(mpr_expr expr);
+
+/*! Grow an evaluation buffer if necessary so it can be used to evaluate the
+ *  given expression without further allocation.
+ *  \param expr         The expression to size the buffer for.
+ *  \param buff         The buffer to resize. */
+void mpr_expr_realloc_eval_buffer(mpr_expr expr, mpr_expr_eval_buffer buff);
+
+void mpr_expr_free_eval_buffer(mpr_expr_eval_buffer buff);
+
 #ifdef DEBUG
 void printexpr(const char*, mpr_expr);
 #endif
 
 /*! Evaluate the given inputs using the compiled expression.
+ *  \param buff         A buffer for the evaluation stack.
  *  \param expr         The expression to use.
  *  \param srcs         An array of mpr_value structures for sources.
  *  \param expr_vars    An array of mpr_value structures for user variables.
@@ -478,14 +685,138 @@ void printexpr(const char*, mpr_expr);
  *                      generated an instance release before the update), and
  *                      MPR_SIG_REL_DNSRTM (if the expression generated an
  *                      instance release after an update). */
-int mpr_expr_eval(mpr_expr expr, mpr_value *srcs, mpr_value *expr_vars,
-                  mpr_value result, mpr_time *t, mpr_type *types, int inst_idx);
+int mpr_expr_eval(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_value *srcs,
+                  mpr_value *expr_vars, mpr_value result, mpr_time *t, mpr_type *types,
+                  int inst_idx);
+
+/*! Evaluate the given inputs for several instances at once. Expressions that
+ *  were compiled to bytecode are run for up to 32 instances per pass so that
+ *  instruction dispatch is shared; other expressions are evaluated using
+ *  mpr_expr_eval() for each instance in turn.
+ *  \param buff         A buffer for the evaluation stack.
+ *  \param expr         The expression to use.
+ *  \param srcs         An array of mpr_value structures for sources.
+ *  \param expr_vars    An array of mpr_value structures for user variables.
+ *  \param result       A mpr_value structure for the destination.
+ *  \param t            A pointer to a timetag structure for storing the time
+ *                      associated with the result.
+ *  \param types        An array of num_inst * result->vlen mpr_type for storing
+ *                      the output type per instance and vector element, or NULL.
+ *  \param inst_idx     Indices of the instances being updated.
+ *  \param num_inst     The number of instances to update.
+ *  \param status       An array of num_inst integers for storing the result of
+ *                      each evaluation, as returned by mpr_expr_eval().
+ *  \result             The number of instances for which an update was generated. */
+int mpr_expr_eval_batch(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_value *srcs,
+                        mpr_value *expr_vars, mpr_value result, mpr_time *t,
+                        mpr_type *types, const int *inst_idx, int num_inst, int *status);
+
+/*! Check whether evaluating several instances together using
+ *  mpr_expr_eval_batch() is faster than evaluating them one at a time. This
+ *  requires an expression compiled to bytecode without branches, and enough
+ *  instances to share the cost of instruction dispatch.
+ *  \param expr         The expression to check.
+ *  \param num_inst     The number of instances to evaluate.
+ *  \return             Non-zero if the instances should be evaluated together. */
+int mpr_expr_get_can_batch(mpr_expr expr, int num_inst);
 
 int mpr_expr_get_num_input_slots(mpr_expr expr);
 
+/*! Choose between the compiled bytecode and the token interpreter when
+ *  evaluating a single instance with mpr_expr_eval(). Expressions that could
+ *  not be compiled always use the interpreter. The bytecode is always used by
+ *  mpr_expr_eval_batch() when available.
+ *  \param expr         The expression to modify.
+ *  \param enable       Non-zero to evaluate using bytecode, zero to use the
+ *                      token interpreter. By default the bytecode is used
+ *                      for expressions with vectors of 16 or more elements.
+ *  \return             1 if the expression will be evaluated using bytecode. */
+int mpr_expr_set_use_bytecode(mpr_expr expr, int enable);
+
+/*! Choose whether affine expressions of the form y=m*x+b are evaluated using a
+ *  fused kernel. Other expressions are not affected.
+ *  \param expr         The expression to modify.
+ *  \param enable       Non-zero to use the fused kernel (the default).
+ *  \return             1 if the expression will be evaluated using the fused kernel. */
+int mpr_expr_set_use_linear(mpr_expr expr, int enable);
+
+/*! Retune the named constants of an expression in place. If the two expression
+ *  strings differ only in the literal values assigned to constant user
+ *  variables, e.g. "sMin=0;" and "sMin=0.5;", the literals are rewritten
+ *  without reparsing so that the expression history and the values of other
+ *  variables are kept. The new values are applied to each instance using
+ *  mpr_expr_eval_consts().
+ *  \param expr         The expression to modify.
+ *  \param old_str      The expression string the expression was parsed from.
+ *  \param new_str      The new expression string.
+ *  \return             A bitmask of the user variables that must be reevaluated,
+ *                      0 if the strings are identical, or -1 if the expression
+ *                      could not be updated in place and must be reparsed. */
+int mpr_expr_update_consts(mpr_expr expr, const char *old_str, const char *new_str);
+
+/*! Reevaluate the statements assigning the given constants for one instance.
+ *  \param buff         A buffer for the evaluation stack.
+ *  \param expr         The expression to use.
+ *  \param expr_vars    An array of mpr_value structures for user variables.
+ *  \param t            A pointer to a timetag structure for the assignment time.
+ *  \param inst_idx     Index of the instance being updated.
+ *  \param vars         A bitmask of variables as returned by mpr_expr_update_consts().
+ *  \return             1 on success, or 0 if evaluation failed. */
+int mpr_expr_eval_consts(mpr_expr_eval_buffer buff, mpr_expr expr, mpr_value *expr_vars,
+                         mpr_time *t, int inst_idx, int vars);
+
 void mpr_expr_free(mpr_expr expr);
 
-void mpr_expr_free_buffers();
+/**** SIMD kernels ****/
+
+/*! Operations with vectorised kernels. */
+typedef enum {
+    MPR_SIMD_ADD,
+    MPR_SIMD_SUB,
+    MPR_SIMD_MUL,
+    MPR_SIMD_DIV,
+    MPR_SIMD_EQ,
+    MPR_SIMD_NE,
+    MPR_SIMD_LT,
+    MPR_SIMD_LE,
+    MPR_SIMD_GT,
+    MPR_SIMD_GE,
+    MPR_SIMD_MIN,
+    MPR_SIMD_MAX,
+    MPR_SIMD_DOT,       /*!< Reduction only. */
+    MPR_SIMD_N_OPS
+} mpr_simd_op;
+
+/*! Instruction sets, in order of preference. */
+typedef enum {
+    MPR_SIMD_AUTO = -1, /*!< The best instruction set supported by the processor. */
+    MPR_SIMD_SCALAR,
+    MPR_SIMD_SSE2,
+    MPR_SIMD_AVX2
+} mpr_simd_isa;
+
+typedef struct _mpr_simd_kernel {
+    /*! Element-wise operation: a[i] = a[i] op b[i] for i < len. */
+    void (*vv)(void *a, const void *b, int len);
+    /*! Broadcast operation: a[i] = a[i] op b[0] for i < len. */
+    void (*vs)(void *a, const void *b, int len);
+    /*! Reduce len rows of stride elements into the first row, so that a[l] becomes the
+     *  reduction of a[i * stride + l] over all rows i. The dot kernel reduces the products
+     *  of a and b; other kernels ignore b. */
+    void (*reduce)(void *a, const void *b, int len, int stride);
+} mpr_simd_kernel_t;
+
+/*! Retrieve the kernels for an operation on packed arrays of a given type.
+ *  \param op           The operation.
+ *  \param type         MPR_INT32, MPR_FLT or MPR_DBL.
+ *  \param isa          The instruction set to use, or MPR_SIMD_AUTO. Instruction sets not
+ *                      supported by the processor are replaced by the best one available.
+ *  \return             The kernels, or NULL if the operation is not supported for this type. */
+const mpr_simd_kernel_t *mpr_simd_get_kernel(mpr_simd_op op, mpr_type type,
+                                             mpr_simd_isa isa);
+
+/*! Retrieve the best instruction set supported by the processor. */
+mpr_simd_isa mpr_simd_get_isa(void);
 
 /**** String tables ****/
 
@@ -622,6 +953,11 @@ MPR_INLINE static int mpr_type_get_size(mpr_type type)
 
 /**** Values ****/
 
+/*! Resize a value to hold num_inst instances with mem_len samples of history each. If the
+ *  history capacity does not grow and enough unused instance slots remain, the slab is kept
+ *  and only the slots of new instances are cleared. Otherwise a new slab is allocated and, for
+ *  inputs keeping their vector length and type, every existing history is copied into it.
+ *  Instance capacity grows to the next power of two, so repeated growth copies less often. */
 void mpr_value_realloc(mpr_value val, int vec_len, mpr_type type,
                        int mem_len, int num_inst, int is_output);
 
@@ -635,32 +971,26 @@ void mpr_value_set_sample(mpr_value v, int idx, void *s, mpr_time t);
 MPR_INLINE static void* mpr_value_get_samp(mpr_value v, int idx)
 {
     mpr_value_buffer b = &v->inst[idx];
-    return (char*)b->samps + b->pos * v->vlen * mpr_type_get_size(v->type);
+    return (char*)b->samps + b->pos * v->samp_stride;
 }
 
 MPR_INLINE static void* mpr_value_get_samp_hist(mpr_value v, int inst_idx, int hist_idx)
 {
     mpr_value_buffer b = &v->inst[inst_idx];
-    int idx = (b->pos + v->mlen + hist_idx) % v->mlen;
-    if (idx < 0)
-        idx += v->mlen;
-    return (char*)b->samps + idx * v->vlen * mpr_type_get_size(v->type);
+    return (char*)b->samps + ((b->pos + hist_idx) & v->mask) * v->samp_stride;
 }
 
 /*! Helper to find the pointer to the current time in a mpr_value_t. */
 MPR_INLINE static mpr_time* mpr_value_get_time(mpr_value v, int idx)
 {
     mpr_value_buffer b = &v->inst[idx];
-    return &b->times[b->pos];
+    return &b->times[b->pos * v->max_inst];
 }
 
 MPR_INLINE static mpr_time* mpr_value_get_time_hist(mpr_value v, int inst_idx, int hist_idx)
 {
     mpr_value_buffer b = &v->inst[inst_idx];
-    int idx = (b->pos + v->mlen + hist_idx) % v->mlen;
-    if (idx < 0)
-        idx += v->mlen;
-    return &b->times[idx];
+    return &b->times[((b->pos + hist_idx) & v->mask) * v->max_inst];
 }
 
 void mpr_value_free(mpr_value v);
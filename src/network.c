@@ -1,3 +1,6 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for sendmmsg() */
+#endif
 #include "config.h"
 
 #include <lo/lo.h>
@@ -14,7 +17,9 @@
 #endif
 
 #ifdef HAVE_ARPA_INET_H
+ #include <sys/socket.h>
  #include <arpa/inet.h>
+ #include <netdb.h>
 #else
  #ifdef HAVE_WINSOCK2_H
   #include <winsock2.h>
@@ -23,6 +28,12 @@
  #endif
 #endif
 
+#ifdef HAVE_SYS_UN_H
+ #include <unistd.h>
+ #include <errno.h>
+ #include <sys/stat.h>
+#endif
+
 #include "mapper_internal.h"
 #include "types_internal.h"
 #include "config.h"
@@ -33,7 +44,7 @@ extern const char* prop_msg_strings[MPR_PROP_EXTRA+1];
 #define BUNDLE_DST_SUBSCRIBERS (void*)-1
 #define BUNDLE_DST_BUS          0
 
-#define MAX_BUNDLE_LEN 65535
+#define SEND_BATCH 64
 #define FIND 0
 #define UPDATE 1
 #define ADD 2
@@ -503,7 +514,8 @@ void mpr_net_add_msg(mpr_net net, const char *s, net_msg_t c, lo_message m)
     int len = lo_bundle_length(net->bundle);
     if (!s)
         s = net_msg_strings[c];
-    if (len && len + lo_message_length(m, s) >= MAX_BUNDLE_LEN) {
+    /* each message is preceded by its length, and the bundle must fit in a single datagram */
+    if (len && len + 4 + lo_message_length(m, s) > MAX_UDP_BUNDLE_LEN) {
         mpr_net_send(net);
         init_bundle(net);
     }
@@ -517,6 +529,110 @@ void mpr_net_free_msgs(mpr_net net)
     net->bundle = 0;
 }
 
+/* Data ports are unique on a host, so the socket path can be derived by peers that know the
+ * port from the device's metadata without any additional negotiation. Sockets are kept in a
+ * directory that only the current user can access, so devices run by other users fall back to
+ * UDP. */
+void mpr_net_get_unix_path(char *path, int len, int port)
+{
+#ifdef HAVE_SYS_UN_H
+    snprintf(path, len, "/tmp/libmapper-%u/%d", (unsigned)getuid(), port);
+#else
+    snprintf(path, len, "libmapper.%d", port);
+#endif
+}
+
+#ifdef HAVE_SYS_UN_H
+int mpr_net_prepare_unix_path(const char *path)
+{
+    struct stat st;
+    char dir[108], *sep;
+    uid_t uid = getuid();
+    snprintf(dir, 108, "%s", path);
+    RETURN_ARG_UNLESS(sep = strrchr(dir, '/'), 0);
+    *sep = 0;
+    if (mkdir(dir, 0700) && EEXIST != errno)
+        return 0;
+    /* refuse a directory that belongs to another user or that others can write to */
+    if (lstat(dir, &st) || !S_ISDIR(st.st_mode) || st.st_uid != uid || (st.st_mode & 022)) {
+        trace_net("not using Unix sockets, %s is not a private directory\n", dir);
+        return 0;
+    }
+    if (0 == lstat(path, &st)) {
+        /* the port is ours, so a socket of ours at this path was left by a device that crashed */
+        RETURN_ARG_UNLESS(S_ISSOCK(st.st_mode) && st.st_uid == uid, 0);
+        unlink(path);
+    }
+    return 1;
+}
+#endif
+
+void mpr_net_queue_udp(mpr_net net, mpr_link link, mpr_bundle b)
+{
+    if (net->udp_queue.num >= net->udp_queue.size) {
+        net->udp_queue.size = net->udp_queue.size ? net->udp_queue.size * 2 : 16;
+        net->udp_queue.links = realloc(net->udp_queue.links,
+                                       net->udp_queue.size * sizeof(mpr_link));
+        net->udp_queue.bundles = realloc(net->udp_queue.bundles,
+                                         net->udp_queue.size * sizeof(mpr_bundle));
+    }
+    net->udp_queue.links[net->udp_queue.num] = link;
+    net->udp_queue.bundles[net->udp_queue.num] = b;
+    ++net->udp_queue.num;
+    b->queued = 1;
+}
+
+void mpr_net_flush_udp(mpr_net net)
+{
+    int i, num = net->udp_queue.num, fd;
+    mpr_link *links = net->udp_queue.links;
+    mpr_bundle *bundles = net->udp_queue.bundles;
+    RETURN_UNLESS(num);
+    fd = lo_server_get_socket_fd(net->servers[SERVER_UDP]);
+#ifdef HAVE_SENDMMSG
+    {
+        /* send bundles for all links from the data port with one system call per batch */
+        struct mmsghdr msgs[SEND_BATCH];
+        struct iovec iovs[SEND_BATCH];
+        int j, batch, sent;
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < num; i += sent) {
+            batch = num - i < SEND_BATCH ? num - i : SEND_BATCH;
+            for (j = 0; j < batch; j++) {
+                iovs[j].iov_base = bundles[i + j]->buf;
+                iovs[j].iov_len = bundles[i + j]->len;
+                msgs[j].msg_hdr.msg_iov = &iovs[j];
+                msgs[j].msg_hdr.msg_iovlen = 1;
+                msgs[j].msg_hdr.msg_name = links[i + j]->addr.udp_raw->ai_addr;
+                msgs[j].msg_hdr.msg_namelen = links[i + j]->addr.udp_raw->ai_addrlen;
+            }
+            sent = sendmmsg(fd, msgs, batch, 0);
+            if (sent <= 0) {
+                /* skip the bundle that could not be sent */
+                trace_net("error sending bundle to device '%s'\n",
+                          links[i]->devs[REMOTE_DEV]->name);
+                sent = 1;
+            }
+            else {
+                /* each bundle after the first saved a system call for the device sending it */
+                for (j = 1; j < sent; j++)
+                    ++((mpr_local_dev)links[i + j]->devs[LOCAL_DEV])->syscalls_saved;
+            }
+        }
+    }
+#else
+    for (i = 0; i < num; i++) {
+        if (sendto(fd, bundles[i]->buf, bundles[i]->len, 0, links[i]->addr.udp_raw->ai_addr,
+                   links[i]->addr.udp_raw->ai_addrlen) < 0)
+            trace_net("error sending bundle to device '%s'\n",
+                      links[i]->devs[REMOTE_DEV]->name);
+    }
+#endif
+    for (i = 0; i < num; i++)
+        bundles[i]->len = bundles[i]->count = bundles[i]->queued = 0;
+    net->udp_queue.num = 0;
+}
+
 /*! Free the memory allocated by a network structure.
  *  \param net      A network structure handle. */
 void mpr_net_free(mpr_net net)
@@ -529,6 +645,8 @@ void mpr_net_free(mpr_net net)
     FUNC_IF(lo_server_free, net->servers[SERVER_MESH]);
     FUNC_IF(lo_address_free, net->addr.bus);
     FUNC_IF(free, net->addr.url);
+    FUNC_IF(free, net->udp_queue.links);
+    FUNC_IF(free, net->udp_queue.bundles);
 }
 
 /*! Probe the network to see if a device's proposed name.ordinal is available. */
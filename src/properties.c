@@ -81,6 +81,8 @@ const char* mpr_protocol_strings[] =
     NULL,           /* MPR_PROTO_UNDEFINED */
     "osc.udp",      /* MPR_PROTO_UDP */
     "osc.tcp",      /* MPR_PROTO_TCP */
+    "osc.shm",      /* MPR_PROTO_SHM */
+    "osc.unix",     /* MPR_PROTO_UNIX */
 };
 
 const char *mpr_steal_strings[] =
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <zlib.h>
 
 #include <lo/lo.h>
 
@@ -19,17 +20,43 @@ static int _is_map_in_scope(mpr_local_map map, mpr_id id)
     return 0;
 }
 
-static mpr_rtr_sig _find_rtr_sig(mpr_rtr rtr, mpr_local_sig sig)
+#define MIN_NUM_BUCKETS 16
+
+MPR_INLINE static unsigned long _hash_path(const char *path)
+{
+    return crc32(0L, (const Bytef *)path, strlen(path));
+}
+
+/* Rebuild the path hash table with num_buckets buckets, which must be a power of two. */
+static void _rehash(mpr_rtr rtr, int num_buckets)
 {
     mpr_rtr_sig rs = rtr->sigs;
-    while (rs && rs->sig != sig)
+    free(rtr->buckets);
+    rtr->buckets = calloc(1, sizeof(mpr_rtr_sig) * num_buckets);
+    rtr->num_buckets = num_buckets;
+    while (rs) {
+        mpr_rtr_sig *bucket = &rtr->buckets[rs->path_hash & (num_buckets - 1)];
+        rs->hash_next = *bucket;
+        *bucket = rs;
         rs = rs->next;
+    }
+}
+
+mpr_rtr_sig mpr_rtr_find_sig_by_path(mpr_rtr rtr, const char *path)
+{
+    unsigned long hash;
+    mpr_rtr_sig rs;
+    RETURN_ARG_UNLESS(rtr->num_buckets, 0);
+    hash = _hash_path(path);
+    rs = rtr->buckets[hash & (rtr->num_buckets - 1)];
+    while (rs && (rs->path_hash != hash || strcmp(rs->sig->path, path)))
+        rs = rs->hash_next;
     return rs;
 }
 
 void mpr_rtr_remove_inst(mpr_rtr rtr, mpr_local_sig sig, int inst_idx) {
     int i;
-    mpr_rtr_sig rs = _find_rtr_sig(rtr, sig);
+    mpr_rtr_sig rs = sig->rsig;
     RETURN_UNLESS(rs);
     for (i = 0; i < rs->num_slots; i++)
         mpr_slot_remove_inst(rs->slots[i], inst_idx);
@@ -40,7 +67,7 @@ void mpr_rtr_num_inst_changed(mpr_rtr rtr, mpr_local_sig sig, int size)
 {
     int i;
     /* check if we have a reference to this signal */
-    mpr_rtr_sig rs = _find_rtr_sig(rtr, sig);
+    mpr_rtr_sig rs = sig->rsig;
     RETURN_UNLESS(rs);
 
     /* for array of slots, may need to reallocate destination instances */
@@ -82,7 +109,6 @@ static void _update_map_count(mpr_rtr rtr)
 void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const void *val, mpr_time t)
 {
     mpr_id_map idmap;
-    lo_message msg;
     mpr_rtr_sig rs;
     mpr_local_map map;
     int i, j, inst_idx;
@@ -96,7 +122,7 @@ void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const vo
     idmap = sig->idmaps[idmap_idx].map;
 
     /* find the router signal */
-    rs = _find_rtr_sig(rtr, sig);
+    rs = sig->rsig;
     RETURN_UNLESS(rs);
 
     inst_idx = sig->idmaps[idmap_idx].inst->idx;
@@ -139,8 +165,7 @@ void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const vo
                     continue;
 
                 if (slot->dir == MPR_DIR_IN) {
-                    msg = mpr_map_build_msg(map, slot, 0, 0, idmap);
-                    mpr_link_add_msg(slot->link, slot->sig, msg, t, map->protocol, bundle_idx);
+                    mpr_map_add_msg(map, slot, 0, 0, idmap, slot->link, slot->sig, t, bundle_idx);
                 }
             }
 
@@ -152,12 +177,9 @@ void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const vo
 
             /* send release to downstream */
             if (slot->dir == MPR_DIR_OUT) {
-                msg = 0;
-                if (in_scope) {
-                    msg = mpr_map_build_msg(map, slot, 0, 0, idmap);
-                    mpr_link_add_msg(dst_slot->link, dst_slot->sig, msg, t, map->protocol,
-                                     bundle_idx);
-                }
+                if (in_scope)
+                    mpr_map_add_msg(map, slot, 0, 0, idmap, dst_slot->link, dst_slot->sig, t,
+                                    bundle_idx);
             }
         }
         *lock = 0;
@@ -192,8 +214,8 @@ void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const vo
             /* bypass map processing and bundle value without type coercion */
             char *types = alloca(sig->len * sizeof(char));
             memset(types, sig->type, sig->len);
-            msg = mpr_map_build_msg(map, slot, val, types, sig->use_inst ? idmap : 0);
-            mpr_link_add_msg(map->dst->link, map->dst->sig, msg, t, map->protocol, bundle_idx);
+            mpr_map_add_msg(map, slot, val, types, sig->use_inst ? idmap : 0, map->dst->link,
+                            map->dst->sig, t, bundle_idx);
             continue;
         }
 
@@ -218,7 +240,7 @@ void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const vo
                 continue;
             inst_idx = idmaps[idmap_idx].inst->idx;
             set_bitflag(map->updated_inst, inst_idx);
-            map->updated = 1;
+            mpr_dev_queue_map(rtr->dev, map, 0);
             if (!all)
                 break;
         }
@@ -226,10 +248,141 @@ void mpr_rtr_process_sig(mpr_rtr rtr, mpr_local_sig sig, int idmap_idx, const vo
     *lock = 0;
 }
 
+void mpr_rtr_process_sig_insts(mpr_rtr rtr, mpr_local_sig sig, int num, const int *idmap_idxs,
+                               mpr_time t)
+{
+    mpr_rtr_sig rs;
+    mpr_local_map map;
+    mpr_sig_inst si;
+    int i, j, k, updated;
+    uint8_t bundle_idx;
+
+    /* abort if signal is already being processed - might be a local loop */
+    if (sig->locked) {
+        trace_dev(rtr->dev, "Mapping loop detected on signal %s! (1)\n", sig->name);
+        return;
+    }
+    rs = sig->rsig;
+    RETURN_UNLESS(rs);
+
+    bundle_idx = rtr->dev->bundle_idx % NUM_BUNDLES;
+    rtr->dev->sending = 1;
+    sig->locked = 1;
+
+    for (i = 0; i < rs->num_slots; i++) {
+        mpr_local_slot slot = rs->slots[i];
+        mpr_local_sig src_sig = sig;
+        char *types = 0;
+        int all;
+        if (!slot || slot->dir == MPR_DIR_IN)
+            continue;
+        map = slot->map;
+        if (map->status < MPR_STATUS_ACTIVE)
+            continue;
+
+        /* If this signal is non-instanced but the map has other instanced
+         * sources we will need to update all of the active map instances. */
+        all = (!sig->use_inst && map->num_src > 1 && map->num_inst > 1);
+        updated = 0;
+
+        for (k = 0; k < num; k++) {
+            struct _mpr_sig_idmap *idmap = &sig->idmaps[idmap_idxs[k]];
+            /* TODO: should we continue for out-of-scope local destination updates? */
+            if (map->use_inst && !_is_map_in_scope(map, idmap->map->GID))
+                continue;
+            si = idmap->inst;
+
+            if (MPR_LOC_DST == map->process_loc) {
+                /* bypass map processing and bundle value without type coercion */
+                if (!types) {
+                    types = alloca(sig->len * sizeof(char));
+                    memset(types, sig->type, sig->len);
+                }
+                mpr_map_add_msg(map, slot, si->val, types, sig->use_inst ? idmap->map : 0,
+                                map->dst->link, map->dst->sig, t, bundle_idx);
+                continue;
+            }
+
+            /* copy input value */
+            mpr_value_set_sample(&slot->val, si->idx, si->val, t);
+
+            if (!slot->causes_update)
+                continue;
+            if (!all)
+                set_bitflag(map->updated_inst, si->idx);
+            updated = 1;
+        }
+        if (!updated)
+            continue;
+
+        if (all) {
+            /* find a source signal with more instances and update all of its active instances */
+            for (j = 0; j < map->num_src; j++)
+                if (map->src[j]->sig->is_local && map->src[j]->num_inst > slot->num_inst)
+                    src_sig = (mpr_local_sig)map->src[j]->sig;
+            for (j = 0; j < src_sig->idmap_len; j++) {
+                if (src_sig->idmaps[j].inst)
+                    set_bitflag(map->updated_inst, src_sig->idmaps[j].inst->idx);
+            }
+        }
+        mpr_dev_queue_map(rtr->dev, map, 0);
+    }
+    sig->locked = 0;
+}
+
+#define RANK_UNKNOWN    -1
+#define RANK_VISITING   -2
+
+/* Return the length of the longest chain of local maps feeding the local sources of a map.
+ * The chain is followed upstream through maps with the same signal as their destination. */
+static int _rank_map(mpr_local_map map)
+{
+    int i, j, rank = 0, up;
+    if (RANK_VISITING == map->rank) {
+        /* this map is part of a loop */
+        return -1;
+    }
+    RETURN_ARG_UNLESS(RANK_UNKNOWN == map->rank, map->rank);
+    map->rank = RANK_VISITING;
+    for (i = 0; i < map->num_src; i++) {
+        mpr_rtr_sig rs = map->src[i]->rsig;
+        if (!map->src[i]->sig->is_local || !rs)
+            continue;
+        for (j = 0; j < rs->num_slots; j++) {
+            mpr_local_slot slot = rs->slots[j];
+            if (!slot || slot->dir != MPR_DIR_IN || slot->map == map)
+                continue;
+            up = _rank_map(slot->map) + 1;
+            if (up > rank)
+                rank = up;
+        }
+    }
+    map->rank = rank;
+    return rank;
+}
+
+void mpr_rtr_rank_maps(mpr_rtr rtr)
+{
+    int i;
+    mpr_rtr_sig rs;
+    for (rs = rtr->sigs; rs; rs = rs->next) {
+        for (i = 0; i < rs->num_slots; i++) {
+            if (rs->slots[i])
+                rs->slots[i]->map->rank = RANK_UNKNOWN;
+        }
+    }
+    for (rs = rtr->sigs; rs; rs = rs->next) {
+        for (i = 0; i < rs->num_slots; i++) {
+            if (rs->slots[i])
+                _rank_map(rs->slots[i]->map);
+        }
+    }
+    rtr->ranks_dirty = 0;
+}
+
 static mpr_rtr_sig _add_rtr_sig(mpr_rtr rtr, mpr_local_sig sig)
 {
-    /* find signal in rtr_sig list */
-    mpr_rtr_sig rs = _find_rtr_sig(rtr, sig);
+    mpr_rtr_sig rs = sig->rsig;
 
     /* if not found, create a new list entry */
     if (!rs) {
@@ -240,6 +393,17 @@ static mpr_rtr_sig _add_rtr_sig(mpr_rtr rtr, mpr_local_sig sig)
         rs->slots[0] = 0;
         rs->next = rtr->sigs;
         rtr->sigs = rs;
+        sig->rsig = rs;
+
+        /* add to the path hash table, growing it to keep chains short */
+        rs->path_hash = _hash_path(sig->path);
+        if (++rtr->num_sigs > rtr->num_buckets)
+            _rehash(rtr, rtr->num_buckets ? rtr->num_buckets * 2 : MIN_NUM_BUCKETS);
+        else {
+            mpr_rtr_sig *bucket = &rtr->buckets[rs->path_hash & (rtr->num_buckets - 1)];
+            rs->hash_next = *bucket;
+            *bucket = rs;
+        }
     }
     return rs;
 }
@@ -393,6 +557,7 @@ void mpr_rtr_add_map(mpr_rtr rtr, mpr_local_map map)
         map->dst->link = map->src[0]->link;
     }
 
+    rtr->ranks_dirty = 1;
     _update_map_count(rtr);
 }
 
@@ -435,10 +600,20 @@ void mpr_rtr_remove_sig(mpr_rtr rtr, mpr_rtr_sig rs)
 {
     if (rtr && rs) {
         /* No maps remaining – we can remove the rtr_sig also */
-        mpr_rtr_sig *rstemp = &rtr->sigs;
+        mpr_rtr_sig *rstemp = &rtr->buckets[rs->path_hash & (rtr->num_buckets - 1)];
+        while (*rstemp) {
+            if (*rstemp == rs) {
+                *rstemp = rs->hash_next;
+                break;
+            }
+            rstemp = &(*rstemp)->hash_next;
+        }
+        rstemp = &rtr->sigs;
         while (*rstemp) {
             if (*rstemp == rs) {
                 *rstemp = rs->next;
+                rs->sig->rsig = 0;
+                --rtr->num_sigs;
                 free(rs->slots);
                 free(rs);
                 break;
@@ -448,6 +623,18 @@ void mpr_rtr_remove_sig(mpr_rtr rtr, mpr_rtr_sig rs)
     }
 }
 
+void mpr_rtr_free(mpr_rtr rtr)
+{
+    while (rtr->sigs) {
+        mpr_rtr_sig rs = rtr->sigs;
+        rtr->sigs = rs->next;
+        free(rs->slots);
+        free(rs);
+    }
+    FUNC_IF(free, rtr->buckets);
+    free(rtr);
+}
+
 int mpr_rtr_remove_map(mpr_rtr rtr, mpr_local_map map)
 {
     /* do not free local names since they point to signal's copy */
@@ -456,12 +643,14 @@ int mpr_rtr_remove_map(mpr_rtr rtr, mpr_local_map map)
     mpr_time t;
     RETURN_ARG_UNLESS(map, 1);
     mpr_time_set(&t, MPR_NOW);
+    mpr_dev_dequeue_map(rtr->dev, map);
+    rtr->ranks_dirty = 1;
 
     if (map->idmap) {
         /* release map-generated instances */
         if (map->dst->rsig) {
             lo_message msg = mpr_map_build_msg(map, 0, 0, 0, map->idmap);
-            mpr_dev_bundle_start(t, NULL);
+            mpr_dev_bundle_start(t, rtr->dev);
             mpr_dev_handler(NULL, lo_message_get_types(msg), lo_message_get_argv(msg),
                             lo_message_get_argc(msg), msg, (void*)map->dst->sig);
         }
@@ -482,7 +671,7 @@ int mpr_rtr_remove_map(mpr_rtr rtr, mpr_local_map map)
                 continue;
             if (maps[i].status & RELEASED_LOCALLY) {
                 mpr_dev_GID_decref(rtr->dev, sig->group, maps[i].map);
-                maps[i].map = 0;
+                mpr_sig_clear_idmap_map(sig, i);
             }
             else {
                 maps[i].status |= RELEASED_REMOTELY;
@@ -494,9 +683,9 @@ int mpr_rtr_remove_map(mpr_rtr rtr, mpr_local_map map)
                 }
                 else {
                     mpr_dev_LID_decref(rtr->dev, sig->group, maps[i].map);
-                    maps[i].map = 0;
+                    mpr_sig_clear_idmap_map(sig, i);
                     maps[i].inst->active = 0;
-                    maps[i].inst = 0;
+                    mpr_sig_clear_idmap_inst(sig, i);
                 }
             }
         }
@@ -556,7 +745,7 @@ int mpr_rtr_loop_check(mpr_rtr rtr, mpr_local_sig sig, int num_remotes, const ch
     int i, j;
     mpr_local_map map;
     mpr_local_slot slot;
-    mpr_rtr_sig rs = _find_rtr_sig(rtr, sig);
+    mpr_rtr_sig rs = sig->rsig;
     RETURN_ARG_UNLESS(rs, 0);
     for (i = 0; i < rs->num_slots; i++) {
         if (!rs->slots[i] || rs->slots[i]->dir == MPR_DIR_IN)
@@ -579,7 +768,7 @@ mpr_local_slot mpr_rtr_get_slot(mpr_rtr rtr, mpr_local_sig sig, int slot_id)
     int i, j;
     mpr_local_map map;
     /* only interested in incoming slots */
-    mpr_rtr_sig rs = _find_rtr_sig(rtr, sig);
+    mpr_rtr_sig rs = sig->rsig;
     RETURN_ARG_UNLESS(rs, NULL);
     for (i = 0; i < rs->num_slots; i++) {
         if (!rs->slots[i] || sig->dir != rs->slots[i]->dir)
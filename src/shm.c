@@ -0,0 +1,259 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_SHM_OPEN)
+ #define MPR_HAVE_SHM
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+#include "mapper_internal.h"
+#include "types_internal.h"
+#include <mapper/mapper.h>
+
+#ifdef MPR_HAVE_SHM
+
+/* Size of the data area of each ring, a power of two. */
+#define SHM_RING_SIZE   (1 << 20)
+#define SHM_RING_MASK   (SHM_RING_SIZE - 1)
+#define SHM_WRAP        0xFFFFFFFF
+#define SHM_CACHE_LINE  64
+
+#define SHM_CONSUMER_CLOSED 1
+#define SHM_PRODUCER_CLOSED 2
+
+/* Layout of the shared segment. A newly created segment is zero-filled, which is a valid empty
+ * ring with no consumer attached. The producer and consumer indices are free-running byte
+ * counts and are kept on separate cache lines.
+ *
+ * Only the consumer creates the segment. The producer attaches to it by name and then removes
+ * the name, so that the segment is freed by the system once both ends have unmapped it, even if
+ * one of them crashes. When one end closes the ring the other stops using it: the producer waits
+ * for a new segment to appear and the consumer creates one. */
+typedef struct _shm_ring {
+    volatile uint32_t head;         /*!< Written by the producer only. */
+    char pad1[SHM_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t tail;         /*!< Written by the consumer only. */
+    char pad2[SHM_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t attached;     /*!< Non-zero while a consumer is reading the ring. */
+    volatile uint32_t waiting;      /*!< Non-zero while the consumer is about to block. */
+    volatile uint32_t closed;       /*!< SHM_CONSUMER_CLOSED and SHM_PRODUCER_CLOSED flags. */
+    volatile uint32_t unlinked;     /*!< Non-zero once the name of the segment is removed. */
+    char pad3[SHM_CACHE_LINE - 4 * sizeof(uint32_t)];
+    char data[SHM_RING_SIZE];
+} shm_ring_t, *shm_ring;
+
+struct _mpr_shm {
+    shm_ring ring;                  /*!< Zero while a producer waits for a consumer. */
+    char *name;
+    uint32_t read_len;              /*!< Length of the record returned by mpr_shm_peek(). */
+    int is_consumer;
+    time_t attempt;                 /*!< Time of the last attempt to attach a producer. */
+};
+
+#define ALIGN4(N) (((N) + 3) & ~3)
+
+/* Create the segment if create is non-zero, otherwise open an existing one, and map it. */
+static shm_ring _map(const char *name, int create)
+{
+    void *ptr;
+    struct stat st;
+    int fd;
+    if (create) {
+        /* replace any segment left behind by a consumer that did not close it */
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        RETURN_ARG_UNLESS(fd >= 0, 0);
+        if (ftruncate(fd, sizeof(shm_ring_t))) {
+            close(fd);
+            shm_unlink(name);
+            return 0;
+        }
+    }
+    else {
+        fd = shm_open(name, O_RDWR, 0);
+        RETURN_ARG_UNLESS(fd >= 0, 0);
+        /* the consumer may not have sized the segment yet */
+        if (fstat(fd, &st) || st.st_size != sizeof(shm_ring_t)) {
+            close(fd);
+            return 0;
+        }
+    }
+    ptr = mmap(0, sizeof(shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == ptr) {
+        if (create)
+            shm_unlink(name);
+        return 0;
+    }
+    return (shm_ring)ptr;
+}
+
+/* Remove the name of the segment, unless the other end has already done so. */
+static void _unlink(mpr_shm shm)
+{
+    if (!__atomic_exchange_n(&shm->ring->unlinked, 1, __ATOMIC_SEQ_CST))
+        shm_unlink(shm->name);
+}
+
+/* Attach a producer to the segment created by the consumer, trying at most once a second. */
+static shm_ring _attach(mpr_shm shm)
+{
+    time_t now = time(NULL);
+    RETURN_ARG_UNLESS(now != shm->attempt, 0);
+    shm->attempt = now;
+    shm->ring = _map(shm->name, 0);
+    RETURN_ARG_UNLESS(shm->ring, 0);
+    /* both ends have mapped the segment so its name is no longer needed */
+    _unlink(shm);
+    return shm->ring;
+}
+
+/* Replace a ring whose producer has closed it with a new segment for the next producer. */
+static void _renew(mpr_shm shm)
+{
+    shm_ring r = _map(shm->name, 1);
+    RETURN_UNLESS(r);
+    munmap(shm->ring, sizeof(shm_ring_t));
+    shm->ring = r;
+    __atomic_store_n(&r->attached, 1, __ATOMIC_SEQ_CST);
+}
+
+mpr_shm mpr_shm_open(const char *name, int is_consumer)
+{
+    mpr_shm shm;
+    shm_ring r = 0;
+    if (is_consumer && !(r = _map(name, 1)))
+        return 0;
+
+    shm = (mpr_shm)calloc(1, sizeof(struct _mpr_shm));
+    shm->ring = r;
+    shm->name = strdup(name);
+    shm->is_consumer = is_consumer;
+    if (is_consumer)
+        __atomic_store_n(&r->attached, 1, __ATOMIC_SEQ_CST);
+    else
+        _attach(shm);
+    return shm;
+}
+
+void mpr_shm_close(mpr_shm shm)
+{
+    RETURN_UNLESS(shm);
+    if (shm->ring) {
+        if (shm->is_consumer) {
+            __atomic_store_n(&shm->ring->attached, 0, __ATOMIC_SEQ_CST);
+            __atomic_or_fetch(&shm->ring->closed, SHM_CONSUMER_CLOSED, __ATOMIC_SEQ_CST);
+            /* no producer has attached and removed the name yet */
+            _unlink(shm);
+        }
+        else
+            __atomic_or_fetch(&shm->ring->closed, SHM_PRODUCER_CLOSED, __ATOMIC_SEQ_CST);
+        munmap(shm->ring, sizeof(shm_ring_t));
+    }
+    free(shm->name);
+    free(shm);
+}
+
+int mpr_shm_write(mpr_shm shm, const char *data, int len, int *wake)
+{
+    shm_ring r = shm->ring;
+    uint32_t head, tail, pos, need = 4 + ALIGN4(len), skip;
+    if (r && (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE) & SHM_CONSUMER_CLOSED)) {
+        /* the consumer has gone, wait for the segment of the next one */
+        munmap(r, sizeof(shm_ring_t));
+        r = shm->ring = 0;
+    }
+    RETURN_ARG_UNLESS(r || (r = _attach(shm)), 0);
+    RETURN_ARG_UNLESS(__atomic_load_n(&r->attached, __ATOMIC_ACQUIRE), 0);
+    head = r->head;
+    tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    pos = head & SHM_RING_MASK;
+
+    /* records are contiguous, so skip to the start if there is not enough space at the end */
+    skip = (SHM_RING_SIZE - pos < need) ? SHM_RING_SIZE - pos : 0;
+    RETURN_ARG_UNLESS(need + skip <= SHM_RING_SIZE - (head - tail), 0);
+    if (skip) {
+        *(uint32_t*)(r->data + pos) = SHM_WRAP;
+        head += skip;
+        pos = 0;
+    }
+    *(uint32_t*)(r->data + pos) = len;
+    memcpy(r->data + pos + 4, data, len);
+    __atomic_store_n(&r->head, head + need, __ATOMIC_SEQ_CST);
+
+    /* wake the consumer if it is about to block on its sockets */
+    *wake = __atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST)
+            && __atomic_exchange_n(&r->waiting, 0, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+char *mpr_shm_peek(mpr_shm shm, int *len)
+{
+    shm_ring r = shm->ring;
+    uint32_t tail = r->tail, head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE), pos, avail;
+    *len = 0;
+    if (tail == head) {
+        if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE) & SHM_PRODUCER_CLOSED)
+            _renew(shm);
+        return 0;
+    }
+    avail = head - tail;
+    pos = tail & SHM_RING_MASK;
+    if (SHM_WRAP == *(uint32_t*)(r->data + pos)) {
+        /* the producer always publishes a record together with a wrap marker */
+        if (SHM_RING_SIZE - pos >= avail) {
+            *len = -1;
+            return 0;
+        }
+        avail -= SHM_RING_SIZE - pos;
+        tail += SHM_RING_SIZE - pos;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+        pos = 0;
+    }
+    shm->read_len = *(uint32_t*)(r->data + pos);
+    /* the segment is writable by any process of this user, so do not trust the length */
+    if (   avail > SHM_RING_SIZE || shm->read_len < 8 || shm->read_len > MAX_UDP_BUNDLE_LEN
+        || shm->read_len > SHM_RING_SIZE - pos - 4 || 4 + ALIGN4(shm->read_len) > avail) {
+        *len = -1;
+        return 0;
+    }
+    *len = shm->read_len;
+    return r->data + pos + 4;
+}
+
+void mpr_shm_release(mpr_shm shm)
+{
+    shm_ring r = shm->ring;
+    __atomic_store_n(&r->tail, r->tail + 4 + ALIGN4(shm->read_len), __ATOMIC_RELEASE);
+}
+
+int mpr_shm_prepare_wait(mpr_shm shm)
+{
+    shm_ring r = shm->ring;
+    __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+    return r->tail != __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+}
+
+void mpr_shm_end_wait(mpr_shm shm)
+{
+    __atomic_store_n(&shm->ring->waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+#else /* !MPR_HAVE_SHM */
+
+mpr_shm mpr_shm_open(const char *name, int is_consumer) { return 0; }
+void mpr_shm_close(mpr_shm shm) {}
+int mpr_shm_write(mpr_shm shm, const char *data, int len, int *wake) { return 0; }
+char *mpr_shm_peek(mpr_shm shm, int *len) { return 0; }
+void mpr_shm_release(mpr_shm shm) {}
+int mpr_shm_prepare_wait(mpr_shm shm) { return 0; }
+void mpr_shm_end_wait(mpr_shm shm) {}
+
+#endif /* MPR_HAVE_SHM */
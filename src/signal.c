@@ -10,13 +10,37 @@
 
 #define MAX_INSTANCES 128
 #define BUFFSIZE 512
+#define QUEUE_CACHE_LINE 64
+
+#define ALIGN8(N) (((N) + 7) & ~7)
 
 /* TODO: MPR_DEFAULT_INST is actually a valid id - we should use
  * another method for distinguishing non-instanced updates. */
 #define MPR_DEFAULT_INST -1
 
+/* Single-producer, single-consumer queue of updates pushed from another thread. The producer
+ * only writes records and the head index, and the device only reads records and advances the
+ * tail, so neither side needs to lock. Each record has room for a vector of 8-byte elements. */
+typedef struct _mpr_sig_queue {
+    volatile uint32_t head;         /*!< Written by the producer only. */
+    char pad1[QUEUE_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t tail;         /*!< Written by the polling thread only. */
+    char pad2[QUEUE_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t mask;                  /*!< Number of records minus one. */
+    int rec_size;
+    char *recs;
+} mpr_sig_queue_t, *mpr_sig_queue;
+
+typedef struct _queue_rec {
+    mpr_id id;
+    mpr_time time;
+    int len;                        /*!< Length of the value, or zero to release the instance. */
+    mpr_type type;
+} queue_rec_t, *queue_rec;
+
 /* Function prototypes */
 static int _add_idmap(mpr_local_sig lsig, mpr_sig_inst si, mpr_id_map map);
+static int _find_idmap(mpr_local_sig lsig, int key, mpr_id id);
 
 static int _compare_inst_ids(const void *l, const void *r)
 {
@@ -117,6 +141,7 @@ void mpr_sig_init(mpr_sig sig, mpr_dir dir, const char *name, int len, mpr_type
         /* Reserve one instance id map */
         lsig->idmap_len = 1;
         lsig->idmaps = calloc(1, sizeof(struct _mpr_sig_idmap));
+        lsig->idmap_buckets = calloc(2, sizeof(int));
     }
     else
         sig->obj.props.staged = mpr_tbl_new();
@@ -185,6 +210,7 @@ void mpr_sig_free(mpr_sig sig)
     mpr_local_sig lsig = (mpr_local_sig)sig;
     mpr_rtr rtr;
     mpr_rtr_sig rs;
+    mpr_list links;
     RETURN_UNLESS(sig && sig->is_local);
     ldev = (mpr_local_dev)sig->dev;
 
@@ -198,10 +224,7 @@ void mpr_sig_free(mpr_sig sig)
     mpr_dev_remove_sig_methods(ldev, lsig);
     net = &sig->obj.graph->net;
     rtr = net->rtr;
-    rs = rtr->sigs;
-    while (rs && rs->sig != lsig)
-        rs = rs->next;
-    if (rs) {
+    if ((rs = lsig->rsig)) {
         mpr_local_map map;
         /* need to unmap */
         for (i = 0; i < rs->num_slots; i++) {
@@ -212,6 +235,12 @@ void mpr_sig_free(mpr_sig sig)
             mpr_rtr_remove_map(rtr, map);
         }
         mpr_rtr_remove_sig(rtr, rs);
+        /* drop updates still queued for this signal by maps between local devices */
+        links = mpr_list_from_data(sig->obj.graph->links);
+        while (links) {
+            mpr_link_remove_local_sig((mpr_link)*links, lsig);
+            links = mpr_list_get_next(links);
+        }
     }
     if (ldev->registered) {
         /* Notify subscribers */
@@ -219,7 +248,14 @@ void mpr_sig_free(mpr_sig sig)
         mpr_net_use_subscribers(net, ldev, dir);
         mpr_sig_send_removed(lsig);
     }
-    free(lsig->updated_inst);
+    if (lsig->queue) {
+        /* stop draining the queue of this signal */
+        mpr_local_sig *qs = &ldev->queued_sigs;
+        while (*qs && *qs != lsig)
+            qs = &(*qs)->queue_next;
+        if (*qs)
+            *qs = lsig->queue_next;
+    }
     mpr_graph_remove_sig(sig->obj.graph, sig, MPR_OBJ_REM);
     mpr_obj_increment_version((mpr_obj)ldev);
 }
@@ -235,14 +271,23 @@ void mpr_sig_free_internal(mpr_sig sig)
             if (lsig->idmaps[i].inst)
                 mpr_sig_release_inst_internal(lsig, i);
         }
+        /* instances released above mark themselves as updated */
+        FUNC_IF(free, lsig->updated_inst);
         free(lsig->idmaps);
+        free(lsig->idmap_buckets);
+        FUNC_IF(free, lsig->inst_idmaps);
         for (i = 0; i < lsig->num_inst; i++) {
             FUNC_IF(free, lsig->inst[i]->val);
             FUNC_IF(free, lsig->inst[i]->has_val_flags);
             free(lsig->inst[i]);
         }
         free(lsig->inst);
+        FUNC_IF(free, lsig->inst_by_idx);
         FUNC_IF(free, lsig->vec_known);
+        if (lsig->queue) {
+            free(lsig->queue->recs);
+            free(lsig->queue);
+        }
     }
 
     FUNC_IF(mpr_tbl_free, sig->obj.props.synced);
@@ -266,6 +311,7 @@ void mpr_sig_call_handler(mpr_local_sig lsig, int evt, mpr_id inst, int len,
     if (!val && !lsig->use_inst)
         return;
     mpr_sig_update_timing_stats(lsig, diff);
+    ((mpr_local_dev)lsig->dev)->sig_events = 1;
     h = (mpr_sig_handler*)lsig->handler;
     if (h && (evt & lsig->event_flags))
         h((mpr_sig)lsig, evt, lsig->use_inst ? inst : 0, len, lsig->type, val, *time);
@@ -273,22 +319,31 @@ void mpr_sig_call_handler(mpr_local_sig lsig, int evt, mpr_id inst, int len,
 
 /**** Instances ****/
 
-static void _init_inst(mpr_sig_inst si)
+static void _init_inst(mpr_sig_inst si, int active)
 {
+    mpr_sig_inst_begin_write(si);
+    si->active = active;
     si->has_val = 0;
     mpr_time_set(&si->created, MPR_NOW);
     mpr_time_set(&si->time, si->created);
+    mpr_sig_inst_end_write(si);
 }
 
 static mpr_sig_inst _reserved_inst(mpr_local_sig lsig, mpr_id *id)
 {
     int i;
+    mpr_sig_inst si;
     for (i = 0; i < lsig->num_inst; i++) {
-        if (!lsig->inst[i]->active) {
-            if (id)
-                lsig->inst[i]->id = *id;
+        si = lsig->inst[i];
+        if (!si->active) {
+            if (id) {
+                mpr_sig_inst_begin_write(si);
+                si->id = *id;
+                mpr_sig_inst_end_write(si);
+            }
+            /* sorting moves the instance to another index */
             qsort(lsig->inst, lsig->num_inst, sizeof(mpr_sig_inst), _compare_inst_ids);
-            return lsig->inst[i];
+            return si;
         }
     }
     return 0;
@@ -360,19 +415,15 @@ mpr_id mpr_sig_get_newest_inst_id(mpr_sig sig)
 
 int mpr_sig_get_idmap_with_LID(mpr_local_sig lsig, mpr_id LID, int flags, mpr_time t, int activate)
 {
-    mpr_sig_idmap_t *maps;
     mpr_sig_handler *h;
     mpr_sig_inst si;
     mpr_id_map map;
     int i;
     if (!lsig->use_inst)
         LID = MPR_DEFAULT_INST;
-    maps = lsig->idmaps;
     h = (mpr_sig_handler*)lsig->handler;
-    for (i = 0; i < lsig->idmap_len; i++) {
-        if (maps[i].inst && maps[i].map->LID == LID)
-            return (maps[i].status & ~flags) ? -1 : i;
-    }
+    if ((i = _find_idmap(lsig, 0, LID)) >= 0)
+        return (lsig->idmaps[i].status & ~flags) ? -1 : i;
     RETURN_ARG_UNLESS(activate, -1);
 
     /* check if device has record of id map */
@@ -389,8 +440,7 @@ int mpr_sig_get_idmap_with_LID(mpr_local_sig lsig, mpr_id LID, int flags, mpr_ti
             mpr_dev_LID_incref((mpr_local_dev)lsig->dev, map);
 
         /* store pointer to device map in a new signal map */
-        si->active = 1;
-        _init_inst(si);
+        _init_inst(si, 1);
         i = _add_idmap(lsig, si, map);
         if (h && (lsig->event_flags & MPR_SIG_INST_NEW))
             h((mpr_sig)lsig, MPR_SIG_INST_NEW, LID, 0, lsig->type, NULL, t);
@@ -427,8 +477,7 @@ int mpr_sig_get_idmap_with_LID(mpr_local_sig lsig, mpr_id LID, int flags, mpr_ti
         }
         else
             mpr_dev_LID_incref((mpr_local_dev)lsig->dev, map);
-        si->active = 1;
-        _init_inst(si);
+        _init_inst(si, 1);
         i = _add_idmap(lsig, si, map);
         if (h && (lsig->event_flags & MPR_SIG_INST_NEW))
             h((mpr_sig)lsig, MPR_SIG_INST_NEW, LID, 0, lsig->type, NULL, t);
@@ -439,17 +488,13 @@ int mpr_sig_get_idmap_with_LID(mpr_local_sig lsig, mpr_id LID, int flags, mpr_ti
 
 int mpr_sig_get_idmap_with_GID(mpr_local_sig lsig, mpr_id GID, int flags, mpr_time t, int activate)
 {
-    mpr_sig_idmap_t *maps;
     mpr_sig_handler *h;
     mpr_sig_inst si;
     mpr_id_map map;
     int i;
-    maps = lsig->idmaps;
     h = (mpr_sig_handler*)lsig->handler;
-    for (i = 0; i < lsig->idmap_len; i++) {
-        if (maps[i].map && maps[i].map->GID == GID)
-            return (maps[i].status & ~flags) ? -1 : i;
-    }
+    if ((i = _find_idmap(lsig, 1, GID)) >= 0)
+        return (lsig->idmaps[i].status & ~flags) ? -1 : i;
     RETURN_ARG_UNLESS(activate, -1);
 
     /* check if the device already has a map for this global id */
@@ -464,8 +509,7 @@ int mpr_sig_get_idmap_with_GID(mpr_local_sig lsig, mpr_id GID, int flags, mpr_ti
         if ((si = _reserved_inst(lsig, NULL))) {
             map = mpr_dev_add_idmap((mpr_local_dev)lsig->dev, lsig->group, si->id, GID);
             map->GID_refcount = 1;
-            si->active = 1;
-            _init_inst(si);
+            _init_inst(si, 1);
             i = _add_idmap(lsig, si, map);
             if (h && (lsig->event_flags & MPR_SIG_INST_NEW))
                 h((mpr_sig)lsig, MPR_SIG_INST_NEW, si->id, 0, lsig->type, NULL, t);
@@ -474,8 +518,7 @@ int mpr_sig_get_idmap_with_GID(mpr_local_sig lsig, mpr_id GID, int flags, mpr_ti
     }
     else if ((si = _find_inst_by_id(lsig, map->LID)) || (si = _reserved_inst(lsig, &map->LID))) {
         if (!si->active) {
-            si->active = 1;
-            _init_inst(si);
+            _init_inst(si, 1);
             i = _add_idmap(lsig, si, map);
             mpr_dev_LID_incref((mpr_local_dev)lsig->dev, map);
             mpr_dev_GID_incref((mpr_local_dev)lsig->dev, map);
@@ -520,8 +563,7 @@ int mpr_sig_get_idmap_with_GID(mpr_local_sig lsig, mpr_id GID, int flags, mpr_ti
         if ((si = _reserved_inst(lsig, NULL))) {
             map = mpr_dev_add_idmap((mpr_local_dev)lsig->dev, lsig->group, si->id, GID);
             map->GID_refcount = 1;
-            si->active = 1;
-            _init_inst(si);
+            _init_inst(si, 1);
             i = _add_idmap(lsig, si, map);
             if (h && (lsig->event_flags & MPR_SIG_INST_NEW))
                 h((mpr_sig)lsig, MPR_SIG_INST_NEW, si->id, 0, lsig->type, NULL, t);
@@ -532,8 +574,7 @@ int mpr_sig_get_idmap_with_GID(mpr_local_sig lsig, mpr_id GID, int flags, mpr_ti
         si = _find_inst_by_id(lsig, map->LID);
         TRACE_RETURN_UNLESS(si && !si->active, -1, "Signal %s has no instance %"
                             PR_MPR_ID" available.", lsig->name, map->LID);
-        si->active = 1;
-        _init_inst(si);
+        _init_inst(si, 1);
         i = _add_idmap(lsig, si, map);
         mpr_dev_LID_incref((mpr_local_dev)lsig->dev, map);
         mpr_dev_GID_incref((mpr_local_dev)lsig->dev, map);
@@ -556,8 +597,11 @@ static int _reserve_inst(mpr_local_sig lsig, mpr_id *id, void *data)
 
     /* reallocate array of instances */
     lsig->inst = realloc(lsig->inst, sizeof(mpr_sig_inst) * (lsig->num_inst + 1));
+    lsig->inst_idmaps = realloc(lsig->inst_idmaps, sizeof(int) * (lsig->num_inst + 1));
+    lsig->inst_idmaps[lsig->num_inst] = 0;
+    lsig->inst_by_idx = realloc(lsig->inst_by_idx, sizeof(mpr_sig_inst) * (lsig->num_inst + 1));
     lsig->inst[lsig->num_inst] = (mpr_sig_inst) calloc(1, sizeof(struct _mpr_sig_inst));
-    si = lsig->inst[lsig->num_inst];
+    si = lsig->inst_by_idx[lsig->num_inst] = lsig->inst[lsig->num_inst];
     si->val = calloc(1, mpr_sig_get_vector_bytes((mpr_sig)lsig));
     si->has_val_flags = calloc(1, lsig->len / 8 + 1);
     si->has_val = 0;
@@ -581,7 +625,7 @@ static int _reserve_inst(mpr_local_sig lsig, mpr_id *id, void *data)
         si->id = lowest_id;
     }
     si->idx = lsig->num_inst;
-    _init_inst(si);
+    _init_inst(si, 0);
     si->data = data;
 
     if (++lsig->num_inst > 1) {
@@ -660,17 +704,52 @@ void mpr_sig_update_timing_stats(mpr_local_sig lsig, float diff)
     }
 }
 
-void mpr_sig_set_value(mpr_sig sig, mpr_id id, int len, mpr_type type, const void *val)
+/* Write a value of the signal's length to an instance, activating it if necessary, and mark the
+ * instance as updated. Returns the index of the instance's id map, or -1 if the value contains
+ * NaN or no instance is available. */
+static int _write_value(mpr_local_sig lsig, mpr_id id, mpr_type type, const void *val,
+                        mpr_time time, int update_stats)
 {
-    mpr_time time;
-    int idmap_idx;
-    mpr_local_sig lsig = (mpr_local_sig)sig;
+    int i, idmap_idx;
     mpr_sig_inst si;
-    RETURN_UNLESS(sig && sig->is_local);
-    if (!len || !val) {
-        mpr_sig_release_inst(sig, id);
-        return;
+
+    /* check for NaN */
+    if (type == MPR_FLT) {
+        for (i = 0; i < lsig->len; i++)
+            RETURN_ARG_UNLESS(((float*)val)[i] == ((float*)val)[i], -1);
+    }
+    else if (type == MPR_DBL) {
+        for (i = 0; i < lsig->len; i++)
+            RETURN_ARG_UNLESS(((double*)val)[i] == ((double*)val)[i], -1);
     }
+    idmap_idx = mpr_sig_get_idmap_with_LID(lsig, id, 0, time, 1);
+    RETURN_ARG_UNLESS(idmap_idx >= 0, -1);
+    si = lsig->idmaps[idmap_idx].inst;
+
+    /* update time */
+    if (update_stats)
+        mpr_sig_update_timing_stats(lsig, si->has_val ? mpr_time_get_diff(time, si->time) : 0);
+    mpr_sig_inst_begin_write(si);
+    memcpy(&si->time, &time, sizeof(mpr_time));
+
+    /* update value */
+    if (type != lsig->type)
+        set_coerced_val(lsig->len, type, val, lsig->len, lsig->type, si->val);
+    else
+        memcpy(si->val, (void*)val, mpr_sig_get_vector_bytes((mpr_sig)lsig));
+    si->has_val = 1;
+    mpr_sig_inst_end_write(si);
+
+    /* mark instance as updated */
+    set_bitflag(lsig->updated_inst, si->idx);
+    return idmap_idx;
+}
+
+static void _set_value(mpr_local_sig lsig, mpr_id id, int len, mpr_type type, const void *val,
+                       mpr_time time)
+{
+    int idmap_idx;
+    mpr_sig_inst si;
     if (!mpr_type_get_is_num(type)) {
 #ifdef DEBUG
         trace("called update on signal '%s' with non-number type '%c'\n", lsig->name, type);
@@ -684,39 +763,140 @@ void mpr_sig_set_value(mpr_sig sig, mpr_id id, int len, mpr_type type, const voi
 #endif
         return;
     }
-    if (type != MPR_INT32) {
-        /* check for NaN */
-        int i;
-        if (type == MPR_FLT) {
-            for (i = 0; i < len; i++)
-                RETURN_UNLESS(((float*)val)[i] == ((float*)val)[i]);
-        }
-        else if (type == MPR_DBL) {
-            for (i = 0; i < len; i++)
-                RETURN_UNLESS(((double*)val)[i] == ((double*)val)[i]);
-        }
-    }
-    time = mpr_dev_get_time(sig->dev);
-    idmap_idx = mpr_sig_get_idmap_with_LID(lsig, id, 0, time, 1);
+    idmap_idx = _write_value(lsig, id, type, val, time, 1);
     RETURN_UNLESS(idmap_idx >= 0);
     si = lsig->idmaps[idmap_idx].inst;
+    ((mpr_local_dev)lsig->dev)->sending = lsig->updated = 1;
 
-    /* update time */
-    mpr_sig_update_timing_stats(lsig, si->has_val ? mpr_time_get_diff(time, si->time) : 0);
-    memcpy(&si->time, &time, sizeof(mpr_time));
+    mpr_rtr_process_sig(lsig->obj.graph->net.rtr, lsig, idmap_idx, si->has_val ? si->val : 0, si->time);
+}
 
-    /* update value */
-    if (type != lsig->type)
-        set_coerced_val(lsig->len, type, val, lsig->len, lsig->type, si->val);
-    else
-        memcpy(si->val, (void*)val, mpr_sig_get_vector_bytes(sig));
-    si->has_val = 1;
+void mpr_sig_set_value(mpr_sig sig, mpr_id id, int len, mpr_type type, const void *val)
+{
+    RETURN_UNLESS(sig && sig->is_local);
+    if (!len || !val) {
+        mpr_sig_release_inst(sig, id);
+        return;
+    }
+    _set_value((mpr_local_sig)sig, id, len, type, val, mpr_dev_get_time(sig->dev));
+}
 
-    /* mark instance as updated */
-    set_bitflag(lsig->updated_inst, si->idx);
-    ((mpr_local_dev)lsig->dev)->sending = lsig->updated = 1;
+int mpr_sig_set_values(mpr_sig sig, int num_inst, const mpr_id *ids, int len, mpr_type type,
+                       const void *vals)
+{
+    mpr_local_sig lsig = (mpr_local_sig)sig;
+    int i, idmap_idx, count = 0, num = 0, stride, buf[64], *idmap_idxs = buf;
+    char routed[MAX_INSTANCES / 8];
+    mpr_time time;
+    RETURN_ARG_UNLESS(sig && sig->is_local && num_inst > 0 && vals, 0);
+    if (!mpr_type_get_is_num(type) || len != sig->len) {
+#ifdef DEBUG
+        trace("called bulk update on signal '%s' with type '%c' and value length %d\n",
+              sig->name, type, len);
+#endif
+        return 0;
+    }
+    stride = len * mpr_type_get_size(type);
+    if (num_inst > 64)
+        idmap_idxs = malloc(num_inst * sizeof(int));
+    time = mpr_dev_get_time(sig->dev);
 
-    mpr_rtr_process_sig(lsig->obj.graph->net.rtr, lsig, idmap_idx, si->has_val ? si->val : 0, si->time);
+    /* write all instances first so that maps see the complete update in a single router pass */
+    for (i = 0; i < num_inst; i++) {
+        idmap_idx = _write_value(lsig, ids ? ids[i] : (mpr_id)i, type,
+                                 (const char*)vals + i * stride, time, !count);
+        if (idmap_idx >= 0)
+            idmap_idxs[count++] = idmap_idx;
+    }
+
+    /* A later id may have stolen an instance written earlier in this call, which either leaves
+     * that id map released or reuses it for the later id. Route each remaining id map once. */
+    memset(routed, 0, sizeof(routed));
+    for (i = 0; i < count; i++) {
+        idmap_idx = idmap_idxs[i];
+        if (   !lsig->idmaps[idmap_idx].inst || !lsig->idmaps[idmap_idx].map
+            || get_bitflag(routed, idmap_idx))
+            continue;
+        set_bitflag(routed, idmap_idx);
+        idmap_idxs[num++] = idmap_idx;
+    }
+    if (num) {
+        ((mpr_local_dev)lsig->dev)->sending = lsig->updated = 1;
+        mpr_rtr_process_sig_insts(lsig->obj.graph->net.rtr, lsig, num, idmap_idxs, time);
+    }
+    if (idmap_idxs != buf)
+        free(idmap_idxs);
+    return num;
+}
+
+int mpr_sig_reserve_queue(mpr_sig sig, int size)
+{
+    mpr_local_sig lsig = (mpr_local_sig)sig;
+    mpr_local_dev ldev;
+    mpr_sig_queue q;
+    int num = 1;
+    RETURN_ARG_UNLESS(sig && sig->is_local && size > 0, 0);
+    while (num < size)
+        num <<= 1;
+    /* the producer may already be pushing to an existing queue, so it is never reallocated */
+    if ((q = lsig->queue))
+        return num <= q->mask + 1;
+    q = lsig->queue = (mpr_sig_queue)calloc(1, sizeof(mpr_sig_queue_t));
+    q->rec_size = ALIGN8(sizeof(queue_rec_t) + sig->len * sizeof(double));
+    q->recs = (char*)malloc(num * q->rec_size);
+    q->mask = num - 1;
+    q->head = q->tail = 0;
+    ldev = (mpr_local_dev)sig->dev;
+    lsig->queue_next = ldev->queued_sigs;
+    ldev->queued_sigs = lsig;
+    return 1;
+}
+
+int mpr_sig_push_value(mpr_sig sig, mpr_id id, int len, mpr_type type, const void *val,
+                       mpr_time time)
+{
+    mpr_sig_queue q;
+    queue_rec rec;
+    uint32_t head;
+    RETURN_ARG_UNLESS(sig && sig->is_local && (q = ((mpr_local_sig)sig)->queue), 0);
+    if (!val)
+        len = 0;
+    RETURN_ARG_UNLESS(!len || (len == sig->len && mpr_type_get_is_num(type)), 0);
+    head = q->head;
+    /* fail rather than wait if the device has not drained the queue */
+    RETURN_ARG_UNLESS(head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) <= q->mask, 0);
+
+    rec = (queue_rec)(q->recs + (head & q->mask) * q->rec_size);
+    rec->id = id;
+    mpr_time_set(&rec->time, time);
+    rec->len = len;
+    rec->type = type;
+    if (len)
+        memcpy(rec + 1, val, len * mpr_type_get_size(type));
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int mpr_sig_process_queue(mpr_local_sig lsig)
+{
+    mpr_sig_queue q = lsig->queue;
+    uint32_t tail, head;
+    int count;
+    RETURN_ARG_UNLESS(q, 0);
+    tail = q->tail;
+    /* only apply the updates present on entry in case the producer keeps pushing */
+    head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    count = head - tail;
+    for (; tail != head; tail++) {
+        queue_rec rec = (queue_rec)(q->recs + (tail & q->mask) * q->rec_size);
+        if (rec->len)
+            _set_value(lsig, rec->id, rec->len, rec->type, rec + 1, rec->time);
+        else
+            mpr_sig_release_inst((mpr_sig)lsig, rec->id);
+        /* hand the record back to the producer */
+        __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    return count;
 }
 
 void mpr_sig_release_inst(mpr_sig sig, mpr_id id)
@@ -740,10 +920,10 @@ void mpr_sig_release_inst_internal(mpr_local_sig lsig, int idmap_idx)
     mpr_rtr_process_sig(lsig->obj.graph->net.rtr, lsig, idmap_idx, 0, smap->inst->time);
 
     if (mpr_dev_LID_decref((mpr_local_dev)lsig->dev, lsig->group, smap->map))
-        smap->map = 0;
+        mpr_sig_clear_idmap_map(lsig, idmap_idx);
     else if ((lsig->dir & MPR_DIR_OUT) || smap->status & RELEASED_REMOTELY) {
         /* TODO: consider multiple upstream source instances? */
-        smap->map = 0;
+        mpr_sig_clear_idmap_map(lsig, idmap_idx);
     }
     else {
         /* mark map as locally-released but do not remove it */
@@ -751,8 +931,10 @@ void mpr_sig_release_inst_internal(mpr_local_sig lsig, int idmap_idx)
     }
 
     /* Put instance back in reserve list */
+    mpr_sig_inst_begin_write(smap->inst);
     smap->inst->active = 0;
-    smap->inst = 0;
+    mpr_sig_inst_end_write(smap->inst);
+    mpr_sig_clear_idmap_inst(lsig, idmap_idx);
 }
 
 void mpr_sig_remove_inst(mpr_sig sig, mpr_id id)
@@ -766,13 +948,13 @@ void mpr_sig_remove_inst(mpr_sig sig, mpr_id id)
     }
     RETURN_UNLESS(i < lsig->num_inst);
 
+    remove_idx = lsig->inst[i]->idx;
+
     if (lsig->inst[i]->active) {
        /* First release instance */
-       mpr_sig_release_inst_internal(lsig, i);
+       mpr_sig_release_inst_internal(lsig, mpr_sig_get_idmap_with_inst_idx(lsig, remove_idx));
     }
 
-    remove_idx = lsig->inst[i]->idx;
-
     /* Free value and timetag memory held by instance */
     FUNC_IF(free, lsig->inst[i]->val);
     FUNC_IF(free, lsig->inst[i]->has_val_flags);
@@ -786,6 +968,11 @@ void mpr_sig_remove_inst(mpr_sig sig, mpr_id id)
     /* Remove instance memory held by map slots */
     mpr_rtr_remove_inst(lsig->obj.graph->net.rtr, lsig, remove_idx);
 
+    memmove(lsig->inst_idmaps + remove_idx, lsig->inst_idmaps + remove_idx + 1,
+            sizeof(int) * (lsig->num_inst - remove_idx));
+    memmove(lsig->inst_by_idx + remove_idx, lsig->inst_by_idx + remove_idx + 1,
+            sizeof(mpr_sig_inst) * (lsig->num_inst - remove_idx));
+
     for (i = 0; i < lsig->num_inst; i++) {
         if (lsig->inst[i]->idx > remove_idx)
             --lsig->inst[i]->idx;
@@ -816,6 +1003,37 @@ const void *mpr_sig_get_value(mpr_sig sig, mpr_id id, mpr_time *time)
     return si->val;
 }
 
+int mpr_sig_copy_value(mpr_sig sig, mpr_id id, void *val, mpr_time *time)
+{
+    mpr_local_sig lsig = (mpr_local_sig)sig;
+    mpr_sig_inst si;
+    mpr_time t;
+    uint32_t seq;
+    int i, found = 0, has_val = 0, size;
+    RETURN_ARG_UNLESS(sig && sig->is_local, 0);
+    size = mpr_sig_get_vector_bytes(sig);
+    /* Instances are looked up in the order they were reserved. The polling thread reorders
+     * lsig->inst and reuses inactive instances for new ids, so the id and status of each
+     * instance are read under its sequence count together with the value. */
+    for (i = 0; i < lsig->num_inst && !found; i++) {
+        si = lsig->inst_by_idx[i];
+        do {
+            /* wait for the polling thread to finish a change that is in progress */
+            while ((seq = __atomic_load_n(&si->seq, __ATOMIC_ACQUIRE)) & 1) {}
+            found = si->active && (!lsig->use_inst || si->id == id);
+            has_val = found && si->has_val;
+            if (has_val) {
+                memcpy(val, si->val, size);
+                memcpy(&t, &si->time, sizeof(mpr_time));
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (__atomic_load_n(&si->seq, __ATOMIC_RELAXED) != seq);
+    }
+    if (has_val && time)
+        memcpy(time, &t, sizeof(mpr_time));
+    return has_val;
+}
+
 int mpr_sig_get_num_inst(mpr_sig sig, mpr_status status)
 {
     int i, j;
@@ -945,10 +1163,72 @@ mpr_list mpr_sig_get_maps(mpr_sig sig, mpr_dir dir)
     return mpr_list_start(q);
 }
 
+/* Each idmap with a device id map is indexed in two chained hash tables stored in
+ * idmap_buckets, the first keyed by LID and the second by GID. Since zeroed memory must
+ * represent empty buckets, bucket heads and chain links hold idmap indices plus one. */
+static void _link_idmap(mpr_local_sig lsig, int idx)
+{
+    mpr_sig_idmap_t *smap = &lsig->idmaps[idx];
+    int i, *bucket;
+    for (i = 0; i < 2; i++) {
+        smap->hash_bucket[i] = mpr_id_hash(i ? smap->map->GID : smap->map->LID)
+                               & (lsig->idmap_len - 1);
+        bucket = lsig->idmap_buckets + i * lsig->idmap_len + smap->hash_bucket[i];
+        smap->hash_next[i] = *bucket;
+        *bucket = idx + 1;
+    }
+}
+
+static void _unlink_idmap(mpr_local_sig lsig, int idx)
+{
+    mpr_sig_idmap_t *smap = &lsig->idmaps[idx];
+    int i, *next;
+    for (i = 0; i < 2; i++) {
+        next = lsig->idmap_buckets + i * lsig->idmap_len + smap->hash_bucket[i];
+        while (*next && *next != idx + 1)
+            next = &lsig->idmaps[*next - 1].hash_next[i];
+        if (*next)
+            *next = smap->hash_next[i];
+        smap->hash_next[i] = 0;
+    }
+}
+
+/* Find the lowest-indexed idmap with an active instance and the given LID (key 0), or with
+ * the given GID (key 1). */
+static int _find_idmap(mpr_local_sig lsig, int key, mpr_id id)
+{
+    int i, found = -1;
+    i = lsig->idmap_buckets[key * lsig->idmap_len + (mpr_id_hash(id) & (lsig->idmap_len - 1))];
+    for (; i; i = lsig->idmaps[i - 1].hash_next[key]) {
+        mpr_sig_idmap_t *smap = &lsig->idmaps[i - 1];
+        if (key ? smap->map->GID != id : (!smap->inst || smap->map->LID != id))
+            continue;
+        if (found < 0 || i - 1 < found)
+            found = i - 1;
+    }
+    return found;
+}
+
+void mpr_sig_clear_idmap_inst(mpr_local_sig lsig, int idmap_idx)
+{
+    mpr_sig_idmap_t *smap = &lsig->idmaps[idmap_idx];
+    RETURN_UNLESS(smap->inst);
+    if (lsig->inst_idmaps[smap->inst->idx] == idmap_idx + 1)
+        lsig->inst_idmaps[smap->inst->idx] = 0;
+    smap->inst = 0;
+}
+
+void mpr_sig_clear_idmap_map(mpr_local_sig lsig, int idmap_idx)
+{
+    RETURN_UNLESS(lsig->idmaps[idmap_idx].map);
+    _unlink_idmap(lsig, idmap_idx);
+    lsig->idmaps[idmap_idx].map = 0;
+}
+
 static int _add_idmap(mpr_local_sig lsig, mpr_sig_inst si, mpr_id_map map)
 {
     /* find unused signal map */
-    int i;
+    int i, j;
     for (i = 0; i < lsig->idmap_len; i++) {
         if (!lsig->idmaps[i].map)
             break;
@@ -963,10 +1243,20 @@ static int _add_idmap(mpr_local_sig lsig, mpr_sig_inst si, mpr_id_map map)
         lsig->idmap_len = lsig->idmap_len ? lsig->idmap_len * 2 : 1;
         lsig->idmaps = realloc(lsig->idmaps, (lsig->idmap_len * sizeof(struct _mpr_sig_idmap)));
         memset(lsig->idmaps + i, 0, ((lsig->idmap_len - i) * sizeof(struct _mpr_sig_idmap)));
+
+        /* rebuild the hash index for the new table size */
+        free(lsig->idmap_buckets);
+        lsig->idmap_buckets = calloc(lsig->idmap_len * 2, sizeof(int));
+        for (j = 0; j < i; j++) {
+            if (lsig->idmaps[j].map)
+                _link_idmap(lsig, j);
+        }
     }
     lsig->idmaps[i].map = map;
     lsig->idmaps[i].inst = si;
     lsig->idmaps[i].status = 0;
+    _link_idmap(lsig, i);
+    lsig->inst_idmaps[si->idx] = i + 1;
     return i;
 }
 
@@ -0,0 +1,478 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapper_internal.h"
+#include "types_internal.h"
+#include <mapper/mapper.h>
+
+/* Vectorised kernels for the expression evaluator. Each table below provides the same set of
+ * operations; SSE2 and AVX2 versions are selected at runtime if the processor supports them and
+ * the scalar versions are used on other architectures or if MPR_NO_SIMD is defined. Kernels
+ * operate on packed arrays of a single type and tolerate unaligned pointers. */
+
+#if !defined(MPR_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SIMD_X86 1
+    #include <immintrin.h>
+#else
+    #define SIMD_X86 0
+#endif
+
+/* Scalar operators, also used for the remainder of vectorised loops. The extrema operators
+ * match the comparisons used by the max() and min() vector functions. */
+#define S_ADD(x, y) ((x) + (y))
+#define S_SUB(x, y) ((x) - (y))
+#define S_MUL(x, y) ((x) * (y))
+#define S_DIV(x, y) ((x) / (y))
+#define S_EQ(x, y)  ((x) == (y))
+#define S_NE(x, y)  ((x) != (y))
+#define S_LT(x, y)  ((x) < (y))
+#define S_LE(x, y)  ((x) <= (y))
+#define S_GT(x, y)  ((x) > (y))
+#define S_GE(x, y)  ((x) >= (y))
+#define S_MIN(x, y) ((y) < (x) ? (y) : (x))
+#define S_MAX(x, y) ((y) > (x) ? (y) : (x))
+
+/**** Scalar kernels ****/
+
+#define SCALAR_BINOP(NAME, TYPE, OP)                                \
+static void scalar_##NAME##_vv(void *a, const void *b, int len)     \
+{                                                                   \
+    TYPE *x = (TYPE*)a;                                             \
+    const TYPE *y = (const TYPE*)b;                                 \
+    int i;                                                          \
+    for (i = 0; i < len; i++)                                       \
+        x[i] = OP(x[i], y[i]);                                      \
+}                                                                   \
+static void scalar_##NAME##_vs(void *a, const void *b, int len)     \
+{                                                                   \
+    TYPE *x = (TYPE*)a, y = *(const TYPE*)b;                        \
+    int i;                                                          \
+    for (i = 0; i < len; i++)                                       \
+        x[i] = OP(x[i], y);                                         \
+}
+
+#define SCALAR_REDUCE(NAME, TYPE, OP)                               \
+static void scalar_##NAME##_reduce(void *a, const void *b, int len, int stride) \
+{                                                                   \
+    TYPE *x = (TYPE*)a;                                             \
+    int i, l;                                                       \
+    for (i = 1; i < len; i++) {                                     \
+        for (l = 0; l < stride; l++)                                \
+            x[l] = OP(x[l], x[i * stride + l]);                     \
+    }                                                               \
+}
+
+#define SCALAR_DOT(NAME, TYPE)                                      \
+static void scalar_##NAME##_dot(void *a, const void *b, int len, int stride) \
+{                                                                   \
+    TYPE *x = (TYPE*)a;                                             \
+    const TYPE *y = (const TYPE*)b;                                 \
+    int i, l;                                                       \
+    for (l = 0; l < stride; l++) {                                  \
+        TYPE acc = 0;                                               \
+        for (i = 0; i < len; i++)                                   \
+            acc += x[i * stride + l] * y[i * stride + l];           \
+        x[l] = acc;                                                 \
+    }                                                               \
+}
+
+#define SCALAR_TYPED(S, TYPE)                                       \
+    SCALAR_BINOP(add##S, TYPE, S_ADD)                               \
+    SCALAR_BINOP(sub##S, TYPE, S_SUB)                               \
+    SCALAR_BINOP(mul##S, TYPE, S_MUL)                               \
+    SCALAR_BINOP(eq##S, TYPE, S_EQ)                                 \
+    SCALAR_BINOP(ne##S, TYPE, S_NE)                                 \
+    SCALAR_BINOP(lt##S, TYPE, S_LT)                                 \
+    SCALAR_BINOP(le##S, TYPE, S_LE)                                 \
+    SCALAR_BINOP(gt##S, TYPE, S_GT)                                 \
+    SCALAR_BINOP(ge##S, TYPE, S_GE)                                 \
+    SCALAR_BINOP(min##S, TYPE, S_MIN)                               \
+    SCALAR_BINOP(max##S, TYPE, S_MAX)                               \
+    SCALAR_REDUCE(add##S, TYPE, S_ADD)                              \
+    SCALAR_REDUCE(min##S, TYPE, S_MIN)                              \
+    SCALAR_REDUCE(max##S, TYPE, S_MAX)                              \
+    SCALAR_DOT(S, TYPE)
+
+SCALAR_TYPED(i, int)
+SCALAR_TYPED(f, float)
+SCALAR_TYPED(d, double)
+SCALAR_BINOP(divf, float, S_DIV)
+SCALAR_BINOP(divd, double, S_DIV)
+
+#if SIMD_X86
+
+/**** Generic vectorised kernels ****/
+
+/* Each ISA section defines ATTR, the vector type VT_<S> and width W_<S>, and load, store and
+ * broadcast macros LD_<S>, ST_<S> and SET1_<S> for each datatype suffix S. Comparison
+ * operators use a local constant 'one' to convert lane masks to 0 or 1. */
+
+#define SIMD_BINOP(ISA, NAME, S, TYPE, VOP, SOP)                    \
+static ATTR void ISA##_##NAME##_vv(void *a, const void *b, int len) \
+{                                                                   \
+    TYPE *x = (TYPE*)a;                                             \
+    const TYPE *y = (const TYPE*)b;                                 \
+    const VT_##S one = SET1_##S(1);                                 \
+    int i = 0;                                                      \
+    (void)one;                                                      \
+    for (; i + W_##S <= len; i += W_##S)                            \
+        ST_##S(x + i, VOP(LD_##S(x + i), LD_##S(y + i)));           \
+    for (; i < len; i++)                                            \
+        x[i] = SOP(x[i], y[i]);                                     \
+}                                                                   \
+static ATTR void ISA##_##NAME##_vs(void *a, const void *b, int len) \
+{                                                                   \
+    TYPE *x = (TYPE*)a, ys = *(const TYPE*)b;                       \
+    const VT_##S one = SET1_##S(1), y = SET1_##S(ys);               \
+    int i = 0;                                                      \
+    (void)one;                                                      \
+    for (; i + W_##S <= len; i += W_##S)                            \
+        ST_##S(x + i, VOP(LD_##S(x + i), y));                       \
+    for (; i < len; i++)                                            \
+        x[i] = SOP(x[i], ys);                                       \
+}
+
+/* Reductions over a single row are computed horizontally using W partial results, which
+ * changes the order of floating-point additions for rows of 2 * W elements or more. Multiple
+ * rows are reduced vertically so each lane is accumulated in element order. */
+#define SIMD_REDUCE(ISA, NAME, S, TYPE, VOP, SOP)                   \
+static ATTR void ISA##_##NAME##_reduce(void *a, const void *b, int len, int stride) \
+{                                                                   \
+    TYPE *x = (TYPE*)a;                                             \
+    int i, l = 0;                                                   \
+    if (1 == stride) {                                              \
+        i = 1;                                                      \
+        if (len >= 2 * W_##S) {                                     \
+            TYPE tmp[W_##S];                                        \
+            VT_##S acc = LD_##S(x);                                 \
+            for (i = W_##S; i + W_##S <= len; i += W_##S)           \
+                acc = VOP(acc, LD_##S(x + i));                      \
+            ST_##S(tmp, acc);                                       \
+            x[0] = tmp[0];                                          \
+            for (l = 1; l < W_##S; l++)                             \
+                x[0] = SOP(x[0], tmp[l]);                           \
+        }                                                           \
+        for (; i < len; i++)                                        \
+            x[0] = SOP(x[0], x[i]);                                 \
+        return;                                                     \
+    }                                                               \
+    for (; l + W_##S <= stride; l += W_##S) {                       \
+        VT_##S acc = LD_##S(x + l);                                 \
+        for (i = 1; i < len; i++)                                   \
+            acc = VOP(acc, LD_##S(x + i * stride + l));             \
+        ST_##S(x + l, acc);                                         \
+    }                                                               \
+    for (; l < stride; l++) {                                       \
+        for (i = 1; i < len; i++)                                   \
+            x[l] = SOP(x[l], x[i * stride + l]);                    \
+    }                                                               \
+}
+
+#define SIMD_DOT(ISA, S, TYPE, VADD, VMUL)                          \
+static ATTR void ISA##_##S##_dot(void *a, const void *b, int len, int stride) \
+{                                                                   \
+    TYPE *x = (TYPE*)a;                                             \
+    const TYPE *y = (const TYPE*)b;                                 \
+    int i, l = 0;                                                   \
+    if (1 == stride && len >= 2 * W_##S) {                          \
+        TYPE tmp[W_##S], sum;                                       \
+        VT_##S acc = VMUL(LD_##S(x), LD_##S(y));                    \
+        for (i = W_##S; i + W_##S <= len; i += W_##S)               \
+            acc = VADD(acc, VMUL(LD_##S(x + i), LD_##S(y + i)));    \
+        ST_##S(tmp, acc);                                           \
+        sum = tmp[0];                                               \
+        for (l = 1; l < W_##S; l++)                                 \
+            sum += tmp[l];                                          \
+        for (; i < len; i++)                                        \
+            sum += x[i] * y[i];                                     \
+        x[0] = sum;                                                 \
+        return;                                                     \
+    }                                                               \
+    for (; l + W_##S <= stride; l += W_##S) {                       \
+        VT_##S acc = SET1_##S(0);                                   \
+        for (i = 0; i < len; i++)                                   \
+            acc = VADD(acc, VMUL(LD_##S(x + i * stride + l), LD_##S(y + i * stride + l))); \
+        ST_##S(x + l, acc);                                         \
+    }                                                               \
+    for (; l < stride; l++) {                                       \
+        TYPE acc = 0;                                               \
+        for (i = 0; i < len; i++)                                   \
+            acc += x[i * stride + l] * y[i * stride + l];           \
+        x[l] = acc;                                                 \
+    }                                                               \
+}
+
+/**** SSE2 ****/
+
+#define ATTR __attribute__((target("sse2")))
+
+#define VT_i __m128i
+#define VT_f __m128
+#define VT_d __m128d
+#define W_i 4
+#define W_f 4
+#define W_d 2
+#define LD_i(P) _mm_loadu_si128((const __m128i*)(P))
+#define LD_f(P) _mm_loadu_ps(P)
+#define LD_d(P) _mm_loadu_pd(P)
+#define ST_i(P, V) _mm_storeu_si128((__m128i*)(P), V)
+#define ST_f(P, V) _mm_storeu_ps(P, V)
+#define ST_d(P, V) _mm_storeu_pd(P, V)
+#define SET1_i(X) _mm_set1_epi32(X)
+#define SET1_f(X) _mm_set1_ps(X)
+#define SET1_d(X) _mm_set1_pd(X)
+
+#define SSE2_ADDi(x, y) _mm_add_epi32(x, y)
+#define SSE2_SUBi(x, y) _mm_sub_epi32(x, y)
+#define SSE2_EQi(x, y)  _mm_and_si128(_mm_cmpeq_epi32(x, y), one)
+#define SSE2_NEi(x, y)  _mm_andnot_si128(_mm_cmpeq_epi32(x, y), one)
+#define SSE2_LTi(x, y)  _mm_and_si128(_mm_cmplt_epi32(x, y), one)
+#define SSE2_LEi(x, y)  _mm_andnot_si128(_mm_cmpgt_epi32(x, y), one)
+#define SSE2_GTi(x, y)  _mm_and_si128(_mm_cmpgt_epi32(x, y), one)
+#define SSE2_GEi(x, y)  _mm_andnot_si128(_mm_cmplt_epi32(x, y), one)
+
+#define SSE2_FP(S, TYPE, SFX)                                               \
+    SIMD_BINOP(sse2, add##S, S, TYPE, _mm_add_##SFX, S_ADD)        \
+    SIMD_BINOP(sse2, sub##S, S, TYPE, _mm_sub_##SFX, S_SUB)        \
+    SIMD_BINOP(sse2, mul##S, S, TYPE, _mm_mul_##SFX, S_MUL)        \
+    SIMD_BINOP(sse2, div##S, S, TYPE, _mm_div_##SFX, S_DIV)        \
+    SIMD_BINOP(sse2, eq##S, S, TYPE, SSE2_EQ##S, S_EQ)             \
+    SIMD_BINOP(sse2, ne##S, S, TYPE, SSE2_NE##S, S_NE)             \
+    SIMD_BINOP(sse2, lt##S, S, TYPE, SSE2_LT##S, S_LT)             \
+    SIMD_BINOP(sse2, le##S, S, TYPE, SSE2_LE##S, S_LE)             \
+    SIMD_BINOP(sse2, gt##S, S, TYPE, SSE2_GT##S, S_GT)             \
+    SIMD_BINOP(sse2, ge##S, S, TYPE, SSE2_GE##S, S_GE)             \
+    SIMD_BINOP(sse2, min##S, S, TYPE, SSE2_MIN##S, S_MIN)          \
+    SIMD_BINOP(sse2, max##S, S, TYPE, SSE2_MAX##S, S_MAX)          \
+    SIMD_REDUCE(sse2, add##S, S, TYPE, _mm_add_##SFX, S_ADD)       \
+    SIMD_REDUCE(sse2, min##S, S, TYPE, SSE2_MIN##S, S_MIN)         \
+    SIMD_REDUCE(sse2, max##S, S, TYPE, SSE2_MAX##S, S_MAX)         \
+    SIMD_DOT(sse2, S, TYPE, _mm_add_##SFX, _mm_mul_##SFX)
+
+/* The operands of min and max are swapped so that comparisons involving NaN select the same
+ * element as the scalar operators. */
+#define SSE2_EQf(x, y)  _mm_and_ps(_mm_cmpeq_ps(x, y), one)
+#define SSE2_NEf(x, y)  _mm_and_ps(_mm_cmpneq_ps(x, y), one)
+#define SSE2_LTf(x, y)  _mm_and_ps(_mm_cmplt_ps(x, y), one)
+#define SSE2_LEf(x, y)  _mm_and_ps(_mm_cmple_ps(x, y), one)
+#define SSE2_GTf(x, y)  _mm_and_ps(_mm_cmpgt_ps(x, y), one)
+#define SSE2_GEf(x, y)  _mm_and_ps(_mm_cmpge_ps(x, y), one)
+#define SSE2_MINf(x, y) _mm_min_ps(y, x)
+#define SSE2_MAXf(x, y) _mm_max_ps(y, x)
+#define SSE2_EQd(x, y)  _mm_and_pd(_mm_cmpeq_pd(x, y), one)
+#define SSE2_NEd(x, y)  _mm_and_pd(_mm_cmpneq_pd(x, y), one)
+#define SSE2_LTd(x, y)  _mm_and_pd(_mm_cmplt_pd(x, y), one)
+#define SSE2_LEd(x, y)  _mm_and_pd(_mm_cmple_pd(x, y), one)
+#define SSE2_GTd(x, y)  _mm_and_pd(_mm_cmpgt_pd(x, y), one)
+#define SSE2_GEd(x, y)  _mm_and_pd(_mm_cmpge_pd(x, y), one)
+#define SSE2_MINd(x, y) _mm_min_pd(y, x)
+#define SSE2_MAXd(x, y) _mm_max_pd(y, x)
+
+/* SSE2 lacks 32-bit integer multiplication and extrema, which use the scalar kernels. */
+SIMD_BINOP(sse2, addi, i, int, SSE2_ADDi, S_ADD)
+SIMD_BINOP(sse2, subi, i, int, SSE2_SUBi, S_SUB)
+SIMD_BINOP(sse2, eqi, i, int, SSE2_EQi, S_EQ)
+SIMD_BINOP(sse2, nei, i, int, SSE2_NEi, S_NE)
+SIMD_BINOP(sse2, lti, i, int, SSE2_LTi, S_LT)
+SIMD_BINOP(sse2, lei, i, int, SSE2_LEi, S_LE)
+SIMD_BINOP(sse2, gti, i, int, SSE2_GTi, S_GT)
+SIMD_BINOP(sse2, gei, i, int, SSE2_GEi, S_GE)
+SIMD_REDUCE(sse2, addi, i, int, SSE2_ADDi, S_ADD)
+SSE2_FP(f, float, ps)
+SSE2_FP(d, double, pd)
+
+#undef ATTR
+
+/**** AVX2 ****/
+
+#define ATTR __attribute__((target("avx2")))
+
+#undef VT_i
+#undef VT_f
+#undef VT_d
+#undef W_i
+#undef W_f
+#undef W_d
+#undef LD_i
+#undef LD_f
+#undef LD_d
+#undef ST_i
+#undef ST_f
+#undef ST_d
+#undef SET1_i
+#undef SET1_f
+#undef SET1_d
+
+#define VT_i __m256i
+#define VT_f __m256
+#define VT_d __m256d
+#define W_i 8
+#define W_f 8
+#define W_d 4
+#define LD_i(P) _mm256_loadu_si256((const __m256i*)(P))
+#define LD_f(P) _mm256_loadu_ps(P)
+#define LD_d(P) _mm256_loadu_pd(P)
+#define ST_i(P, V) _mm256_storeu_si256((__m256i*)(P), V)
+#define ST_f(P, V) _mm256_storeu_ps(P, V)
+#define ST_d(P, V) _mm256_storeu_pd(P, V)
+#define SET1_i(X) _mm256_set1_epi32(X)
+#define SET1_f(X) _mm256_set1_ps(X)
+#define SET1_d(X) _mm256_set1_pd(X)
+
+#define AVX2_ADDi(x, y) _mm256_add_epi32(x, y)
+#define AVX2_SUBi(x, y) _mm256_sub_epi32(x, y)
+#define AVX2_MULi(x, y) _mm256_mullo_epi32(x, y)
+#define AVX2_EQi(x, y)  _mm256_and_si256(_mm256_cmpeq_epi32(x, y), one)
+#define AVX2_NEi(x, y)  _mm256_andnot_si256(_mm256_cmpeq_epi32(x, y), one)
+#define AVX2_LTi(x, y)  _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one)
+#define AVX2_LEi(x, y)  _mm256_andnot_si256(_mm256_cmpgt_epi32(x, y), one)
+#define AVX2_GTi(x, y)  _mm256_and_si256(_mm256_cmpgt_epi32(x, y), one)
+#define AVX2_GEi(x, y)  _mm256_andnot_si256(_mm256_cmpgt_epi32(y, x), one)
+#define AVX2_MINi(x, y) _mm256_min_epi32(x, y)
+#define AVX2_MAXi(x, y) _mm256_max_epi32(x, y)
+
+#define AVX2_CMP(SFX, x, y, PRED) _mm256_and_##SFX(_mm256_cmp_##SFX(x, y, PRED), one)
+#define AVX2_EQf(x, y)  AVX2_CMP(ps, x, y, _CMP_EQ_OQ)
+#define AVX2_NEf(x, y)  AVX2_CMP(ps, x, y, _CMP_NEQ_UQ)
+#define AVX2_LTf(x, y)  AVX2_CMP(ps, x, y, _CMP_LT_OQ)
+#define AVX2_LEf(x, y)  AVX2_CMP(ps, x, y, _CMP_LE_OQ)
+#define AVX2_GTf(x, y)  AVX2_CMP(ps, x, y, _CMP_GT_OQ)
+#define AVX2_GEf(x, y)  AVX2_CMP(ps, x, y, _CMP_GE_OQ)
+#define AVX2_MINf(x, y) _mm256_min_ps(y, x)
+#define AVX2_MAXf(x, y) _mm256_max_ps(y, x)
+#define AVX2_EQd(x, y)  AVX2_CMP(pd, x, y, _CMP_EQ_OQ)
+#define AVX2_NEd(x, y)  AVX2_CMP(pd, x, y, _CMP_NEQ_UQ)
+#define AVX2_LTd(x, y)  AVX2_CMP(pd, x, y, _CMP_LT_OQ)
+#define AVX2_LEd(x, y)  AVX2_CMP(pd, x, y, _CMP_LE_OQ)
+#define AVX2_GTd(x, y)  AVX2_CMP(pd, x, y, _CMP_GT_OQ)
+#define AVX2_GEd(x, y)  AVX2_CMP(pd, x, y, _CMP_GE_OQ)
+#define AVX2_MINd(x, y) _mm256_min_pd(y, x)
+#define AVX2_MAXd(x, y) _mm256_max_pd(y, x)
+
+#define AVX2_TYPED(S, TYPE, ADD, SUB, MUL)                                  \
+    SIMD_BINOP(avx2, add##S, S, TYPE, ADD, S_ADD)                           \
+    SIMD_BINOP(avx2, sub##S, S, TYPE, SUB, S_SUB)                           \
+    SIMD_BINOP(avx2, mul##S, S, TYPE, MUL, S_MUL)                           \
+    SIMD_BINOP(avx2, eq##S, S, TYPE, AVX2_EQ##S, S_EQ)                      \
+    SIMD_BINOP(avx2, ne##S, S, TYPE, AVX2_NE##S, S_NE)                      \
+    SIMD_BINOP(avx2, lt##S, S, TYPE, AVX2_LT##S, S_LT)                      \
+    SIMD_BINOP(avx2, le##S, S, TYPE, AVX2_LE##S, S_LE)                      \
+    SIMD_BINOP(avx2, gt##S, S, TYPE, AVX2_GT##S, S_GT)                      \
+    SIMD_BINOP(avx2, ge##S, S, TYPE, AVX2_GE##S, S_GE)                      \
+    SIMD_BINOP(avx2, min##S, S, TYPE, AVX2_MIN##S, S_MIN)                   \
+    SIMD_BINOP(avx2, max##S, S, TYPE, AVX2_MAX##S, S_MAX)                   \
+    SIMD_REDUCE(avx2, add##S, S, TYPE, ADD, S_ADD)                          \
+    SIMD_REDUCE(avx2, min##S, S, TYPE, AVX2_MIN##S, S_MIN)                  \
+    SIMD_REDUCE(avx2, max##S, S, TYPE, AVX2_MAX##S, S_MAX)                  \
+    SIMD_DOT(avx2, S, TYPE, ADD, MUL)
+
+AVX2_TYPED(i, int, AVX2_ADDi, AVX2_SUBi, AVX2_MULi)
+AVX2_TYPED(f, float, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps)
+AVX2_TYPED(d, double, _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd)
+SIMD_BINOP(avx2, divf, f, float, _mm256_div_ps, S_DIV)
+SIMD_BINOP(avx2, divd, d, double, _mm256_div_pd, S_DIV)
+
+#undef ATTR
+
+#endif /* SIMD_X86 */
+
+/**** Kernel tables ****/
+
+#define K_BIN(ISA, NAME) { ISA##_##NAME##_vv, ISA##_##NAME##_vs, 0 }
+#define K_RED(ISA, NAME) { ISA##_##NAME##_vv, ISA##_##NAME##_vs, ISA##_##NAME##_reduce }
+#define K_DOT(ISA, S) { 0, 0, ISA##_##S##_dot }
+#define K_NONE { 0, 0, 0 }
+
+/* Tables are indexed by mpr_simd_op and then by datatype (int, float, double). */
+static const mpr_simd_kernel_t scalar_kernels[MPR_SIMD_N_OPS][3] = {
+    { K_RED(scalar, addi), K_RED(scalar, addf), K_RED(scalar, addd) },
+    { K_BIN(scalar, subi), K_BIN(scalar, subf), K_BIN(scalar, subd) },
+    { K_BIN(scalar, muli), K_BIN(scalar, mulf), K_BIN(scalar, muld) },
+    { K_NONE,              K_BIN(scalar, divf), K_BIN(scalar, divd) },
+    { K_BIN(scalar, eqi),  K_BIN(scalar, eqf),  K_BIN(scalar, eqd)  },
+    { K_BIN(scalar, nei),  K_BIN(scalar, nef),  K_BIN(scalar, ned)  },
+    { K_BIN(scalar, lti),  K_BIN(scalar, ltf),  K_BIN(scalar, ltd)  },
+    { K_BIN(scalar, lei),  K_BIN(scalar, lef),  K_BIN(scalar, led)  },
+    { K_BIN(scalar, gti),  K_BIN(scalar, gtf),  K_BIN(scalar, gtd)  },
+    { K_BIN(scalar, gei),  K_BIN(scalar, gef),  K_BIN(scalar, ged)  },
+    { K_RED(scalar, mini), K_RED(scalar, minf), K_RED(scalar, mind) },
+    { K_RED(scalar, maxi), K_RED(scalar, maxf), K_RED(scalar, maxd) },
+    { K_DOT(scalar, i),    K_DOT(scalar, f),    K_DOT(scalar, d)    },
+};
+
+#if SIMD_X86
+
+static const mpr_simd_kernel_t sse2_kernels[MPR_SIMD_N_OPS][3] = {
+    { K_RED(sse2, addi),   K_RED(sse2, addf),   K_RED(sse2, addd)   },
+    { K_BIN(sse2, subi),   K_BIN(sse2, subf),   K_BIN(sse2, subd)   },
+    { K_BIN(scalar, muli), K_BIN(sse2, mulf),   K_BIN(sse2, muld)   },
+    { K_NONE,              K_BIN(sse2, divf),   K_BIN(sse2, divd)   },
+    { K_BIN(sse2, eqi),    K_BIN(sse2, eqf),    K_BIN(sse2, eqd)    },
+    { K_BIN(sse2, nei),    K_BIN(sse2, nef),    K_BIN(sse2, ned)    },
+    { K_BIN(sse2, lti),    K_BIN(sse2, ltf),    K_BIN(sse2, ltd)    },
+    { K_BIN(sse2, lei),    K_BIN(sse2, lef),    K_BIN(sse2, led)    },
+    { K_BIN(sse2, gti),    K_BIN(sse2, gtf),    K_BIN(sse2, gtd)    },
+    { K_BIN(sse2, gei),    K_BIN(sse2, gef),    K_BIN(sse2, ged)    },
+    { K_RED(scalar, mini), K_RED(sse2, minf),   K_RED(sse2, mind)   },
+    { K_RED(scalar, maxi), K_RED(sse2, maxf),   K_RED(sse2, maxd)   },
+    { K_DOT(scalar, i),    K_DOT(sse2, f),      K_DOT(sse2, d)      },
+};
+
+static const mpr_simd_kernel_t avx2_kernels[MPR_SIMD_N_OPS][3] = {
+    { K_RED(avx2, addi),   K_RED(avx2, addf),   K_RED(avx2, addd)   },
+    { K_BIN(avx2, subi),   K_BIN(avx2, subf),   K_BIN(avx2, subd)   },
+    { K_BIN(avx2, muli),   K_BIN(avx2, mulf),   K_BIN(avx2, muld)   },
+    { K_NONE,              K_BIN(avx2, divf),   K_BIN(avx2, divd)   },
+    { K_BIN(avx2, eqi),    K_BIN(avx2, eqf),    K_BIN(avx2, eqd)    },
+    { K_BIN(avx2, nei),    K_BIN(avx2, nef),    K_BIN(avx2, ned)    },
+    { K_BIN(avx2, lti),    K_BIN(avx2, ltf),    K_BIN(avx2, ltd)    },
+    { K_BIN(avx2, lei),    K_BIN(avx2, lef),    K_BIN(avx2, led)    },
+    { K_BIN(avx2, gti),    K_BIN(avx2, gtf),    K_BIN(avx2, gtd)    },
+    { K_BIN(avx2, gei),    K_BIN(avx2, gef),    K_BIN(avx2, ged)    },
+    { K_RED(avx2, mini),   K_RED(avx2, minf),   K_RED(avx2, mind)   },
+    { K_RED(avx2, maxi),   K_RED(avx2, maxf),   K_RED(avx2, maxd)   },
+    { K_DOT(avx2, i),      K_DOT(avx2, f),      K_DOT(avx2, d)      },
+};
+
+#endif /* SIMD_X86 */
+
+static mpr_simd_isa get_isa(void)
+{
+#if SIMD_X86
+    if (__builtin_cpu_supports("avx2"))
+        return MPR_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return MPR_SIMD_SSE2;
+#endif
+    return MPR_SIMD_SCALAR;
+}
+
+const mpr_simd_kernel_t *mpr_simd_get_kernel(mpr_simd_op op, mpr_type type, mpr_simd_isa isa)
+{
+    const mpr_simd_kernel_t (*tbl)[3], *k;
+    int type_idx;
+
+    RETURN_ARG_UNLESS(op >= 0 && op < MPR_SIMD_N_OPS, 0);
+    switch (type) {
+        case MPR_INT32: type_idx = 0;   break;
+        case MPR_FLT:   type_idx = 1;   break;
+        case MPR_DBL:   type_idx = 2;   break;
+        default:        return 0;
+    }
+    if (MPR_SIMD_AUTO == isa || isa > get_isa())
+        isa = get_isa();
+    switch (isa) {
+#if SIMD_X86
+        case MPR_SIMD_AVX2: tbl = avx2_kernels;     break;
+        case MPR_SIMD_SSE2: tbl = sse2_kernels;     break;
+#endif
+        default:            tbl = scalar_kernels;   break;
+    }
+    k = &tbl[op][type_idx];
+    return (k->vv || k->reduce) ? k : 0;
+}
+
+mpr_simd_isa mpr_simd_get_isa(void)
+{
+    return get_isa();
+}
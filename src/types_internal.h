@@ -30,6 +30,7 @@
  * be repeated, therefore they are refered to by struct name. */
 
 typedef struct _mpr_expr *mpr_expr;
+typedef struct _mpr_expr_eval_buffer *mpr_expr_eval_buffer;
 
 /* Forward declarations for this file. */
 
@@ -43,6 +44,7 @@ typedef struct _mpr_local_dev *mpr_local_dev;
 struct _mpr_map;
 struct _mpr_allocated_t;
 struct _mpr_id_map;
+struct addrinfo;
 typedef int mpr_sig_group;
 
 /**** String tables ****/
@@ -106,12 +108,13 @@ typedef struct _mpr_subscription {
 #define SERVER_DEVICE   2
 #define SERVER_UDP      2
 #define SERVER_TCP      3
+#define SERVER_UNIX     4   /* Unix domain datagrams from devices on the same host. */
 
 /*! A structure that keeps information about network communications. */
 typedef struct _mpr_net {
     struct _mpr_graph *graph;
 
-    lo_server servers[4];
+    lo_server servers[5];
 
     struct {
         lo_address bus;             /*!< LibLo address for the multicast bus. */
@@ -135,6 +138,13 @@ typedef struct _mpr_net {
 
     struct _mpr_rtr *rtr;
 
+    struct {
+        struct _mpr_link **links;       /*!< Links of the bundles waiting to be sent. */
+        struct _mpr_bundle **bundles;   /*!< UDP bundles waiting to be sent together. */
+        int num;
+        int size;
+    } udp_queue;
+
     int random_id;                  /*!< Random id for allocation speedup. */
     int msgs_recvd;                 /*!< 1 if messages have been received on the
                                      *   multicast bus/mesh. */
@@ -265,8 +275,16 @@ typedef struct _mpr_value_buffer
     mpr_time *times;            /*!< Time for each sample of stored history. */
     int8_t pos;                 /*!< Current position in the circular buffer. */
     uint8_t full;               /*!< Indicates whether complete buffer contains valid data. */
+    uint8_t slot;               /*!< Column of the value slab used by this instance. */
 } mpr_value_buffer_t, *mpr_value_buffer;
 
+/* The history of every instance is a ring buffer with a power-of-two capacity so
+ * that positions can be wrapped using the mask instead of a modulo. Samples and
+ * times for all instances are stored in a single cache-aligned slab laid out as
+ * [hist][inst][vlen], so that each history row holds the same sample of every
+ * instance. The samps and times pointers of each instance point into the first
+ * row and successive rows are found using the row strides. Slots left by removed
+ * instances are kept on a free list and reused rather than compacted. */
 typedef struct _mpr_value
 {
     mpr_value_buffer inst;      /*!< Array of value histories for each signal instance. */
@@ -274,6 +292,13 @@ typedef struct _mpr_value
     uint8_t num_inst;           /*!< Number of instances. */
     mpr_type type;              /*!< The type of this signal. */
     int8_t mlen;                /*!< History size of the buffer. */
+    uint8_t mask;               /*!< Ring buffer capacity minus one. */
+    int max_inst;               /*!< Number of instance slots in each history row. */
+    size_t samp_stride;         /*!< Size in bytes of one history row of samples. */
+    void *slab;                 /*!< Aligned storage for samples and times. */
+    void *mem;                  /*!< Allocation containing the slab. */
+    uint8_t *free_slots;        /*!< Stack of unused instance slots. */
+    int num_free;               /*!< Number of unused instance slots. */
 } mpr_value_t, *mpr_value;
 
 /*! Bit flags for indicating instance id_map status. */
@@ -298,6 +323,8 @@ typedef struct _mpr_sig_inst
 
     void *val;                  /*!< The current value of this signal instance. */
     mpr_time time;              /*!< The time associated with the current value. */
+    volatile uint32_t seq;      /*!< Incremented before and after each change of value and
+                                 *   time, so it is odd while they are being written. */
 
     uint8_t idx;                /*!< Index for accessing value history. */
     uint8_t has_val;            /*!< Indicates whether this instance has a value. */
@@ -311,6 +338,8 @@ typedef struct _mpr_sig_idmap
     struct _mpr_sig_inst *inst; /*!< Signal instance. */
     int status;                 /*!< Either 0 or a combination of UPDATED,
                                  *   RELEASED_LOCALLY and RELEASED_REMOTELY. */
+    int hash_bucket[2];         /*!< LID and GID hash buckets holding this entry. */
+    int hash_next[2];           /*!< Next entry in the LID and GID buckets, plus one. */
 } mpr_sig_idmap_t;
 
 #define MPR_SIG_STRUCT_ITEMS                                                            \
@@ -346,7 +375,12 @@ typedef struct _mpr_local_sig
 
     struct _mpr_sig_idmap *idmaps;  /*!< ID maps and active instances. */
     int idmap_len;
-    struct _mpr_sig_inst **inst;    /*!< Array of pointers to the signal insts. */
+    int *idmap_buckets;             /*!< Hash buckets of idmap indices plus one, keyed by
+                                     *   LID and then by GID. */
+    int *inst_idmaps;               /*!< Idmap index plus one of each instance, by idx. */
+    struct _mpr_sig_inst **inst;    /*!< Array of pointers to the signal insts, sorted by id. */
+    struct _mpr_sig_inst **inst_by_idx; /*!< The same insts by idx, which is never reordered
+                                         *   while polling so other threads can read it. */
     char *vec_known;                /*!< Bitflags when entire vector is known. */
     char *updated_inst;             /*!< Bitflags to indicate updated instances. */
 
@@ -357,6 +391,11 @@ typedef struct _mpr_local_sig
                                      *  instance event handler. */
 
     mpr_sig_group group;            /* TODO: replace with hierarchical instancing */
+    struct _mpr_rtr_sig *rsig;      /*!< Router entry for this signal if it is mapped. */
+    struct _mpr_local_sig *hash_next;   /*!< Next signal in the device path hash bucket. */
+    unsigned long path_hash;        /*!< Hash of the signal path. */
+    struct _mpr_sig_queue *queue;   /*!< Updates pushed from another thread, if reserved. */
+    struct _mpr_local_sig *queue_next;  /*!< Next signal of the device with a queue. */
     uint8_t locked;
     uint8_t updated;                /* TODO: fold into updated_inst bitflags. */
 } mpr_local_sig_t, *mpr_local_sig;
@@ -366,12 +405,23 @@ typedef struct _mpr_local_sig
 typedef struct _mpr_bundle {
     lo_bundle udp;
     lo_bundle tcp;
+    char *buf;          /*!< Preallocated OSC bundle encoded for sending over UDP, or queued
+                         *   updates for local signals if the link is to the same device. */
+    int size;           /*!< Allocated size of the bundle buffer. */
+    int len;            /*!< Number of bytes used in the bundle buffer. */
+    int count;          /*!< Number of messages in the bundle buffer. */
+    mpr_proto proto;    /*!< Protocol of the messages in the bundle buffer. */
+    int queued;         /*!< Non-zero while the bundle buffer is waiting to be sent. */
 } mpr_bundle_t, *mpr_bundle;
 
 #define NUM_BUNDLES 1
+#define MAX_UDP_BUNDLE_LEN 65507    /* largest UDP payload over IPv4 */
 #define LOCAL_DEV   0
 #define REMOTE_DEV  1
 
+/*! A single-producer, single-consumer ring of datagrams in shared memory. */
+typedef struct _mpr_shm *mpr_shm;
+
 typedef struct _mpr_link {
     mpr_obj_t obj;                  /* always first */
     mpr_dev devs[2];
@@ -381,10 +431,22 @@ typedef struct _mpr_link {
         lo_address admin;               /*!< Network address of remote endpoint */
         lo_address udp;                 /*!< Network address of remote endpoint */
         lo_address tcp;                 /*!< Network address of remote endpoint */
+        struct addrinfo *udp_raw;       /*!< Resolved UDP address for encoded bundles */
+        struct sockaddr_un *unix_raw;   /*!< Unix socket of a device on the same host */
     } addr;
 
+    mpr_shm shm_out;                    /*!< Ring for bundles sent to a device on this host. */
+    mpr_shm shm_in;                     /*!< Ring for bundles received from it. */
+    int use_shm;                        /*!< Non-zero once a map over this link uses SHM. */
+
     mpr_bundle_t bundles[NUM_BUNDLES];  /*!< Circular buffer to handle interrupts during poll() */
 
+    struct {
+        char *buf;                      /*!< Updates for local signals being delivered. */
+        int len;
+        int size;
+    } local_msgs;
+
     mpr_sync_clock_t clock;
 } mpr_link_t, *mpr_link;
 
@@ -453,16 +515,24 @@ typedef struct _mpr_local_map {
     int num_vars;                   /*!< Number of user variables. */
     int num_inst;                   /*!< Number of local instances. */
 
+    struct _mpr_local_map *next_updated;    /*!< The next map in the device worklist. */
+    int rank;                       /*!< Length of the longest chain of local maps feeding this
+                                     *   map's sources, used to order the device worklists. */
+    uint32_t cycle;                 /*!< The last processing cycle in which the map was
+                                     *   evaluated. */
+
     uint8_t is_local_only;
     uint8_t one_src;
-    uint8_t updated;
+    uint8_t updated;                /*!< Non-zero if the map is in a device worklist. */
 } mpr_local_map_t, *mpr_local_map;
 
 /*! The rtr_sig is a linked list containing a signal and a list of mapping
- *  slots.  TODO: This should be replaced with a more efficient approach
- *  such as a hash table or search tree. */
+ *  slots. Each local signal also points to its own rtr_sig, and the router
+ *  indexes them in a hash table by signal path for loopback delivery. */
 typedef struct _mpr_rtr_sig {
     struct _mpr_rtr_sig *next;      /*!< The next rtr_sig in the list. */
+    struct _mpr_rtr_sig *hash_next; /*!< The next rtr_sig in the same hash bucket. */
+    unsigned long path_hash;        /*!< Hash of the signal path. */
 
     struct _mpr_rtr *link;          /*!< The parent link. */
     struct _mpr_local_sig *sig;     /*!< The associated signal. */
@@ -477,12 +547,21 @@ typedef struct _mpr_rtr_sig {
 typedef struct _mpr_rtr {
     struct _mpr_local_dev *dev;     /*!< The device associated with this link. */
     mpr_rtr_sig sigs;               /*!< The list of mappings for each signal. */
+    mpr_rtr_sig *buckets;           /*!< Hash table of rtr_sigs keyed by signal path. */
+    int num_buckets;
+    int num_sigs;
+    int ranks_dirty;                /*!< Non-zero if maps were added or removed since their ranks
+                                     *   were last computed. */
 } mpr_rtr_t, *mpr_rtr;
 
 /*! The instance ID map is a linked list of int32 instance ids for coordinating
  *  remote and local instances. */
 typedef struct _mpr_id_map {
     struct _mpr_id_map *next;       /*!< The next id map in the list. */
+    struct _mpr_id_map *prev;       /*!< The previous id map in the active list. */
+    struct _mpr_id_map *next_LID;   /*!< The next id map in the same LID hash bucket. */
+    struct _mpr_id_map *next_GID;   /*!< The next id map in the same GID hash bucket. */
+    mpr_sig_group group;
 
     mpr_id GID;                     /*!< Hash for originating device. */
     mpr_id LID;                     /*!< Local instance id to map. */
@@ -513,6 +592,13 @@ struct _mpr_dev {
     MPR_DEV_STRUCT_ITEMS
 };
 
+/*! An intrusive FIFO of local maps with updated values waiting to be processed. */
+typedef struct _mpr_map_worklist {
+    struct _mpr_local_map *head;
+    struct _mpr_local_map *tail;
+    int len;
+} mpr_map_worklist_t, *mpr_map_worklist;
+
 struct _mpr_local_dev {
     MPR_DEV_STRUCT_ITEMS
 
@@ -526,15 +612,40 @@ struct _mpr_local_dev {
     struct {
         struct _mpr_id_map **active;    /*!< The list of active instance id maps. */
         struct _mpr_id_map *reserve;    /*!< The list of reserve instance id maps. */
+        struct _mpr_id_map **LID_hash;  /*!< Active id maps hashed by group and LID. */
+        struct _mpr_id_map **GID_hash;  /*!< Active id maps hashed by group and GID. */
+        int num_buckets;
+        int num_active;
     } idmaps;
 
+    struct {
+        struct _mpr_local_sig **buckets;    /*!< Signals accepting updates, hashed by path. */
+        int num_buckets;
+        int num_sigs;
+    } sig_paths;
+
+    mpr_expr_eval_buffer expr_eval_buff;    /*!< Evaluation stack for this device's maps. */
+    char *recv_buf;                     /*!< Buffer for datagrams read from the data port. */
+    int recv_slots;                     /*!< Number of datagrams recv_buf can hold. */
+    mpr_local_sig queued_sigs;          /*!< Signals with queues to drain when polled. */
+    struct _mpr_poll_thread *thread;    /*!< Thread polling the device in the background. */
+
+    mpr_map_worklist_t updated_in;      /*!< Incoming maps with updated sources. */
+    mpr_map_worklist_t updated_out;     /*!< Outgoing maps with updated sources. */
+    mpr_map_worklist_t deferred;        /*!< Updated maps left for the next processing cycle. */
+    uint32_t map_cycle;                 /*!< Counter of map processing cycles. */
+
     mpr_time time;
+    mpr_time bundle_time;               /*!< Timetag of the bundle being dispatched. */
     int num_sig_groups;
+    int batch_depth;                    /*!< Nesting depth of mpr_dev_begin_batch() calls. */
+    uint64_t syscalls_saved;            /*!< Bundles sent in a system call with earlier ones. */
     uint8_t time_is_stale;
     uint8_t polling;
     uint8_t bundle_idx;
     uint8_t sending;
     uint8_t receiving;
+    uint8_t sig_events;                 /*!< Set when a signal event was dispatched while polling. */
 };
 
 /**** Messages ****/
@@ -10,109 +10,149 @@
 #include "types_internal.h"
 #include <mapper/mapper.h>
 
-MPR_INLINE static int _min(int a, int b) { return a < b ? a : b; }
+#define VALUE_ALIGN 64
+
+MPR_INLINE static size_t _align(size_t size)
+{
+    return (size + VALUE_ALIGN - 1) & ~(size_t)(VALUE_ALIGN - 1);
+}
+
+MPR_INLINE static int _pow2(int n)
+{
+    int p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+MPR_INLINE static mpr_time *_times(mpr_value v)
+{
+    return (mpr_time*)((char*)v->slab + _align((v->mask + 1) * v->samp_stride));
+}
+
+/* Point an instance buffer at its slot in the first history row. */
+MPR_INLINE static void _set_inst_ptrs(mpr_value v, mpr_value_buffer b, int slot)
+{
+    b->slot = slot;
+    b->samps = (char*)v->slab + slot * v->vlen * mpr_type_get_size(v->type);
+    b->times = _times(v) + slot;
+}
+
+/* Allocate a zeroed slab with cap history rows of max_inst slots and push every slot from
+ * num_used upwards onto the free list. */
+static void _alloc_slab(mpr_value v, int cap, int max_inst, int samp_size, int num_used)
+{
+    int i;
+    v->mask = cap - 1;
+    v->max_inst = max_inst;
+    v->samp_stride = (size_t)max_inst * samp_size;
+    v->mem = calloc(1, _align(cap * v->samp_stride) + cap * max_inst * sizeof(mpr_time)
+                    + VALUE_ALIGN - 1);
+    v->slab = (void*)_align((size_t)v->mem);
+    v->inst = realloc(v->inst, sizeof(mpr_value_buffer_t) * max_inst);
+    v->free_slots = realloc(v->free_slots, max_inst);
+    for (i = max_inst - 1, v->num_free = 0; i >= num_used; i--)
+        v->free_slots[v->num_free++] = i;
+}
+
+/* Zero every history row of an instance slot. */
+static void _clear_slot(mpr_value v, int slot)
+{
+    int i, samp_size = v->vlen * mpr_type_get_size(v->type);
+    char *s = (char*)v->slab + slot * samp_size;
+    mpr_time *t = _times(v) + slot;
+    for (i = 0; i <= v->mask; i++, s += v->samp_stride, t += v->max_inst) {
+        memset(s, 0, samp_size);
+        memset(t, 0, sizeof(mpr_time));
+    }
+}
 
 void mpr_value_realloc(mpr_value v, int vlen, mpr_type type, int mlen, int num_inst, int is_input)
 {
-    int i, samp_size;
-    mpr_value_buffer_t *b, tmp;
+    int i, j, cap, old_cap, keep, samp_size;
     RETURN_UNLESS(v && mlen && num_inst >= v->num_inst);
-    samp_size = vlen * mpr_type_get_size(type);
 
-    if (!v->inst || num_inst > v->num_inst) {
-        if (v->inst)
-            v->inst = realloc(v->inst, sizeof(mpr_value_buffer_t) * num_inst);
-        else {
-            v->inst = malloc(sizeof(mpr_value_buffer_t) * num_inst);
-            v->num_inst = 0;
-        }
-        /* initialize new instances */
-        for (i = v->num_inst; i < num_inst; i++) {
-            b = &v->inst[i];
-            b->samps = calloc(1, mlen * samp_size);
-            b->times = calloc(1, mlen * sizeof(mpr_time));
-            b->pos = -1;
-            b->full = 0;
-        }
+    if (!v->inst) {
+        v->num_inst = 0;
+        v->max_inst = 0;
+        v->num_free = 0;
+        v->mem = v->slab = 0;
+        v->free_slots = 0;
     }
+    old_cap = v->inst ? v->mask + 1 : 0;
+    cap = _pow2(mlen);
+    keep = v->inst && is_input && vlen == v->vlen && type == v->type;
+    samp_size = vlen * mpr_type_get_size(type);
 
-    if (!is_input || vlen != v->vlen || type != v->type) {
-        /* reallocate old instances (v->num_inst has not yet been updated) */
+    /* Ring buffers holding history are never shrunk, so unless they need to grow or more
+     * instances are needed than there are free slots this only changes the history size. */
+    if (keep && (cap > old_cap || num_inst - v->num_inst > v->num_free)) {
+        /* Move existing histories into a larger slab, compacting their slots. If the ring
+         * buffers grow each history is unrolled in order from the oldest sample. */
+        void *old_mem = v->mem;
+        char *old_slab = v->slab;
+        mpr_time *old_times = _times(v);
+        size_t old_stride = v->samp_stride;
+        int old_max_inst = v->max_inst;
+        if (cap < old_cap)
+            cap = old_cap;
+        _alloc_slab(v, cap, num_inst > v->max_inst ? _pow2(num_inst) : v->max_inst, samp_size,
+                    v->num_inst);
         for (i = 0; i < v->num_inst; i++) {
-            b = &v->inst[i];
-            b->samps = realloc(b->samps, mlen * samp_size);
-            b->times = realloc(b->times, mlen * sizeof(mpr_time));
-            /* Initialize entire value to 0 */
-            memset(b->samps, 0, mlen * samp_size);
-            memset(b->times, 0, mlen * sizeof(mpr_time));
-            b->pos = -1;
-            b->full = 0;
+            mpr_value_buffer b = &v->inst[i];
+            int old_slot = b->slot;
+            _set_inst_ptrs(v, b, i);
+            if (b->pos < 0)
+                continue;
+            for (j = 0; j < old_cap; j++) {
+                int from = cap == old_cap ? j : (b->pos + 1 + j) & (old_cap - 1);
+                memcpy((char*)b->samps + j * v->samp_stride,
+                       old_slab + from * old_stride + old_slot * samp_size, samp_size);
+                b->times[j * v->max_inst] = old_times[from * old_max_inst + old_slot];
+            }
+            if (cap != old_cap)
+                b->pos = old_cap - 1;
         }
-        goto done;
+        free(old_mem);
     }
-
-    if (mlen == v->mlen)
-        goto done;
-
-    /* only the memory size is different */
-
-    for (i = 0; i < v->num_inst; i++) {
-        b = &v->inst[i];
-        tmp.samps = malloc(samp_size * mlen);
-        tmp.times = malloc(sizeof(mpr_time) * mlen);
-
-        /* TODO: don't bother copying memory if pos is -1 */
-        if (mlen > v->mlen) {
-            int npos = v->mlen - b->pos;
-            /* copy from [v->pos, v->mlen] to [0, v->mlen - v->pos] */
-            memcpy(tmp.samps, (char*)b->samps + b->pos * samp_size, npos * samp_size);
-            memcpy(tmp.times, &b->times[b->pos], npos * sizeof(mpr_time));
-            /* copy from [0, v->pos] to [v->mlen - v->pos, v->mlen] */
-            memcpy((char*)tmp.samps + npos * samp_size, b->samps, b->pos * samp_size);
-            memcpy(&tmp.times[npos], b->times, b->pos * sizeof(mpr_time));
-            /* zero remainder */
-            memset((char*)tmp.samps + v->mlen * samp_size, 0, (mlen - v->mlen) * samp_size);
-            memset(&tmp.times[v->mlen], 0, (mlen - v->mlen) * sizeof(mpr_time));
-            b->pos = v->mlen;
-            b->full = 0;
+    else if (!keep) {
+        /* Reset existing instances, reusing the slab if its layout is unchanged. */
+        if (v->inst && cap == old_cap && samp_size == v->vlen * mpr_type_get_size(v->type)
+            && num_inst <= v->max_inst) {
+            for (i = v->max_inst - 1, v->num_free = 0; i >= 0; i--)
+                v->free_slots[v->num_free++] = i;
         }
         else {
-            int len = _min(v->mlen - b->pos, mlen);
-            memcpy(tmp.samps, (char*)b->samps + b->pos * samp_size, len * samp_size);
-            memcpy(tmp.times, &b->times[b->pos], len * sizeof(mpr_time));
-            if (mlen > len) {
-                memcpy((char*)tmp.samps + len * samp_size, b->samps, (mlen - len) * samp_size);
-                memcpy(&tmp.times[len], b->times, (mlen - len) * sizeof(mpr_time));
-            }
-            b->pos = len;
-            b->full = (b->pos > mlen);
+            FUNC_IF(free, v->mem);
+            _alloc_slab(v, cap, _pow2(num_inst), samp_size, 0);
         }
-        free(b->samps);
-        free(b->times);
-        b->samps = tmp.samps;
-        b->times = tmp.times;
+        v->num_inst = 0;
     }
 
-done:
     v->vlen = vlen;
     v->type = type;
     v->mlen = mlen;
+
+    /* initialize new instances using free slots */
+    for (i = v->num_inst; i < num_inst; i++) {
+        mpr_value_buffer b = &v->inst[i];
+        _set_inst_ptrs(v, b, v->free_slots[--v->num_free]);
+        _clear_slot(v, b->slot);
+        b->pos = -1;
+        b->full = 0;
+    }
     v->num_inst = num_inst;
 }
 
 int mpr_value_remove_inst(mpr_value v, int idx)
 {
-    int i;
     RETURN_ARG_UNLESS(idx >= 0 && idx < v->num_inst, v->num_inst);
-    free(v->inst[idx].samps);
-    free(v->inst[idx].times);
-    for (i = idx + 1; i < v->num_inst; i++) {
-        /* shift values down */
-        memcpy(&(v->inst[i-1]), &(v->inst[i]), sizeof(mpr_value_buffer_t));
-    }
+    /* return the slot to the free list and shift the following instance buffers down */
+    v->free_slots[v->num_free++] = v->inst[idx].slot;
+    memmove(&v->inst[idx], &v->inst[idx + 1],
+            (v->num_inst - idx - 1) * sizeof(mpr_value_buffer_t));
     --v->num_inst;
     assert(v->num_inst >= 0);
-    v->inst = realloc(v->inst, sizeof(mpr_value_buffer_t) * v->num_inst);
     return v->num_inst;
 }
 
@@ -121,8 +161,7 @@ void mpr_value_reset_inst(mpr_value v, int idx)
     mpr_value_buffer b;
     RETURN_UNLESS(v->inst);
     b = &v->inst[idx];
-    memset(b->samps, 0, v->mlen * v->vlen * mpr_type_get_size(v->type));
-    memset(b->times, 0, v->mlen * sizeof(mpr_time));
+    _clear_slot(v, b->slot);
     b->pos = -1;
     b->full = 0;
 }
@@ -130,24 +169,27 @@ void mpr_value_reset_inst(mpr_value v, int idx)
 void mpr_value_set_sample(mpr_value v, int idx, void *s, mpr_time t)
 {
     mpr_value_buffer b = &v->inst[idx];
-    b->pos += 1;
-    if (b->pos >= v->mlen) {
+    if (b->pos >= v->mask) {
         b->pos = 0;
         b->full = 1;
     }
+    else
+        ++b->pos;
     memcpy(mpr_value_get_samp(v, idx), s, v->vlen * mpr_type_get_size(v->type));
     memcpy(mpr_value_get_time(v, idx), &t, sizeof(mpr_time));
 }
 
 void mpr_value_free(mpr_value v) {
-    int i;
     RETURN_UNLESS(v->inst);
-    for (i = 0; i < v->num_inst; i++) {
-        FUNC_IF(free, v->inst[i].samps);
-        FUNC_IF(free, v->inst[i].times);
-    }
+    FUNC_IF(free, v->mem);
+    FUNC_IF(free, v->free_slots);
     free(v->inst);
     v->inst = 0;
+    v->mem = v->slab = 0;
+    v->free_slots = 0;
+    v->num_inst = 0;
+    v->max_inst = 0;
+    v->num_free = 0;
 }
 
 #ifdef DEBUG
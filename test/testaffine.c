@@ -0,0 +1,248 @@
+#include "../src/mapper_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define MAX_VARS 8
+#define MAX_LEN 8
+
+int verbose = 1;
+int iterations = 200000;
+
+/* Linear expressions as generated for maps between signals with ranges [0,10] and [-1,1]. */
+#define LINEAR_COEFFS "sRange=sMax-sMin;m=sRange?((dMax-dMin)/sRange):0;"          \
+                      "b=sRange?(dMin*sMax-dMax*sMin)/sRange:dMin;"
+#define LINEAR_MAP "sMin=0;sMax=10;dMin=-1;dMax=1;" LINEAR_COEFFS
+#define LINEAR_MAP_VEC "sMin=[0,0,0];sMax=[10,10,10];dMin=[-1,-1,-1];dMax=[1,1,1];" \
+                       LINEAR_COEFFS
+
+typedef struct _test_expr {
+    const char *str;
+    mpr_type type;
+    int src_len;
+    int dst_len;
+    int fused;          /* expect the fused kernel to be used */
+} test_expr_t;
+
+static const test_expr_t exprs[] = {
+    { "y=x*2+1",                                    MPR_FLT,   1, 1, 1 },
+    { "y=2*x-1",                                    MPR_FLT,   4, 4, 1 },
+    { "y=3-x*0.5",                                  MPR_FLT,   3, 3, 1 },
+    { "y=x+1",                                      MPR_FLT,   2, 2, 1 },
+    { "y=x*2",                                      MPR_FLT,   2, 2, 1 },
+    { "y=min(max(x*2.5-1,0),10)",                   MPR_FLT,   3, 3, 1 },
+    { "y=max(0,x*0.5+1)",                           MPR_FLT,   1, 1, 1 },
+    { "y=x*0.25+0.5",                               MPR_DBL,   2, 2, 1 },
+    { "y=x*3+2",                                    MPR_INT32, 2, 2, 1 },
+    { LINEAR_MAP "y=m*x+b;",                        MPR_FLT,   1, 1, 1 },
+    { LINEAR_MAP "y=m*x+b;",                        MPR_DBL,   1, 1, 1 },
+    { LINEAR_MAP_VEC "y=m*x+b;",                    MPR_FLT,   3, 3, 1 },
+    { LINEAR_MAP_VEC "y=m*x+b;",                    MPR_DBL,   3, 3, 1 },
+    { LINEAR_MAP_VEC "y[0:2]=m*x+b;",               MPR_FLT,   3, 5, 1 },
+    { LINEAR_MAP_VEC "y=m*x[0:2]+b;",               MPR_FLT,   5, 3, 1 },
+    { "y[1:2]=1.5*x[0:1]+[1,2]",                    MPR_FLT,   2, 3, 0 },
+    { "y=x*x+1",                                    MPR_FLT,   1, 1, 0 },
+    { "y=x{-1}*2+1",                                MPR_FLT,   1, 1, 0 },
+    { "y=x*2+1;y=y+1",                              MPR_FLT,   1, 1, 0 },
+};
+
+#define NUM_EXPRS (sizeof(exprs) / sizeof(test_expr_t))
+
+typedef struct _eval_data {
+    mpr_expr expr;
+    mpr_value_t src, dst, vars[MAX_VARS];
+    int num_vars;
+} eval_data_t;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static int setup(eval_data_t *d, const test_expr_t *t, int use_bc, int use_lin)
+{
+    int i;
+    memset(d, 0, sizeof(eval_data_t));
+    d->expr = mpr_expr_new_from_str(t->str, 1, &t->type, &t->src_len, t->type, t->dst_len);
+    if (!d->expr)
+        return 1;
+    mpr_expr_set_use_bytecode(d->expr, use_bc);
+    use_lin = mpr_expr_set_use_linear(d->expr, use_lin);
+
+    mpr_value_realloc(&d->src, t->src_len, t->type, mpr_expr_get_in_hist_size(d->expr, 0), 1, 0);
+    d->src.inst[0].pos = 0;
+    mpr_value_realloc(&d->dst, t->dst_len, t->type, mpr_expr_get_out_hist_size(d->expr), 1, 1);
+
+    d->num_vars = mpr_expr_get_num_vars(d->expr);
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++) {
+        mpr_value_realloc(&d->vars[i], mpr_expr_get_var_vec_len(d->expr, i),
+                          mpr_expr_get_var_type(d->expr, i), 1, 1, 0);
+    }
+    return use_lin;
+}
+
+static void cleanup(eval_data_t *d)
+{
+    int i;
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++)
+        mpr_value_free(&d->vars[i]);
+    mpr_value_free(&d->src);
+    mpr_value_free(&d->dst);
+    if (d->expr)
+        mpr_expr_free(d->expr);
+}
+
+static void set_input(eval_data_t *d, const test_expr_t *t, int iter)
+{
+    void *x = mpr_value_get_samp(&d->src, 0);
+    int i;
+    for (i = 0; i < t->src_len; i++) {
+        double val = ((iter + i * 5) % 17) * 0.75 - 3;
+        switch (t->type) {
+            case MPR_INT32: ((int*)x)[i] = (int)(val * 4); break;
+            case MPR_FLT:   ((float*)x)[i] = (float)val;   break;
+            default:        ((double*)x)[i] = val;         break;
+        }
+    }
+}
+
+static int eval(mpr_expr_eval_buffer buff, eval_data_t *d, mpr_type *types)
+{
+    mpr_value src_p = &d->src, vars_p = d->vars;
+    mpr_time t = {0, 0};
+    return mpr_expr_eval(buff, d->expr, &src_p, &vars_p, &d->dst, &t, types, 0);
+}
+
+static double run_bench(mpr_expr_eval_buffer buff, eval_data_t *d, const test_expr_t *t)
+{
+    mpr_type types[MAX_LEN];
+    mpr_time start, end;
+    int i;
+    set_input(d, t, 1);
+    mpr_time_set(&start, MPR_NOW);
+    for (i = 0; i < iterations; i++)
+        eval(buff, d, types);
+    mpr_time_set(&end, MPR_NOW);
+    return mpr_time_get_diff(end, start);
+}
+
+/* Check that the fused kernel matches the interpreter exactly for a range of inputs. */
+static int check(mpr_expr_eval_buffer buff, const test_expr_t *t, eval_data_t *ref,
+                 eval_data_t *fused)
+{
+    mpr_type types_ref[MAX_LEN], types_fused[MAX_LEN];
+    int i, status_ref, status_fused, size = mpr_type_get_size(t->type) * t->dst_len;
+    for (i = 0; i < 40; i++) {
+        set_input(ref, t, i);
+        set_input(fused, t, i);
+        status_ref = eval(buff, ref, types_ref);
+        status_fused = eval(buff, fused, types_fused);
+        if (status_ref != status_fused) {
+            eprintf("  status mismatch at iteration %d (%d != %d)\n", i, status_ref, status_fused);
+            return 1;
+        }
+        if (ref->dst.inst[0].pos != fused->dst.inst[0].pos) {
+            eprintf("  position mismatch at iteration %d\n", i);
+            return 1;
+        }
+        if (memcmp(types_ref, types_fused, t->dst_len)) {
+            eprintf("  type mismatch at iteration %d\n", i);
+            return 1;
+        }
+        if (memcmp(mpr_value_get_samp(&ref->dst, 0), mpr_value_get_samp(&fused->dst, 0), size)) {
+            eprintf("  value mismatch at iteration %d\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    mpr_expr_eval_buffer buff;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testaffine.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    buff = mpr_expr_new_eval_buffer(NULL);
+
+    for (i = 0; i < NUM_EXPRS && !result; i++) {
+        const test_expr_t *t = &exprs[i];
+        eval_data_t interp, bytecode, fused;
+        int use_lin;
+
+        eprintf("'%s' (%s, length %d -> %d)\n", t->str, t->type == MPR_INT32 ? "int"
+                : t->type == MPR_FLT ? "float" : "double", t->src_len, t->dst_len);
+        setup(&interp, t, 0, 0);
+        setup(&bytecode, t, 1, 0);
+        use_lin = setup(&fused, t, 1, 1);
+        if (!interp.expr || !bytecode.expr || !fused.expr) {
+            eprintf("  failed to parse expression\n");
+            result = 1;
+        }
+        else if (use_lin != t->fused) {
+            eprintf("  fused kernel %s\n", use_lin ? "used unexpectedly" : "not used");
+            result = 1;
+        }
+        else
+            result = check(buff, t, &interp, &fused);
+
+        if (!result) {
+            double interp_time = run_bench(buff, &interp, t);
+            double bytecode_time = run_bench(buff, &bytecode, t);
+            double fused_time = run_bench(buff, &fused, t);
+            eprintf("  %f seconds interpreted, %f seconds bytecode, %f seconds %s (%.2fx)\n",
+                    interp_time, bytecode_time, fused_time, use_lin ? "fused" : "default",
+                    fused_time > 0 ? interp_time / fused_time : 0);
+        }
+        cleanup(&interp);
+        cleanup(&bytecode);
+        cleanup(&fused);
+    }
+
+    mpr_expr_free_eval_buffer(buff);
+
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
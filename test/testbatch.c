@@ -0,0 +1,241 @@
+#include "../src/mapper_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define NUM_EXPRS 8
+#define VLEN 3
+#define MAX_VARS 4
+#define MAX_INST 200
+
+int verbose = 1;
+int iterations = 2000;
+
+static const char *expr_strs[NUM_EXPRS] = {
+    "y=x*2+1",
+    "y=(x+1)*(x-1)/(x*x+1)",
+    "s=s+x;y=s",
+    "y=x+y{-1}",
+    "y=x.sum()*[1,2,3]",
+    "y{-1}=100;y=y{-1}*0.9+x*0.1",
+    "alive=x[0]>2;y=x*0.5",
+    "y=x-x.pool().mean()",
+};
+
+static const int inst_counts[] = {1, 4, 16, 64, 200};
+
+typedef struct _eval_data {
+    mpr_expr expr;
+    mpr_value_t src, dst, vars[MAX_VARS];
+    int num_vars;
+} eval_data_t;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static void setup(eval_data_t *d, const char *str, int num_inst)
+{
+    mpr_type src_type = MPR_FLT;
+    int i, j, src_len = VLEN;
+
+    memset(d, 0, sizeof(eval_data_t));
+    d->expr = mpr_expr_new_from_str(str, 1, &src_type, &src_len, MPR_FLT, VLEN);
+    if (!d->expr)
+        return;
+
+    mpr_value_realloc(&d->src, VLEN, MPR_FLT, mpr_expr_get_in_hist_size(d->expr, 0), num_inst, 0);
+    for (i = 0; i < num_inst; i++) {
+        float *x;
+        d->src.inst[i].pos = 0;
+        x = mpr_value_get_samp(&d->src, i);
+        for (j = 0; j < VLEN; j++)
+            x[j] = (i % 7) + j * 0.5f;
+    }
+    mpr_value_realloc(&d->dst, VLEN, MPR_FLT, mpr_expr_get_out_hist_size(d->expr), num_inst, 1);
+
+    d->num_vars = mpr_expr_get_num_vars(d->expr);
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++) {
+        mpr_value_realloc(&d->vars[i], mpr_expr_get_var_vec_len(d->expr, i),
+                          mpr_expr_get_var_type(d->expr, i), 1, num_inst, 0);
+    }
+}
+
+static void cleanup(eval_data_t *d)
+{
+    int i;
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++)
+        mpr_value_free(&d->vars[i]);
+    mpr_value_free(&d->src);
+    mpr_value_free(&d->dst);
+    if (d->expr)
+        mpr_expr_free(d->expr);
+}
+
+/* Evaluate each instance in turn using mpr_expr_eval(). */
+static void eval_single(mpr_expr_eval_buffer buff, eval_data_t *d, const int *idx, int num_inst,
+                        int *status, mpr_type *types)
+{
+    mpr_value src_p = &d->src, vars_p = d->vars;
+    mpr_time t = {0, 0};
+    int i;
+    for (i = 0; i < num_inst; i++)
+        status[i] = mpr_expr_eval(buff, d->expr, &src_p, &vars_p, &d->dst, &t,
+                                  types + i * VLEN, idx[i]);
+}
+
+static void eval_batch(mpr_expr_eval_buffer buff, eval_data_t *d, const int *idx, int num_inst,
+                       int *status, mpr_type *types)
+{
+    mpr_value src_p = &d->src, vars_p = d->vars;
+    mpr_time t = {0, 0};
+    mpr_expr_eval_batch(buff, d->expr, &src_p, &vars_p, &d->dst, &t, types, idx, num_inst, status);
+}
+
+/* Check that both evaluation strategies produce identical results. */
+static int compare(const char *str, eval_data_t *a, eval_data_t *b, int num_inst,
+                   int *status_a, int *status_b, mpr_type *types_a, mpr_type *types_b)
+{
+    int i, j;
+    for (i = 0; i < num_inst; i++) {
+        float *ya, *yb;
+        if (status_a[i] != status_b[i]) {
+            eprintf("'%s': status mismatch for instance %d (%d != %d)\n",
+                    str, i, status_a[i], status_b[i]);
+            return 1;
+        }
+        if (a->dst.inst[i].pos != b->dst.inst[i].pos) {
+            eprintf("'%s': position mismatch for instance %d\n", str, i);
+            return 1;
+        }
+        if (a->dst.inst[i].pos < 0)
+            continue;
+        if (memcmp(types_a + i * VLEN, types_b + i * VLEN, VLEN)) {
+            eprintf("'%s': type mismatch for instance %d\n", str, i);
+            return 1;
+        }
+        ya = mpr_value_get_samp(&a->dst, i);
+        yb = mpr_value_get_samp(&b->dst, i);
+        for (j = 0; j < VLEN; j++) {
+            if (ya[j] != yb[j]) {
+                eprintf("'%s': value mismatch for instance %d (%g != %g)\n",
+                        str, i, ya[j], yb[j]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static double run_bench(mpr_expr_eval_buffer buff, eval_data_t *d, const int *idx, int num_inst,
+                        int *status, mpr_type *types, int batch)
+{
+    mpr_time start, end;
+    int i;
+    mpr_time_set(&start, MPR_NOW);
+    for (i = 0; i < iterations; i++) {
+        if (batch)
+            eval_batch(buff, d, idx, num_inst, status, types);
+        else
+            eval_single(buff, d, idx, num_inst, status, types);
+    }
+    mpr_time_set(&end, MPR_NOW);
+    return mpr_time_get_diff(end, start);
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, k, result = 0;
+    int idx[MAX_INST], status_a[MAX_INST], status_b[MAX_INST];
+    mpr_type types_a[MAX_INST * VLEN], types_b[MAX_INST * VLEN];
+    mpr_expr_eval_buffer buff;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testbatch.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 100;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    buff = mpr_expr_new_eval_buffer(NULL);
+
+    for (i = 0; i < MAX_INST; i++)
+        idx[i] = i;
+
+    for (i = 0; i < NUM_EXPRS && !result; i++) {
+        eprintf("'%s'\n", expr_strs[i]);
+        for (j = 0; j < sizeof(inst_counts) / sizeof(int) && !result; j++) {
+            int num_inst = inst_counts[j];
+            double single_time, batch_time;
+            eval_data_t a, b;
+
+            setup(&a, expr_strs[i], num_inst);
+            setup(&b, expr_strs[i], num_inst);
+            if (!a.expr || !b.expr) {
+                eprintf("  failed to parse expression\n");
+                result = 1;
+            }
+            else {
+                /* evaluate a few times from a fresh state to check equivalence */
+                for (k = 0; k < 3 && !result; k++) {
+                    eval_single(buff, &a, idx, num_inst, status_a, types_a);
+                    eval_batch(buff, &b, idx, num_inst, status_b, types_b);
+                    result = compare(expr_strs[i], &a, &b, num_inst, status_a, status_b,
+                                     types_a, types_b);
+                }
+            }
+            if (!result) {
+                single_time = run_bench(buff, &a, idx, num_inst, status_a, types_a, 0);
+                batch_time = run_bench(buff, &b, idx, num_inst, status_b, types_b, 1);
+                eprintf("  %3d instances: %f seconds single, %f seconds batched (%.2fx)%s\n",
+                        num_inst, single_time, batch_time,
+                        batch_time > 0 ? single_time / batch_time : 0,
+                        mpr_expr_get_can_batch(b.expr, num_inst) ? "" : " (maps evaluate singly)");
+            }
+            cleanup(&a);
+            cleanup(&b);
+        }
+    }
+
+    mpr_expr_free_eval_buffer(buff);
+
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,290 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define NUM_INST 64
+#define VLEN 3
+#define STEAL_POOL 4
+#define STEAL_INST (STEAL_POOL * 2)
+
+int verbose = 1;
+int done = 0;
+int iterations = 1000;
+
+mpr_dev src = 0;
+mpr_dev dst = 0;
+mpr_sig sendsig = 0;
+mpr_sig recvsig = 0;
+mpr_sig stealsig = 0;
+mpr_sig stealrecv = 0;
+
+int iteration = 0;
+int received = 0;
+int wrong_values = 0;
+float expected[NUM_INST][VLEN];
+int steal_received[STEAL_INST];
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    int idx;
+    if (!value)
+        return;
+    /* instance ids may differ between devices, so find the sending instance from the value */
+    idx = (int)((float*)value)[0] - iteration;
+    if (idx < 0 || idx >= NUM_INST || memcmp(value, expected[idx], sizeof(float) * VLEN))
+        ++wrong_values;
+    ++received;
+}
+
+/*! Release the instance chosen for stealing so that it can be reused. */
+void steal_handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+                   mpr_type type, const void *value, mpr_time t)
+{
+    if (event & MPR_SIG_REL_UPSTRM)
+        mpr_sig_release_inst(sig, instance);
+}
+
+void steal_recv_handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+                        mpr_type type, const void *value, mpr_time t)
+{
+    int idx;
+    if (!value) {
+        /* the sender stole this instance */
+        mpr_sig_release_inst(sig, instance);
+        return;
+    }
+    idx = (int)((float*)value)[0] - iteration;
+    if (idx < 0 || idx >= STEAL_INST || memcmp(value, expected[idx], sizeof(float) * VLEN))
+        ++wrong_values;
+    else
+        ++steal_received[idx];
+}
+
+int setup()
+{
+    int num_inst = NUM_INST, pool = STEAL_POOL, steal_mode = MPR_STEAL_OLDEST;
+    mpr_map map, steal_map;
+
+    src = mpr_dev_new("testbulk-send", 0);
+    dst = mpr_dev_new("testbulk-recv", 0);
+    if (!src || !dst)
+        return 1;
+
+    sendsig = mpr_sig_new(src, MPR_DIR_OUT, "outsig", VLEN, MPR_FLT, NULL,
+                          NULL, NULL, &num_inst, NULL, 0);
+    recvsig = mpr_sig_new(dst, MPR_DIR_IN, "insig", VLEN, MPR_FLT, NULL,
+                          NULL, NULL, &num_inst, handler, MPR_SIG_UPDATE);
+
+    /* fewer instances than each bulk update uses, so later ids steal earlier ones */
+    stealsig = mpr_sig_new(src, MPR_DIR_OUT, "stealsig", VLEN, MPR_FLT, NULL,
+                           NULL, NULL, &pool, steal_handler, MPR_SIG_REL_UPSTRM);
+    mpr_obj_set_prop(stealsig, MPR_PROP_STEAL_MODE, NULL, 1, MPR_INT32, &steal_mode, 1);
+    stealrecv = mpr_sig_new(dst, MPR_DIR_IN, "stealrecv", VLEN, MPR_FLT, NULL,
+                            NULL, NULL, &num_inst, steal_recv_handler, MPR_SIG_UPDATE);
+
+    while (!done && !(mpr_dev_get_is_ready(src) && mpr_dev_get_is_ready(dst))) {
+        mpr_dev_poll(src, 25);
+        mpr_dev_poll(dst, 25);
+    }
+
+    map = mpr_map_new(1, &sendsig, 1, &recvsig);
+    mpr_obj_push(map);
+    steal_map = mpr_map_new(1, &stealsig, 1, &stealrecv);
+    mpr_obj_push(steal_map);
+    while (!done && !(mpr_map_get_is_ready(map) && mpr_map_get_is_ready(steal_map))) {
+        mpr_dev_poll(src, 10);
+        mpr_dev_poll(dst, 10);
+    }
+    return done;
+}
+
+/*! Update every instance once per iteration, either with one bulk call or with one call per
+ *  instance, and wait for all updates to arrive. Returns the mean time per iteration, or a
+ *  negative value if updates were lost. */
+double run_updates(int bulk)
+{
+    int i, j, k;
+    double start = current_time(), sent;
+
+    for (i = 0; i < iterations && !done; i++) {
+        for (j = 0; j < NUM_INST; j++) {
+            for (k = 0; k < VLEN; k++)
+                expected[j][k] = i + j + k;
+        }
+        iteration = i;
+        received = 0;
+        if (bulk)
+            mpr_sig_set_values(sendsig, NUM_INST, NULL, VLEN, MPR_FLT, expected);
+        else {
+            for (j = 0; j < NUM_INST; j++)
+                mpr_sig_set_value(sendsig, j, VLEN, MPR_FLT, expected[j]);
+        }
+        mpr_dev_update_maps(src);
+
+        sent = current_time();
+        while (!done && received < NUM_INST && current_time() - sent < 1)
+            mpr_dev_poll(dst, 0);
+        if (received != NUM_INST) {
+            eprintf("iteration %d: received %d of %d instance updates\n", i, received, NUM_INST);
+            return -1;
+        }
+        mpr_dev_poll(src, 0);
+    }
+    return (current_time() - start) / iterations;
+}
+
+/*! Update more instances than the signal has with one bulk call, so that ids later in the call
+ *  steal the instances of earlier ones. Each instance left holding a value must be sent exactly
+ *  once. Returns non-zero on failure. */
+int run_steal()
+{
+    int i, j, k, num, total;
+    mpr_id ids[STEAL_INST];
+    double sent;
+
+    for (i = 0; i < iterations && !done; i++) {
+        for (j = 0; j < STEAL_INST; j++) {
+            ids[j] = i * STEAL_INST + j;
+            for (k = 0; k < VLEN; k++)
+                expected[j][k] = i + j + k;
+        }
+        iteration = i;
+        memset(steal_received, 0, sizeof(steal_received));
+        num = mpr_sig_set_values(stealsig, STEAL_INST, ids, VLEN, MPR_FLT, expected);
+        if (num != STEAL_POOL) {
+            eprintf("iteration %d: %d of %d instances updated, expected %d\n", i, num,
+                    STEAL_INST, STEAL_POOL);
+            return 1;
+        }
+        mpr_dev_update_maps(src);
+
+        sent = current_time();
+        total = 0;
+        while (!done && total < num && current_time() - sent < 1) {
+            mpr_dev_poll(dst, 0);
+            for (j = 0, total = 0; j < STEAL_INST; j++)
+                total += steal_received[j];
+        }
+        mpr_dev_poll(dst, 10);
+        for (j = 0, total = 0; j < STEAL_INST; j++) {
+            if (steal_received[j] > 1) {
+                eprintf("iteration %d: update %d sent %d times\n", i, j, steal_received[j]);
+                return 1;
+            }
+            total += steal_received[j];
+        }
+        if (total != num) {
+            eprintf("iteration %d: received %d of %d instance updates\n", i, total, num);
+            return 1;
+        }
+        mpr_dev_poll(src, 0);
+    }
+    return wrong_values != 0;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    double single, bulk;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testbulk.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 100;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing devices and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    single = run_updates(0);
+    bulk = run_updates(1);
+    if (single < 0 || bulk < 0 || wrong_values) {
+        if (wrong_values)
+            eprintf("%d instance updates had the wrong value\n", wrong_values);
+        result = 1;
+        goto done;
+    }
+    eprintf("%d instances per update: %f microseconds with one call per instance, "
+            "%f microseconds with one bulk call\n", NUM_INST, single * 1000000, bulk * 1000000);
+
+    if (run_steal()) {
+        if (wrong_values)
+            eprintf("%d stolen instance updates had the wrong value\n", wrong_values);
+        result = 1;
+        goto done;
+    }
+    eprintf("%d instances per update with %d available: all updates sent once\n",
+            STEAL_INST, STEAL_POOL);
+
+  done:
+    if (src)
+        mpr_dev_free(src);
+    if (dst)
+        mpr_dev_free(dst);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
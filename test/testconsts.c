@@ -0,0 +1,315 @@
+#include "../src/mapper_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define MAX_VARS 8
+#define MAX_LEN 8
+
+int verbose = 1;
+int iterations = 100000;
+
+/* Linear expressions as generated for maps with the given source and destination ranges. */
+#define LINEAR_COEFFS "sRange=sMax-sMin;m=sRange?((dMax-dMin)/sRange):0;"          \
+                      "b=sRange?(dMin*sMax-dMax*sMin)/sRange:dMin;y=m*x+b;"
+#define LINEAR_MAP(S_MIN, S_MAX, D_MIN, D_MAX)                                      \
+    "sMin=" S_MIN ";sMax=" S_MAX ";dMin=" D_MIN ";dMax=" D_MAX ";" LINEAR_COEFFS
+
+/* Expected results of mpr_expr_update_consts() */
+#define EXPECT_UPDATED     1
+#define EXPECT_UNCHANGED   0
+#define EXPECT_REPARSE    -1
+
+typedef struct _test_expr {
+    const char *old_str;
+    const char *new_str;
+    mpr_type type;
+    int len;
+    int expected;
+} test_expr_t;
+
+static const test_expr_t exprs[] = {
+    { LINEAR_MAP("0", "10", "-1", "1"),
+      LINEAR_MAP("0", "5", "-1", "2"),                  MPR_FLT,   1, EXPECT_UPDATED },
+    { LINEAR_MAP("0", "10", "-1", "1"),
+      LINEAR_MAP("2.5", "10", "-1", "1"),               MPR_DBL,   1, EXPECT_REPARSE },
+    { LINEAR_MAP("[0,0,0]", "[10,10,10]", "[-1,-1,-1]", "[1,1,1]"),
+      LINEAR_MAP("[0,0,0]", "[10,10,10]", "[-2,-2,-2]", "[1,1,1]"),
+                                                        MPR_FLT,   3, EXPECT_UPDATED },
+    { "d=[1,2,3];y=x*d",        "d=[4, -5, 6];y=x*d",   MPR_FLT,   3, EXPECT_UPDATED },
+    { "d=[1,2,3];y=x*d",        "d=[4,5];y=x*d",        MPR_FLT,   3, EXPECT_REPARSE },
+    { "d=[0,0,0];y=x+d",        "d=[0,1,0];y=x+d",      MPR_FLT,   3, EXPECT_REPARSE },
+    { "a=0.5;y=y{-1}*a+x*(1-a)", "a=0.25;y=y{-1}*a+x*(1-a)",
+                                                        MPR_FLT,   1, EXPECT_UPDATED },
+    { "y{-1}=1;c=0.5;y=y{-1}*c+x", "y{-1}=1;c=0.75;y=y{-1}*c+x",
+                                                        MPR_DBL,   1, EXPECT_UPDATED },
+    { "k=2;s=0;s=s+x*k;y=s",    "k=3;s=0;s=s+x*k;y=s",  MPR_INT32, 1, EXPECT_UPDATED },
+    { "k=2;y=x*k",              "k=-7;y=x*k",           MPR_INT32, 1, EXPECT_UPDATED },
+    { "k=2;y=x*k",              "k=2;y=x*k",            MPR_INT32, 1, EXPECT_UNCHANGED },
+    { "k=2;y=x*k",              "k=2;y=x*k+1",          MPR_INT32, 1, EXPECT_REPARSE },
+    { "y=x*2+1",                "y=x*3+1",              MPR_FLT,   1, EXPECT_REPARSE },
+    { "a=1;y=x*a",              "a=1.5;y=x*a",          MPR_FLT,   1, EXPECT_REPARSE },
+    { "a=2;y=x*a",              "a=2;b=1;y=x*a+b",      MPR_FLT,   1, EXPECT_REPARSE },
+};
+
+#define NUM_EXPRS (sizeof(exprs) / sizeof(test_expr_t))
+
+typedef struct _eval_data {
+    mpr_expr expr;
+    mpr_value_t src, dst, vars[MAX_VARS];
+    int num_vars;
+} eval_data_t;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static int setup(eval_data_t *d, const char *str, const test_expr_t *t, int use_bc)
+{
+    int i;
+    memset(d, 0, sizeof(eval_data_t));
+    d->expr = mpr_expr_new_from_str(str, 1, &t->type, &t->len, t->type, t->len);
+    if (!d->expr)
+        return 1;
+    mpr_expr_set_use_bytecode(d->expr, use_bc);
+
+    mpr_value_realloc(&d->src, t->len, t->type, mpr_expr_get_in_hist_size(d->expr, 0), 1, 0);
+    d->src.inst[0].pos = 0;
+    mpr_value_realloc(&d->dst, t->len, t->type, mpr_expr_get_out_hist_size(d->expr), 1, 1);
+
+    d->num_vars = mpr_expr_get_num_vars(d->expr);
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++) {
+        mpr_value_realloc(&d->vars[i], mpr_expr_get_var_vec_len(d->expr, i),
+                          mpr_expr_get_var_type(d->expr, i), 1, 1, 0);
+    }
+    return 0;
+}
+
+static void cleanup(eval_data_t *d)
+{
+    int i;
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++)
+        mpr_value_free(&d->vars[i]);
+    mpr_value_free(&d->src);
+    mpr_value_free(&d->dst);
+    if (d->expr)
+        mpr_expr_free(d->expr);
+}
+
+static void copy_value(mpr_value to, mpr_value from)
+{
+    int size = from->mlen * from->vlen * mpr_type_get_size(from->type);
+    memcpy(to->inst[0].samps, from->inst[0].samps, size);
+    memcpy(to->inst[0].times, from->inst[0].times, from->mlen * sizeof(mpr_time));
+    to->inst[0].pos = from->inst[0].pos;
+    to->inst[0].full = from->inst[0].full;
+}
+
+static int value_cmp(mpr_value a, mpr_value b)
+{
+    return memcmp(a->inst[0].samps, b->inst[0].samps,
+                  a->mlen * a->vlen * mpr_type_get_size(a->type));
+}
+
+static int eval(mpr_expr_eval_buffer buff, eval_data_t *d, const test_expr_t *t, int iter)
+{
+    mpr_value src_p = &d->src, vars_p = d->vars;
+    mpr_type types[MAX_LEN];
+    mpr_time time = {0, 0};
+    void *x = mpr_value_get_samp(&d->src, 0);
+    int i;
+    for (i = 0; i < t->len; i++) {
+        double val = ((iter + i * 5) % 17) * 0.75 - 3;
+        switch (t->type) {
+            case MPR_INT32: ((int*)x)[i] = (int)(val * 4); break;
+            case MPR_FLT:   ((float*)x)[i] = (float)val;   break;
+            default:        ((double*)x)[i] = val;         break;
+        }
+    }
+    return mpr_expr_eval(buff, d->expr, &src_p, &vars_p, &d->dst, &time, types, 0);
+}
+
+/* Update the constants of an expression in place after some evaluations, and compare the
+ * following evaluations against a newly parsed expression given the same state. */
+static int check(mpr_expr_eval_buffer buff, const test_expr_t *t, int use_bc)
+{
+    eval_data_t a, b;
+    mpr_value_t saved[MAX_VARS];
+    mpr_value vars_p;
+    mpr_time time = {0, 0};
+    int i, vars, result = 0;
+
+    memset(saved, 0, sizeof(saved));
+    if (setup(&a, t->old_str, t, use_bc) || setup(&b, t->new_str, t, use_bc)) {
+        eprintf("  failed to parse expression\n");
+        result = 1;
+        goto done;
+    }
+    for (i = 0; i < 10; i++)
+        eval(buff, &a, t, i);
+    for (i = 0; i < a.num_vars; i++) {
+        mpr_value_realloc(&saved[i], a.vars[i].vlen, a.vars[i].type, 1, 1, 0);
+        copy_value(&saved[i], &a.vars[i]);
+    }
+
+    vars = mpr_expr_update_consts(a.expr, t->old_str, t->new_str);
+    if ((vars > 0 ? EXPECT_UPDATED : vars) != t->expected) {
+        eprintf("  unexpected result %d from mpr_expr_update_consts()\n", vars);
+        result = 1;
+        goto done;
+    }
+    if (vars <= 0) {
+        /* the expression must not have been modified */
+        cleanup(&b);
+        setup(&b, t->old_str, t, use_bc);
+        for (i = 0; i < 10; i++)
+            eval(buff, &b, t, i);
+    }
+    else {
+        vars_p = a.vars;
+        if (!mpr_expr_eval_consts(buff, a.expr, &vars_p, &time, 0, vars)) {
+            eprintf("  failed to evaluate constants\n");
+            result = 1;
+            goto done;
+        }
+        /* the reference expression initialises its constants on first evaluation */
+        eval(buff, &b, t, 0);
+        for (i = 0; i < a.num_vars && !result; i++) {
+            if (vars & (1 << i))
+                result = value_cmp(&a.vars[i], &b.vars[i]);
+            else
+                result = value_cmp(&a.vars[i], &saved[i]);
+            if (result)
+                eprintf("  variable '%s' %s\n", mpr_expr_get_var_name(a.expr, i),
+                        vars & (1 << i) ? "was not updated" : "lost its state");
+        }
+        if (result)
+            goto done;
+        copy_value(&b.dst, &a.dst);
+        for (i = 0; i < a.num_vars; i++)
+            copy_value(&b.vars[i], &a.vars[i]);
+    }
+
+    for (i = 10; i < 50; i++) {
+        if (eval(buff, &a, t, i) != eval(buff, &b, t, i)) {
+            eprintf("  status mismatch at iteration %d\n", i);
+            result = 1;
+            break;
+        }
+        if (value_cmp(&a.dst, &b.dst)) {
+            eprintf("  value mismatch at iteration %d\n", i);
+            result = 1;
+            break;
+        }
+    }
+
+  done:
+    for (i = 0; i < MAX_VARS; i++)
+        mpr_value_free(&saved[i]);
+    cleanup(&a);
+    cleanup(&b);
+    return result;
+}
+
+/* Compare retuning the constants of a linear map against replacing its expression. */
+static void run_bench(mpr_expr_eval_buffer buff)
+{
+    const test_expr_t *t = &exprs[0];
+    const char *strs[2] = {t->old_str, t->new_str};
+    mpr_time start, end, time = {0, 0};
+    double elapsed[2];
+    eval_data_t d;
+    mpr_value vars_p;
+    int i, vars;
+
+    setup(&d, t->old_str, t, 1);
+    eval(buff, &d, t, 0);
+    vars_p = d.vars;
+    mpr_time_set(&start, MPR_NOW);
+    for (i = 0; i < iterations; i++) {
+        vars = mpr_expr_update_consts(d.expr, strs[i & 1], strs[(i + 1) & 1]);
+        mpr_expr_eval_consts(buff, d.expr, &vars_p, &time, 0, vars);
+    }
+    mpr_time_set(&end, MPR_NOW);
+    elapsed[0] = mpr_time_get_diff(end, start);
+    cleanup(&d);
+
+    mpr_time_set(&start, MPR_NOW);
+    for (i = 0; i < iterations; i++) {
+        setup(&d, strs[(i + 1) & 1], t, 1);
+        eval(buff, &d, t, 0);
+        cleanup(&d);
+    }
+    mpr_time_set(&end, MPR_NOW);
+    elapsed[1] = mpr_time_get_diff(end, start);
+
+    eprintf("%d range updates: %f seconds in place, %f seconds reparsed (%.2fx)\n",
+            iterations, elapsed[0], elapsed[1], elapsed[0] > 0 ? elapsed[1] / elapsed[0] : 0);
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    mpr_expr_eval_buffer buff;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testconsts.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    buff = mpr_expr_new_eval_buffer(NULL);
+
+    for (i = 0; i < NUM_EXPRS && !result; i++) {
+        const test_expr_t *t = &exprs[i];
+        eprintf("'%s' -> '%s'\n", t->old_str, t->new_str);
+        for (j = 0; j < 2 && !result; j++)
+            result = check(buff, t, j);
+    }
+
+    if (!result)
+        run_bench(buff);
+
+    mpr_expr_free_eval_buffer(buff);
+
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,205 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+
+#define VEC_LEN  4
+#define NUM_INST 4
+#define NUM_IDS  10
+
+int verbose = 1;
+int done = 0;
+int iterations = 200000;
+
+mpr_dev dev = 0;
+mpr_sig sig = 0;
+
+volatile int writing = 1;
+
+/* written by the reader thread */
+volatile int reading = 0;
+int reads = 0, hits = 0, errors = 0;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Every element of a value holds the instance id and the iteration that wrote it. */
+static void make_value(int *v, int id, int iteration)
+{
+    int i;
+    for (i = 0; i < VEC_LEN; i++)
+        v[i] = id * 1000000 + iteration;
+}
+
+/*! Read all instance ids while the main thread activates, updates and releases instances, and
+ *  check that each value read is whole and belongs to the requested instance. */
+void *reader_thread(void *context)
+{
+    int i, id, v[VEC_LEN];
+    mpr_time t;
+    __atomic_store_n(&reading, 1, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&writing, __ATOMIC_ACQUIRE)) {
+        for (id = 0; id < NUM_IDS; id++) {
+            ++reads;
+            if (!mpr_sig_copy_value(sig, id, v, &t))
+                continue;
+            ++hits;
+            for (i = 0; i < VEC_LEN; i++) {
+                if (v[i] != v[0] || v[i] / 1000000 != id) {
+                    eprintf("Read torn or foreign value %d for instance %d\n", v[i], id);
+                    ++errors;
+                    break;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int setup()
+{
+    int num_inst = NUM_INST;
+
+    dev = mpr_dev_new("testcopyvalue", 0);
+    if (!dev)
+        return 1;
+    sig = mpr_sig_new(dev, MPR_DIR_OUT, "outsig", VEC_LEN, MPR_INT32, NULL,
+                      NULL, NULL, &num_inst, NULL, 0);
+    if (!sig)
+        return 1;
+
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+    return done;
+}
+
+/*! Check from the main thread that only active instances return a value. */
+int check_released()
+{
+    int id, v[VEC_LEN], result = 0;
+
+    for (id = 0; id < NUM_IDS; id++)
+        mpr_sig_release_inst(sig, id);
+    for (id = 0; id < NUM_IDS; id++) {
+        if (mpr_sig_copy_value(sig, id, v, NULL)) {
+            eprintf("Released instance %d still has a value\n", id);
+            result = 1;
+        }
+    }
+
+    make_value(v, 3, 42);
+    mpr_sig_set_value(sig, 3, VEC_LEN, MPR_INT32, v);
+    memset(v, 0, sizeof(v));
+    if (!mpr_sig_copy_value(sig, 3, v, NULL) || v[0] != 3000042) {
+        eprintf("Active instance 3 has value %d, expected 3000042\n", v[0]);
+        result = 1;
+    }
+    if (mpr_sig_copy_value(sig, 4, v, NULL)) {
+        eprintf("Instance 4 has a value but was never activated\n");
+        result = 1;
+    }
+    return result;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, id, result = 0, v[VEC_LEN];
+    pthread_t reader;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testcopyvalue.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 20000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing device.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (pthread_create(&reader, 0, reader_thread, 0)) {
+        eprintf("Error creating reader thread.\n");
+        result = 1;
+        goto done;
+    }
+
+    while (!done && !__atomic_load_n(&reading, __ATOMIC_ACQUIRE))
+        usleep(100);
+
+    /* more ids than instances, so instances are released and reused for other ids */
+    for (i = 0; i < iterations && !done; i++) {
+        id = i % NUM_IDS;
+        make_value(v, id, i);
+        mpr_sig_set_value(sig, id, VEC_LEN, MPR_INT32, v);
+        if (i % 3 == 0)
+            mpr_sig_release_inst(sig, (i * 7) % NUM_IDS);
+        if (i % 1000 == 0) {
+            mpr_dev_poll(dev, 0);
+            /* let the reader run on machines with a single core */
+            usleep(100);
+        }
+    }
+    __atomic_store_n(&writing, 0, __ATOMIC_RELEASE);
+    pthread_join(reader, 0);
+
+    eprintf("%d reads, %d with a value, %d errors\n", reads, hits, errors);
+    if (errors || !hits)
+        result = 1;
+
+    result |= check_released();
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
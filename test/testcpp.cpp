@@ -343,6 +343,26 @@ int main(int argc, char ** argv)
         dev.poll(period);
     }
 
+    // test batched updates, which are held back until the batch goes out of scope
+    out << "testing batched updates" << std::endl;
+    int before = received;
+    {
+        Device::Batch batch(dev);
+        v[0] = -1;
+        sig.set_value(v);
+        dev.update_maps().poll(period);
+        if (received != before) {
+            out << "  update was sent before the batch was committed" << std::endl;
+            result = 1;
+        }
+    }
+    for (i = 0; i < 10 && received == before && !done; i++)
+        dev.poll(period);
+    if (received == before) {
+        out << "  batched update was not received" << std::endl;
+        result = 1;
+    }
+
     // try retrieving linked devices
     out << "devices linked to " << dev << ":" << std::endl;
     List<Device> foo = dev[Property::LINKED];
@@ -413,6 +433,12 @@ int main(int argc, char ** argv)
         dev.poll(period);
     }
 
+    // update several instances at once
+    std::vector<float> multivals = {1.0f, 2.0f, 3.0f};
+    std::vector<Id> multiids = {5, 6, 7};
+    multisend.set_value(multivals, multiids);
+    dev.poll(period);
+
     // test some time manipulation
     Time t1(10, 200);
     Time t2(10, 300);
@@ -0,0 +1,177 @@
+#include <mapper/mapper.h>
+#include <lo/lo.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_SIGS 10000
+
+int verbose = 1;
+int done = 0;
+int iterations = 10000;
+int max_sigs = MAX_SIGS;
+
+mpr_dev dev = 0;
+lo_address addr = 0;
+int num_sigs = 0;
+int received = 0;
+
+static const int sig_counts[] = {10, 1000, MAX_SIGS};
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value)
+        ++received;
+}
+
+/*! Add input signals until the device has count signals. */
+int add_sigs(int count)
+{
+    char name[32];
+    for (; num_sigs < count && !done; num_sigs++) {
+        snprintf(name, 32, "in%d", num_sigs);
+        if (!mpr_sig_new(dev, MPR_DIR_IN, name, 1, MPR_FLT, NULL, NULL, NULL, NULL,
+                         handler, MPR_SIG_UPDATE))
+            return 1;
+    }
+    mpr_dev_poll(dev, 0);
+    return done;
+}
+
+/*! Send updates directly to the first and last signals and return the mean time for each
+ *  update to be received and dispatched. */
+double run_updates()
+{
+    char first[32], last[32];
+    int i, expected;
+    double start, sent;
+
+    snprintf(first, 32, "/in%d", 0);
+    snprintf(last, 32, "/in%d", num_sigs - 1);
+
+    received = 0;
+    start = current_time();
+    for (i = 0; i < iterations && !done; i++) {
+        lo_send(addr, (i & 1) ? last : first, "f", (float)i);
+        /* wait for this update before sending the next one */
+        expected = i + 1;
+        sent = current_time();
+        while (!done && received < expected && current_time() - sent < 1)
+            mpr_dev_poll(dev, 0);
+    }
+    return (current_time() - start) / iterations;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    double first = 0, elapsed = 0;
+    char port[16];
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testdispatch.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        max_sigs = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    dev = mpr_dev_new("testdispatch", 0);
+    if (!dev) {
+        eprintf("Error initializing device.\n");
+        result = 1;
+        goto done;
+    }
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+
+    snprintf(port, 16, "%d", mpr_obj_get_prop_as_int32(dev, MPR_PROP_PORT, NULL));
+    addr = lo_address_new("localhost", port);
+
+    for (i = 0; i < sizeof(sig_counts) / sizeof(int) && sig_counts[i] <= max_sigs; i++) {
+        if (add_sigs(sig_counts[i])) {
+            eprintf("Error initializing signals.\n");
+            result = 1;
+            goto done;
+        }
+        elapsed = run_updates();
+        if (!i)
+            first = elapsed;
+        eprintf("%5d signals: %f microseconds per update, received %d of %d updates\n",
+                num_sigs, elapsed * 1000000, received, iterations);
+        if (received != iterations) {
+            result = 1;
+            goto done;
+        }
+    }
+    if (first > 0)
+        eprintf("Cost of an update with %d signals is %.2fx the cost with %d signals\n",
+                num_sigs, elapsed / first, sig_counts[0]);
+
+  done:
+    if (addr)
+        lo_address_free(addr);
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,226 @@
+#include "../src/mapper_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#define NUM_EXPRS 5
+#define VLEN 3
+#define MAX_VARS 4
+#define MAX_THREADS 32
+
+int verbose = 1;
+int num_threads = 8;
+int iterations = 20000;
+
+typedef struct _thread_data {
+    int idx;
+    int errors;
+    int evals;
+} thread_data_t;
+
+static const char *expr_strs[NUM_EXPRS] = {
+    "y=x*2+1",
+    "y=(x+1)*(x-1)/(x*x+1)",
+    "s=s+x;y=s",
+    "y=x+y{-1}",
+    "y=x.sum()*[1,2,3]",
+};
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static float expected_value(int expr_idx, const float *x, int i, int n)
+{
+    switch (expr_idx) {
+        case 0: return x[i] * 2 + 1;
+        case 1: return (x[i] + 1) * (x[i] - 1) / (x[i] * x[i] + 1);
+        case 2:
+        case 3: return x[i] * n;
+        case 4: return (x[0] + x[1] + x[2]) * (i + 1);
+        default: return 0;
+    }
+}
+
+/* Each thread parses and evaluates the same set of expressions with its own
+ * inputs and its own evaluation buffer. Odd-numbered threads use the token
+ * interpreter so that both evaluators are exercised concurrently. */
+#ifdef HAVE_WIN32_THREADS
+unsigned __stdcall eval_thread(void *context)
+#else
+void *eval_thread(void *context)
+#endif
+{
+    thread_data_t *data = (thread_data_t*)context;
+    mpr_expr_eval_buffer buff = mpr_expr_new_eval_buffer(NULL);
+    mpr_type src_type = MPR_FLT, types[VLEN];
+    int i, j, k, src_len = VLEN;
+    float x[VLEN];
+
+    for (i = 0; i < VLEN; i++)
+        x[i] = (data->idx + i + 1) * 0.5f;
+
+    for (i = 0; i < NUM_EXPRS; i++) {
+        mpr_value_t src = {0, 0, 0, 0, 0}, dst = {0, 0, 0, 0, 0}, vars[MAX_VARS];
+        mpr_value src_p = &src, vars_p = vars;
+        mpr_time t = {0, 0};
+        int num_vars, status, updates = 0;
+        float *y;
+
+        mpr_expr e = mpr_expr_new_from_str(expr_strs[i], 1, &src_type, &src_len, MPR_FLT, VLEN);
+        if (!e) {
+            eprintf("thread %d: failed to parse '%s'\n", data->idx, expr_strs[i]);
+            ++data->errors;
+            continue;
+        }
+        mpr_expr_set_use_bytecode(e, !(data->idx % 2));
+        mpr_expr_realloc_eval_buffer(e, buff);
+
+        mpr_value_realloc(&src, VLEN, MPR_FLT, mpr_expr_get_in_hist_size(e, 0), 1, 0);
+        src.inst[0].pos = 0;
+        memcpy(mpr_value_get_samp(&src, 0), x, sizeof(float) * VLEN);
+        mpr_value_realloc(&dst, VLEN, MPR_FLT, mpr_expr_get_out_hist_size(e), 1, 1);
+
+        num_vars = mpr_expr_get_num_vars(e);
+        memset(vars, 0, sizeof(vars));
+        for (j = 0; j < num_vars && j < MAX_VARS; j++)
+            mpr_value_realloc(&vars[j], mpr_expr_get_var_vec_len(e, j),
+                              mpr_expr_get_var_type(e, j), 1, 1, 0);
+
+        for (j = 0; j < iterations; j++) {
+            status = mpr_expr_eval(buff, e, &src_p, &vars_p, &dst, &t, types, 0);
+            if (status & EXPR_UPDATE)
+                ++updates;
+        }
+        data->evals += iterations;
+
+        y = (float*)mpr_value_get_samp(&dst, 0);
+        for (k = 0; k < VLEN; k++) {
+            float exp = expected_value(i, x, k, iterations);
+            if (fabsf(y[k] - exp) > fabsf(exp) * 0.0001f) {
+                eprintf("thread %d: expression '%s' got %g at index %d (expected %g)\n",
+                        data->idx, expr_strs[i], y[k], k, exp);
+                ++data->errors;
+                break;
+            }
+        }
+        if (updates != iterations) {
+            eprintf("thread %d: expression '%s' produced %d updates (expected %d)\n",
+                    data->idx, expr_strs[i], updates, iterations);
+            ++data->errors;
+        }
+
+        for (j = 0; j < num_vars && j < MAX_VARS; j++)
+            mpr_value_free(&vars[j]);
+        mpr_value_free(&src);
+        mpr_value_free(&dst);
+        mpr_expr_free(e);
+    }
+    mpr_expr_free_eval_buffer(buff);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0, evals = 0;
+    thread_data_t data[MAX_THREADS];
+#ifdef HAVE_WIN32_THREADS
+    HANDLE threads[MAX_THREADS];
+#else
+    pthread_t threads[MAX_THREADS];
+#endif
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testexprthread.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--threads <int> (default %d), "
+                               "--num_iterations <int> (default %d)\n",
+                               num_threads, iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--threads")==0 && argc>i+1) {
+                            i++;
+                            num_threads = atoi(argv[i]);
+                            j = len;
+                        }
+                        else if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+    if (num_threads < 1)
+        num_threads = 1;
+    else if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+
+    eprintf("Evaluating %d expressions %d times on each of %d threads\n",
+            NUM_EXPRS, iterations, num_threads);
+
+    for (i = 0; i < num_threads; i++) {
+        data[i].idx = i;
+        data[i].errors = data[i].evals = 0;
+#ifdef HAVE_WIN32_THREADS
+        if (!(threads[i]=(HANDLE)_beginthreadex(NULL, 0, &eval_thread, &data[i], 0, NULL)))
+#else
+        if (pthread_create(&threads[i], 0, eval_thread, &data[i]))
+#endif
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < num_threads; i++) {
+#ifdef HAVE_WIN32_THREADS
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+        eprintf("thread %d: %d evaluations, %d errors\n", i, data[i].evals, data[i].errors);
+        evals += data[i].evals;
+        if (data[i].errors)
+            result = 1;
+    }
+
+    printf("...................Test %s\x1B[0m.",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    if (!result)
+        printf(" (%d evaluations)\n", evals);
+    else
+        printf("\n");
+    return result;
+}
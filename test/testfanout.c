@@ -0,0 +1,202 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#define MAX_DSTS 40
+
+int verbose = 1;
+int done = 0;
+int iterations = 1000;
+int num_dsts = MAX_DSTS;
+
+mpr_dev src = 0;
+mpr_dev dsts[MAX_DSTS];
+mpr_sig sendsig = 0;
+mpr_sig recvsigs[MAX_DSTS];
+
+int received = 0;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value)
+        ++received;
+}
+
+void poll_all(int block_ms)
+{
+    int i;
+    mpr_dev_poll(src, block_ms);
+    for (i = 0; i < num_dsts; i++)
+        mpr_dev_poll(dsts[i], 0);
+}
+
+int all_ready()
+{
+    int i;
+    if (!mpr_dev_get_is_ready(src))
+        return 0;
+    for (i = 0; i < num_dsts; i++) {
+        if (!mpr_dev_get_is_ready(dsts[i]))
+            return 0;
+    }
+    return 1;
+}
+
+int setup()
+{
+    int i;
+    mpr_map maps[MAX_DSTS];
+
+    src = mpr_dev_new("testfanout-send", 0);
+    if (!src)
+        return 1;
+    sendsig = mpr_sig_new(src, MPR_DIR_OUT, "outsig", 1, MPR_INT32, NULL,
+                          NULL, NULL, NULL, NULL, 0);
+    for (i = 0; i < num_dsts; i++) {
+        if (!(dsts[i] = mpr_dev_new("testfanout-recv", 0)))
+            return 1;
+        recvsigs[i] = mpr_sig_new(dsts[i], MPR_DIR_IN, "insig", 1, MPR_INT32, NULL,
+                                  NULL, NULL, NULL, handler, MPR_SIG_UPDATE);
+    }
+
+    while (!done && !all_ready())
+        poll_all(25);
+
+    for (i = 0; i < num_dsts; i++) {
+        maps[i] = mpr_map_new(1, &sendsig, 1, &recvsigs[i]);
+        mpr_obj_push(maps[i]);
+    }
+    for (i = 0; i < num_dsts && !done; i++) {
+        while (!done && !mpr_map_get_is_ready(maps[i]))
+            poll_all(10);
+    }
+    return done;
+}
+
+/*! Update the source signal once per poll and wait for the update to reach every destination.
+ *  Returns the number of updates received by all destinations. */
+int run_updates(double *elapsed)
+{
+    int i, expected;
+    double start = current_time(), sent;
+
+    received = 0;
+    for (i = 0; i < iterations && !done; i++) {
+        mpr_sig_set_value(sendsig, 0, 1, MPR_INT32, &i);
+        expected = (i + 1) * num_dsts;
+        sent = current_time();
+        while (!done && received < expected && current_time() - sent < 1)
+            poll_all(0);
+        if (received < expected)
+            break;
+    }
+    *elapsed = current_time() - start;
+    return i;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0, num;
+    double elapsed;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testfanout.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 100;
+                        num_dsts = 8;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+    memset(dsts, 0, sizeof(dsts));
+
+    if (setup()) {
+        eprintf("Error initializing devices and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    num = run_updates(&elapsed);
+    eprintf("%d of %d updates received by %d devices, %f microseconds per update\n",
+            num, iterations, num_dsts, elapsed * 1000000 / iterations);
+    eprintf("%" PRIu64 " system calls saved by batching sends\n",
+            mpr_dev_get_num_syscalls_saved(src));
+    if (num != iterations)
+        result = 1;
+    /* the count is kept per device, and the destinations send no updates */
+    for (i = 0; i < num_dsts; i++) {
+        if (mpr_dev_get_num_syscalls_saved(dsts[i])) {
+            eprintf("Destination %d counted system calls saved for updates it did not send\n", i);
+            result = 1;
+        }
+    }
+
+  done:
+    if (src)
+        mpr_dev_free(src);
+    for (i = 0; i < num_dsts; i++) {
+        if (dsts[i])
+            mpr_dev_free(dsts[i]);
+    }
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,329 @@
+#include "../src/mapper_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define MAX_VARS 8
+#define CHECK_LEN 300
+
+int verbose = 1;
+int iterations = 200000;
+
+/* Reference implementations indexed by iteration, with samples before the first treated as
+ * zero. */
+static float input(int iter)
+{
+    return iter < 0 ? 0 : (float)((iter * 7) % 23) - 11;
+}
+
+static float out(const float *y, int iter)
+{
+    return iter < 0 ? 0 : y[iter];
+}
+
+static float delay_1(const float *y, int i) { return input(i - 1); }
+static float delay_3(const float *y, int i) { return input(i - 3); }
+static float delay_5(const float *y, int i) { return input(i - 5); }
+static float delay_12(const float *y, int i) { return input(i - 12); }
+static float delay_31(const float *y, int i) { return input(i - 31); }
+static float delay_100(const float *y, int i) { return input(i - 100); }
+static float diff_7(const float *y, int i) { return input(i) - input(i - 7); }
+
+static float mean_5(const float *y, int i)
+{
+    return (input(i) + input(i - 1) + input(i - 2) + input(i - 3) + input(i - 4)) * 0.2f;
+}
+
+static float iir_1(const float *y, int i) { return input(i) + out(y, i - 1) * 0.5f; }
+static float iir_9(const float *y, int i) { return input(i) - out(y, i - 9); }
+
+typedef struct _test_expr {
+    const char *str;
+    float (*ref)(const float *y, int iter);
+} test_expr_t;
+
+static const test_expr_t exprs[] = {
+    { "y=x{-1}",                                delay_1   },
+    { "y=x{-3}",                                delay_3   },
+    { "y=x{-5}",                                delay_5   },
+    { "y=x{-12}",                               delay_12  },
+    { "y=x{-31}",                               delay_31  },
+    { "y=x{-100}",                              delay_100 },
+    { "y=x-x{-7}",                              diff_7    },
+    { "y=(x+x{-1}+x{-2}+x{-3}+x{-4})*0.2",      mean_5    },
+    { "y=x+y{-1}*0.5",                          iir_1     },
+    { "y=x-y{-9}",                              iir_9     },
+};
+
+#define NUM_EXPRS (sizeof(exprs) / sizeof(test_expr_t))
+
+typedef struct _eval_data {
+    mpr_expr expr;
+    mpr_value_t src, dst, vars[MAX_VARS];
+    int num_vars;
+} eval_data_t;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static int setup(eval_data_t *d, const char *str, int use_bc)
+{
+    mpr_type type = MPR_FLT;
+    int i, len = 1;
+    memset(d, 0, sizeof(eval_data_t));
+    d->expr = mpr_expr_new_from_str(str, 1, &type, &len, MPR_FLT, 1);
+    if (!d->expr)
+        return 1;
+    mpr_expr_set_use_bytecode(d->expr, use_bc);
+    mpr_value_realloc(&d->src, 1, MPR_FLT, mpr_expr_get_in_hist_size(d->expr, 0), 1, 1);
+    mpr_value_realloc(&d->dst, 1, MPR_FLT, mpr_expr_get_out_hist_size(d->expr), 1, 1);
+    d->num_vars = mpr_expr_get_num_vars(d->expr);
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++) {
+        mpr_value_realloc(&d->vars[i], mpr_expr_get_var_vec_len(d->expr, i),
+                          mpr_expr_get_var_type(d->expr, i), 1, 1, 0);
+    }
+    return 0;
+}
+
+static void cleanup(eval_data_t *d)
+{
+    int i;
+    for (i = 0; i < d->num_vars && i < MAX_VARS; i++)
+        mpr_value_free(&d->vars[i]);
+    mpr_value_free(&d->src);
+    mpr_value_free(&d->dst);
+    if (d->expr)
+        mpr_expr_free(d->expr);
+}
+
+static int update(mpr_expr_eval_buffer buff, eval_data_t *d, int iter)
+{
+    float x = input(iter);
+    mpr_value src_p = &d->src, vars_p = d->vars;
+    mpr_type types[1];
+    mpr_time t = {0, 0};
+    t.frac = iter;
+    mpr_value_set_sample(&d->src, 0, &x, t);
+    return mpr_expr_eval(buff, d->expr, &src_p, &vars_p, &d->dst, &t, types, 0);
+}
+
+/* Compare against the reference, running long enough for the ring buffers to wrap many
+ * times. */
+static int check(mpr_expr_eval_buffer buff, const test_expr_t *t, eval_data_t *d)
+{
+    float y[CHECK_LEN];
+    int i;
+    for (i = 0; i < CHECK_LEN; i++) {
+        float got;
+        update(buff, d, i);
+        got = *(float*)mpr_value_get_samp(&d->dst, 0);
+        y[i] = t->ref(y, i);
+        if (got != y[i]) {
+            eprintf("  mismatch at iteration %d (%g != %g)\n", i, got, y[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static double run_bench(mpr_expr_eval_buffer buff, eval_data_t *d)
+{
+    mpr_time start, end;
+    int i;
+    mpr_time_set(&start, MPR_NOW);
+    for (i = 0; i < iterations; i++)
+        update(buff, d, i);
+    mpr_time_set(&end, MPR_NOW);
+    return mpr_time_get_diff(end, start);
+}
+
+/* Resizing a value must keep the existing history of every instance. */
+static int check_resize(void)
+{
+    mpr_value_t v;
+    mpr_time t = {0, 0};
+    int i, j, result = 0;
+    memset(&v, 0, sizeof(v));
+
+    mpr_value_realloc(&v, 2, MPR_DBL, 3, 2, 1);
+    for (i = 0; i < 10; i++) {
+        for (j = 0; j < 2; j++) {
+            double s[2] = {i, j * 100 + i};
+            t.sec = i;
+            mpr_value_set_sample(&v, j, s, t);
+        }
+    }
+    eprintf("Growing history size from 3 to 20\n");
+    mpr_value_realloc(&v, 2, MPR_DBL, 20, 2, 1);
+    eprintf("Growing number of instances from 2 to 9\n");
+    mpr_value_realloc(&v, 2, MPR_DBL, 20, 9, 1);
+    eprintf("Shrinking history size from 20 to 2\n");
+    mpr_value_realloc(&v, 2, MPR_DBL, 2, 9, 1);
+    for (j = 0; j < 2 && !result; j++) {
+        for (i = 0; i > -2; i--) {
+            double *s = mpr_value_get_samp_hist(&v, j, i);
+            mpr_time *tt = mpr_value_get_time_hist(&v, j, i);
+            if (s[0] != 9 + i || s[1] != j * 100 + 9 + i || tt->sec != 9 + i) {
+                eprintf("  instance %d lost history at index %d\n", j, i);
+                result = 1;
+                break;
+            }
+        }
+        if ((size_t)mpr_value_get_samp(&v, j) % sizeof(double)) {
+            eprintf("  instance %d samples are misaligned\n", j);
+            result = 1;
+        }
+    }
+    for (j = 2; j < 9 && !result; j++) {
+        if (v.inst[j].pos != -1) {
+            eprintf("  new instance %d not initialized\n", j);
+            result = 1;
+        }
+    }
+    if (!result) {
+        eprintf("Removing instance 0\n");
+        mpr_value_remove_inst(&v, 0);
+        if (v.num_inst != 8 || ((double*)mpr_value_get_samp(&v, 0))[1] != 109) {
+            eprintf("  remaining instance has wrong value\n");
+            result = 1;
+        }
+    }
+    mpr_value_free(&v);
+    return result;
+}
+
+/* Removed instances should leave their data in place and have their slots reused. */
+static int check_slots(void)
+{
+    mpr_value_t v;
+    mpr_time t = {0, 0};
+    int i, slot, result = 0;
+    memset(&v, 0, sizeof(v));
+
+    mpr_value_realloc(&v, 3, MPR_FLT, 4, 6, 0);
+    for (i = 0; i < 6; i++) {
+        float s[3] = {i, i + 0.5f, -i};
+        mpr_value_set_sample(&v, i, s, t);
+    }
+    eprintf("Removing instances 1 and 4\n");
+    slot = v.inst[1].slot;
+    mpr_value_remove_inst(&v, 4);
+    mpr_value_remove_inst(&v, 1);
+    for (i = 0; i < v.num_inst; i++) {
+        float *s = mpr_value_get_samp(&v, i);
+        int expect = i < 1 ? i : i < 3 ? i + 1 : i + 2;
+        if (s[0] != expect || s[2] != -expect) {
+            eprintf("  instance %d has wrong value after removal\n", i);
+            result = 1;
+        }
+    }
+    eprintf("Adding an instance\n");
+    mpr_value_realloc(&v, 3, MPR_FLT, 4, 5, 1);
+    if (!result && (v.inst[4].slot != slot || v.inst[4].pos != -1
+                    || ((float*)mpr_value_get_samp_hist(&v, 4, 1))[0] != 0)) {
+        eprintf("  free slot not reused and cleared\n");
+        result = 1;
+    }
+    eprintf("Changing vector length\n");
+    mpr_value_realloc(&v, 6, MPR_FLT, 4, 8, 0);
+    for (i = 0; i < 16; i++) {
+        float s[6] = {i, i, i, i, i, i};
+        mpr_value_set_sample(&v, i % 8, s, t);
+    }
+    for (i = 0; i < 8 && !result; i++) {
+        float *s = mpr_value_get_samp_hist(&v, i, -1);
+        if (s[0] != i || s[5] != i || ((float*)mpr_value_get_samp(&v, i))[5] != i + 8) {
+            eprintf("  instance %d has wrong value after changing vector length\n", i);
+            result = 1;
+        }
+    }
+    mpr_value_free(&v);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    mpr_expr_eval_buffer buff;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testhistory.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    result = check_resize() || check_slots();
+
+    buff = mpr_expr_new_eval_buffer(NULL);
+
+    for (i = 0; i < NUM_EXPRS && !result; i++) {
+        const test_expr_t *t = &exprs[i];
+        eval_data_t interp, bytecode;
+
+        eprintf("'%s'\n", t->str);
+        result = setup(&interp, t->str, 0);
+        result |= setup(&bytecode, t->str, 1);
+        if (result) {
+            eprintf("  failed to parse expression\n");
+            result = 1;
+        }
+        else {
+            mpr_expr_realloc_eval_buffer(interp.expr, buff);
+            mpr_expr_realloc_eval_buffer(bytecode.expr, buff);
+            result = check(buff, t, &interp) || check(buff, t, &bytecode);
+        }
+
+        if (!result) {
+            double interp_time = run_bench(buff, &interp);
+            double bytecode_time = run_bench(buff, &bytecode);
+            eprintf("  %f seconds interpreted, %f seconds bytecode\n",
+                    interp_time, bytecode_time);
+        }
+        cleanup(&interp);
+        cleanup(&bytecode);
+    }
+
+    mpr_expr_free_eval_buffer(buff);
+
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,192 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define NUM_SIGS 8
+#define INST_PER_SIG 125
+#define MAX_INST (NUM_SIGS * INST_PER_SIG)
+
+int verbose = 1;
+int done = 0;
+int iterations = 20000;
+
+mpr_dev dev = 0;
+mpr_sig outsigs[NUM_SIGS];
+mpr_sig insigs[NUM_SIGS];
+mpr_map maps[NUM_SIGS];
+int received = 0;
+
+static const int inst_counts[] = {10, 100, MAX_INST};
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value)
+        ++received;
+}
+
+/*! Create instanced signal pairs whose instance ids are unique across the device, so that
+ *  every active instance needs its own device id map. */
+int setup()
+{
+    char name[32];
+    mpr_id ids[INST_PER_SIG];
+    int i, j;
+
+    dev = mpr_dev_new("testidmap", 0);
+    if (!dev)
+        return 1;
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+
+    for (i = 0; i < NUM_SIGS; i++) {
+        for (j = 0; j < INST_PER_SIG; j++)
+            ids[j] = i * INST_PER_SIG + j;
+        snprintf(name, 32, "out%d", i);
+        outsigs[i] = mpr_sig_new(dev, MPR_DIR_OUT, name, 1, MPR_FLT, NULL,
+                                 NULL, NULL, NULL, NULL, 0);
+        snprintf(name, 32, "in%d", i);
+        insigs[i] = mpr_sig_new(dev, MPR_DIR_IN, name, 1, MPR_FLT, NULL,
+                                NULL, NULL, NULL, handler, MPR_SIG_UPDATE);
+        if (!outsigs[i] || !insigs[i])
+            return 1;
+        mpr_sig_reserve_inst(outsigs[i], INST_PER_SIG, ids, NULL);
+        mpr_sig_reserve_inst(insigs[i], INST_PER_SIG, ids, NULL);
+        maps[i] = mpr_map_new(1, &outsigs[i], 1, &insigs[i]);
+        mpr_obj_push(maps[i]);
+    }
+
+    /* Wait until all maps have been established */
+    for (i = 0; i < NUM_SIGS && !done; i++) {
+        while (!done && !mpr_map_get_is_ready(maps[i]))
+            mpr_dev_poll(dev, 10);
+    }
+    return done;
+}
+
+/*! Update instance n of the active set, spreading instances across the signals. */
+void update_inst(int n, float value)
+{
+    int sig_idx = n % NUM_SIGS;
+    mpr_id id = sig_idx * INST_PER_SIG + n / NUM_SIGS;
+    mpr_sig_set_value(outsigs[sig_idx], id, 1, MPR_FLT, &value);
+}
+
+/*! Activate num_inst instances, then update them round-robin and return the mean time per
+ *  update. */
+double run_updates(int num_inst)
+{
+    int i;
+    double start;
+
+    for (i = 0; i < num_inst && !done; i++)
+        update_inst(i, 0);
+    mpr_dev_poll(dev, 0);
+
+    received = 0;
+    start = current_time();
+    for (i = 0; i < iterations && !done; i++) {
+        update_inst(i % num_inst, i);
+        mpr_dev_poll(dev, 0);
+    }
+    return (current_time() - start) / iterations;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    double first = 0, elapsed = 0;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testidmap.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 2000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing device, signals and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    for (i = 0; i < sizeof(inst_counts) / sizeof(int) && !done; i++) {
+        elapsed = run_updates(inst_counts[i]);
+        if (!i)
+            first = elapsed;
+        eprintf("%5d active instances: %f microseconds per update, received %d of %d updates\n",
+                inst_counts[i], elapsed * 1000000, received, iterations);
+        if (received != iterations) {
+            result = 1;
+            goto done;
+        }
+    }
+    if (first > 0)
+        eprintf("Cost of an update with %d active instances is %.2fx the cost with %d\n",
+                MAX_INST, elapsed / first, inst_counts[0]);
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,268 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+
+#define VEC_LEN 2
+#define NUM_INST 4
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+int period = 50;
+int iterations = 50;
+
+mpr_dev dev = 0;
+mpr_sig sendsig = 0;
+mpr_sig recvsig = 0;
+mpr_sig freesig = 0;
+
+int sent = 0;
+int received = 0;
+int errors = 0;
+int released = 0;
+int freed_updates = 0;
+int freed = 0;
+
+float expected[VEC_LEN];
+mpr_id expected_inst;
+mpr_time expected_time;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Check that each update arrives with the value, instance and timetag it was sent with. */
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    int i;
+    const float *v = (const float*)value;
+    if (!value) {
+        eprintf("handler: instance %d released\n", (int)instance);
+        if (instance == expected_inst)
+            ++released;
+        else
+            ++errors;
+        return;
+    }
+    eprintf("handler: instance %d got [%f, %f], time %f\n", (int)instance, v[0], v[1],
+            mpr_time_as_dbl(t));
+    ++received;
+    if (instance != expected_inst) {
+        eprintf("  expected instance %d\n", (int)expected_inst);
+        ++errors;
+    }
+    for (i = 0; i < VEC_LEN; i++) {
+        if (fabs(v[i] - expected[i]) > 0.0001) {
+            eprintf("  expected value [%f, %f]\n", expected[0], expected[1]);
+            ++errors;
+            break;
+        }
+    }
+    if (mpr_time_cmp(t, expected_time)) {
+        eprintf("  expected time %f\n", mpr_time_as_dbl(expected_time));
+        ++errors;
+    }
+}
+
+/*! Count updates that reach a signal after it has been freed. */
+void freed_handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+                   mpr_type type, const void *value, mpr_time t)
+{
+    if (freed)
+        ++freed_updates;
+}
+
+int setup(char *iface)
+{
+    int num_inst = NUM_INST;
+
+    dev = mpr_dev_new("testlocalupdate", 0);
+    if (!dev)
+        goto error;
+    if (iface)
+        mpr_graph_set_interface(mpr_obj_get_graph(dev), iface);
+    eprintf("device created.\n");
+
+    sendsig = mpr_sig_new(dev, MPR_DIR_OUT, "outsig", VEC_LEN, MPR_FLT, NULL,
+                          NULL, NULL, &num_inst, NULL, 0);
+    recvsig = mpr_sig_new(dev, MPR_DIR_IN, "insig", VEC_LEN, MPR_FLT, NULL,
+                          NULL, NULL, &num_inst, handler, MPR_SIG_UPDATE | MPR_SIG_REL_UPSTRM);
+    freesig = mpr_sig_new(dev, MPR_DIR_IN, "freesig", VEC_LEN, MPR_FLT, NULL,
+                          NULL, NULL, &num_inst, freed_handler, MPR_SIG_ALL);
+    if (!sendsig || !recvsig || !freesig)
+        goto error;
+    eprintf("signals registered.\n");
+    return 0;
+
+  error:
+    return 1;
+}
+
+void cleanup()
+{
+    if (dev) {
+        eprintf("Freeing device.. ");
+        fflush(stdout);
+        mpr_dev_free(dev);
+        eprintf("ok\n");
+    }
+}
+
+void wait_ready()
+{
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+}
+
+int setup_maps()
+{
+    mpr_map maps[2];
+    maps[0] = mpr_map_new(1, &sendsig, 1, &recvsig);
+    maps[1] = mpr_map_new(1, &sendsig, 1, &freesig);
+    mpr_obj_push(maps[0]);
+    mpr_obj_push(maps[1]);
+
+    /* Wait until mappings have been established */
+    while (!done && !(mpr_map_get_is_ready(maps[0]) && mpr_map_get_is_ready(maps[1])))
+        mpr_dev_poll(dev, 10);
+    eprintf("maps initialized\n");
+    return done;
+}
+
+void loop()
+{
+    int i = 0;
+    float v[VEC_LEN];
+
+    eprintf("Polling device..\n");
+    while ((!terminate || i < iterations) && !done) {
+        expected_inst = i % NUM_INST;
+        expected[0] = v[0] = i;
+        expected[1] = v[1] = i * 0.5f;
+        eprintf("Updating instance %d to [%f, %f]\n", (int)expected_inst, v[0], v[1]);
+        mpr_sig_set_value(sendsig, expected_inst, VEC_LEN, MPR_FLT, v);
+        ++sent;
+
+        /* setting the time evaluates the maps, so the update must arrive with this timetag */
+        mpr_time_set(&expected_time, mpr_dev_get_time(dev));
+        mpr_time_add_dbl(&expected_time, 10.0 + i);
+        mpr_dev_set_time(dev, expected_time);
+
+        if (terminate && i == iterations - 1) {
+            /* releasing the instance queues a release for both destinations on the link, so the
+             * one for 'freesig' is still queued when the signal is freed */
+            mpr_sig_release_inst(sendsig, expected_inst);
+            eprintf("Freeing signal 'freesig' with an update queued\n");
+            mpr_sig_free(freesig);
+            freesig = 0;
+            freed = 1;
+        }
+
+        mpr_dev_poll(dev, period);
+        i++;
+
+        if (!verbose) {
+            printf("\r  Sent: %4i, Received: %4i   ", sent, received);
+            fflush(stdout);
+        }
+    }
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    char *iface = 0;
+
+    /* process flags for -v verbose, -t terminate, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testlocalupdate.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'f':
+                        period = 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--iface")==0 && argc>i+1) {
+                            i++;
+                            iface = argv[i];
+                            j = 1;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup(iface)) {
+        eprintf("Error initializing device.\n");
+        result = 1;
+        goto done;
+    }
+
+    wait_ready();
+
+    if (setup_maps()) {
+        eprintf("Error initializing maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    loop();
+
+    if (freed && !released) {
+        eprintf("Instance release was not received.\n");
+        result = 1;
+    }
+    if (!received || sent != received || errors) {
+        eprintf("Updated value %d time%s and received %d of them with %d error%s.\n",
+                sent, sent == 1 ? "" : "s", received, errors, errors == 1 ? "" : "s");
+        result = 1;
+    }
+    if (freed_updates) {
+        eprintf("Freed signal received %d update%s.\n", freed_updates,
+                freed_updates == 1 ? "" : "s");
+        result = 1;
+    }
+
+  done:
+    cleanup();
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
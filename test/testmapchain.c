@@ -0,0 +1,180 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+
+#define CHAIN_LEN 4
+
+int verbose = 1;
+int done = 0;
+int iterations = 1000;
+
+mpr_dev dev = 0;
+mpr_sig sigs[CHAIN_LEN];
+mpr_map maps[CHAIN_LEN];
+
+int received = 0;
+int last_value = -1;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value) {
+        last_value = *(int*)value;
+        ++received;
+    }
+}
+
+/*! Map signal src to signal dst of the same device, adding one to the value. */
+mpr_map add_map(int src, int dst)
+{
+    mpr_map map = mpr_map_new(1, &sigs[src], 1, &sigs[dst]);
+    mpr_obj_set_prop(map, MPR_PROP_EXPR, NULL, 1, MPR_STR, "y=x+1", 1);
+    mpr_obj_push(map);
+    while (!done && !mpr_map_get_is_ready(map))
+        mpr_dev_poll(dev, 10);
+    return map;
+}
+
+int setup()
+{
+    int i;
+    char name[16];
+
+    dev = mpr_dev_new("testmapchain", 0);
+    if (!dev)
+        return 1;
+    for (i = 0; i < CHAIN_LEN; i++) {
+        snprintf(name, 16, "sig%d", i);
+        /* only the end of the chain has a handler */
+        sigs[i] = mpr_sig_new(dev, MPR_DIR_IN, name, 1, MPR_INT32, NULL, NULL, NULL, NULL,
+                              i == CHAIN_LEN - 1 ? handler : NULL, MPR_SIG_UPDATE);
+    }
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+
+    /* create the maps from the end of the chain so that they are not ranked in creation order */
+    for (i = CHAIN_LEN - 2; i >= 0; i--)
+        maps[i] = add_map(i, i + 1);
+    eprintf("Chain of %d local maps established.\n", CHAIN_LEN - 1);
+    return done;
+}
+
+/*! Update the start of the chain and check that the update reaches the end of the chain
+ *  within a single poll. */
+int run_chain()
+{
+    int i;
+    for (i = 0; i < iterations && !done; i++) {
+        mpr_sig_set_value(sigs[0], 0, 1, MPR_INT32, &i);
+        mpr_dev_poll(dev, 0);
+        if (last_value != i + CHAIN_LEN - 1) {
+            eprintf("Update %d reached the end of the chain as %d after one poll.\n",
+                    i, last_value);
+            return 1;
+        }
+    }
+    eprintf("%d updates propagated through the chain within one poll each.\n", i);
+    return 0;
+}
+
+/*! Close the chain into a loop and check that polling neither blocks nor lets the loop run
+ *  more than once around for each cycle of map processing. */
+int run_loop()
+{
+    int i, value = 0, before, polls = 10;
+    maps[CHAIN_LEN - 1] = add_map(CHAIN_LEN - 1, 0);
+    eprintf("Loop of %d local maps established.\n", CHAIN_LEN);
+
+    before = received;
+    mpr_sig_set_value(sigs[0], 0, 1, MPR_INT32, &value);
+    for (i = 0; i < polls && !done; i++)
+        mpr_dev_poll(dev, 0);
+    eprintf("Loop updated the end of the chain %d times in %d polls.\n",
+            received - before, polls);
+    /* the map processing runs at most twice in a non-blocking poll */
+    return received == before || received - before > polls * 2;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testmapchain.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 100;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing device and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (run_chain()) {
+        result = 1;
+        goto done;
+    }
+
+    if (run_loop()) {
+        eprintf("Update loop was not bounded by the map processing cycle.\n");
+        result = 1;
+    }
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -248,6 +248,14 @@ int main(int argc, char **argv)
         set_map_protocol(MPR_PROTO_TCP);
         eprintf("SENDING TCP\n");
         loop();
+
+        set_map_protocol(MPR_PROTO_SHM);
+        eprintf("SENDING SHM\n");
+        loop();
+
+        set_map_protocol(MPR_PROTO_UNIX);
+        eprintf("SENDING UNIX\n");
+        loop();
     } while (!terminate && !done);
 
     if (sent != received) {
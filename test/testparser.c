@@ -16,6 +16,7 @@
 int verbose = 1;
 char str[256];
 mpr_expr e;
+mpr_expr_eval_buffer eval_buff;
 int iterations = 20000;
 int expression_count = 1;
 int token_count = 0;
@@ -25,7 +26,7 @@ int src_int[SRC_ARRAY_LEN], dst_int[DST_ARRAY_LEN], expect_int[DST_ARRAY_LEN];
 float src_flt[SRC_ARRAY_LEN], dst_flt[DST_ARRAY_LEN], expect_flt[DST_ARRAY_LEN];
 double src_dbl[SRC_ARRAY_LEN], dst_dbl[DST_ARRAY_LEN], expect_dbl[DST_ARRAY_LEN];
 double then, now;
-double total_elapsed_time = 0;
+double total_elapsed_time = 0, total_elapsed_time_bc = 0;
 mpr_type out_types[DST_ARRAY_LEN];
 
 mpr_time time_in = {0, 0}, time_out = {0, 0};
@@ -247,22 +248,24 @@ void setup_test(mpr_type in_type, int in_len, mpr_type out_type, int out_len)
 #define EXPECT_SUCCESS 0
 #define EXPECT_FAILURE 1
 
-int parse_and_eval(int expectation, int max_tokens, int check, int exp_updates)
+static int _parse_and_eval(int expectation, int max_tokens, int check, int exp_updates,
+                           int use_bytecode)
 {
     /* clear output arrays */
     int i, j, result = 0, mlen, status;
 
     if (verbose) {
-        printf("***************** Expression %d *****************\n", expression_count++);
+        printf("***************** Expression %d (%s) *****************\n", expression_count,
+               use_bytecode ? "bytecode" : "interpreter");
         printf("Parsing string '%s'\n", str);
     }
     else {
-        printf("\rExpression %d", expression_count++);
+        printf("\rExpression %d", expression_count);
         fflush(stdout);
     }
     e = mpr_expr_new_from_str(str, n_sources, src_types, src_lens, dst_type, dst_len);
     if (!e) {
-        eprintf("Parser FAILED (expression %d)\n", expression_count - 1);
+        eprintf("Parser FAILED (expression %d)\n", expression_count);
         goto fail;
     }
     else if (EXPECT_FAILURE == expectation) {
@@ -270,6 +273,9 @@ int parse_and_eval(int expectation, int max_tokens, int check, int exp_updates)
         result = 1;
         goto free;
     }
+    mpr_expr_realloc_eval_buffer(e, eval_buff);
+    if (!mpr_expr_set_use_bytecode(e, use_bytecode) && use_bytecode)
+        eprintf("Expression could not be compiled, using interpreter.\n");
     mpr_time_set(&time_in, MPR_NOW);
     for (i = 0; i < n_sources; i++) {
         void *v;
@@ -341,13 +347,14 @@ int parse_and_eval(int expectation, int max_tokens, int check, int exp_updates)
     }
 #endif
 
-    token_count += e->n_tokens;
+    if (use_bytecode)
+        token_count += e->n_tokens;
 
     update_count = 0;
     then = current_time();
 
     eprintf("Try evaluation once... ");
-    status = mpr_expr_eval(e, inh_p, &user_vars_p, &outh, &time_in, out_types, 0);
+    status = mpr_expr_eval(eval_buff, e, inh_p, &user_vars_p, &outh, &time_in, out_types, 0);
     if (!status) {
         eprintf("FAILED.\n");
         result = 1;
@@ -382,14 +389,17 @@ int parse_and_eval(int expectation, int max_tokens, int check, int exp_updates)
             }
             memcpy(mpr_value_get_time(&inh[j], 0), &time_in, sizeof(mpr_time));
         }
-        status = mpr_expr_eval(e, inh_p, &user_vars_p, &outh, &time_in, out_types, 0);
+        status = mpr_expr_eval(eval_buff, e, inh_p, &user_vars_p, &outh, &time_in, out_types, 0);
         if (status & MPR_SIG_UPDATE)
             ++update_count;
         /* sleep here stops compiler from optimizing loop away */
         usleep(1);
     }
     now = current_time();
-    total_elapsed_time += now-then;
+    if (use_bytecode)
+        total_elapsed_time_bc += now-then;
+    else
+        total_elapsed_time += now-then;
 
     if (0 == result)
         eprintf("OK\n");
@@ -421,6 +431,17 @@ fail:
     return 1;
 }
 
+/*! Parse and evaluate the current expression string using both the token
+ *  interpreter and the compiled bytecode. */
+int parse_and_eval(int expectation, int max_tokens, int check, int exp_updates)
+{
+    int result = _parse_and_eval(expectation, max_tokens, check, exp_updates, 0);
+    if (!result)
+        result = _parse_and_eval(expectation, max_tokens, check, exp_updates, 1);
+    ++expression_count;
+    return result;
+}
+
 int run_tests()
 {
     int i;
@@ -1159,7 +1180,9 @@ int main(int argc, char **argv)
     for (i = 0; i < SRC_ARRAY_LEN; i++)
         inh_p[i] = &inh[i];
 
+    eval_buff = mpr_expr_new_eval_buffer(NULL);
     result = run_tests();
+    mpr_expr_free_eval_buffer(eval_buff);
 
     for (i = 0; i < SRC_ARRAY_LEN; i++)
         mpr_value_free(&inh[i]);
@@ -1169,7 +1192,8 @@ int main(int argc, char **argv)
     printf("\r..................................................Test %s\x1B[0m.",
            result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
     if (!result)
-        printf(" (%f seconds, %d tokens).\n", total_elapsed_time, token_count);
+        printf(" (%f seconds interpreted, %f seconds bytecode, %d tokens).\n",
+               total_elapsed_time, total_elapsed_time_bc, token_count);
     else
         printf("\n");
     return result;
@@ -0,0 +1,216 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+int verbose = 1;
+int done = 0;
+int iterations = 1000;
+int block_ms = 100;
+
+mpr_dev src = 0;
+mpr_dev dst = 0;
+mpr_sig sendsig = 0;
+mpr_sig recvsig = 0;
+
+/* written by the polling thread of the destination device */
+volatile int received = 0;
+volatile int last_value = -1;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value) {
+        __atomic_store_n(&last_value, *(int*)value, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&received, 1, __ATOMIC_RELEASE);
+    }
+}
+
+int setup()
+{
+    mpr_map map;
+
+    src = mpr_dev_new("testpollthread-send", 0);
+    dst = mpr_dev_new("testpollthread-recv", 0);
+    if (!src || !dst)
+        return 1;
+
+    sendsig = mpr_sig_new(src, MPR_DIR_OUT, "outsig", 1, MPR_INT32, NULL,
+                          NULL, NULL, NULL, NULL, 0);
+    recvsig = mpr_sig_new(dst, MPR_DIR_IN, "insig", 1, MPR_INT32, NULL,
+                          NULL, NULL, NULL, handler, MPR_SIG_UPDATE);
+    /* the main thread will update the signal while the device is polled in the background */
+    mpr_sig_reserve_queue(sendsig, 16);
+
+    while (!done && !(mpr_dev_get_is_ready(src) && mpr_dev_get_is_ready(dst))) {
+        mpr_dev_poll(src, 25);
+        mpr_dev_poll(dst, 25);
+    }
+
+    map = mpr_map_new(1, &sendsig, 1, &recvsig);
+    mpr_obj_push(map);
+    while (!done && !mpr_map_get_is_ready(map)) {
+        mpr_dev_poll(src, 10);
+        mpr_dev_poll(dst, 10);
+    }
+    return done;
+}
+
+/*! Wait until the polling thread of the destination device reports signal events, and read the
+ *  value it received. Returns the value, or -1 if nothing arrived within the timeout. */
+int wait_value(int fd, double timeout)
+{
+    fd_set fds;
+    struct timeval tv;
+    char buf[64];
+    int value;
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    tv.tv_sec = 0;
+    tv.tv_usec = timeout * 1000000;
+    if (select(fd + 1, &fds, 0, 0, &tv) <= 0)
+        return -1;
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+    return mpr_sig_copy_value(recvsig, 0, &value, 0) ? value : -1;
+}
+
+/*! Push updates from this thread and wait for each to be received by the destination device.
+ *  Returns the number of updates received before timing out. */
+int run_updates(double *elapsed)
+{
+    int i, fd = mpr_dev_get_update_fd(dst), value = -1;
+    double start = current_time(), sent;
+
+    for (i = 0; i < iterations && !done; i++) {
+        while (!done && !mpr_sig_push_value(sendsig, 0, 1, MPR_INT32, &i, MPR_NOW))
+            usleep(100);
+        /* wake the polling thread instead of waiting up to block_ms */
+        mpr_dev_update_maps(src);
+        sent = current_time();
+        /* wait for the destination's update descriptor instead of spinning */
+        while (!done && value != i && current_time() - sent < 1)
+            value = wait_value(fd, 1 - (current_time() - sent));
+        if (value != i || __atomic_load_n(&last_value, __ATOMIC_ACQUIRE) != i)
+            break;
+    }
+    *elapsed = current_time() - start;
+    return i;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0, num;
+    double elapsed;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testpollthread.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 100;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing devices and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (mpr_dev_start_polling(src, block_ms) || mpr_dev_start_polling(dst, block_ms)) {
+        eprintf("Error starting polling threads.\n");
+        result = 1;
+        goto done;
+    }
+    if (mpr_dev_get_update_fd(dst) < 0) {
+        eprintf("No update descriptor for a device polled in the background.\n");
+        result = 1;
+        goto done;
+    }
+    /* the application must not poll a device that is polled in the background */
+    if (mpr_dev_poll(src, 0)) {
+        eprintf("Device polled by both the application and its thread.\n");
+        result = 1;
+    }
+
+    num = run_updates(&elapsed);
+    eprintf("%d of %d updates received, %f microseconds per update with %d ms poll timeout\n",
+            num, iterations, elapsed * 1000000 / iterations, block_ms);
+    if (num != iterations)
+        result = 1;
+
+    if (mpr_dev_stop_polling(src) || mpr_dev_stop_polling(dst)) {
+        eprintf("Error stopping polling threads.\n");
+        result = 1;
+    }
+    if (mpr_dev_get_update_fd(dst) >= 0) {
+        eprintf("Update descriptor still available after stopping the polling thread.\n");
+        result = 1;
+    }
+
+  done:
+    if (src)
+        mpr_dev_free(src);
+    if (dst)
+        mpr_dev_free(dst);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
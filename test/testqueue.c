@@ -0,0 +1,272 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+
+#define QUEUE_SIZE 8
+#define NUM_INST 2
+
+int verbose = 1;
+int done = 0;
+int iterations = 10000;
+
+mpr_dev dev = 0;
+mpr_sig sendsig = 0;
+mpr_sig recvsig = 0;
+
+/* written by the producer thread */
+int pushed = 0;
+int push_count = 0;
+int push_retry = 0;
+
+/* written by the handler */
+int next_expected = 0;
+int last = -1;
+int received = 0;
+int released = 0;
+int errors = 0;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Check that values arrive in the order they were pushed. Maps are evaluated when the device is
+ *  polled, so updates queued between two polls arrive as the latest of them. */
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (!value) {
+        eprintf("handler: instance %d released\n", (int)instance);
+        ++released;
+        mpr_sig_release_inst(sig, instance);
+        return;
+    }
+    if (instance)
+        return;
+    if (*(int*)value < next_expected) {
+        eprintf("handler: got %d, expected at least %d\n", *(int*)value, next_expected);
+        ++errors;
+    }
+    last = *(int*)value;
+    next_expected = last + 1;
+    ++received;
+}
+
+/*! Push values until one is refused, without waiting for the device. */
+void *fill_thread(void *context)
+{
+    while (!done && mpr_sig_push_value(sendsig, 0, 1, MPR_INT32, &pushed, MPR_NOW))
+        ++pushed;
+    return 0;
+}
+
+/*! Push push_count values, waiting whenever the queue is full. */
+void *push_thread(void *context)
+{
+    while (!done && pushed < push_count) {
+        if (mpr_sig_push_value(sendsig, 0, 1, MPR_INT32, &pushed, MPR_NOW))
+            ++pushed;
+        else {
+            ++push_retry;
+            usleep(100);
+        }
+    }
+    return 0;
+}
+
+int setup()
+{
+    int num_inst = NUM_INST;
+    mpr_map map;
+
+    dev = mpr_dev_new("testqueue", 0);
+    if (!dev)
+        return 1;
+    sendsig = mpr_sig_new(dev, MPR_DIR_OUT, "outsig", 1, MPR_INT32, NULL,
+                          NULL, NULL, &num_inst, NULL, 0);
+    recvsig = mpr_sig_new(dev, MPR_DIR_IN, "insig", 1, MPR_INT32, NULL,
+                          NULL, NULL, &num_inst, handler, MPR_SIG_UPDATE | MPR_SIG_REL_UPSTRM);
+    if (!sendsig || !recvsig)
+        return 1;
+
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+
+    map = mpr_map_new(1, &sendsig, 1, &recvsig);
+    mpr_obj_push(map);
+    while (!done && !mpr_map_get_is_ready(map))
+        mpr_dev_poll(dev, 10);
+    return done;
+}
+
+int run_thread(void *(*func)(void*))
+{
+    pthread_t thread;
+    if (pthread_create(&thread, 0, func, 0)) {
+        eprintf("Error creating thread.\n");
+        return 1;
+    }
+    if (func == push_thread) {
+        /* apply pushed updates while the thread keeps pushing */
+        while (!done && last < push_count - 1)
+            mpr_dev_poll(dev, 1);
+    }
+    pthread_join(thread, 0);
+    return 0;
+}
+
+/*! The queue must refuse updates once it holds the reserved number, and later accept more. */
+int check_full()
+{
+    if (run_thread(fill_thread))
+        return 1;
+    eprintf("Queue accepted %d updates before it was full\n", pushed);
+    if (pushed != QUEUE_SIZE) {
+        eprintf("Expected the queue to hold %d updates\n", QUEUE_SIZE);
+        return 1;
+    }
+    mpr_dev_poll(dev, 10);
+    if (mpr_sig_get_num_inst(sendsig, MPR_STATUS_ACTIVE) != 1 || last != QUEUE_SIZE - 1 || errors) {
+        eprintf("Received %d after draining %d queued updates, with %d errors\n", last,
+                QUEUE_SIZE, errors);
+        return 1;
+    }
+    if (!mpr_sig_push_value(sendsig, 0, 1, MPR_INT32, &pushed, MPR_NOW)) {
+        eprintf("Queue still full after polling\n");
+        return 1;
+    }
+    ++pushed;
+    mpr_dev_poll(dev, 10);
+    return last != pushed - 1;
+}
+
+/*! Updates pushed while the device is polled must arrive in order, without loss. */
+int check_order()
+{
+    push_count = pushed + iterations;
+    if (run_thread(push_thread))
+        return 1;
+    eprintf("Pushed %d updates, waited %d times for a full queue, received %d in order\n",
+            push_count, push_retry, received);
+    return last != push_count - 1 || errors;
+}
+
+/*! Pushing a zero length update must release the instance, after any update queued before it. */
+int check_release()
+{
+    int value = 1;
+    if (   !mpr_sig_push_value(sendsig, 1, 1, MPR_INT32, &value, MPR_NOW)
+        || !mpr_sig_push_value(sendsig, 1, 0, MPR_INT32, NULL, MPR_NOW)) {
+        eprintf("Could not push an update and a release\n");
+        return 1;
+    }
+    mpr_dev_poll(dev, 10);
+    if (mpr_sig_get_num_inst(sendsig, MPR_STATUS_ACTIVE) != 1) {
+        eprintf("Instance 1 is still active after an update and a release\n");
+        return 1;
+    }
+
+    /* the receiving instance only exists once an update has been sent for it */
+    mpr_sig_push_value(sendsig, 1, 1, MPR_INT32, &value, MPR_NOW);
+    mpr_dev_poll(dev, 10);
+    mpr_sig_push_value(sendsig, 1, 0, MPR_INT32, NULL, MPR_NOW);
+    mpr_dev_poll(dev, 10);
+    if (mpr_sig_get_num_inst(sendsig, MPR_STATUS_ACTIVE) != 1 || released != 1) {
+        eprintf("Instance 1 was not released: %d active instances, %d releases received\n",
+                mpr_sig_get_num_inst(sendsig, MPR_STATUS_ACTIVE), released);
+        return 1;
+    }
+    return 0;
+}
+
+/*! A reserved queue is never reallocated, so only requests it can already hold succeed. */
+int check_resize()
+{
+    if (!mpr_sig_reserve_queue(sendsig, QUEUE_SIZE / 2)) {
+        eprintf("Reserving a smaller queue failed\n");
+        return 1;
+    }
+    if (mpr_sig_reserve_queue(sendsig, QUEUE_SIZE * 2)) {
+        eprintf("Reserving a larger queue succeeded\n");
+        return 1;
+    }
+    return 0;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testqueue.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing device.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (!mpr_sig_reserve_queue(sendsig, QUEUE_SIZE)) {
+        eprintf("Error reserving queue.\n");
+        result = 1;
+        goto done;
+    }
+
+    result = check_full() || check_order() || check_release() || check_resize();
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,170 @@
+#include <mapper/mapper.h>
+#include <lo/lo.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define NUM_SENDERS 8
+
+int verbose = 1;
+int done = 0;
+int iterations = 100000;
+int rate = 100000;
+
+mpr_dev dev = 0;
+int received = 0;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value)
+        ++received;
+}
+
+/*! Send iterations updates to the device at the requested rate from several sockets at once,
+ *  in bursts once per millisecond. */
+void send_updates(const char *port)
+{
+    lo_address addrs[NUM_SENDERS];
+    int i, j, sent = 0, per_ms = rate / 1000;
+    double start, next, now;
+
+    if (per_ms < 1)
+        per_ms = 1;
+    for (i = 0; i < NUM_SENDERS; i++)
+        addrs[i] = lo_address_new("localhost", port);
+
+    start = next = current_time();
+    while (sent < iterations) {
+        for (j = 0; j < per_ms && sent < iterations; j++, sent++)
+            lo_send(addrs[sent % NUM_SENDERS], "/in", "i", sent);
+        next += 0.001;
+        /* sleep rather than spin so the receiver is not starved on machines with few cores */
+        if ((now = current_time()) < next)
+            usleep((next - now) * 1000000);
+    }
+    eprintf("sent %d updates in %f seconds\n", sent, current_time() - start);
+
+    for (i = 0; i < NUM_SENDERS; i++)
+        lo_address_free(addrs[i]);
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0, status;
+    double then;
+    char port[16];
+    pid_t pid;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testrecvload.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d), "
+                               "--rate <int> messages per second (default %d)\n",
+                               iterations, rate);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 20000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        else if (strcmp(argv[i], "--rate")==0 && argc>i+1) {
+                            i++;
+                            rate = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    dev = mpr_dev_new("testrecvload", 0);
+    if (!dev || !mpr_sig_new(dev, MPR_DIR_IN, "in", 1, MPR_INT32, NULL, NULL, NULL, NULL,
+                             handler, MPR_SIG_UPDATE)) {
+        eprintf("Error initializing device.\n");
+        result = 1;
+        goto done;
+    }
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+    snprintf(port, 16, "%d", mpr_obj_get_prop_as_int32(dev, MPR_PROP_PORT, NULL));
+
+    pid = fork();
+    if (pid < 0) {
+        eprintf("Error starting sender process.\n");
+        result = 1;
+        goto done;
+    }
+    if (!pid) {
+        send_updates(port);
+        _exit(0);
+    }
+
+    /* poll until the sender has finished, then allow time for the last updates to arrive */
+    while (!done && !waitpid(pid, &status, WNOHANG))
+        mpr_dev_poll(dev, 0);
+    then = current_time();
+    while (!done && current_time() - then < 0.5)
+        mpr_dev_poll(dev, 10);
+
+    eprintf("received %d of %d updates at %d messages per second, drop rate %.2f%%\n",
+            received, iterations, rate, 100.0 * (iterations - received) / iterations);
+    if (received <= 0 || received > iterations)
+        result = 1;
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,177 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_SIGS 5000
+
+int verbose = 1;
+int done = 0;
+int iterations = 10000;
+int max_sigs = MAX_SIGS;
+
+mpr_dev dev = 0;
+mpr_sig outsigs[MAX_SIGS / 2];
+mpr_sig insigs[MAX_SIGS / 2];
+mpr_map maps[MAX_SIGS / 2];
+int num_pairs = 0;
+int received = 0;
+
+static const int sig_counts[] = {10, 100, 1000, MAX_SIGS};
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value)
+        ++received;
+}
+
+/*! Add pairs of mapped signals until the device has num_sigs signals. */
+int add_sigs(int num_sigs)
+{
+    char name[32];
+    int i, first = num_pairs;
+
+    for (; num_pairs < num_sigs / 2; num_pairs++) {
+        snprintf(name, 32, "out%d", num_pairs);
+        outsigs[num_pairs] = mpr_sig_new(dev, MPR_DIR_OUT, name, 1, MPR_FLT, NULL,
+                                         NULL, NULL, NULL, NULL, 0);
+        snprintf(name, 32, "in%d", num_pairs);
+        insigs[num_pairs] = mpr_sig_new(dev, MPR_DIR_IN, name, 1, MPR_FLT, NULL,
+                                        NULL, NULL, NULL, handler, MPR_SIG_UPDATE);
+        if (!outsigs[num_pairs] || !insigs[num_pairs])
+            return 1;
+        maps[num_pairs] = mpr_map_new(1, &outsigs[num_pairs], 1, &insigs[num_pairs]);
+        mpr_obj_push(maps[num_pairs]);
+    }
+
+    /* Wait until all new maps have been established */
+    for (i = first; i < num_pairs && !done; i++) {
+        while (!done && !mpr_map_get_is_ready(maps[i]))
+            mpr_dev_poll(dev, 10);
+    }
+    return done;
+}
+
+/*! Update the first and last mapped output signals and return the mean time per update. */
+double run_updates()
+{
+    int i;
+    float value;
+    double start = current_time();
+
+    received = 0;
+    for (i = 0; i < iterations && !done; i++) {
+        value = i;
+        mpr_sig_set_value(outsigs[(i & 1) ? num_pairs - 1 : 0], 0, 1, MPR_FLT, &value);
+        mpr_dev_poll(dev, 0);
+    }
+    return (current_time() - start) / iterations;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    double first = 0, elapsed = 0;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testrouter.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        max_sigs = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    dev = mpr_dev_new("testrouter", 0);
+    if (!dev) {
+        eprintf("Error initializing device.\n");
+        result = 1;
+        goto done;
+    }
+    while (!done && !mpr_dev_get_is_ready(dev))
+        mpr_dev_poll(dev, 25);
+
+    for (i = 0; i < sizeof(sig_counts) / sizeof(int) && sig_counts[i] <= max_sigs; i++) {
+        if (add_sigs(sig_counts[i])) {
+            eprintf("Error initializing signals and maps.\n");
+            result = 1;
+            goto done;
+        }
+        elapsed = run_updates();
+        if (!i)
+            first = elapsed;
+        eprintf("%5d signals: %f microseconds per update, received %d of %d updates\n",
+                num_pairs * 2, elapsed * 1000000, received, iterations);
+        if (received != iterations) {
+            result = 1;
+            goto done;
+        }
+    }
+    if (first > 0)
+        eprintf("Cost of an update with %d signals is %.2fx the cost with %d signals\n",
+                num_pairs * 2, elapsed / first, sig_counts[0]);
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,265 @@
+#include "../src/mapper_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define MAX_LEN 80
+#define MAX_STRIDE 12
+#define NUM_EXPRS 8
+
+int verbose = 1;
+int iterations = 20000;
+
+static const char *isa_names[] = {"scalar", "SSE2", "AVX2"};
+static const char *type_names[] = {"int", "float", "double"};
+static const mpr_type types[] = {MPR_INT32, MPR_FLT, MPR_DBL};
+static const char *op_names[] = {"add", "sub", "mul", "div", "eq", "ne", "lt", "le", "gt",
+                                 "ge", "min", "max", "dot"};
+
+static const char *expr_strs[NUM_EXPRS] = {
+    "y=x*2+1",
+    "y=(x+1)*(x-1)-x*x",
+    "y=x>3",
+    "y=(x*0.5)<=x.mean()",
+    "y=x+x.sum()",
+    "y=x.max()-x.min()",
+    "y=dot(x, x+1)",
+    "y=x.norm()",
+};
+
+static const int vec_lens[] = {8, 64, 128};
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/* Fill an array with small integer values so that reductions are exact regardless of the
+ * order of evaluation. Divisors are kept non-zero. */
+static void fill(void *v, mpr_type type, int len, int seed, int nonzero)
+{
+    int i;
+    for (i = 0; i < len; i++) {
+        int val = ((i * 7 + seed * 13) % 11) - 5;
+        if (nonzero && !val)
+            val = 3;
+        switch (type) {
+            case MPR_INT32: ((int*)v)[i] = val;           break;
+            case MPR_FLT:   ((float*)v)[i] = val * 0.5f;  break;
+            default:        ((double*)v)[i] = val * 0.25; break;
+        }
+    }
+}
+
+/* Check every available kernel against the scalar implementation, including lengths that
+ * leave a remainder after the vector loop. */
+static int check_kernels(mpr_simd_isa isa)
+{
+    int op, t, len, stride;
+    double a[MAX_LEN * MAX_STRIDE], b[MAX_LEN * MAX_STRIDE], ref[MAX_LEN * MAX_STRIDE];
+
+    for (op = 0; op < MPR_SIMD_N_OPS; op++) {
+        for (t = 0; t < 3; t++) {
+            const mpr_simd_kernel_t *k = mpr_simd_get_kernel(op, types[t], isa);
+            const mpr_simd_kernel_t *s = mpr_simd_get_kernel(op, types[t], MPR_SIMD_SCALAR);
+            int size = mpr_type_get_size(types[t]);
+            if (!k && !s)
+                continue;
+            if (!k || !s) {
+                eprintf("  %s %s: kernel missing for %s\n", op_names[op], type_names[t],
+                        k ? "scalar" : isa_names[isa]);
+                return 1;
+            }
+            for (len = 1; len <= MAX_LEN; len++) {
+                if (k->vv) {
+                    fill(a, types[t], len, op, 0);
+                    fill(b, types[t], len, len, 1);
+                    memcpy(ref, a, len * size);
+                    s->vv(ref, b, len);
+                    k->vv(a, b, len);
+                    if (memcmp(a, ref, len * size)) {
+                        eprintf("  %s %s: vv mismatch for length %d\n", op_names[op],
+                                type_names[t], len);
+                        return 1;
+                    }
+                    fill(a, types[t], len, op, 0);
+                    memcpy(ref, a, len * size);
+                    s->vs(ref, b, len);
+                    k->vs(a, b, len);
+                    if (memcmp(a, ref, len * size)) {
+                        eprintf("  %s %s: vs mismatch for length %d\n", op_names[op],
+                                type_names[t], len);
+                        return 1;
+                    }
+                }
+                if (!k->reduce)
+                    continue;
+                for (stride = 1; stride <= MAX_STRIDE; stride++) {
+                    fill(a, types[t], len * stride, op + stride, 0);
+                    fill(b, types[t], len * stride, len, 0);
+                    memcpy(ref, a, len * stride * size);
+                    s->reduce(ref, b, len, stride);
+                    k->reduce(a, b, len, stride);
+                    if (memcmp(a, ref, stride * size)) {
+                        eprintf("  %s %s: reduce mismatch for length %d, stride %d\n",
+                                op_names[op], type_names[t], len, stride);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static double time_kernel(const mpr_simd_kernel_t *k, float *a, float *b, int len)
+{
+    mpr_time start, end;
+    int i;
+    mpr_time_set(&start, MPR_NOW);
+    for (i = 0; i < iterations; i++) {
+        k->vv(a, b, len);
+        k->reduce(a, b, len, 1);
+    }
+    mpr_time_set(&end, MPR_NOW);
+    return mpr_time_get_diff(end, start);
+}
+
+/* Compare the bytecode evaluator against the token interpreter for long vectors. The third
+ * expression keeps the default evaluator chosen by the parser. */
+static int check_expr(mpr_expr_eval_buffer buff, const char *str, int vlen)
+{
+    mpr_type src_type = MPR_FLT;
+    mpr_expr e[3];
+    mpr_value_t src = {0, 0, 0, 0, 0}, dst[3];
+    mpr_value src_p = &src;
+    mpr_time t = {0, 0}, start, end;
+    mpr_type out_types[MPR_MAX_VECTOR_LEN];
+    double elapsed[3];
+    int i, j, result = 0;
+    float *x;
+
+    memset(dst, 0, sizeof(dst));
+    for (i = 0; i < 3; i++) {
+        e[i] = mpr_expr_new_from_str(str, 1, &src_type, &vlen, MPR_FLT, vlen);
+        if (!e[i]) {
+            eprintf("  failed to parse '%s'\n", str);
+            while (--i >= 0)
+                mpr_expr_free(e[i]);
+            return 1;
+        }
+        if (i < 2)
+            mpr_expr_set_use_bytecode(e[i], i);
+        mpr_expr_realloc_eval_buffer(e[i], buff);
+        mpr_value_realloc(&dst[i], vlen, MPR_FLT, mpr_expr_get_out_hist_size(e[i]), 1, 1);
+    }
+
+    mpr_value_realloc(&src, vlen, MPR_FLT, 1, 1, 0);
+    src.inst[0].pos = 0;
+    x = mpr_value_get_samp(&src, 0);
+    fill(x, MPR_FLT, vlen, vlen, 0);
+
+    for (i = 0; i < 3; i++) {
+        mpr_time_set(&start, MPR_NOW);
+        for (j = 0; j < iterations / 10; j++)
+            mpr_expr_eval(buff, e[i], &src_p, 0, &dst[i], &t, out_types, 0);
+        mpr_time_set(&end, MPR_NOW);
+        elapsed[i] = mpr_time_get_diff(end, start);
+    }
+
+    for (i = 1; i < 3; i++) {
+        if (memcmp(mpr_value_get_samp(&dst[0], 0), mpr_value_get_samp(&dst[i], 0),
+                   vlen * sizeof(float))) {
+            eprintf("  '%s' (length %d): %s result does not match interpreter\n", str, vlen,
+                    i == 1 ? "bytecode" : "default");
+            result = 1;
+        }
+    }
+    if (!result) {
+        eprintf("  '%s' (length %d): %f seconds interpreted, %f seconds bytecode (%.2fx), "
+                "%f seconds default (%.2fx)\n", str, vlen, elapsed[0], elapsed[1],
+                elapsed[0] / elapsed[1], elapsed[2], elapsed[0] / elapsed[2]);
+    }
+
+    for (i = 0; i < 3; i++) {
+        mpr_value_free(&dst[i]);
+        mpr_expr_free(e[i]);
+    }
+    mpr_value_free(&src);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    mpr_simd_isa isa, max_isa = mpr_simd_get_isa();
+    mpr_expr_eval_buffer buff;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testsimd.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 1000;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    eprintf("Using %s kernels\n", isa_names[max_isa]);
+
+    for (isa = MPR_SIMD_SCALAR; isa <= max_isa && !result; isa++) {
+        float a[MAX_LEN * MAX_STRIDE], b[MAX_LEN * MAX_STRIDE];
+        eprintf("Checking %s kernels\n", isa_names[isa]);
+        result = check_kernels(isa);
+        if (result)
+            break;
+        fill(a, MPR_FLT, MAX_LEN, 1, 0);
+        fill(b, MPR_FLT, MAX_LEN, 2, 0);
+        eprintf("  add + sum of %d floats: %f seconds\n", MAX_LEN,
+                time_kernel(mpr_simd_get_kernel(MPR_SIMD_ADD, MPR_FLT, isa), a, b, MAX_LEN));
+    }
+
+    buff = mpr_expr_new_eval_buffer(NULL);
+    eprintf("Comparing evaluators\n");
+    for (i = 0; i < NUM_EXPRS && !result; i++) {
+        for (j = 0; j < sizeof(vec_lens) / sizeof(int) && !result; j++)
+            result = check_expr(buff, expr_strs[i], vec_lens[j]);
+    }
+    mpr_expr_free_eval_buffer(buff);
+
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
@@ -0,0 +1,205 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_SIGS 300
+
+int verbose = 1;
+int done = 0;
+int iterations = 100;
+int num_sigs = MAX_SIGS;
+
+mpr_dev src = 0;
+mpr_dev dst = 0;
+mpr_sig sendsigs[MAX_SIGS];
+mpr_sig recvsigs[MAX_SIGS];
+
+int received = 0;
+int mismatched_times = 0;
+mpr_time frame_time;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (!value)
+        return;
+    /* all updates in a frame should carry the time of the first one */
+    if (!received)
+        frame_time = t;
+    else if (mpr_time_cmp(t, frame_time))
+        ++mismatched_times;
+    ++received;
+}
+
+int setup()
+{
+    int i;
+    char name[32];
+    mpr_map maps[MAX_SIGS];
+
+    src = mpr_dev_new("testtransaction-send", 0);
+    dst = mpr_dev_new("testtransaction-recv", 0);
+    if (!src || !dst)
+        return 1;
+
+    for (i = 0; i < num_sigs; i++) {
+        snprintf(name, 32, "out%d", i);
+        sendsigs[i] = mpr_sig_new(src, MPR_DIR_OUT, name, 1, MPR_FLT, NULL,
+                                  NULL, NULL, NULL, NULL, 0);
+        snprintf(name, 32, "in%d", i);
+        recvsigs[i] = mpr_sig_new(dst, MPR_DIR_IN, name, 1, MPR_FLT, NULL,
+                                  NULL, NULL, NULL, handler, MPR_SIG_UPDATE);
+    }
+
+    while (!done && !(mpr_dev_get_is_ready(src) && mpr_dev_get_is_ready(dst))) {
+        mpr_dev_poll(src, 25);
+        mpr_dev_poll(dst, 25);
+    }
+
+    for (i = 0; i < num_sigs; i++) {
+        maps[i] = mpr_map_new(1, &sendsigs[i], 1, &recvsigs[i]);
+        mpr_obj_push(maps[i]);
+    }
+    for (i = 0; i < num_sigs && !done; i++) {
+        while (!done && !mpr_map_get_is_ready(maps[i])) {
+            mpr_dev_poll(src, 10);
+            mpr_dev_poll(dst, 10);
+        }
+    }
+    return done;
+}
+
+/*! Update every signal inside a batch once per frame. Returns non-zero if any update was sent
+ *  before the batch was committed, or if a frame was not received in full. */
+int run_frames(double *elapsed)
+{
+    int i, j, early = 0;
+    float v;
+    double start = current_time(), sent;
+
+    for (i = 0; i < iterations && !done; i++) {
+        received = 0;
+        mpr_dev_begin_batch(src);
+        for (j = 0; j < num_sigs; j++) {
+            v = i + j;
+            mpr_sig_set_value(sendsigs[j], 0, 1, MPR_FLT, &v);
+            /* this would normally send the updates made so far */
+            if (j == num_sigs / 2)
+                mpr_dev_update_maps(src);
+        }
+        mpr_dev_poll(dst, 1);
+        if (received) {
+            eprintf("frame %d: %d updates were sent before the batch was committed\n",
+                    i, received);
+            early = 1;
+        }
+        mpr_dev_commit_batch(src);
+
+        sent = current_time();
+        while (!done && received < num_sigs && current_time() - sent < 1)
+            mpr_dev_poll(dst, 0);
+        if (received != num_sigs) {
+            eprintf("frame %d: received %d of %d updates\n", i, received, num_sigs);
+            return 1;
+        }
+        mpr_dev_poll(src, 0);
+    }
+    *elapsed = current_time() - start;
+    return early || done;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    double elapsed = 0;
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testtransaction.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 10;
+                        num_sigs = 30;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup()) {
+        eprintf("Error initializing devices and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    result = run_frames(&elapsed);
+    if (mismatched_times) {
+        eprintf("%d updates were not tagged with the time of their frame\n", mismatched_times);
+        result = 1;
+    }
+    if (!result)
+        eprintf("%d frames of %d updates, %f microseconds per frame\n",
+                iterations, num_sigs, elapsed * 1000000 / iterations);
+
+  done:
+    if (src)
+        mpr_dev_free(src);
+    if (dst)
+        mpr_dev_free(dst);
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}
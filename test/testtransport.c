@@ -0,0 +1,244 @@
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+int verbose = 1;
+int done = 0;
+int iterations = 2000;
+
+mpr_dev dev = 0;
+mpr_sig outsig = 0;
+mpr_sig insig = 0;
+mpr_map maps[2] = {0, 0};
+int received = 0;
+int last_value = -1;
+
+static void eprintf(const char *format, ...)
+{
+    va_list args;
+    if (!verbose)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+/*! Handler for the echo process: send each update straight back. */
+void echo_handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+                  mpr_type type, const void *value, mpr_time t)
+{
+    if (value)
+        mpr_sig_set_value(outsig, 0, 1, MPR_INT32, value);
+}
+
+/*! Run the echo device in the child process until it is terminated. */
+int run_echo()
+{
+    dev = mpr_dev_new("testtransport-echo", 0);
+    if (!dev)
+        return 1;
+    outsig = mpr_sig_new(dev, MPR_DIR_OUT, "echo_out", 1, MPR_INT32, NULL,
+                         NULL, NULL, NULL, NULL, 0);
+    insig = mpr_sig_new(dev, MPR_DIR_IN, "echo_in", 1, MPR_INT32, NULL,
+                        NULL, NULL, NULL, echo_handler, MPR_SIG_UPDATE);
+    while (!done && getppid() != 1)
+        mpr_dev_poll(dev, 10);
+    mpr_dev_free(dev);
+    return 0;
+}
+
+void handler(mpr_sig sig, mpr_sig_evt event, mpr_id instance, int length,
+             mpr_type type, const void *value, mpr_time t)
+{
+    if (value) {
+        last_value = *(int*)value;
+        ++received;
+    }
+}
+
+/*! Find a signal belonging to the echo process by name. */
+mpr_sig find_sig(const char *name)
+{
+    mpr_sig sig = 0;
+    mpr_list l = mpr_graph_get_objs(mpr_obj_get_graph(dev), MPR_SIG);
+    l = mpr_list_filter(l, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
+    if (l) {
+        sig = (mpr_sig)*l;
+        mpr_list_free(l);
+    }
+    return sig;
+}
+
+int setup()
+{
+    mpr_sig echo_in = 0, echo_out = 0;
+    int i;
+
+    dev = mpr_dev_new("testtransport-send", 0);
+    if (!dev)
+        return 1;
+    outsig = mpr_sig_new(dev, MPR_DIR_OUT, "out", 1, MPR_INT32, NULL,
+                         NULL, NULL, NULL, NULL, 0);
+    insig = mpr_sig_new(dev, MPR_DIR_IN, "in", 1, MPR_INT32, NULL,
+                        NULL, NULL, NULL, handler, MPR_SIG_UPDATE);
+    mpr_graph_subscribe(mpr_obj_get_graph(dev), NULL, MPR_SIG, -1);
+
+    /* wait for the signals of the echo process */
+    while (!done && !(mpr_dev_get_is_ready(dev) && echo_in && echo_out)) {
+        mpr_dev_poll(dev, 25);
+        echo_in = find_sig("echo_in");
+        echo_out = find_sig("echo_out");
+    }
+    if (done)
+        return 1;
+
+    maps[0] = mpr_map_new(1, &outsig, 1, &echo_in);
+    maps[1] = mpr_map_new(1, &echo_out, 1, &insig);
+    for (i = 0; i < 2; i++) {
+        mpr_obj_push(maps[i]);
+        while (!done && !mpr_map_get_is_ready(maps[i]))
+            mpr_dev_poll(dev, 10);
+    }
+    return done;
+}
+
+void set_map_protocol(mpr_proto proto)
+{
+    int i;
+    for (i = 0; i < 2; i++) {
+        mpr_obj_set_prop((mpr_obj)maps[i], MPR_PROP_PROTOCOL, NULL, 1, MPR_INT32, &proto, 1);
+        mpr_obj_push((mpr_obj)maps[i]);
+    }
+    /* wait until change has taken effect */
+    for (i = 0; i < 2 && !done; i++) {
+        while (!done && mpr_obj_get_prop_as_int32(maps[i], MPR_PROP_PROTOCOL, NULL) != proto)
+            mpr_dev_poll(dev, 10);
+    }
+    /* allow the echo process to see the change too */
+    mpr_dev_poll(dev, 100);
+}
+
+/*! Send updates one at a time and wait for each to be echoed. Returns the number of updates
+ *  that were echoed before timing out. */
+int run_updates(double *elapsed)
+{
+    int i;
+    double start = current_time(), sent;
+
+    received = 0;
+    for (i = 0; i < iterations && !done; i++) {
+        mpr_sig_set_value(outsig, 0, 1, MPR_INT32, &i);
+        mpr_dev_poll(dev, 0);
+        sent = current_time();
+        while (!done && last_value != i && current_time() - sent < 1)
+            mpr_dev_poll(dev, 0);
+        if (last_value != i)
+            break;
+    }
+    *elapsed = current_time() - start;
+    return i;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0, status;
+    double elapsed;
+    pid_t pid;
+    mpr_proto protos[] = {MPR_PROTO_UDP, MPR_PROTO_TCP, MPR_PROTO_SHM, MPR_PROTO_UNIX};
+    const char *names[] = {"UDP", "TCP", "SHM", "UNIX"};
+
+    /* process flags for -v verbose, -f fast, -h help */
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testtransport.c: possible arguments "
+                               "-f fast (execute quickly), "
+                               "-q quiet (suppress output), "
+                               "-h help, "
+                               "--num_iterations <int> (default %d)\n",
+                               iterations);
+                        return 1;
+                        break;
+                    case 'f':
+                        iterations = 200;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case '-':
+                        if (strcmp(argv[i], "--num_iterations")==0 && argc>i+1) {
+                            i++;
+                            iterations = atoi(argv[i]);
+                            j = len;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+    signal(SIGTERM, ctrlc);
+
+    pid = fork();
+    if (pid < 0) {
+        eprintf("Error starting echo process.\n");
+        result = 1;
+        goto done;
+    }
+    if (0 == pid)
+        return run_echo();
+
+    if (setup()) {
+        eprintf("Error initializing devices and maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    for (i = 0; i < sizeof(protos) / sizeof(mpr_proto) && !done; i++) {
+        set_map_protocol(protos[i]);
+        j = run_updates(&elapsed);
+        eprintf("%4s: %d of %d updates echoed, %f microseconds round trip, %f updates/second\n",
+                names[i], j, iterations, elapsed * 1000000 / iterations, j / elapsed);
+        if (j != iterations) {
+            result = 1;
+            break;
+        }
+    }
+
+  done:
+    if (dev)
+        mpr_dev_free(dev);
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, &status, 0);
+    }
+    printf("...................Test %s\x1B[0m.\n",
+           result ? "\x1B[31mFAILED" : "\x1B[32mPASSED");
+    return result;
+}